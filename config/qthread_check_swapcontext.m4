@@ -13,6 +13,22 @@ AC_ARG_ENABLE([fastcontext],
                                calls. If you run into bugs, you can disable it
                                on some systems to use the slower libc-provided
                                version.])])
+AC_ARG_ENABLE([minimal-context],
+              [AS_HELP_STRING([--disable-minimal-context],
+                              [on x86-64 and AArch64, fastcontext switches
+                               tasks by saving only the registers that the
+                               ABI requires a callee to preserve. Disable
+                               to use the general fastcontext swap, which
+                               also saves argument registers (and, on
+                               AArch64, every vector register).])])
+AC_ARG_ENABLE([context-fp-control],
+              [AS_HELP_STRING([--enable-context-fp-control],
+                              [make the minimal context swap save and
+                               restore the floating-point control registers
+                               (MXCSR and the x87 control word, or FPCR), so
+                               that every task keeps its own rounding and
+                               exception modes. Default disabled: tasks
+                               share their worker's modes.])])
 AC_MSG_CHECKING([whether we have a fast context swap for this system])
 case "$host" in
   *-solaris2.8)
@@ -54,6 +70,28 @@ AS_IF([test "x$enable_fastcontext" = "xno"],
 	  [QTHREAD_CHECK_COMPAT_MAKECONTEXT([qt_cv_pick_ctxt="own"])])
 AS_IF([test "x$qt_cv_pick_ctxt" = "xnone"], 
 	  [AC_MSG_ERROR([Can not find working makecontext.])])
+AC_MSG_CHECKING([whether to use the minimal context swap])
+AS_IF([test "x$qt_cv_pick_ctxt" = "xown" -a "x$enable_minimal_context" != "xno"],
+      [case "$host" in
+         x86_64-*-linux*|x86_64-*-darwin*|aarch64-*-linux*|arm64-*-darwin*|aarch64-*-darwin*)
+           qt_cv_pick_ctxt="minimal"
+           ;;
+       esac])
+AS_IF([test "x$qt_cv_pick_ctxt" = "xminimal"],
+      [AC_MSG_RESULT([yes])
+       AC_DEFINE([QTHREAD_MINIMAL_CONTEXT], [1],
+                 [swap task contexts by saving only callee-saved registers])
+       AS_IF([test "x$enable_context_fp_control" = "xyes"],
+             [AC_DEFINE([QTHREAD_CONTEXT_SAVE_FP_CONTROL], [1],
+                        [save and restore floating-point control registers on every task switch])])],
+      [AC_MSG_RESULT([no])
+       AS_IF([test "x$enable_minimal_context" = "xyes"],
+             [AC_MSG_ERROR([The minimal context swap is only available with fastcontext on x86-64 and AArch64])])
+       AS_IF([test "x$enable_context_fp_control" = "xyes"],
+             [AC_MSG_ERROR([--enable-context-fp-control requires the minimal context swap])])])
+AS_IF([test "x$qt_cv_pick_ctxt" != "xnative"],
+      [AC_DEFINE([QTHREAD_CONTEXT_SIGNAL_FREE], [1],
+                 [task context swaps never save or restore the signal mask (and so never make a system call)])])
 $1=$qt_cv_pick_ctxt
 ])
 
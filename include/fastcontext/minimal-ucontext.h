@@ -0,0 +1,56 @@
+#ifndef QT_MINIMAL_UCONTEXT_H
+#define QT_MINIMAL_UCONTEXT_H
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stddef.h> /* for size_t, per C89 */
+
+#include "qt_visibility.h"
+
+/* The minimal context swap (x86-64 and AArch64). A suspended context is
+ * nothing but its stack pointer: qt_swapctxt() pushes the callee-saved
+ * registers (and, with QTHREAD_CONTEXT_SAVE_FP_CONTROL, the floating-point
+ * control registers) onto the old stack, records the stack pointer, and
+ * pops the same frame off the new stack. Everything the calling convention
+ * lets a callee clobber is left alone, and the signal mask is never
+ * touched, so a swap is a plain function call without any system call. */
+
+typedef struct uctxt uctxt_t;
+
+struct uctxt {
+    void *sp;                   /* saved stack pointer; the rest is on the stack */
+    struct {
+        void  *ss_sp;
+        size_t ss_size;
+        int    ss_flags;
+    } uc_stack;
+};
+
+int INTERNAL  qt_minimal_swapctxt(uctxt_t *oucp,
+                                  uctxt_t *ucp);
+void INTERNAL qt_minimal_setctxt(uctxt_t *ucp);
+void INTERNAL qt_minimal_makectxt(uctxt_t *ucp,
+                                  void     (*func)(void),
+                                  int      argc,
+                                  ...);
+
+#define qt_swapctxt(o, u)       qt_minimal_swapctxt((o), (u))
+#define qt_makectxt(u, f, ...)  qt_minimal_makectxt((u), (f), __VA_ARGS__)
+
+/* A context is captured by swapping out of it, so there is nothing to get. */
+static inline int qt_minimal_getctxt(uctxt_t *ucp)
+{
+    (void)ucp;
+    return 0;
+}
+
+#define getcontext(u) qt_minimal_getctxt(u)
+
+/* nothing that includes this may switch contexts through libc, which would
+ * save and restore the signal mask with a system call */
+#pragma GCC poison swapcontext setcontext makecontext
+
+#endif // ifndef QT_MINIMAL_UCONTEXT_H
+/* vim:set expandtab: */
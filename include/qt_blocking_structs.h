@@ -28,6 +28,7 @@ typedef enum blocking_syscalls {
     WAIT4,
     WRITE,
     PWRITE,
+    FD_READY,                   /* not a call: wait for a descriptor (see qt_io_epoll.h) */
     USER_DEFINED
 } syscall_t;
 
@@ -2,8 +2,14 @@
 #define QT_CONTEXT_H
 
 #if defined(HAVE_UCONTEXT_H) && defined(HAVE_NATIVE_MAKECONTEXT)
+# ifdef QTHREAD_CONTEXT_SIGNAL_FREE
+#  error libc swapcontext() saves and restores the signal mask
+# endif
 # include <ucontext.h>                 /* for ucontext_t */
 typedef ucontext_t qt_context_t;
+#elif defined(QTHREAD_MINIMAL_CONTEXT)
+# include "fastcontext/minimal-ucontext.h"
+typedef uctxt_t qt_context_t;
 #else
 # include "fastcontext/taskimpl.h"
 typedef uctxt_t qt_context_t;
@@ -3,7 +3,12 @@
 
 #include "qt_visibility.h"
 
-#define HAZARD_PTRS_PER_SHEP 2
+/* Slots 0 and 1 belong to whoever is calling (the addrstat in feb.c and
+ * syncvar.c, queue nodes in mtsfifo); the lock-free hash's list traversal
+ * uses the other two, so a lookup can run while slot 0 is held. */
+#define HAZARD_PTRS_PER_SHEP 4
+#define HAZARD_PTR_LF_PREV   2
+#define HAZARD_PTR_LF_CUR    3
 
 typedef struct {
     void (*freefunc)(void *);
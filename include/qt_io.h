@@ -24,8 +24,8 @@
 extern qt_mpool syscall_job_pool;
 
 void            qt_blocking_subsystem_init(void);
-int             qt_process_blocking_call(void);
 void            qt_blocking_subsystem_enqueue(qt_blocking_queue_node_t *job);
+void            qt_blocking_subsystem_complete(qt_blocking_queue_node_t *job);
 
 static inline int qt_blockable(void)
 {
@@ -0,0 +1,62 @@
+#ifndef QT_IO_EPOLL_H
+#define QT_IO_EPOLL_H
+
+#include <sys/types.h>
+#include <sys/socket.h>               /* for struct sockaddr and socklen_t */
+#include <qthread/qthread.h>          /* for aligned_t */
+#include "qt_visibility.h"
+
+/* Readiness-based socket calls (--enable-io-epoll).
+ *
+ * The read, write, accept and connect wrappers first try the call without
+ * blocking (recv() and send() with MSG_DONTWAIT; accept() and connect() on
+ * a socket in non-blocking mode). If the socket is not ready, the task
+ * blocks on an FD_READY job, which the worker it ran on registers with the
+ * runtime's epoll instance once the task has switched out, and tries again
+ * when the socket becomes ready. So a socket that never becomes ready costs
+ * a waiting task and nothing else, where a proxy thread would be stuck in
+ * the call.
+ *
+ * Waiting tasks are listed per descriptor, and each descriptor is armed
+ * one-shot for what its waiters want. Idle workers ask epoll for ready
+ * descriptors (QT_IO_IDLE(), see qt_io_poll.h); a poller thread blocks in
+ * epoll_wait() to catch the rest, so workers may park as usual.
+ *
+ * Calls on descriptors that are not sockets, and all calls when QT_IO_EPOLL
+ * is 0, go the usual way (io_uring or the proxy threads). */
+
+struct _qt_blocking_queue_node_s;
+
+#ifdef QTHREAD_IO_EPOLL
+extern aligned_t qt_io_epoll_waiting;  /* tasks waiting for a descriptor */
+
+void INTERNAL qt_io_epoll_init(void);
+void INTERNAL qt_io_epoll_stop(void);
+void INTERNAL qt_io_epoll_finalize(void);
+int INTERNAL  qt_io_epoll_submit(struct _qt_blocking_queue_node_s *job); /* 0 unless an FD_READY job */
+int INTERNAL  qt_io_epoll_poll(int timeout); /* wakes waiters; returns how many */
+
+/* These return 0 if the call must go the usual way; otherwise they return
+ * 1, having made the call, and store its result in *ret (and errno). */
+int INTERNAL qt_io_epoll_read(int     fd,
+                              void   *buf,
+                              size_t  nbyte,
+                              ssize_t *ret);
+int INTERNAL qt_io_epoll_write(int         fd,
+                               const void *buf,
+                               size_t      nbyte,
+                               ssize_t    *ret);
+int INTERNAL qt_io_epoll_accept(int              fd,
+                                struct sockaddr *address,
+                                socklen_t       *address_len,
+                                int             *ret);
+int INTERNAL qt_io_epoll_connect(int                    fd,
+                                 const struct sockaddr *address,
+                                 socklen_t              address_len,
+                                 int                   *ret);
+#else
+# define qt_io_epoll_submit(job) 0
+#endif /* ifdef QTHREAD_IO_EPOLL */
+
+#endif // ifndef QT_IO_EPOLL_H
+/* vim:set expandtab: */
@@ -0,0 +1,66 @@
+#ifndef QT_IO_POLL_H
+#define QT_IO_POLL_H
+
+#ifdef HAVE_SCHED_YIELD
+# include <sched.h>                    /* for sched_yield() */
+#endif
+
+#include "qt_expect.h"
+#include "qt_shepherd_innards.h"       /* for qthread_internal_getshep() */
+#include "qt_io_uring.h"
+#include "qt_io_epoll.h"
+
+/* Where workers collect finished system calls for the I/O engines that do
+ * not have threads of their own to do it.
+ *
+ * QT_IO_POLL() goes between tasks in qthread_master(); it reaps io_uring
+ * completions, which costs a load when none are in flight and no system
+ * calls otherwise. QT_IO_IDLE() goes in the schedulers' idle loops; it also
+ * asks epoll which sockets have become ready, which is a system call, so
+ * busy workers leave that to the epoll poller thread. QT_IO_PENDING() says
+ * whether a worker must keep polling rather than go to sleep: true while
+ * io_uring calls are in flight, since nothing else reaps them.
+ *
+ * Proxy threads may run on their shepherd's processors (see io.c), so
+ * QT_IO_IDLE() also yields the processor while any of the shepherd's tasks
+ * are in calls on proxies. */
+
+#ifdef HAVE_SCHED_YIELD
+# define QT_IO_PROXY_YIELD() do {                                            \
+        if (QTHREAD_UNLIKELY(qthread_internal_getshep()->io_proxied != 0)) { \
+            sched_yield();                                                   \
+        }                                                                    \
+} while (0)
+#else
+# define QT_IO_PROXY_YIELD() do { } while (0)
+#endif
+
+#ifdef QTHREAD_IO_URING
+# define QT_IO_PENDING() (qt_io_inflight != 0)
+# define QT_IO_POLL()    do {                         \
+        if (QTHREAD_UNLIKELY(qt_io_inflight != 0)) {  \
+            qt_io_uring_poll();                       \
+        }                                             \
+} while (0)
+#else
+# define QT_IO_PENDING() 0
+# define QT_IO_POLL()    do { } while (0)
+#endif /* ifdef QTHREAD_IO_URING */
+
+#ifdef QTHREAD_IO_EPOLL
+# define QT_IO_IDLE() do {                            \
+        QT_IO_POLL();                                 \
+        QT_IO_PROXY_YIELD();                          \
+        if (QTHREAD_UNLIKELY(qt_io_epoll_waiting != 0)) { \
+            qt_io_epoll_poll(0);                      \
+        }                                             \
+} while (0)
+#else
+# define QT_IO_IDLE() do {                            \
+        QT_IO_POLL();                                 \
+        QT_IO_PROXY_YIELD();                          \
+} while (0)
+#endif /* ifdef QTHREAD_IO_EPOLL */
+
+#endif // ifndef QT_IO_POLL_H
+/* vim:set expandtab: */
@@ -0,0 +1,37 @@
+#ifndef QT_IO_URING_H
+#define QT_IO_URING_H
+
+#include <qthread/qthread.h>          /* for aligned_t */
+#include "qt_visibility.h"
+
+/* Blocking system calls through io_uring (--enable-io-uring).
+ *
+ * Each shepherd has a ring. When a task makes a wrapped system call that
+ * the ring can do (read, pread, write, pwrite, accept and connect), the
+ * worker it ran on submits the call to its shepherd's ring once the task has
+ * switched out, in place of handing the call to a proxy pthread (see io.c).
+ * Completions are reaped by workers: between tasks in qthread_master(), and
+ * on every trip around their idle loops while any call is in flight, which
+ * also keeps workers from parking (or sleeping in a condwait) until the calls
+ * complete (see qt_io_poll.h). A reaped completion puts its task back on its shepherd's ready
+ * queue, as a proxy does.
+ *
+ * If the kernel refuses to set up a ring, or lacks an operation, or a ring
+ * has as many calls in flight as its completion queue holds, calls go to
+ * the proxies as before; QT_IO_URING=0 sends them all there. */
+
+struct _qt_blocking_queue_node_s;
+
+#ifdef QTHREAD_IO_URING
+extern aligned_t qt_io_inflight;       /* over all rings */
+
+void INTERNAL qt_io_uring_init(void);
+void INTERNAL qt_io_uring_finalize(void);
+int INTERNAL  qt_io_uring_submit(struct _qt_blocking_queue_node_s *job); /* 0 if the ring cannot take it */
+int INTERNAL  qt_io_uring_poll(void);  /* reaps completions; returns how many */
+#else
+# define qt_io_uring_submit(job) 0
+#endif /* ifdef QTHREAD_IO_URING */
+
+#endif // ifndef QT_IO_URING_H
+/* vim:set expandtab: */
@@ -16,7 +16,14 @@ qt_mpool qt_mpool_create_aligned(size_t       item_size,
                                  const size_t alignment);
 void qt_mpool_destroy(qt_mpool pool);
 
-void qt_mpool_subsystem_init(void);
+void qt_mpool_set_name(qt_mpool    pool,
+                       const char *name); /* for qthread_pool_stats() */
+
+void   qt_mpool_subsystem_init(void);
+size_t qt_mpool_bytes(void);          /* in chunks, over all pools */
+size_t qt_mpool_hugepage_bytes(void); /* of those, in huge-page regions */
+
+void qt_mpool_idle(void);             /* from idle workers, to compact pools when asked */
 
 #endif // ifndef QT_MPOOL_H
 /* vim:set expandtab: */
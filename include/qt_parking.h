@@ -0,0 +1,111 @@
+#ifndef QT_PARKING_H
+#define QT_PARKING_H
+
+#include "qt_visibility.h"
+#include "qt_atomics.h"
+#include "qt_expect.h"
+#include "qt_threadqueues.h"
+#include "qt_mpool.h"                  /* for qt_mpool_idle() */
+#include "qt_io_poll.h"                /* for QT_IO_IDLE() */
+
+/* Idle-worker parking.
+ *
+ * A worker that finds nothing to do calls QT_PARK_IDLE() once per trip
+ * around its idle loop. The first calls spin with an exponentially growing
+ * number of pauses; once PARK_SPINS pauses have gone by without work the
+ * worker announces itself as a sleeper, re-checks for work, and then sleeps
+ * on its own futex word until an enqueue wakes it (or PARK_TIMEOUT expires,
+ * which bounds the damage of any wakeup the scheduler does not issue).
+ *
+ * Enqueuers call QT_PARK_NOTIFY() after publishing a task. When no worker
+ * is parked this costs one fence and one load of a shared counter; otherwise
+ * exactly one parked worker is woken, preferring the shepherd that owns the
+ * queue and, if the task may be stolen, the nearest other shepherd.
+ *
+ * Without --enable-parking, QT_PARK_IDLE() is SPINLOCK_BODY() and
+ * QT_PARK_NOTIFY() is nothing.
+ *
+ * Either way, a worker that has been idle for a while (PARK_SPINS pauses
+ * with parking, just before it parks; QT_IDLE_HOOK_SPINS trips without)
+ * calls qt_mpool_idle(), which compacts the memory pools when that has been
+ * asked for. Idle loops that do not pause at all without parking count
+ * their trips with QT_IDLE_HOOK() instead.
+ *
+ * Both also collect finished system calls on every trip, and a worker does
+ * not park while io_uring calls are in flight (see qt_io_poll.h). */
+
+typedef struct {
+    uint32_t round; /* pauses in the next spin round */
+    uint32_t spent; /* pauses since the worker last found work */
+} qt_park_backoff_t;
+
+#define QT_PARK_BACKOFF_INITIALIZER { 1, 0 }
+#define QT_PARK_MAX_ROUND           64
+#define QT_IDLE_HOOK_SPINS          4096
+
+#define QT_IDLE_HOOK(b) do {                                    \
+        QT_IO_IDLE();                                           \
+        if (++(b).spent >= QT_IDLE_HOOK_SPINS) {                \
+            qt_mpool_idle();                                    \
+            (b).spent = 0;                                      \
+        }                                                       \
+} while (0)
+
+#ifdef QTHREAD_PARKING
+extern aligned_t qt_park_sleepers;
+extern uint32_t  qt_park_spins;
+
+void INTERNAL qt_park_init(void);
+void INTERNAL qt_park_prepare(void);
+void INTERNAL qt_park_cancel(void);
+void INTERNAL qt_park_commit(void);
+void INTERNAL qt_park_wake(qt_threadqueue_t *q,
+                           int               anywhere);
+void INTERNAL qt_park_wake_all(void);
+
+# define QT_PARK_IDLE(b, has_work) do {                         \
+        QT_IO_IDLE();                                           \
+        if ((b).spent < qt_park_spins) {                        \
+            uint32_t qt_park_i_;                                \
+            for (qt_park_i_ = 0; qt_park_i_ < (b).round; qt_park_i_++) { \
+                SPINLOCK_BODY();                                \
+            }                                                   \
+            (b).spent += (b).round;                             \
+            if ((b).round < QT_PARK_MAX_ROUND) { (b).round <<= 1; } \
+        } else {                                                \
+            qt_mpool_idle();                                    \
+            qt_park_prepare();                                  \
+            if ((has_work) || QT_IO_PENDING()) {                \
+                qt_park_cancel();                               \
+            } else {                                            \
+                qt_park_commit();                               \
+            }                                                   \
+            (b).round = 1;                                      \
+            (b).spent = 0;                                      \
+        }                                                       \
+} while (0)
+
+/* The fence orders the caller's publication of the task before the read of
+ * qt_park_sleepers; qt_park_prepare() orders the other way around. */
+# define QT_PARK_NOTIFY(q, anywhere) do {                      \
+        MACHINE_FENCE;                                         \
+        if (QTHREAD_UNLIKELY(qt_park_sleepers != 0)) {         \
+            qt_park_wake((q), (anywhere));                     \
+        }                                                      \
+} while (0)
+
+# define QT_PARK_NOTIFY_ALL() do {                             \
+        MACHINE_FENCE;                                         \
+        if (qt_park_sleepers != 0) { qt_park_wake_all(); }     \
+} while (0)
+#else /* ifdef QTHREAD_PARKING */
+# define QT_PARK_IDLE(b, has_work) do {                         \
+        SPINLOCK_BODY();                                        \
+        QT_IDLE_HOOK(b);                                        \
+} while (0)
+# define QT_PARK_NOTIFY(q, anywhere) do { } while (0)
+# define QT_PARK_NOTIFY_ALL()        do { } while (0)
+#endif /* ifdef QTHREAD_PARKING */
+
+#endif // ifndef QT_PARKING_H
+/* vim:set expandtab: */
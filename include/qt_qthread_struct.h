@@ -36,6 +36,11 @@
 #define QTHREAD_RESERVED_FLAG2   (1 << 14)
 #define QTHREAD_RESERVED_FLAG1   (1 << 15)
 
+/* the reserved flags carry the task's scheduling priority level (0 = normal) */
+#define QTHREAD_PRIORITY_SHIFT   13
+#define QTHREAD_PRIORITY_MASK    (QTHREAD_RESERVED_FLAG3 | QTHREAD_RESERVED_FLAG2 | QTHREAD_RESERVED_FLAG1)
+#define QTHREAD_PRIORITY_OF(f)   (((f) & QTHREAD_PRIORITY_MASK) >> QTHREAD_PRIORITY_SHIFT)
+
 #define QTHREAD_RET_MASK (QTHREAD_RET_IS_SYNCVAR | QTHREAD_RET_IS_SINC)
 
 struct qthread_runtime_data_s {
@@ -52,6 +57,7 @@ struct qthread_runtime_data_s {
         qthread_queue_t           queue;
     } blockedon;
     qthread_shepherd_t *shepherd_ptr;    /* the shepherd we run on */
+    qthread_worker_t   *stack_owner;     /* the worker that allocated the stack */
     unsigned            tasklocal_size;
     int                 criticalsect; /* critical section depth */
     qt_barrier_t       *barrier;      /* add to allow barriers to be stacked/nested parallelism - akp 10/16/12 */
@@ -83,6 +89,8 @@ struct qthread_s {
     qthread_shepherd_id_t      target_shepherd; /* the shepherd we'd rather run on; set to NO_SHEPHERD unless the thread either migrated or was spawned to a specific destination (aka the programmer expressed a desire for this thread to be somewhere) */
     uint16_t                   flags;           /* may not need all bits */
     uint8_t                    thread_state : 4;
+    uint8_t                    size_class   : 4; /* task structure size class */
+    uint8_t                    stack_class  : 2; /* QTHREAD_STACK_* */
 
     Q_ALIGNED(8) uint8_t data[]; /* this is where we stick argcopy and tasklocal data */
 };
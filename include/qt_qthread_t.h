@@ -3,4 +3,8 @@
 
 typedef struct qthread_s qthread_t;
 
+/* task structures come in this many sizes, by how much argument data they
+ * can hold inline; class 0 holds none (see qthread_thread_new()) */
+#define QTHREAD_TASK_CLASSES 8
+
 #endif
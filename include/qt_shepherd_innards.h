@@ -36,6 +36,15 @@ typedef struct qthread_shepherd_s qthread_shepherd_t;
 
 # define STEAL_BUFFER_LENGTH 128
 
+/* Locality levels for steal victims, nearest first. The affinity layer may
+ * classify each shepherd pair; anything it does not classify is remote. */
+typedef enum {
+    QT_STEAL_LEVEL_CACHE = 0, /* shares a data cache with the thief */
+    QT_STEAL_LEVEL_NUMA,      /* same NUMA node, different cache */
+    QT_STEAL_LEVEL_REMOTE,    /* another NUMA node or socket */
+    QT_STEAL_NUM_LEVELS
+} qt_steal_level_t;
+
 struct qthread_worker_s {
     uintptr_t                 hazard_ptrs[HAZARD_PTRS_PER_SHEP]; /* hazard pointers (see http://portal.acm.org/citation.cfm?id=987524.987595) */
     hazard_freelist_t         hazard_free_list;
@@ -44,11 +53,29 @@ struct qthread_worker_s {
     struct qthread_s        **nostealbuffer;
     struct qthread_s        **stealbuffer;
     qthread_t                *current;
+    qthread_t                *handoff; /* woken task to run next, ahead of the ready queue (QT_WAKE_HANDOFF) */
+    struct qthread_runtime_data_s *simple_rdata; /* spare rdata for the next QTHREAD_SIMPLE task */
+    void                    **stack_cache;     /* per stack class, a LIFO of the stacks last freed here, hottest last */
+    unsigned int              stack_cache_len[QTHREAD_STACK_CLASSES];
+    void                     *stack_inbox[QTHREAD_STACK_CLASSES];     /* stacks donated back by other workers, linked through their rdata */
+    aligned_t                 stack_inbox_len[QTHREAD_STACK_CLASSES]; /* roughly how many */
+    size_t                    stack_hits;      /* stacks taken from stack_cache */
+    size_t                    stack_misses;    /* stacks that had to come from the pool */
+    size_t                    stack_donations; /* stacks freed here but allocated elsewhere, kept or sent home */
+    size_t                    task_allocs[QTHREAD_TASK_CLASSES]; /* task structures allocated here, by size class */
+    size_t                    task_frees[QTHREAD_TASK_CLASSES];
+    aligned_t                 pool_compact_gen; /* the last pool compaction request acted on (see qt_mpool_idle()) */
+#ifdef QTHREAD_GROWABLE_STACKS
+    void                     *sigstack;        /* alternate signal stack for growing task stacks */
+#endif
     qthread_worker_id_t       unique_id;
     qthread_worker_id_t       worker_id;
     qthread_worker_id_t       packed_worker_id;
 #ifdef QTHREAD_PERFORMANCE
     struct qtperfdata_s*             performance_data;
+#endif
+#ifdef QTHREAD_PARKING
+    uint32_t                  park_word; /* futex word; nonzero while parked (see qt_parking.h) */
 #endif
     Q_ALIGNED(8) uint_fast8_t QTHREAD_CASLOCK(active);
 };
@@ -75,6 +102,12 @@ struct qthread_shepherd_s {
     unsigned int          *shep_dists;
     qthread_shepherd_id_t *sorted_sheplist;
     unsigned int           stealing; /* True when a worker is in the steal (attempt) process OR if stealing disabled*/
+    unsigned char         *steal_levels;  /* qt_steal_level_t of each shep, from the affinity layer (may be NULL) */
+    qthread_shepherd_id_t *steal_victims; /* sorted_sheplist grouped by level; private to the elected thief */
+    qthread_shepherd_id_t  steal_level_end[QT_STEAL_NUM_LEVELS]; /* one past the last victim of each level */
+    qthread_shepherd_id_t  steal_budget[QT_STEAL_NUM_LEVELS];    /* probes per level per sweep */
+    uint32_t               steal_seed;
+    saligned_t             io_proxied; /* this shepherd's tasks in calls on proxy threads */
 #ifdef QTHREAD_OMP_AFFINITY
     unsigned int           stealing_mode; /* Specifies when a shepherd may steal */
 #endif
@@ -83,6 +116,7 @@ struct qthread_shepherd_s {
     size_t steal_elected;
     size_t steal_attempted;
     size_t steal_failed;
+    size_t steal_level_successful[QT_STEAL_NUM_LEVELS];
 #endif
 #ifdef QTHREAD_SHEPHERD_PROFILING
     qtimer_t total_time;        /* how much time the shepherd spent running */
@@ -116,6 +150,9 @@ struct qthread_shepherd_s {
     double   febwait_maxtime;   /* max time spent blocking on FEBs */
     double   febwait_time;      /* total time spent blocking on FEBs */
     size_t   febwait_count;     /* num FEB blocking waits required */
+    size_t   spinwait_hits;     /* readers that spun and found the word full */
+    size_t   spinwait_misses;   /* readers that spun and then blocked anyway */
+    size_t   spinwait_skips;    /* readers whose history said not to spin */
     double   empty_maxtime;     /* max time addresses spent empty */
     double   empty_time;        /* total time addresses spent empty */
     size_t   empty_count;       /* num times addresses were empty */
@@ -143,6 +180,8 @@ static QINLINE qthread_worker_t *qthread_internal_getworker(void)
 unsigned int INTERNAL qthread_internal_shep_to_node(const qthread_shepherd_id_t shep);
 qthread_shepherd_t INTERNAL *qthread_find_active_shepherd(qthread_shepherd_id_t *l,
                                                           unsigned int          *d);
+void INTERNAL qt_shepherd_steal_levels_init(qthread_shepherd_t   *sheps,
+                                            qthread_shepherd_id_t nshepherds);
 
 void qthread_back_to_master(qthread_t *t);
 void qthread_back_to_master2(qthread_t *t);
@@ -0,0 +1,62 @@
+#ifndef QT_SPINWAIT_H
+#define QT_SPINWAIT_H
+
+#include <qthread/qthread-int.h> /* for uint32_t */
+
+#include "qt_visibility.h"
+#include "qt_expect.h"
+
+/* Adaptive spin-then-block waiting for FEB and syncvar readers.
+ *
+ * A reader that finds its word not full normally queues itself and goes
+ * back to its worker, which costs two context switches and a trip through
+ * the scheduler even when the writer is only a few hundred nanoseconds
+ * away. With QT_SPIN_WAIT set, the reader first re-checks the word between
+ * growing bursts of pauses for up to a per-address budget. The budget comes
+ * from a small table of how long recent waits on (a word hashing to the same
+ * slot as) that address took: twice the running average, capped at
+ * QT_SPIN_WAIT microseconds, or nothing at all when waits there have lately
+ * been longer than the cap. Both spins that succeed and waits that end up
+ * blocking feed the average, so an address that stops being worth spinning
+ * on can become worth it again.
+ *
+ * Usage:
+ *
+ *     qt_spinwait_t spin = QT_SPINWAIT_INITIALIZER;
+ *   retry:
+ *     ...look at the word...
+ *     if (not full && QT_SPINWAIT_AGAIN(spin, addr)) { ...unlock...; goto retry; }
+ *     ...block, or take the word...
+ *     QT_SPINWAIT_DONE(spin, addr, blocked);
+ *
+ * When spinning is off (the default, and always with a single worker),
+ * QT_SPINWAIT_AGAIN() is one load and QT_SPINWAIT_DONE() one test. */
+
+typedef struct {
+    double   start;  /* when the first retry began, 0 if none yet */
+    double   budget; /* seconds we are willing to spin for */
+    uint32_t round;  /* pauses in the next burst */
+} qt_spinwait_t;
+
+#define QT_SPINWAIT_INITIALIZER { 0.0, 0.0, 1 }
+#define QT_SPINWAIT_MAX_ROUND   64
+
+extern double qt_spinwait_max; /* seconds; 0 means do not spin */
+
+void INTERNAL qt_spinwait_init(unsigned long nworkers);
+int INTERNAL  qt_spinwait_again(qt_spinwait_t *s,
+                                const void    *addr);
+void INTERNAL qt_spinwait_done(qt_spinwait_t *s,
+                               const void    *addr,
+                               int            blocked);
+
+#define QT_SPINWAIT_AGAIN(s, addr) \
+    (QTHREAD_UNLIKELY(qt_spinwait_max > 0.0) && qt_spinwait_again(&(s), (addr)))
+#define QT_SPINWAIT_DONE(s, addr, blocked) do {          \
+        if (QTHREAD_UNLIKELY((s).start != 0.0)) {        \
+            qt_spinwait_done(&(s), (addr), (blocked));   \
+        }                                                \
+} while (0)
+
+#endif // ifndef QT_SPINWAIT_H
+/* vim:set expandtab: */
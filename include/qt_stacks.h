@@ -0,0 +1,67 @@
+#ifndef QT_STACKS_H
+#define QT_STACKS_H
+
+#include "qt_visibility.h"
+
+/* Task stack arenas (--enable-stack-arenas).
+ *
+ * Stacks are carved out of large mmap()'d regions, one set of regions per
+ * NUMA node and stack size class, reserved without committing swap and
+ * bound to their node so that pages land there no matter which worker
+ * touches them first. Each slot is laid out as ALLOC_STACK() has always laid
+ * out a stack:
+ *
+ *     [guard][stack][guard][rdata][slot header]
+ *
+ * with the guard pages present only when guard pages are on. Guard pages are
+ * protected once, when the slot is first carved, and stay protected while
+ * the slot goes around the free lists. Without guard pages the stack sits at
+ * the end of its slot, so that rdata shares a page with the top of the stack.
+ *
+ * These are the stack pool behind the workers' stack caches (see
+ * alloc_stack() in qthread.c), which only keep stacks from their own node's
+ * arena. Stacks that do not fit in a cache, or that belong to another node,
+ * go back to their arena, which keeps up to QT_STACK_RETAIN of them warm;
+ * beyond that a stack's pages are handed back to the OS with
+ * madvise(MADV_DONTNEED) before it joins the arena's cold list. New stacks
+ * come from the arena's warm list, then its cold list, and only then from
+ * fresh address space.
+ *
+ * Growable stacks (--enable-growable-stacks) reserve QT_STACK_RESERVE bytes
+ * of address space for every stack, or the class's size if that is larger,
+ * and qt_stacks_init() raises qlib->stack_class_size[] to match. Only the
+ * class's configured size at the top of the stack is committed; the rest
+ * is PROT_NONE, with a guard page below it that is never committed. A fault
+ * in the uncommitted part of the running task's stack is caught by a
+ * SIGSEGV (and SIGBUS) handler, running on each worker's alternate signal
+ * stack, that commits at least twice as much and lets the task carry on.
+ * A fault on the guard page is reported as a stack overflow. When a grown
+ * stack goes back to its arena, the pages beyond its initial commit are
+ * returned to the OS and protected again. Without an upper guard page the
+ * stack takes up the rest of its slot, so rdata and the header share the
+ * page at its top. Each growable stack costs the process two mappings, so
+ * only about vm.max_map_count / 2 of them fit; stacks carved beyond that are
+ * committed in full and do not grow. */
+
+void INTERNAL  qt_stacks_init(size_t rdata_size,
+                              int    guard_pages);
+void INTERNAL  qt_stacks_finalize(void);
+void INTERNAL *qt_stack_alloc(unsigned int cls);
+void INTERNAL  qt_stack_free(void        *stack,
+                             unsigned int cls);
+int INTERNAL   qt_stack_is_local(void        *stack,
+                                 unsigned int cls); /* from the caller's node's arena? */
+
+#ifdef QTHREAD_GROWABLE_STACKS
+/* set up (on the worker's own thread) and tear down a worker's alternate
+ * signal stack, which the growth handler runs on */
+void INTERNAL      qt_stacks_worker_init(struct qthread_worker_s *w);
+void INTERNAL      qt_stacks_worker_finalize(struct qthread_worker_s *w);
+aligned_t INTERNAL qt_stacks_growths(void);
+#else
+# define qt_stacks_worker_init(w)
+# define qt_stacks_worker_finalize(w)
+#endif
+
+#endif // ifndef QT_STACKS_H
+/* vim:set expandtab: */
@@ -0,0 +1,72 @@
+#ifndef QT_STEAL_H
+#define QT_STEAL_H
+
+#include "qt_shepherd_innards.h"
+
+/* Hierarchical victim selection for the work-stealing schedulers.
+ *
+ * A sweep visits the thief's victims one locality level at a time (shared
+ * cache, then NUMA node, then remote), spending at most steal_budget[level]
+ * probes at each level. Victims within a level are drawn in random order
+ * without replacement (a partial Fisher-Yates shuffle of steal_victims), so
+ * concurrent thieves do not all converge on the same victim and a budget
+ * smaller than the level still covers every victim over several sweeps.
+ *
+ * The cursor and the thief's steal_victims/steal_seed are only touched by
+ * the one worker per shepherd that currently holds the right to steal. */
+
+typedef struct {
+    unsigned int          level; /* level of the victim most recently returned */
+    qthread_shepherd_id_t pos;   /* next unprobed slot in steal_victims */
+    qthread_shepherd_id_t left;  /* probes left at this level */
+} qt_steal_cursor_t;
+
+static QINLINE uint32_t qt_steal_rand(qthread_shepherd_t *thief)
+{   /*{{{*/
+    uint32_t x = thief->steal_seed;
+
+    x                ^= x << 13;
+    x                ^= x >> 17;
+    x                ^= x << 5;
+    thief->steal_seed = x;
+    return x;
+} /*}}}*/
+
+static QINLINE void qt_steal_sweep_begin(qthread_shepherd_t *thief,
+                                         qt_steal_cursor_t  *c)
+{   /*{{{*/
+    c->level = 0;
+    c->pos   = 0;
+    c->left  = thief->steal_budget[0];
+} /*}}}*/
+
+/* Returns 0 once the sweep has used up every level's budget. */
+static QINLINE int qt_steal_next_victim(qthread_shepherd_t    *thief,
+                                        qt_steal_cursor_t     *c,
+                                        qthread_shepherd_id_t *victim)
+{   /*{{{*/
+    qthread_shepherd_id_t *const victims = thief->steal_victims;
+
+    while (c->level < QT_STEAL_NUM_LEVELS) {
+        qthread_shepherd_id_t const end = thief->steal_level_end[c->level];
+
+        if ((c->left > 0) && (c->pos < end)) {
+            qthread_shepherd_id_t const j   = c->pos + qt_steal_rand(thief) % (end - c->pos);
+            qthread_shepherd_id_t const tmp = victims[j];
+
+            victims[j]        = victims[c->pos];
+            victims[c->pos++] = tmp;
+            c->left--;
+            *victim = tmp;
+            return 1;
+        }
+        c->pos = end;
+        if (++c->level < QT_STEAL_NUM_LEVELS) {
+            c->left = thief->steal_budget[c->level];
+        }
+    }
+    return 0;
+} /*}}}*/
+
+#endif // ifndef QT_STEAL_H
+/* vim:set expandtab: */
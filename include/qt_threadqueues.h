@@ -28,6 +28,11 @@ void INTERNAL qt_threadqueue_filter(qt_threadqueue_t       *q,
                                     qt_threadqueue_filter_f f);
 void INTERNAL qt_threadqueue_enqueue(qt_threadqueue_t *restrict q,
                                      qthread_t *restrict        t);
+/* Puts n tasks, in order, at the tail of q as cheaply as the queue allows;
+ * used to release many FEB waiters at once. */
+void INTERNAL qt_threadqueue_enqueue_batch(qt_threadqueue_t *restrict q,
+                                           qthread_t *const          *t,
+                                           size_t                     n);
 void INTERNAL qt_threadqueue_enqueue_yielded(qt_threadqueue_t *restrict q,
                                              qthread_t *restrict        t);
 void INTERNAL qt_threadqueue_enqueue_cache(qt_threadqueue_t         *q,
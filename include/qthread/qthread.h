@@ -321,6 +321,27 @@ enum _qthread_features {
 #define QTHREAD_SPAWN_LOCAL_PRIORITY (1 << SPAWN_LOCAL_PRIORITY)
 #define QTHREAD_SPAWN_NETWORK (1 << SPAWN_NETWORK)
 
+/* Scheduling priority, OR'd into qthread_spawn()'s feature_flag. Level 0 is
+ * the default; higher levels run first. Levels at or above the runtime's
+ * QT_PRIORITY_LEVELS are treated as the highest configured level. */
+#define QTHREAD_PRIORITY_LEVELS_MAX   8
+#define QTHREAD_SPAWN_PRIORITY_SHIFT  24
+#define QTHREAD_SPAWN_PRIORITY_MASK   ((QTHREAD_PRIORITY_LEVELS_MAX - 1) << QTHREAD_SPAWN_PRIORITY_SHIFT)
+#define QTHREAD_SPAWN_PRIORITY(p)     ((((unsigned int)(p)) << QTHREAD_SPAWN_PRIORITY_SHIFT) & QTHREAD_SPAWN_PRIORITY_MASK)
+
+/* Stack size class, OR'd into qthread_spawn()'s feature_flag. The default
+ * class gets QT_STACK_SIZE bytes; the others are sized by QT_STACK_SIZE_SMALL,
+ * QT_STACK_SIZE_LARGE and QT_STACK_SIZE_HUGE (see qthread_stack_class_size(3)).
+ * Ignored for QTHREAD_SPAWN_SIMPLE tasks, which have no stack of their own. */
+#define QTHREAD_STACK_DEFAULT      0
+#define QTHREAD_STACK_SMALL        1
+#define QTHREAD_STACK_LARGE        2
+#define QTHREAD_STACK_HUGE         3
+#define QTHREAD_STACK_CLASSES      4
+#define QTHREAD_SPAWN_STACK_SHIFT  27
+#define QTHREAD_SPAWN_STACK_MASK   ((QTHREAD_STACK_CLASSES - 1) << QTHREAD_SPAWN_STACK_SHIFT)
+#define QTHREAD_SPAWN_STACK(c)     ((((unsigned int)(c)) << QTHREAD_SPAWN_STACK_SHIFT) & QTHREAD_SPAWN_STACK_MASK)
+
 int qthread_spawn(qthread_f             f,
                   const void           *arg,
                   size_t                arg_size,
@@ -356,6 +377,7 @@ void* qthread_tos(void);
 void* qthread_bos(void);
 
 size_t     qthread_stackleft(void);
+size_t     qthread_stack_class_size(unsigned int stack_class);
 aligned_t *qthread_retloc(void);
 int        qthread_shep_ok(void);
 void       qthread_shep_next(qthread_shepherd_id_t *shep);
@@ -391,10 +413,49 @@ enum introspective_state {
     CURRENT_WORKER,
     CURRENT_UNIQUE_WORKER,
     CURRENT_TEAM,
-    PARENT_TEAM
+    PARENT_TEAM,
+    STACK_CACHE_HITS,
+    STACK_CACHE_MISSES,
+    STACK_DONATIONS,
+    STACK_GROWTHS,
+    POOL_BYTES,
+    POOL_HUGEPAGE_BYTES
 };
 size_t qthread_readstate(const enum introspective_state type);
 
+/* task structure size classes (see qthread_task_class_stats(3)) */
+typedef struct qthread_task_class_stats_s {
+    size_t bytes;  /* size of each task structure in this class */
+    size_t args;   /* inline argument bytes it can carry */
+    size_t allocs; /* task structures handed out so far */
+    size_t live;   /* of those, how many have not been freed */
+} qthread_task_class_stats_t;
+unsigned int qthread_task_classes(void);
+int          qthread_task_class_stats(unsigned int                cls,
+                                      qthread_task_class_stats_t *stats);
+
+/* the runtime's memory pools (see qthread_pool_stats(3)) */
+typedef struct qthread_pool_stats_s {
+    const char *name;
+    size_t      item_size;    /* bytes per item */
+    size_t      reserved;     /* bytes of chunks the pool holds */
+    size_t      reserved_hwm; /* the most it has held */
+    size_t      live;         /* items handed out and not freed */
+    size_t      live_hwm;     /* the most seen live, sampled as the pool grows */
+    size_t      cached;       /* free items in per-thread caches */
+    size_t      shared;       /* free items in the pool's shared list */
+    size_t      allocs;       /* these three only with --enable-profiling=pools */
+    size_t      frees;
+    size_t      remote_frees; /* at least this many freed on another thread */
+} qthread_pool_stats_t;
+unsigned int qthread_pools(void);
+int          qthread_pool_stats(unsigned int          pool,
+                                qthread_pool_stats_t *stats);
+size_t       qthread_pool_cached(unsigned int pool,
+                                 unsigned int worker);
+void         qthread_pool_stats_dump(int fd);
+size_t       qthread_pool_compact(void); /* see qthread_pool_compact(3) */
+
 /* Task team interface. */
 typedef enum qt_team_critical_section_e {
     BEGIN,
@@ -483,6 +544,32 @@ typedef struct {
 int qthread_feb_status(const aligned_t *addr);
 int qthread_syncvar_status(syncvar_t *const v);
 
+/* These functions keep the FEB state of the 'count' aligned words starting at
+ * 'base' in a two-bit-per-word map instead of the central hash table, so that
+ * FEB operations on them that don't have to wait never touch the table. No FEB
+ * operations on the region may be in progress while it is (un)registered.
+ * Regions may not overlap; not available with --enable-lf-febs. */
+int qthread_feb_region_register(const aligned_t *base,
+                                size_t           count);
+int qthread_feb_region_unregister(const aligned_t *base);
+
+/* Vectored FEB operations: the same as calling writeF(dests[i], &srcs[i]),
+ * fill(addrs[i]), empty(addrs[i]) or readFF(&dests[i], srcs[i]) for each i
+ * in turn, but the central FEB table is locked once per stripe instead of
+ * once per word, and all the tasks released are made runnable together.
+ * dests may be NULL for qthread_readFF_many(); words that are not yet full
+ * are waited on one after the other. */
+int qthread_writeF_many(aligned_t *const *dests,
+                        const aligned_t  *srcs,
+                        size_t            n);
+int qthread_fill_many(aligned_t *const *addrs,
+                      size_t            n);
+int qthread_empty_many(aligned_t *const *addrs,
+                       size_t            n);
+int qthread_readFF_many(aligned_t        *dests,
+                        aligned_t *const *srcs,
+                        size_t            n);
+
 /* The empty/fill functions merely assert the empty or full state of the given
  * address. */
 int qthread_empty(const aligned_t *dest);
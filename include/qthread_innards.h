@@ -50,12 +50,20 @@ typedef struct qlib_s {
     qt_threadqueue_t         **local_priority_queues;
 #endif /* ifdef QTHREAD_LOCAL_PRIORITY */
 
-    unsigned                   qthread_stack_size;
+    unsigned                   qthread_stack_size;      /* the default stack class's size */
+    unsigned                   stack_class_size[QTHREAD_STACK_CLASSES]; /* usable bytes per stack class */
     unsigned                   master_stack_size;
     unsigned                   max_stack_size;
 
     unsigned                   qthread_argcopy_size;
     unsigned                   qthread_tasklocal_size;
+    unsigned                   task_classes;
+    unsigned                   task_class_args[QTHREAD_TASK_CLASSES];   /* inline argument bytes in each class */
+    aligned_t                  task_class_allocs[QTHREAD_TASK_CLASSES]; /* by threads that are not workers */
+    aligned_t                  task_class_frees[QTHREAD_TASK_CLASSES];
+
+    uint_fast8_t               wake_handoff; /* run a lone released FEB/syncvar waiter next on the waker's worker */
+    uint_fast8_t               hugepages;    /* back memory pools (and stack arenas) with huge pages */
 
     qthread_t                 *mccoy_thread; /* free when exiting */
 
@@ -128,8 +136,14 @@ typedef struct qlib_s {
 
 extern qlib_t qlib;
 
+/* where in a task's data[] its default task-local storage starts: right
+ * after the inline arguments that its size class has room for */
+#define QTHREAD_TASKLOCAL_OFFSET(t) \
+    (((t)->flags & QTHREAD_BIG_STRUCT) ? qlib->task_class_args[(t)->size_class] : 0)
+
 void INTERNAL qthread_exec(qthread_t    *t,
                            qt_context_t *c);
+int INTERNAL  qthread_internal_handoff(qthread_t *t);
 
 
 #endif // ifndef QTHREAD_INNARDS_H
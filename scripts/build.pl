@@ -19,6 +19,7 @@ my %config = (
     lifo          => '--with-scheduler=lifo',
     mutexfifo     => '--with-scheduler=mutexfifo',
     mtsfifo       => '--with-scheduler=mtsfifo',
+    chaselev      => '--with-scheduler=chaselev',
     nottingham    => '--with-scheduler=nottingham',
     slowcontext   => '--disable-fastcontext',
     shavit        => '--with-dict=shavit',
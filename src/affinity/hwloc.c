@@ -574,6 +574,40 @@ void INTERNAL qt_affinity_set(qthread_worker_t *me,
     }
 }                                      /*}}} */
 
+static int obj_is_data_cache(hwloc_obj_t obj)
+{   /*{{{*/
+#if HWLOC_API_VERSION >= 0x00020000
+    return hwloc_obj_type_is_dcache(obj->type);
+#else
+    return obj->type == HWLOC_OBJ_CACHE;
+#endif
+} /*}}}*/
+
+/* Classify how far a steal from shepherd object b would move work for a thief
+ * on shepherd object a: same data cache, same NUMA node, or remote. */
+static unsigned char steal_level_between(hwloc_topology_t topo,
+                                         hwloc_obj_t      a,
+                                         hwloc_obj_t      b)
+{   /*{{{*/
+    if ((a == NULL) || (b == NULL)) {
+        return QT_STEAL_LEVEL_REMOTE;
+    }
+    if (a == b) {
+        return QT_STEAL_LEVEL_CACHE;
+    }
+    for (hwloc_obj_t o = hwloc_get_common_ancestor_obj(topo, a, b); o; o = o->parent) {
+        if (obj_is_data_cache(o)) {
+            return QT_STEAL_LEVEL_CACHE;
+        }
+    }
+#if HWLOC_API_VERSION > 0x00010000
+    if (a->nodeset && b->nodeset && hwloc_bitmap_isequal(a->nodeset, b->nodeset)) {
+        return QT_STEAL_LEVEL_NUMA;
+    }
+#endif
+    return QT_STEAL_LEVEL_REMOTE;
+} /*}}}*/
+
 int INTERNAL qt_affinity_gendists(qthread_shepherd_t   *sheps,
                                   qthread_shepherd_id_t nshepherds)
 {                                                                                      /*{{{ */
@@ -639,7 +673,21 @@ int INTERNAL qt_affinity_gendists(qthread_shepherd_t   *sheps,
             sort_sheps(sheps[i].shep_dists, sheps[i].sorted_sheplist, nshepherds);
         }
     }
-       /* there does not seem to be a way to extract distances... <sigh> */
+       for (size_t i = 0; i < nshepherds; ++i) {
+        hwloc_obj_t me = hwloc_get_obj_inside_cpuset_by_depth(topology, allowed_cpuset, shep_depth, sheps[i].node);
+
+        sheps[i].steal_levels = qt_calloc(nshepherds, sizeof(unsigned char));
+        assert(sheps[i].steal_levels);
+        for (size_t j = 0; j < nshepherds; ++j) {
+            if (j != i) {
+                hwloc_obj_t them = hwloc_get_obj_inside_cpuset_by_depth(topology, allowed_cpuset, shep_depth, sheps[j].node);
+                sheps[i].steal_levels[j] = steal_level_between(topology, me, them);
+                qthread_debug(AFFINITY_DETAILS, "steal level from %i to %i is %i\n",
+                              (int)i, (int)j, (int)sheps[i].steal_levels[j]);
+            }
+        }
+    }
+    /* there does not seem to be a way to extract distances... <sigh> */
     return QTHREAD_SUCCESS;
 }                                      /*}}} */
 
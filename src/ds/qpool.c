@@ -29,7 +29,10 @@ qpool *qpool_create_aligned(const size_t isize,
     ret->alignment = alignment;
     return ret;
 #else
-    return qt_mpool_create_aligned(isize, alignment);
+    qpool *ret = qt_mpool_create_aligned(isize, alignment);
+
+    if (ret) { qt_mpool_set_name(ret, "qpool"); }
+    return ret;
 #endif
 }                                      /*}}} */
 
@@ -0,0 +1,82 @@
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdarg.h>      /* for va_list */
+#include <qthread-int.h> /* for uintptr_t */
+
+#include "qthread/common.h"
+
+#include "fastcontext/minimal-ucontext.h"
+#include "qt_visibility.h"
+#include "qt_asserts.h"
+
+/* the first code a new context runs (minimal-asm.S) */
+extern void qt_minimal_start(void);
+
+/* Builds the frame that qt_minimal_swapctxt() pops when it first switches to
+ * ucp (the layouts are described in minimal-asm.S): the argument and the
+ * function go where qt_minimal_start expects them, and the frame "returns"
+ * to qt_minimal_start with a 16-byte aligned stack. Only the first variable
+ * argument is passed on; qthreads never uses more. */
+void INTERNAL qt_minimal_makectxt(uctxt_t *ucp,
+                                  void     (*func)(void),
+                                  int      argc,
+                                  ...)
+{
+    uintptr_t *sp;
+    uintptr_t  arg = 0;
+    va_list    ap;
+
+    assert(ucp->uc_stack.ss_sp != NULL);
+    if (argc > 0) {
+        va_start(ap, argc);
+        arg = va_arg(ap, uintptr_t);
+        va_end(ap);
+    }
+
+    sp = (uintptr_t *)(((uintptr_t)ucp->uc_stack.ss_sp + ucp->uc_stack.ss_size) & ~(uintptr_t)15);
+
+#if (QTHREAD_ASSEMBLY_ARCH == QTHREAD_AMD64)
+    *--sp = 0;                            /* padding */
+    *--sp = 0;                            /* qt_minimal_start's return address */
+    *--sp = (uintptr_t)qt_minimal_start;  /* popped by ret: %rsp is then aligned */
+    *--sp = 0;                            /* %rbp */
+    *--sp = 0;                            /* %rbx */
+    *--sp = arg;                          /* %r12 */
+    *--sp = (uintptr_t)func;              /* %r13 */
+    *--sp = 0;                            /* %r14 */
+    *--sp = 0;                            /* %r15 */
+# ifdef QTHREAD_CONTEXT_SAVE_FP_CONTROL
+    {
+        /* a new task starts with its creator's floating-point modes */
+        uint32_t mxcsr;
+        uint16_t cw;
+
+        __asm__ __volatile__ ("stmxcsr %0" : "=m" (mxcsr));
+        __asm__ __volatile__ ("fnstcw %0" : "=m" (cw));
+        *--sp = (uintptr_t)mxcsr | ((uintptr_t)cw << 32);
+    }
+# endif
+#elif (QTHREAD_ASSEMBLY_ARCH == QTHREAD_ARMV8_A64)
+# ifdef QTHREAD_CONTEXT_SAVE_FP_CONTROL
+    sp -= 22;
+    __asm__ __volatile__ ("mrs %0, fpcr" : "=r" (sp[20]));
+    sp[21] = 0;
+# else
+    sp -= 20;
+# endif
+    for (int i = 0; i < 20; i++) {
+        sp[i] = 0;
+    }
+    sp[0]  = arg;                         /* x19 */
+    sp[1]  = (uintptr_t)func;             /* x20 */
+    sp[11] = (uintptr_t)qt_minimal_start; /* x30, where ret goes */
+#else
+# error The minimal context swap supports only x86-64 and AArch64
+#endif
+
+    ucp->sp = sp;
+}
+
+/* vim:set expandtab: */
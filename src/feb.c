@@ -26,6 +26,7 @@
 #include "qt_blocking_structs.h"
 #include "qt_addrstat.h"
 #include "qt_threadqueues.h"
+#include "qt_spinwait.h"
 #include "qt_debug.h"
 #ifdef QTHREAD_USE_EUREKAS
 #include "qt_eurekas.h" // for qthread_internal_assassinate() (used in taskfilter)
@@ -36,6 +37,29 @@
  * Local Variables
  *********************************************************************/
 static qt_hash *FEBs;
+#ifndef LOCK_FREE_FEBS
+/* Words in a registered region keep their FEB state in a shadow map, two
+ * bits per word, and only go to the hash table when a task has to wait on
+ * them; see qthread_feb_region_register(). */
+# define QT_FEB_MAX_REGIONS     32
+# define QT_FEB_INLINE_FULL     ((aligned_t)0) /* zero, so a fresh map is all full */
+# define QT_FEB_INLINE_EMPTY    ((aligned_t)1)
+# define QT_FEB_INLINE_BUSY     ((aligned_t)2) /* an inline op is moving the data */
+# define QT_FEB_INLINE_HASHED   ((aligned_t)3) /* the hash table has the word */
+# define QT_FEB_INLINE_MASK     ((aligned_t)3)
+# define QT_FEB_INLINE_PER_WORD (sizeof(aligned_t) * 4)
+# define QT_FEB_INLINE_MAPLEN(count) \
+    ((((count) + QT_FEB_INLINE_PER_WORD - 1) / QT_FEB_INLINE_PER_WORD) * sizeof(aligned_t))
+# define QT_FEB_IN(state)       (1u << (state))
+typedef struct {
+    const aligned_t *base;
+    size_t           count;
+    aligned_t       *bits;
+} qt_feb_region_t;
+static qt_feb_region_t       feb_regions[QT_FEB_MAX_REGIONS];
+static volatile unsigned int feb_nregions = 0; /* slots in use, holes included */
+static QTHREAD_FASTLOCK_TYPE feb_regions_lock;
+#endif /* ifndef LOCK_FREE_FEBS */
 #ifdef QTHREAD_COUNT_THREADS
 aligned_t *febs_stripes;
 # ifdef QTHREAD_MUTEX_INCREMENT
@@ -67,6 +91,15 @@ typedef struct {
     int             retval;
 } qthread_feb_blocker_t;
 
+/* Waiters released by one of the *_many() functions, to be put on the ready
+ * queue together once all the stripes have been visited. */
+#define QT_FEB_WAKEUP_BATCH 64
+typedef struct {
+    qthread_shepherd_t *shep;
+    size_t              n;
+    qthread_t          *tasks[QT_FEB_WAKEUP_BATCH];
+} qt_feb_wakeup_t;
+
 /********************************************************************
  * Local Prototypes
  *********************************************************************/
@@ -77,7 +110,8 @@ static QINLINE void qthread_gotlock_fill_inner(qthread_shepherd_t *shep,
                                                qthread_addrstat_t *m,
                                                void               *maddr,
                                                const uint_fast8_t  recursive,
-                                               qthread_addrres_t **precond_tasks);
+                                               qthread_addrres_t **precond_tasks,
+                                               qt_feb_wakeup_t    *wake);
 static QINLINE void qthread_gotlock_empty(qthread_shepherd_t *shep,
                                           qthread_addrstat_t *m,
                                           void               *maddr);
@@ -85,7 +119,8 @@ static QINLINE void qthread_gotlock_empty_inner(qthread_shepherd_t *shep,
                                                 qthread_addrstat_t *m,
                                                 void               *maddr,
                                                 const uint_fast8_t  recursive,
-                                                qthread_addrres_t **precond_tasks);
+                                                qthread_addrres_t **precond_tasks,
+                                                qt_feb_wakeup_t    *wake);
 
 /********************************************************************
  * Shared Globals
@@ -121,6 +156,16 @@ static void qt_feb_subsystem_shutdown(void)
 #endif
     }
     FREE(FEBs, sizeof(qt_hash) * QTHREAD_LOCKING_STRIPES);
+#ifndef LOCK_FREE_FEBS
+    for (unsigned i = 0; i < feb_nregions; i++) {
+        if (feb_regions[i].bits) {
+            FREE(feb_regions[i].bits, QT_FEB_INLINE_MAPLEN(feb_regions[i].count));
+            feb_regions[i].bits = NULL;
+        }
+    }
+    feb_nregions = 0;
+    QTHREAD_FASTLOCK_DESTROY(feb_regions_lock);
+#endif
 #ifdef QTHREAD_COUNT_THREADS
     FREE(febs_stripes, sizeof(aligned_t) * QTHREAD_LOCKING_STRIPES);
 # ifdef QTHREAD_MUTEX_INCREMENT
@@ -143,12 +188,17 @@ void INTERNAL qt_feb_subsystem_init(uint_fast8_t need_sync)
 {
 #if !defined(UNPOOLED_ADDRSTAT) && !defined(UNPOOLED)
     generic_addrstat_pool = qt_mpool_create(sizeof(qthread_addrstat_t));
+    qt_mpool_set_name(generic_addrstat_pool, "FEB addrstats");
 #endif
 #if !defined(UNPOOLED_ADDRRES) && !defined(UNPOOLED)
     generic_addrres_pool = qt_mpool_create(sizeof(qthread_addrres_t));
+    qt_mpool_set_name(generic_addrres_pool, "FEB waiters");
 #endif
     FEBs = MALLOC(sizeof(qt_hash) * QTHREAD_LOCKING_STRIPES);
     assert(FEBs);
+#ifndef LOCK_FREE_FEBS
+    QTHREAD_FASTLOCK_INIT(feb_regions_lock);
+#endif
 #ifdef QTHREAD_COUNT_THREADS
     febs_stripes = MALLOC(sizeof(aligned_t) * QTHREAD_LOCKING_STRIPES);
     assert(febs_stripes);
@@ -170,15 +220,33 @@ void INTERNAL qt_feb_subsystem_init(uint_fast8_t need_sync)
     qthread_internal_cleanup_late(qt_feb_subsystem_shutdown);
 }
 
+static QINLINE void qt_feb_wakeup_flush(qt_feb_wakeup_t *wake)
+{   /*{{{*/
+    if (wake->n) {
+        qt_threadqueue_enqueue_batch(wake->shep->ready, wake->tasks, wake->n);
+        wake->n = 0;
+    }
+} /*}}}*/
+
 static inline void qt_feb_schedule(qthread_t          *waiter,
-                                   qthread_shepherd_t *shep)
+                                   qthread_shepherd_t *shep,
+                                   const int           handoff,
+                                   qt_feb_wakeup_t    *wake)
 {
     qthread_debug(FEB_DETAILS, "waiter(%p:%i), shep(%p:%i): setting waiter to 'RUNNING'\n", waiter, (int)waiter->thread_id, shep, (int)shep->shepherd_id);
     waiter->thread_state = QTHREAD_STATE_RUNNING;
     QTPERF_QTHREAD_ENTER_STATE(waiter->rdata->performance_data, QTHREAD_STATE_RUNNING);
+    if (handoff && qthread_internal_handoff(waiter)) {
+        return;
+    }
     if ((waiter->flags & QTHREAD_UNSTEALABLE) && (waiter->rdata->shepherd_ptr != shep)) {
         qthread_debug(FEB_DETAILS, "waiter(%p:%i), shep(%p:%i): enqueueing waiter in target_shep's ready queue (%p:%i)\n", waiter, (int)waiter->thread_id, shep, (int)shep->shepherd_id, waiter->rdata->shepherd_ptr, waiter->rdata->shepherd_ptr->shepherd_id);
         qt_threadqueue_enqueue(waiter->rdata->shepherd_ptr->ready, waiter);
+    } else if (wake) {
+        wake->tasks[wake->n++] = waiter;
+        if (wake->n == QT_FEB_WAKEUP_BATCH) {
+            qt_feb_wakeup_flush(wake);
+        }
     } else
 #ifdef QTHREAD_USE_SPAWNCACHE
     if (!qt_spawncache_spawn(waiter, shep->ready))
@@ -256,6 +324,319 @@ static int qthread_feb_blocker_func(void        *dest,
  * may need to move to a new mechanism.
  */
 
+#ifndef LOCK_FREE_FEBS
+static QINLINE aligned_t *qt_feb_inline_word(const aligned_t *addr,
+                                             unsigned int    *shift)
+{   /*{{{*/
+    const unsigned int n = feb_nregions;
+
+    addr = (const aligned_t *)((uintptr_t)addr & ~(uintptr_t)(sizeof(aligned_t) - 1));
+    for (unsigned int i = 0; i < n; i++) {
+        const qt_feb_region_t *r = &feb_regions[i];
+
+        if ((addr >= r->base) && (addr < r->base + r->count)) {
+            const size_t idx = addr - r->base;
+
+            *shift = (idx % QT_FEB_INLINE_PER_WORD) * 2;
+            return &r->bits[idx / QT_FEB_INLINE_PER_WORD];
+        }
+    }
+    return NULL;
+} /*}}}*/
+
+/* Moves a word from any of the states in 'from' (a QT_FEB_IN() mask) to 'to'
+ * and returns the state it found; if that was not in 'from', nothing changed.
+ * A BUSY word is waited out unless BUSY is in 'from'. */
+static QINLINE aligned_t qt_feb_inline_move(aligned_t         *w,
+                                            const unsigned int shift,
+                                            const unsigned int from,
+                                            const aligned_t    to)
+{   /*{{{*/
+    aligned_t old = *(volatile aligned_t *)w;
+
+    while (1) {
+        const aligned_t s = (old >> shift) & QT_FEB_INLINE_MASK;
+        aligned_t       got;
+
+        if ((s == QT_FEB_INLINE_BUSY) && !(from & QT_FEB_IN(QT_FEB_INLINE_BUSY))) {
+            SPINLOCK_BODY();
+            old = *(volatile aligned_t *)w;
+            continue;
+        }
+        if (!(from & QT_FEB_IN(s))) { return s; }
+        got = qthread_cas(w, old, (old & ~(QT_FEB_INLINE_MASK << shift)) | (to << shift));
+        if (got == old) { return s; }
+        old = got;
+    }
+} /*}}}*/
+
+/* The uncontended cases of every FEB operation on a registered word: returns
+ * 1 with *rc set if the operation is done, or 0 to send the caller to the
+ * hash table (the word is HASHED, or the caller has to wait). */
+static QINLINE int qt_feb_inline(const blocker_type       op,
+                                 aligned_t *restrict       dest,
+                                 const aligned_t *restrict src,
+                                 int                      *rc)
+{   /*{{{*/
+    const aligned_t *addr = (op < READFF) ? dest : src;
+    unsigned int     shift;
+    aligned_t       *w;
+    aligned_t        s;
+
+    if (feb_nregions == 0) { return 0; }
+    w = qt_feb_inline_word(addr, &shift);
+    if (w == NULL) { return 0; }
+    *rc = QTHREAD_SUCCESS;
+    switch (op) {
+        case READFF:
+        case READFF_NB:
+            while ((s = qt_feb_inline_move(w, shift, 0, 0)) == QT_FEB_INLINE_FULL) {
+                if (dest && (dest != src)) {
+                    THREAD_FENCE_MEM_ACQUIRE;
+                    *dest = *(volatile aligned_t *)src;
+                    THREAD_FENCE_MEM_ACQUIRE;
+                }
+                /* if it is still full, the copy happened while it was */
+                if (((*(volatile aligned_t *)w >> shift) & QT_FEB_INLINE_MASK) == QT_FEB_INLINE_FULL) {
+                    return 1;
+                }
+            }
+            if ((s == QT_FEB_INLINE_EMPTY) && (op == READFF_NB)) {
+                *rc = QTHREAD_OPFAIL;
+                return 1;
+            }
+            return 0;
+
+        case READFE:
+        case READFE_NB:
+            s = qt_feb_inline_move(w, shift, QT_FEB_IN(QT_FEB_INLINE_FULL), QT_FEB_INLINE_BUSY);
+            if (s == QT_FEB_INLINE_FULL) {
+                if (dest && (dest != src)) { *dest = *src; }
+                qt_feb_inline_move(w, shift, QT_FEB_IN(QT_FEB_INLINE_BUSY), QT_FEB_INLINE_EMPTY);
+                return 1;
+            }
+            if ((s == QT_FEB_INLINE_EMPTY) && (op == READFE_NB)) {
+                *rc = QTHREAD_OPFAIL;
+                return 1;
+            }
+            return 0;
+
+        case WRITEEF:
+        case WRITEEF_NB:
+            s = qt_feb_inline_move(w, shift, QT_FEB_IN(QT_FEB_INLINE_EMPTY), QT_FEB_INLINE_BUSY);
+            if (s == QT_FEB_INLINE_EMPTY) {
+                if (dest != src) { *dest = *src; }
+                qt_feb_inline_move(w, shift, QT_FEB_IN(QT_FEB_INLINE_BUSY), QT_FEB_INLINE_FULL);
+                return 1;
+            }
+            if ((s == QT_FEB_INLINE_FULL) && (op == WRITEEF_NB)) {
+                *rc = QTHREAD_OPFAIL;
+                return 1;
+            }
+            return 0;
+
+        case WRITEFF:
+            s = qt_feb_inline_move(w, shift, QT_FEB_IN(QT_FEB_INLINE_FULL), QT_FEB_INLINE_BUSY);
+            if (s != QT_FEB_INLINE_FULL) { return 0; }
+            if (dest != src) { *dest = *src; }
+            qt_feb_inline_move(w, shift, QT_FEB_IN(QT_FEB_INLINE_BUSY), QT_FEB_INLINE_FULL);
+            return 1;
+
+        case WRITEF:
+        case PURGE:
+            s = qt_feb_inline_move(w, shift,
+                                   QT_FEB_IN(QT_FEB_INLINE_FULL) | QT_FEB_IN(QT_FEB_INLINE_EMPTY),
+                                   QT_FEB_INLINE_BUSY);
+            if (s == QT_FEB_INLINE_HASHED) { return 0; }
+            if (dest != src) { *dest = *src; }
+            qt_feb_inline_move(w, shift, QT_FEB_IN(QT_FEB_INLINE_BUSY),
+                               (op == WRITEF) ? QT_FEB_INLINE_FULL : QT_FEB_INLINE_EMPTY);
+            return 1;
+
+        case FILL:
+            s = qt_feb_inline_move(w, shift, QT_FEB_IN(QT_FEB_INLINE_EMPTY), QT_FEB_INLINE_FULL);
+            return s != QT_FEB_INLINE_HASHED;
+
+        case EMPTY:
+            s = qt_feb_inline_move(w, shift, QT_FEB_IN(QT_FEB_INLINE_FULL), QT_FEB_INLINE_EMPTY);
+            return s != QT_FEB_INLINE_HASHED;
+    }
+    return 0;
+} /*}}}*/
+
+/* Called with the word's stripe locked, before the hash table is consulted:
+ * takes a registered word out of the shadow map and gives it an addrstat, so
+ * that the table has the whole story. A word is HASHED exactly when it has an
+ * addrstat, until qthread_FEB_remove() hands it back. With 'full_too' unset,
+ * full words are left alone (absent from the table means full anyway). */
+static QINLINE void qt_feb_inline_to_hash(const aligned_t *addr,
+                                          qt_hash          bin,
+                                          const int        full_too)
+{   /*{{{*/
+    unsigned int        shift;
+    aligned_t          *w;
+    aligned_t           s;
+    qthread_addrstat_t *m;
+
+    if (feb_nregions == 0) { return; }
+    w = qt_feb_inline_word(addr, &shift);
+    if (w == NULL) { return; }
+    s = qt_feb_inline_move(w, shift,
+                           (full_too ? QT_FEB_IN(QT_FEB_INLINE_FULL) : 0) | QT_FEB_IN(QT_FEB_INLINE_EMPTY),
+                           QT_FEB_INLINE_HASHED);
+    if ((s == QT_FEB_INLINE_HASHED) || ((s == QT_FEB_INLINE_FULL) && !full_too)) { return; }
+    m = qthread_addrstat_new();
+    assert(m);
+    if (s == QT_FEB_INLINE_EMPTY) {
+        m->full = 0;
+        QTHREAD_EMPTY_TIMER_START(m);
+    }
+    qassertnot(qt_hash_put_locked(bin, (void *)addr, m), 0);
+} /*}}}*/
+
+/* Called with the word's stripe locked, once its addrstat is gone (i.e. it is
+ * full with nobody waiting): hands it back to the shadow map. */
+static QINLINE void qt_feb_inline_from_hash(const aligned_t *addr)
+{   /*{{{*/
+    unsigned int shift;
+    aligned_t   *w;
+
+    if (feb_nregions == 0) { return; }
+    w = qt_feb_inline_word(addr, &shift);
+    if (w) {
+        qt_feb_inline_move(w, shift, QT_FEB_IN(QT_FEB_INLINE_HASHED), QT_FEB_INLINE_FULL);
+    }
+} /*}}}*/
+
+/* 1 for full, 0 for empty, -1 if the hash table has to be asked */
+static QINLINE int qt_feb_inline_status(const aligned_t *addr)
+{   /*{{{*/
+    unsigned int shift;
+    aligned_t   *w;
+
+    if (feb_nregions == 0) { return -1; }
+    w = qt_feb_inline_word(addr, &shift);
+    if (w == NULL) { return -1; }
+    switch (qt_feb_inline_move(w, shift, 0, 0)) {
+        case QT_FEB_INLINE_FULL:  return 1;
+        case QT_FEB_INLINE_EMPTY: return 0;
+        default:                  return -1;
+    }
+} /*}}}*/
+
+# define QT_FEB_INLINE(op, dest, src) do {                           \
+        int qt_feb_rc_;                                              \
+        if (qt_feb_inline((op), (aligned_t *)(dest), (src), &qt_feb_rc_)) { \
+            return qt_feb_rc_;                                       \
+        }                                                            \
+} while (0)
+#else /* ifndef LOCK_FREE_FEBS */
+# define QT_FEB_INLINE(op, dest, src) do { } while (0)
+#endif /* ifndef LOCK_FREE_FEBS */
+
+int API_FUNC qthread_feb_region_register(const aligned_t *base,
+                                         size_t           count)
+{   /*{{{*/
+#ifdef LOCK_FREE_FEBS
+    return QTHREAD_NOT_ALLOWED;
+#else
+    aligned_t   *bits;
+    unsigned int slot;
+
+    assert(qthread_library_initialized);
+    if ((base == NULL) || (count == 0) ||
+        ((uintptr_t)base & (sizeof(aligned_t) - 1))) {
+        return QTHREAD_BADARGS;
+    }
+    bits = qt_calloc(1, QT_FEB_INLINE_MAPLEN(count));
+    if (bits == NULL) { return QTHREAD_MALLOC_ERROR; }
+    QTHREAD_FASTLOCK_LOCK(&feb_regions_lock);
+    slot = feb_nregions;
+    for (unsigned int i = 0; i < feb_nregions; i++) {
+        const qt_feb_region_t *r = &feb_regions[i];
+
+        if (r->base == NULL) {
+            if (slot == feb_nregions) { slot = i; }
+        } else if ((base < r->base + r->count) && (r->base < base + count)) {
+            QTHREAD_FASTLOCK_UNLOCK(&feb_regions_lock);
+            FREE(bits, QT_FEB_INLINE_MAPLEN(count));
+            return QTHREAD_BADARGS;
+        }
+    }
+    if (slot == QT_FEB_MAX_REGIONS) {
+        QTHREAD_FASTLOCK_UNLOCK(&feb_regions_lock);
+        FREE(bits, QT_FEB_INLINE_MAPLEN(count));
+        return QTHREAD_OVERFLOW;
+    }
+    /* words the table already knows about (emptied, or waited on) stay there */
+    for (size_t i = 0; i < count; i++) {
+        const aligned_t *word    = base + i;
+        const int        lockbin = QTHREAD_CHOOSE_STRIPE2(word);
+
+        qt_hash_lock(FEBs[lockbin]);
+        if (qt_hash_get_locked(FEBs[lockbin], (void *)word)) {
+            bits[i / QT_FEB_INLINE_PER_WORD] |=
+                QT_FEB_INLINE_HASHED << ((i % QT_FEB_INLINE_PER_WORD) * 2);
+        }
+        qt_hash_unlock(FEBs[lockbin]);
+    }
+    /* readers match on base last, so publish it last */
+    feb_regions[slot].bits  = bits;
+    feb_regions[slot].count = count;
+    MACHINE_FENCE;
+    feb_regions[slot].base = base;
+    if (slot == feb_nregions) {
+        MACHINE_FENCE;
+        feb_nregions = slot + 1;
+    }
+    QTHREAD_FASTLOCK_UNLOCK(&feb_regions_lock);
+    qthread_debug(FEB_BEHAVIOR, "registered %p..%p in slot %u\n", base, base + count, slot);
+    return QTHREAD_SUCCESS;
+#endif /* ifdef LOCK_FREE_FEBS */
+} /*}}}*/
+
+int API_FUNC qthread_feb_region_unregister(const aligned_t *base)
+{   /*{{{*/
+#ifdef LOCK_FREE_FEBS
+    return QTHREAD_NOT_ALLOWED;
+#else
+    qt_feb_region_t *r = NULL;
+
+    assert(qthread_library_initialized);
+    QTHREAD_FASTLOCK_LOCK(&feb_regions_lock);
+    for (unsigned int i = 0; i < feb_nregions; i++) {
+        if ((base != NULL) && (feb_regions[i].base == base)) {
+            r = &feb_regions[i];
+            break;
+        }
+    }
+    if (r == NULL) {
+        QTHREAD_FASTLOCK_UNLOCK(&feb_regions_lock);
+        return QTHREAD_BADARGS;
+    }
+    /* empty words have to carry on being empty in the table */
+    for (size_t i = 0; i < r->count; i++) {
+        const aligned_t *word    = base + i;
+        const int        lockbin = QTHREAD_CHOOSE_STRIPE2(word);
+
+        qt_hash_lock(FEBs[lockbin]);
+        qt_feb_inline_to_hash(word, FEBs[lockbin], 0);
+        qt_hash_unlock(FEBs[lockbin]);
+    }
+    r->base = NULL;
+    MACHINE_FENCE;
+    FREE(r->bits, QT_FEB_INLINE_MAPLEN(r->count));
+    r->bits  = NULL;
+    r->count = 0;
+    while (feb_nregions > 0 && feb_regions[feb_nregions - 1].base == NULL) {
+        feb_nregions--;
+    }
+    QTHREAD_FASTLOCK_UNLOCK(&feb_regions_lock);
+    qthread_debug(FEB_BEHAVIOR, "unregistered %p\n", base);
+    return QTHREAD_SUCCESS;
+#endif /* ifdef LOCK_FREE_FEBS */
+} /*}}}*/
+
 /* This is just a little function that should help in debugging */
 int API_FUNC qthread_feb_status(const aligned_t *addr)
 {                      /*{{{ */
@@ -271,6 +652,14 @@ int API_FUNC qthread_feb_status(const aligned_t *addr)
 
     QALIGN(addr, alignedaddr);
     QTHREAD_COUNT_THREADS_BINCOUNTER(febs, lockbin);
+#ifndef LOCK_FREE_FEBS
+    status = qt_feb_inline_status(alignedaddr);
+    if (status >= 0) {
+        qthread_debug(FEB_BEHAVIOR, "addr %p is %i (inline)\n", addr, status);
+        return status;
+    }
+    status = 1;
+#endif
 #ifdef LOCK_FREE_FEBS
     do {
         m = qt_hash_get(FEBs[lockbin], (void *)alignedaddr);
@@ -357,6 +746,7 @@ got_m:
                 (m->full == 1)) {
                 qthread_debug(FEB_DETAILS, "maddr=%p: lists are empty, status is full; invalidating and removing\n", maddr);
                 qassertnot(qt_hash_remove_locked(FEBs[lockbin], maddr), 0);
+                qt_feb_inline_from_hash(maddr);
             } else {
                 QTHREAD_FASTLOCK_UNLOCK(&(m->lock));
                 qthread_debug(FEB_DETAILS, "maddr=%p: addrstat cannot be removed; in use\n", maddr);
@@ -405,7 +795,8 @@ static QINLINE void qthread_gotlock_empty_inner(qthread_shepherd_t *shep,
                                                 qthread_addrstat_t *m,
                                                 void               *maddr,
                                                 const uint_fast8_t  recursive,
-                                                qthread_addrres_t **precond_tasks)
+                                                qthread_addrres_t **precond_tasks,
+                                                qt_feb_wakeup_t    *wake)
 {                      /*{{{ */
     qthread_addrres_t *X = NULL;
     int                removeable;
@@ -426,9 +817,9 @@ static QINLINE void qthread_gotlock_empty_inner(qthread_shepherd_t *shep,
         }
         /* requeue */
         qthread_debug(FEB_DETAILS, "m(%p), maddr(%p), recursive(%u): dQ 1 EFQ (%u releasing tid %u with %u), will fill\n", m, maddr, recursive, qthread_id(), X->waiter->thread_id, *(X->addr));
-        qt_feb_schedule(X->waiter, shep);
+        qt_feb_schedule(X->waiter, shep, 0, wake);
         FREE_ADDRRES(X);
-        qthread_gotlock_fill_inner(shep, m, maddr, 1, precond_tasks);
+        qthread_gotlock_fill_inner(shep, m, maddr, 1, precond_tasks, wake);
     }
     if ((m->full == 1) && (m->EFQ == NULL) && (m->FEQ == NULL) && (m->FFQ == NULL) && (m->FFWQ == NULL)) {
         removeable = 1;
@@ -452,14 +843,15 @@ static QINLINE void qthread_gotlock_empty(qthread_shepherd_t *shep,
 {
     qthread_addrres_t *tmp = NULL;
 
-    qthread_gotlock_empty_inner(shep, m, maddr, 0, &tmp);
+    qthread_gotlock_empty_inner(shep, m, maddr, 0, &tmp, NULL);
 }
 
 static QINLINE void qthread_gotlock_fill_inner(qthread_shepherd_t *shep,
                                                qthread_addrstat_t *m,
                                                void               *maddr,
                                                const uint_fast8_t  recursive,
-                                               qthread_addrres_t **precond_tasks)
+                                               qthread_addrres_t **precond_tasks,
+                                               qt_feb_wakeup_t    *wake)
 {                      /*{{{ */
     qthread_addrres_t *X = NULL;
 
@@ -467,6 +859,11 @@ static QINLINE void qthread_gotlock_fill_inner(qthread_shepherd_t *shep,
     assert(m);
     assert(precond_tasks);
     assert(maddr);
+    /* a fill that releases exactly one reader may hand it straight to this
+     * worker (QT_WAKE_HANDOFF) */
+    const int lone = !recursive && qlib->wake_handoff &&
+                     (((m->FFWQ != NULL) + (m->FFQ != NULL) + (m->FEQ != NULL)) == 1) &&
+                     ((m->FEQ != NULL) || ((m->FFWQ ? m->FFWQ : m->FFQ)->next == NULL));
     m->full = 1;
     QTHREAD_EMPTY_TIMER_STOP(m);
     /* dequeue all FFWQ, do their operation, and schedule them */
@@ -505,7 +902,7 @@ static QINLINE void qthread_gotlock_fill_inner(qthread_shepherd_t *shep,
             ((qthread_addrres_t *)((*precond_tasks)->waiter))->next = X;
             (*precond_tasks)->waiter                                = (void *)X;
         } else {
-            qt_feb_schedule(waiter, shep);
+            qt_feb_schedule(waiter, shep, lone, wake);
             FREE_ADDRRES(X);
         }
     }
@@ -531,7 +928,7 @@ static QINLINE void qthread_gotlock_fill_inner(qthread_shepherd_t *shep,
             ((qthread_addrres_t *)((*precond_tasks)->waiter))->next = X;
             (*precond_tasks)->waiter                                = (void *)X;
         } else {
-            qt_feb_schedule(waiter, shep);
+            qt_feb_schedule(waiter, shep, lone, wake);
             FREE_ADDRRES(X);
         }
     }
@@ -545,9 +942,9 @@ static QINLINE void qthread_gotlock_fill_inner(qthread_shepherd_t *shep,
             MACHINE_FENCE;
         }
         qthread_debug(FEB_DETAILS, "m(%p), maddr(%p), recursive(%u): dQ 1 EFQ (%u releasing tid %u with %u), will empty\n", m, maddr, recursive, qthread_id(), X->waiter->thread_id, *(aligned_t *)maddr);
-        qt_feb_schedule(X->waiter, shep);
+        qt_feb_schedule(X->waiter, shep, lone, wake);
         FREE_ADDRRES(X);
-        qthread_gotlock_empty_inner(shep, m, maddr, 1, precond_tasks);
+        qthread_gotlock_empty_inner(shep, m, maddr, 1, precond_tasks, wake);
     }
     if (recursive == 0) {
         int removeable;
@@ -575,7 +972,7 @@ static QINLINE void qthread_gotlock_fill(qthread_shepherd_t *shep,
 {
     qthread_addrres_t *tmp = NULL;
 
-    qthread_gotlock_fill_inner(shep, m, maddr, 0, &tmp);
+    qthread_gotlock_fill_inner(shep, m, maddr, 0, &tmp, NULL);
 }
 
 int API_FUNC qthread_empty(const aligned_t *dest)
@@ -588,6 +985,7 @@ int API_FUNC qthread_empty(const aligned_t *dest)
 
     assert(qthread_library_initialized);
 
+    QT_FEB_INLINE(EMPTY, NULL, dest);
     if (!shep) {
         return qthread_feb_blocker_func((void *)dest, NULL, EMPTY);
     }
@@ -634,6 +1032,7 @@ int API_FUNC qthread_empty(const aligned_t *dest)
     } while (1);
 #else  /* ifdef LOCK_FREE_FEBS */
     qt_hash_lock(FEBbin);
+    qt_feb_inline_to_hash(alignedaddr, FEBbin, 1);
     {                      /* BEGIN CRITICAL SECTION */
         m = (qthread_addrstat_t *)qt_hash_get_locked(FEBbin, (void *)alignedaddr);
         if (!m) {
@@ -678,6 +1077,7 @@ int API_FUNC qthread_fill(const aligned_t *dest)
 
     assert(qthread_library_initialized);
 
+    QT_FEB_INLINE(FILL, NULL, dest);
     if (!shep) {
         return qthread_feb_blocker_func((void *)dest, NULL, FILL);
     }
@@ -704,6 +1104,7 @@ int API_FUNC qthread_fill(const aligned_t *dest)
     } while (1);
 #else  /* ifdef LOCK_FREE_FEBS */
     qt_hash_lock(FEBs[lockbin]);
+    qt_feb_inline_to_hash(alignedaddr, FEBs[lockbin], 1);
     {                      /* BEGIN CRITICAL SECTION */
         m = (qthread_addrstat_t *)qt_hash_get_locked(FEBs[lockbin], (void *)alignedaddr);
         if (m) {
@@ -739,6 +1140,7 @@ int API_FUNC qthread_writeF(aligned_t *restrict       dest,
 
     assert(qthread_library_initialized);
 
+    QT_FEB_INLINE(WRITEF, dest, src);
     if (!shep) {
         return qthread_feb_blocker_func(dest, (void *)src, WRITEF);
     }
@@ -767,6 +1169,7 @@ got_m:
     } while (1);
 #else  /* ifdef LOCK_FREE_FEBS */
     qt_hash_lock(FEBs[lockbin]); {    /* lock hash */
+        qt_feb_inline_to_hash(alignedaddr, FEBs[lockbin], 1);
         m = (qthread_addrstat_t *)qt_hash_get_locked(FEBs[lockbin], (void *)alignedaddr);
         if (m) {
             QTHREAD_FASTLOCK_LOCK(&m->lock);
@@ -807,6 +1210,7 @@ int API_FUNC qthread_purge_to(aligned_t *restrict       dest,
 
     assert(qthread_library_initialized);
 
+    QT_FEB_INLINE(PURGE, dest, src);
     if (!shep) {
         return qthread_feb_blocker_func(dest, (void *)src, PURGE);
     }
@@ -854,6 +1258,7 @@ int API_FUNC qthread_purge_to(aligned_t *restrict       dest,
     } while (1);
 #else  /* ifdef LOCK_FREE_FEBS */
     qt_hash_lock(FEBbin);
+    qt_feb_inline_to_hash(alignedaddr, FEBbin, 1);
     {                      /* BEGIN CRITICAL SECTION */
         m = (qthread_addrstat_t *)qt_hash_get_locked(FEBbin, (void *)alignedaddr);
         if (!m) {
@@ -921,6 +1326,7 @@ int API_FUNC qthread_writeEF(aligned_t *restrict       dest,
 
     assert(qthread_library_initialized);
 
+    QT_FEB_INLINE(WRITEEF, dest, src);
     if (!me) {
         return qthread_feb_blocker_func(dest, (void *)src, WRITEEF);
     }
@@ -973,6 +1379,7 @@ got_m:
     } while(1);
 #else  /* ifdef LOCK_FREE_FEBS */
     qt_hash_lock(FEBs[lockbin]);
+    qt_feb_inline_to_hash(alignedaddr, FEBs[lockbin], 1);
     {
         m = (qthread_addrstat_t *)qt_hash_get_locked(FEBs[lockbin], (void *)alignedaddr);
         if (!m) {
@@ -1040,6 +1447,7 @@ int API_FUNC qthread_writeEF_nb(aligned_t *restrict       dest,
     const int           lockbin = QTHREAD_CHOOSE_STRIPE2(dest);
     qthread_t          *me      = qthread_internal_self();
 
+    QT_FEB_INLINE(WRITEEF_NB, dest, src);
     if (!me) {
         return qthread_feb_blocker_func(dest, (void *)src, WRITEEF);
     }
@@ -1065,6 +1473,7 @@ int API_FUNC qthread_writeEF_nb(aligned_t *restrict       dest,
     } while (1);
 # else /* ifdef LOCK_FREE_FEBS */
     qt_hash_lock(FEBs[lockbin]);
+    qt_feb_inline_to_hash(alignedaddr, FEBs[lockbin], 1);
     {
         m = (qthread_addrstat_t *)qt_hash_get_locked(FEBs[lockbin], (void *)alignedaddr);
         if (m) {
@@ -1116,6 +1525,7 @@ int API_FUNC qthread_writeFF(aligned_t *restrict       dest,
 
     assert(qthread_library_initialized);
 
+    QT_FEB_INLINE(WRITEFF, dest, src);
     if (!me) {
         return qthread_feb_blocker_func(dest, (void *)src, WRITEFF);
     }
@@ -1140,6 +1550,7 @@ int API_FUNC qthread_writeFF(aligned_t *restrict       dest,
     } while(1);
 # else /* ifdef LOCK_FREE_FEBS */
     qt_hash_lock(FEBs[lockbin]);
+    qt_feb_inline_to_hash(alignedaddr, FEBs[lockbin], 1);
     {
         m = (qthread_addrstat_t *)qt_hash_get_locked(FEBs[lockbin], (void *)alignedaddr);
         if (m) {
@@ -1210,11 +1621,13 @@ int API_FUNC qthread_readFF(aligned_t *restrict       dest,
     qthread_addrres_t  *X       = NULL;
     const int           lockbin = QTHREAD_CHOOSE_STRIPE2(src);
     qthread_t          *me      = qthread_internal_self();
+    qt_spinwait_t       spin    = QT_SPINWAIT_INITIALIZER;
 
     QTHREAD_FEB_TIMER_DECLARATION(febblock);
 
     assert(qthread_library_initialized);
 
+    QT_FEB_INLINE(READFF, dest, src);
     if (!me) {
         return qthread_feb_blocker_func(dest, (void *)src, READFF);
     }
@@ -1222,6 +1635,7 @@ int API_FUNC qthread_readFF(aligned_t *restrict       dest,
     QTHREAD_FEB_UNIQUERECORD(feb, src, me);
     QTHREAD_FEB_TIMER_START(febblock);
     QALIGN(src, alignedaddr);
+spin_again:
     QTHREAD_COUNT_THREADS_BINCOUNTER(febs, lockbin);
 # ifdef LOCK_FREE_FEBS
     do {
@@ -1239,6 +1653,7 @@ int API_FUNC qthread_readFF(aligned_t *restrict       dest,
     } while(1);
 # else /* ifdef LOCK_FREE_FEBS */
     qt_hash_lock(FEBs[lockbin]);
+    qt_feb_inline_to_hash(alignedaddr, FEBs[lockbin], 0);
     {
         m = (qthread_addrstat_t *)qt_hash_get_locked(FEBs[lockbin], (void *)alignedaddr);
         if (m) {
@@ -1248,6 +1663,11 @@ int API_FUNC qthread_readFF(aligned_t *restrict       dest,
     qt_hash_unlock(FEBs[lockbin]);
 # endif /* ifdef LOCK_FREE_FEBS */
     qthread_debug(FEB_DETAILS, "dest=%p, src=%p (tid=%u): data structure locked or null (m=%p)\n", dest, src, me->thread_id, m);
+    if (m && (m->full != 1) && QT_SPINWAIT_AGAIN(spin, alignedaddr)) {
+        /* the writer may be close; look again before going to sleep */
+        QTHREAD_FASTLOCK_UNLOCK(&m->lock);
+        goto spin_again;
+    }
     /* now m, if it exists, is locked - if m is NULL, then we're done! */
     if (m == NULL) {               /* already full! */
         if (dest && (dest != src)) {
@@ -1255,6 +1675,7 @@ int API_FUNC qthread_readFF(aligned_t *restrict       dest,
             MACHINE_FENCE;
         }
         qthread_debug(FEB_BEHAVIOR, "dest=%p, src=%p (tid=%u): non-blocking success!\n", dest, src, me->thread_id);
+        QT_SPINWAIT_DONE(spin, alignedaddr, 0);
     } else if (m->full != 1) {         /* not full... so we must block */
         QTHREAD_WAIT_TIMER_DECLARATION;
         X = ALLOC_ADDRRES();
@@ -1272,6 +1693,7 @@ int API_FUNC qthread_readFF(aligned_t *restrict       dest,
         QTHREAD_WAIT_TIMER_START();
         qthread_back_to_master(me);
         QTHREAD_WAIT_TIMER_STOP(me, febwait);
+        QT_SPINWAIT_DONE(spin, alignedaddr, 1);
 #ifdef QTHREAD_USE_EUREKAS
         qt_eureka_check(0);
 #endif /* QTHREAD_USE_EUREKAS */
@@ -1283,6 +1705,7 @@ int API_FUNC qthread_readFF(aligned_t *restrict       dest,
         }
         qthread_debug(FEB_BEHAVIOR, "dest=%p, src=%p (tid=%u): succeeded!\n", dest, src, me->thread_id);
         QTHREAD_FASTLOCK_UNLOCK(&m->lock);
+        QT_SPINWAIT_DONE(spin, alignedaddr, 0);
     }
     QTHREAD_FEB_TIMER_STOP(febblock, me);
     return QTHREAD_SUCCESS;
@@ -1298,6 +1721,7 @@ int API_FUNC qthread_readFF_nb(aligned_t *restrict       dest,
     const int           lockbin = QTHREAD_CHOOSE_STRIPE2(src);
     qthread_t          *me      = qthread_internal_self();
 
+    QT_FEB_INLINE(READFF_NB, dest, src);
     if (!me) {
         return qthread_feb_blocker_func(dest, (void *)src, READFF_NB);
     }
@@ -1326,6 +1750,7 @@ got_m:
     } while(1);
 # else /* ifdef LOCK_FREE_FEBS */
     qt_hash_lock(FEBs[lockbin]);
+    qt_feb_inline_to_hash(alignedaddr, FEBs[lockbin], 0);
     {
         m = (qthread_addrstat_t *)qt_hash_get_locked(FEBs[lockbin], (void *)alignedaddr);
         if (m) {
@@ -1371,11 +1796,13 @@ int API_FUNC qthread_readFE(aligned_t *restrict       dest,
     qthread_addrstat_t *m;
     const int           lockbin = QTHREAD_CHOOSE_STRIPE2(src);
     qthread_t          *me      = qthread_internal_self();
+    qt_spinwait_t       spin    = QT_SPINWAIT_INITIALIZER;
 
     QTHREAD_FEB_TIMER_DECLARATION(febblock);
 
     assert(qthread_library_initialized);
 
+    QT_FEB_INLINE(READFE, dest, src);
     if (!me) {
         return qthread_feb_blocker_func(dest, (void *)src, READFE);
     }
@@ -1384,6 +1811,7 @@ int API_FUNC qthread_readFE(aligned_t *restrict       dest,
     QTHREAD_FEB_UNIQUERECORD(feb, src, me);
     QTHREAD_FEB_TIMER_START(febblock);
     QALIGN(src, alignedaddr);
+spin_again:
     QTHREAD_COUNT_THREADS_BINCOUNTER(febs, lockbin);
 # ifdef LOCK_FREE_FEBS
     do {
@@ -1419,6 +1847,7 @@ got_m:
     } while (1);
 # else /* ifdef LOCK_FREE_FEBS */
     qt_hash_lock(FEBs[lockbin]);
+    qt_feb_inline_to_hash(alignedaddr, FEBs[lockbin], 1);
     {
         m = (qthread_addrstat_t *)qt_hash_get_locked(FEBs[lockbin], alignedaddr);
         if (!m) {
@@ -1436,6 +1865,11 @@ got_m:
     assert(m);
     qthread_debug(FEB_DETAILS, "data structure locked\n");
     /* by this point m is locked */
+    if ((m->full == 0) && QT_SPINWAIT_AGAIN(spin, alignedaddr)) {
+        /* the writer may be close; look again before going to sleep */
+        QTHREAD_FASTLOCK_UNLOCK(&m->lock);
+        goto spin_again;
+    }
     if (m->full == 0) {            /* empty, thus, we must block */
         QTHREAD_WAIT_TIMER_DECLARATION;
         qthread_addrres_t *X = ALLOC_ADDRRES();
@@ -1456,6 +1890,7 @@ got_m:
         QTHREAD_WAIT_TIMER_START();
         qthread_back_to_master(me);
         QTHREAD_WAIT_TIMER_STOP(me, febwait);
+        QT_SPINWAIT_DONE(spin, alignedaddr, 1);
 #ifdef QTHREAD_USE_EUREKAS
         qt_eureka_check(0);
 #endif /* QTHREAD_USE_EUREKAS */
@@ -1467,6 +1902,7 @@ got_m:
         }
         qthread_debug(FEB_BEHAVIOR, "tid %u succeeded on %p=%p\n", me->thread_id, dest, src);
         qthread_gotlock_empty(me->rdata->shepherd_ptr, m, (void *)alignedaddr);
+        QT_SPINWAIT_DONE(spin, alignedaddr, 0);
     }
     QTHREAD_FEB_TIMER_STOP(febblock, me);
     return QTHREAD_SUCCESS;
@@ -1499,6 +1935,7 @@ int API_FUNC qthread_readFE_nb(aligned_t *restrict       dest,
     const int           lockbin = QTHREAD_CHOOSE_STRIPE2(src);
     qthread_t          *me      = qthread_internal_self();
 
+    QT_FEB_INLINE(READFE_NB, dest, src);
     if (!me) {
         return qthread_feb_blocker_func(dest, (void *)src, READFE_NB);
     }
@@ -1535,6 +1972,7 @@ int API_FUNC qthread_readFE_nb(aligned_t *restrict       dest,
     } while (1);
 # else /* ifdef LOCK_FREE_FEBS */
     qt_hash_lock(FEBs[lockbin]);
+    qt_feb_inline_to_hash(alignedaddr, FEBs[lockbin], 1);
     {
         m = (qthread_addrstat_t *)qt_hash_get_locked(FEBs[lockbin], alignedaddr);
         if (!m) {
@@ -1566,6 +2004,195 @@ int API_FUNC qthread_readFE_nb(aligned_t *restrict       dest,
     return QTHREAD_SUCCESS;
 }                      /*}}} */
 
+/* The *_many() functions visit their words grouped by hash stripe, so that
+ * each stripe is locked once per call rather than once per word, and put all
+ * the waiters they release on the ready queue in one go. There are at most
+ * 128 stripes, so the words are grouped with a counting sort, which also
+ * keeps each stripe's words in the order they were given. */
+#ifndef LOCK_FREE_FEBS
+typedef struct {
+    int    bin;
+    size_t idx;
+} qt_feb_many_entry_t;
+
+# define QT_FEB_MANY_STACK   128
+# define QT_FEB_MANY_STRIPES 128
+#endif /* ifndef LOCK_FREE_FEBS */
+
+/* op is WRITEF (vals[i] goes into *addrs[i]), FILL, EMPTY, or READFF
+ * (*addrs[i] goes into vals[i], if vals is not NULL) */
+static int qt_feb_many(const blocker_type op,
+                       aligned_t *const  *addrs,
+                       aligned_t         *vals,
+                       const size_t       n)
+{   /*{{{*/
+    size_t i;
+
+    assert(qthread_library_initialized);
+    if (n == 0) { return QTHREAD_SUCCESS; }
+    if ((addrs == NULL) || ((op == WRITEF) && (vals == NULL))) { return QTHREAD_BADARGS; }
+#ifndef LOCK_FREE_FEBS
+    qthread_shepherd_t *shep = qthread_internal_getshep();
+
+    if (shep != NULL) {
+        qt_feb_many_entry_t  stackbuf[2 * QT_FEB_MANY_STACK];
+        qt_feb_many_entry_t *found = stackbuf, *order = stackbuf + QT_FEB_MANY_STACK;
+        size_t               start[QT_FEB_MANY_STRIPES + 1] = { 0 };
+        qthread_addrres_t   *precond_tasks = NULL;
+        qt_feb_wakeup_t      wake;
+        size_t               nslow = 0, nblocked = 0, k, waitfor;
+
+        assert(QTHREAD_LOCKING_STRIPES <= QT_FEB_MANY_STRIPES);
+        if (n > QT_FEB_MANY_STACK) {
+            found = MALLOC(2 * n * sizeof(qt_feb_many_entry_t));
+            if (found == NULL) { return QTHREAD_MALLOC_ERROR; }
+            order = found + n;
+        }
+        /* words that don't need the table */
+        for (i = 0; i < n; i++) {
+            aligned_t *dest = (op == READFF) ? (vals ? &vals[i] : NULL) : addrs[i];
+            aligned_t *src  = (op == WRITEF) ? &vals[i] : addrs[i];
+            int        rc, bin;
+
+            if (qt_feb_inline(op, dest, src, &rc)) { continue; }
+            bin                = QTHREAD_CHOOSE_STRIPE2(addrs[i]);
+            found[nslow].bin   = bin;
+            found[nslow++].idx = i;
+            start[bin + 1]++;
+        }
+        for (k = 1; k <= QTHREAD_LOCKING_STRIPES; k++) {
+            start[k] += start[k - 1];
+        }
+        for (k = 0; k < nslow; k++) {
+            order[start[found[k].bin]++] = found[k];
+        }
+        wake.shep = shep;
+        wake.n    = 0;
+        for (k = 0; k < nslow;) {
+            const int     bin = order[k].bin;
+            const qt_hash h   = FEBs[bin];
+
+            QTHREAD_COUNT_THREADS_BINCOUNTER(febs, bin);
+            qt_hash_lock(h);
+            waitfor = nslow;
+            for (; k < nslow && order[k].bin == bin; k++) {
+                aligned_t          *alignedaddr;
+                qthread_addrstat_t *m;
+
+                i = order[k].idx;
+                QALIGN(addrs[i], alignedaddr);
+                qt_feb_inline_to_hash(alignedaddr, h, op != READFF);
+                m = (qthread_addrstat_t *)qt_hash_get_locked(h, (void *)alignedaddr);
+                if (m) { QTHREAD_FASTLOCK_LOCK(&m->lock); }
+                if (op == READFF) {
+                    if (m && (m->full != 1)) {
+                        /* has to wait; the rest of the words are picked up
+                         * after it has been filled */
+                        QTHREAD_FASTLOCK_UNLOCK(&m->lock);
+                        waitfor = k;
+                        break;
+                    }
+                    if (vals && (&vals[i] != alignedaddr)) {
+                        vals[i] = *alignedaddr;
+                    }
+                    if (m) { QTHREAD_FASTLOCK_UNLOCK(&m->lock); }
+                    continue;
+                }
+                if (op == EMPTY) {
+                    if (m) {
+                        qthread_gotlock_empty_inner(shep, m, alignedaddr, 1, &precond_tasks, &wake);
+                        QTHREAD_FASTLOCK_UNLOCK(&m->lock);
+                        continue;
+                    }
+                    /* currently full, and must be added to the hash to empty */
+                    m = qthread_addrstat_new();
+                    assert(m);
+                    m->full = 0;
+                    QTHREAD_EMPTY_TIMER_START(m);
+                    qassertnot(qt_hash_put_locked(h, (void *)alignedaddr, m), 0);
+                    continue;
+                }
+                if (op == WRITEF) { *alignedaddr = vals[i]; }
+                if (m) {
+                    /* the stripe is ours, so m can go straight away if it
+                     * ends up unused (qthread_FEB_remove() would relock it) */
+                    qthread_gotlock_fill_inner(shep, m, alignedaddr, 1, &precond_tasks, &wake);
+                    if ((m->full == 1) && (m->EFQ == NULL) && (m->FEQ == NULL) &&
+                        (m->FFQ == NULL) && (m->FFWQ == NULL)) {
+                        qassertnot(qt_hash_remove_locked(h, (void *)alignedaddr), 0);
+                        qt_feb_inline_from_hash(alignedaddr);
+                        QTHREAD_FASTLOCK_UNLOCK(&m->lock);
+                        qthread_addrstat_delete(m);
+                    } else {
+                        QTHREAD_FASTLOCK_UNLOCK(&m->lock);
+                    }
+                }
+            }
+            qt_hash_unlock(h);
+            if (waitfor < nslow) {
+                i = order[waitfor].idx;
+                qthread_readFF(vals ? &vals[i] : NULL, addrs[i]);
+                nblocked++;
+                k = waitfor + 1;
+            }
+        }
+        qt_feb_wakeup_flush(&wake);
+        if (precond_tasks) {
+            qthread_precond_launch(shep, precond_tasks);
+        }
+        if (found != stackbuf) {
+            FREE(found, 2 * n * sizeof(qt_feb_many_entry_t));
+        }
+        qthread_debug(FEB_BEHAVIOR, "%lu words, %lu blocked\n",
+                      (unsigned long)n, (unsigned long)nblocked);
+        return QTHREAD_SUCCESS;
+    }
+#endif /* ifndef LOCK_FREE_FEBS */
+    /* no shepherd to batch the wakeups on (or nothing to gain from it) */
+    for (i = 0; i < n; i++) {
+        int rc;
+
+        switch (op) {
+            case WRITEF: rc = qthread_writeF(addrs[i], &vals[i]); break;
+            case FILL:   rc = qthread_fill(addrs[i]); break;
+            case EMPTY:  rc = qthread_empty(addrs[i]); break;
+            default:     rc = qthread_readFF(vals ? &vals[i] : NULL, addrs[i]); break;
+        }
+        if (rc != QTHREAD_SUCCESS) { return rc; }
+    }
+    return QTHREAD_SUCCESS;
+} /*}}}*/
+
+int API_FUNC qthread_writeF_many(aligned_t *const *dests,
+                                 const aligned_t  *srcs,
+                                 size_t            n)
+{   /*{{{*/
+    qthread_debug(FEB_CALLS, "dests=%p, srcs=%p, n=%lu\n", dests, srcs, (unsigned long)n);
+    return qt_feb_many(WRITEF, dests, (aligned_t *)srcs, n);
+} /*}}}*/
+
+int API_FUNC qthread_fill_many(aligned_t *const *addrs,
+                               size_t            n)
+{   /*{{{*/
+    qthread_debug(FEB_CALLS, "addrs=%p, n=%lu\n", addrs, (unsigned long)n);
+    return qt_feb_many(FILL, addrs, NULL, n);
+} /*}}}*/
+
+int API_FUNC qthread_empty_many(aligned_t *const *addrs,
+                                size_t            n)
+{   /*{{{*/
+    qthread_debug(FEB_CALLS, "addrs=%p, n=%lu\n", addrs, (unsigned long)n);
+    return qt_feb_many(EMPTY, addrs, NULL, n);
+} /*}}}*/
+
+int API_FUNC qthread_readFF_many(aligned_t        *dests,
+                                 aligned_t *const *srcs,
+                                 size_t            n)
+{   /*{{{*/
+    qthread_debug(FEB_CALLS, "dests=%p, srcs=%p, n=%lu\n", dests, srcs, (unsigned long)n);
+    return qt_feb_many(READFF, srcs, dests, n);
+} /*}}}*/
+
 #ifdef QTHREAD_COUNT_THREADS
 extern aligned_t             threadcount;
 extern aligned_t             maxconcurrentthreads;
@@ -1608,6 +2235,12 @@ int INTERNAL qthread_check_feb_preconds(qthread_t *t)
         QTHREAD_FEB_TIMER_START(febblock);
         QALIGN(this_sync, alignedaddr);
         QTHREAD_COUNT_THREADS_BINCOUNTER(febs, lockbin);
+#ifndef LOCK_FREE_FEBS
+        if (qt_feb_inline_status(alignedaddr) == 1) { /* already full! */
+            these_preconds[0] = (aligned_t *)(((uintptr_t)these_preconds[0]) - 1);
+            continue;
+        }
+#endif
 #ifdef LOCK_FREE_FEBS
         do {
             m = qt_hash_get(FEBs[lockbin], (void *)alignedaddr);
@@ -1624,6 +2257,7 @@ int INTERNAL qthread_check_feb_preconds(qthread_t *t)
         } while(1);
 #else   /* ifdef LOCK_FREE_FEBS */
         qt_hash_lock(FEBs[lockbin]);
+        qt_feb_inline_to_hash(alignedaddr, FEBs[lockbin], 0);
         {
             m = (qthread_addrstat_t *)qt_hash_get_locked(FEBs[lockbin], (void *)alignedaddr);
             if (m) {
@@ -1695,17 +2329,9 @@ static filter_code qt_feb_tf_call_cb(const qt_key_t            addr,
     void             *tls;
 
     if (waiter->rdata->tasklocal_size <= qlib->qthread_tasklocal_size) {
-        if (waiter->flags & QTHREAD_BIG_STRUCT) {
-            tls = &waiter->data[qlib->qthread_argcopy_size];
-        } else {
-            tls = waiter->data;
-        }
+        tls = &waiter->data[QTHREAD_TASKLOCAL_OFFSET(waiter)];
     } else {
-        if (waiter->flags & QTHREAD_BIG_STRUCT) {
-            tls = *(void **)&waiter->data[qlib->qthread_argcopy_size];
-        } else {
-            tls = *(void **)&waiter->data[0];
-        }
+        tls = *(void **)&waiter->data[QTHREAD_TASKLOCAL_OFFSET(waiter)];
     }
     f((void *)addr, waiter->f, waiter->arg, waiter->ret, waiter->thread_id, tls, f_arg);
     return IGNORE_AND_CONTINUE;
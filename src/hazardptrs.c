@@ -43,7 +43,10 @@ static void hazardptr_internal_teardown(void)
 
 void INTERNAL initialize_hazardptrs(void)
 {/*{{{*/
-    freelist_max = qthread_num_shepherds() * qlib->nworkerspershep + 7;
+    /* A scan can only keep what is currently hazardous, so the list has to be
+     * comfortably longer than the number of hazard slots or a scan could
+     * find every entry pinned. */
+    freelist_max = 2 * (qthread_num_shepherds() * qlib->nworkerspershep + 4) * HAZARD_PTRS_PER_SHEP;
     for (qthread_shepherd_id_t i = 0; i < qthread_num_shepherds(); ++i) {
         for (qthread_worker_id_t j = 0; j < qlib->nworkerspershep; ++j) {
             memset(qlib->shepherds[i].workers[j].hazard_ptrs, 0, sizeof(uintptr_t) * HAZARD_PTRS_PER_SHEP);
@@ -92,33 +95,38 @@ void INTERNAL hazardous_ptr(unsigned int which,
 static int void_cmp(const void *a,
                     const void *b)
 {/*{{{*/
-    return (*(intptr_t *)a) - (*(intptr_t *)b);
+    const uintptr_t x = *(const uintptr_t *)a;
+    const uintptr_t y = *(const uintptr_t *)b;
+
+    return (x < y) ? -1 : (x > y);
 }/*}}}*/
 
 static int binary_search(uintptr_t *list,
                          uintptr_t  findme,
                          size_t     len)
 {/*{{{*/
-    size_t max  = len;
-    size_t min  = 0;
-    size_t curs = max / 2;
+    size_t max = len;
+    size_t min = 0;
+
+    while (min < max) {
+        const size_t curs = min + (max - min) / 2;
 
-    while (list[curs] != findme) {
-        if (list[curs] > findme) {
+        if (list[curs] == findme) {
+            return 1;
+        } else if (list[curs] > findme) {
             max = curs;
-        } else if (list[curs] < findme) {
-            min = curs;
+        } else {
+            min = curs + 1;
         }
-        if (max == min + 1) { break; }
-        curs = (max + min) / 2;
     }
-    return (list[curs] == findme);
+    return 0;
 }/*}}}*/
 
 static void hazardous_scan(hazard_freelist_t *hfl)
 {/*{{{*/
-    const size_t num_hps = qthread_num_workers() * HAZARD_PTRS_PER_SHEP;
-    void            **plist = MALLOC(sizeof(void *) * (num_hps + hzptr_list_len));
+    const size_t      num_hps = qthread_num_workers() * HAZARD_PTRS_PER_SHEP;
+    const size_t      max_hps = num_hps + hzptr_list_len * HAZARD_PTRS_PER_SHEP;
+    void            **plist   = MALLOC(sizeof(void *) * max_hps);
     hazard_freelist_t tmpfreelist;
 
     assert(plist);
@@ -126,40 +134,40 @@ static void hazardous_scan(hazard_freelist_t *hfl)
                                      sizeof(hazard_freelist_entry_t));
     assert(tmpfreelist.freelist);
     do {
-        /* Stage 1: Collect hazardpointers */
+        size_t len = 0;
+
+        /* Stage 1: Collect hazardpointers. Our own count too: the caller may
+         * be in the middle of a traversal that protects some of them. */
         {
-            qthread_shepherd_id_t i;
-            for (i = 0; i < qthread_num_shepherds(); ++i) {
+            for (qthread_shepherd_id_t i = 0; i < qthread_num_shepherds(); ++i) {
                 for (qthread_worker_id_t j = 0; j < qlib->nworkerspershep; ++j) {
-                    if (&(qlib->shepherds[i].workers[j].hazard_free_list) != hfl) {
-                        memcpy(plist + (i * qlib->nworkerspershep * HAZARD_PTRS_PER_SHEP) + (j * HAZARD_PTRS_PER_SHEP),
-                               qlib->shepherds[i].workers[j].hazard_ptrs,
-                               sizeof(void *) * HAZARD_PTRS_PER_SHEP);
-                    } else {
-                        memset(plist + (i * qlib->nworkerspershep * HAZARD_PTRS_PER_SHEP) + (j * HAZARD_PTRS_PER_SHEP),
-                               0,
-                               sizeof(void *) * HAZARD_PTRS_PER_SHEP);
-                    }
+                    memcpy(plist + len,
+                           qlib->shepherds[i].workers[j].hazard_ptrs,
+                           sizeof(void *) * HAZARD_PTRS_PER_SHEP);
+                    len += HAZARD_PTRS_PER_SHEP;
                 }
             }
             uintptr_t *hzptr_tmp = QTHREAD_CASLOCK_READ(hzptr_list);
-            while (hzptr_tmp != NULL) {
-                memcpy(plist + (i * qlib->nworkerspershep * HAZARD_PTRS_PER_SHEP),
+            /* non-worker threads that registered after we sized plist cannot
+             * be holding anything we retired before they registered */
+            while (hzptr_tmp != NULL && len + HAZARD_PTRS_PER_SHEP <= max_hps) {
+                memcpy(plist + len,
                        hzptr_tmp,
                        sizeof(uintptr_t) * HAZARD_PTRS_PER_SHEP);
+                len      += HAZARD_PTRS_PER_SHEP;
                 hzptr_tmp = (uintptr_t *)hzptr_tmp[HAZARD_PTRS_PER_SHEP];
             }
         }
 
         /* Stage 2: free pointers that are not in the set of hazardous pointers */
         tmpfreelist.count = 0;
-        qsort(plist, num_hps, sizeof(void *), void_cmp);
+        qsort(plist, len, sizeof(void *), void_cmp);
         assert(hfl->count == freelist_max);
         for (size_t i = 0; i < freelist_max; ++i) {
             const uintptr_t ptr = (uintptr_t)hfl->freelist[i].ptr;
             if (ptr == 0) { break; }
             /* look for this ptr in the plist */
-            if (binary_search((uintptr_t *)plist, ptr, num_hps)) {
+            if (binary_search((uintptr_t *)plist, ptr, len)) {
                 /* if found, cannot free it */
                 tmpfreelist.freelist[tmpfreelist.count] = hfl->freelist[i];
                 tmpfreelist.count++;
@@ -176,25 +184,29 @@ static void hazardous_scan(hazard_freelist_t *hfl)
     assert(tmpfreelist.count < freelist_max);
     memcpy(hfl->freelist, tmpfreelist.freelist, tmpfreelist.count * sizeof(hazard_freelist_entry_t));
     hfl->count = tmpfreelist.count;
-    FREE(tmpfreelist.freelist, sizeof(hazard_freelist_entry_t));
-    FREE(plist, sizeof(void *) * (num_hps + hzptr_list_len));
+    FREE(tmpfreelist.freelist, freelist_max * sizeof(hazard_freelist_entry_t));
+    FREE(plist, sizeof(void *) * max_hps);
 }/*}}}*/
 
 void INTERNAL hazardous_release_node(void  (*freefunc)(void *),
                                      void *ptr)
 {/*{{{*/
-    hazard_freelist_t *hfl = &(qthread_internal_getworker()->hazard_free_list);
-    uintptr_t *hzptrs = TLS_GET(ts_hazard_ptrs);
+    qthread_worker_t  *wkr = qthread_internal_getworker();
+    hazard_freelist_t *hfl;
 
     assert(ptr != NULL);
     assert(freefunc != NULL);
+    if (wkr == NULL) {
+        /* Only workers have a free list to defer the free to; a foreign
+         * thread that unlinks something has to leave it be. */
+        qthread_debug(ALWAYS_OUTPUT, "leaking %p retired outside of a worker\n", ptr);
+        return;
+    }
+    hfl = &(wkr->hazard_free_list);
     assert(hfl->count < freelist_max);
     hfl->freelist[hfl->count].freefunc = freefunc;
-    hfl->freelist[hfl->count].ptr  = ptr;
+    hfl->freelist[hfl->count].ptr      = ptr;
     hfl->count++;
-    if (hzptrs != NULL) {
-        memset(hzptrs, 0, sizeof(uintptr_t) * HAZARD_PTRS_PER_SHEP);
-    }
     if (hfl->count == freelist_max) {
         hazardous_scan(hfl);
     }
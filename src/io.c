@@ -6,6 +6,10 @@
 #include <qthread/qthread-int.h>       /* for uint64_t */
 #include <stdio.h>                     /* for fprintf() */
 #include <stdlib.h>                    /* for abort() */
+#include <string.h>                    /* for memset() */
+#include <limits.h>                    /* for IOV_MAX */
+#include <pthread.h>
+#include <sched.h>                     /* for cpu_set_t */
 #include <sys/time.h>                  /* for gettimeofday() */
 #ifdef HAVE_SYS_SYSCALL_H
 /* - syscall(2) */
@@ -21,7 +25,7 @@
 #include <time.h>
 /* - poll(2) */
 #include <poll.h>
-/* - read(2) */
+/* - read(2), preadv(2) */
 #include <sys/uio.h>
 /* - select(2) */
 #include <sys/select.h>
@@ -32,6 +36,8 @@
 
 /* Internal Headers */
 #include "qt_io.h"
+#include "qt_io_uring.h"
+#include "qt_io_epoll.h"
 #include "qt_macros.h"
 #include "qt_asserts.h"
 #include "qthread_innards.h" /* for qthread_exec() */
@@ -39,18 +45,41 @@
 #include "qt_debug.h"
 #include "qt_envariables.h"
 #include "qt_subsystems.h"
+#include "qt_alloc.h"                  /* for qt_internal_aligned_alloc() */
 
+/* The proxies' queue has a shard per shepherd. Workers push a job onto their
+ * own shepherd's shard with a swap on the tail, as in the nemesis scheduler,
+ * and take a lock only to wake a proxy that is asleep there. Popping is
+ * single-consumer, so a proxy holds the shard's lock while it pops; that is a
+ * mutex rather than a flag to spin on, since proxies outnumber processors and
+ * one that is preempted while popping must not hold up the others. Proxies
+ * serve their own shard first and steal from the others, nearest first, when
+ * it is empty. */
 typedef struct {
+    /* written by the workers */
     qt_blocking_queue_node_t *head;
     qt_blocking_queue_node_t *tail;
-    saligned_t                length;
-    pthread_mutex_t           lock;
+    uint8_t                   pad1[CACHELINE_WIDTH - (2 * sizeof(void *))];
+    /* written by the proxies */
+    qt_blocking_queue_node_t *shadow_head;
+    saligned_t                length;  /* jobs waiting */
+    saligned_t                idle;    /* proxies asleep here */
+    saligned_t                proxies; /* proxies that live here */
+    pthread_mutex_t           lock;    /* for popping, sleeping, and waking */
     pthread_cond_t            notempty;
-} qt_blocking_queue_t;
+} Q_ALIGNED(CACHELINE_WIDTH) qt_blocking_shard_t;
 
-static qt_blocking_queue_t theQueue;
-static saligned_t          io_worker_count = -1;
-static saligned_t          io_worker_max   = 10;
+static qt_blocking_shard_t  *shards          = NULL;
+static qthread_shepherd_id_t nshards         = 0;
+static saligned_t            io_worker_count = -1;
+static saligned_t            io_worker_max   = 10;
+static saligned_t            io_keepalive    = 1; /* proxies per shard that never time out */
+#if defined(HAVE_PREADV) && defined(HAVE_PWRITEV)
+/* jobs merged into one preadv() or pwritev() at most */
+# define QT_IO_COALESCE_MAX 64
+static size_t        io_coalesce        = 16;
+static unsigned long io_coalesce_window = 0; // in microseconds
+#endif
 #if !defined(UNPOOLED)
 qt_mpool syscall_job_pool = NULL;
 #endif
@@ -58,28 +87,86 @@ static unsigned long timeout    = 100; // in microseconds
 static int           proxy_exit = 0;
 TLS_DECL_INIT(qthread_t *, IO_task_struct);
 
+static int qt_process_blocking_call(qt_blocking_shard_t *home);
+
+static void qt_blocking_shard_wake(qt_blocking_shard_t *s,
+                                   int                  everyone)
+{   /*{{{*/
+    QTHREAD_LOCK(&s->lock);
+    if (everyone) {
+        QTHREAD_COND_BCAST(s->notempty);
+    } else {
+        QTHREAD_COND_SIGNAL(s->notempty);
+    }
+    QTHREAD_UNLOCK(&s->lock);
+} /*}}}*/
+
 static void qt_blocking_subsystem_internal_stopwork(void)
 {   /*{{{*/
+    qthread_shepherd_id_t i;
+
+#ifdef QTHREAD_IO_EPOLL
+    qt_io_epoll_stop();
+#endif
     proxy_exit = 1;
     MACHINE_FENCE;
+    for (i = 0; i < nshards; i++) {
+        qt_blocking_shard_wake(&shards[i], 1);
+    }
     while (io_worker_count != 0) SPINLOCK_BODY();
-    QTHREAD_LOCK(&theQueue.lock);
-    QTHREAD_UNLOCK(&theQueue.lock);
 } /*}}}*/
 
 static void qt_blocking_subsystem_internal_freemem(void)
 {   /*{{{*/
+    qthread_shepherd_id_t i;
+
+#ifdef QTHREAD_IO_URING
+    qt_io_uring_finalize();
+#endif
+#ifdef QTHREAD_IO_EPOLL
+    qt_io_epoll_finalize();
+#endif
 #if !defined(UNPOOLED)
     qt_mpool_destroy(syscall_job_pool);
 #endif
-    QTHREAD_DESTROYLOCK(&theQueue.lock);
-    QTHREAD_DESTROYCOND(&theQueue.notempty);
+    for (i = 0; i < nshards; i++) {
+        QTHREAD_DESTROYLOCK(&shards[i].lock);
+        QTHREAD_DESTROYCOND(&shards[i].notempty);
+    }
+    qt_internal_aligned_free(shards, CACHELINE_WIDTH);
+    shards  = NULL;
+    nshards = 0;
+} /*}}}*/
+
+/* A proxy may run wherever its shepherd's workers may, which keeps it off
+ * other shepherds' processors and near the caches its tasks use. (It would
+ * otherwise inherit the binding of whichever worker spawned it.) */
+static void qt_blocking_proxy_bind(qt_blocking_shard_t *home)
+{   /*{{{*/
+#if defined(HAVE_PTHREAD_GETAFFINITY_NP) && defined(HAVE_PTHREAD_SETAFFINITY_NP)
+    const qthread_shepherd_t *shep = &qlib->shepherds[home - shards];
+    cpu_set_t                 near, cpus;
+    qthread_worker_id_t       w;
+
+    CPU_ZERO(&near);
+    for (w = 0; w < qlib->nworkerspershep; w++) {
+        if (pthread_getaffinity_np(shep->workers[w].worker, sizeof(cpus), &cpus) == 0) {
+            CPU_OR(&near, &near, &cpus);
+        }
+    }
+    if (CPU_COUNT(&near) > 0) {
+        (void)pthread_setaffinity_np(pthread_self(), sizeof(near), &near);
+    }
+#endif
 } /*}}}*/
 
-static void *qt_blocking_subsystem_proxy_thread(void *QUNUSED(arg))
+static void *qt_blocking_subsystem_proxy_thread(void *arg)
 {   /*{{{*/
+    qt_blocking_shard_t *home = (qt_blocking_shard_t *)arg;
+
+    qt_blocking_proxy_bind(home);
     while (proxy_exit == 0) {
-        if (qt_process_blocking_call()) {
+        if (qt_process_blocking_call(home)) {
             break;
         }
         COMPILER_FENCE;
@@ -95,87 +182,398 @@ static void *qt_blocking_subsystem_proxy_thread(void *QUNUSED(arg))
     return 0;
 } /*}}}*/
 
-static void qt_blocking_subsystem_spawnworker(void)
+static void qt_blocking_subsystem_spawnworker(qt_blocking_shard_t *home)
 {   /*{{{*/
     int       r;
     pthread_t thr;
 
-    if ((r = pthread_create(&thr, NULL, qt_blocking_subsystem_proxy_thread, NULL)) != 0) {
+    if (qthread_incr(&io_worker_count, 1) >= io_worker_max) {
+        (void)qthread_incr(&io_worker_count, -1);
+        return;
+    }
+    (void)qthread_incr(&home->proxies, 1);
+    if ((r = pthread_create(&thr, NULL, qt_blocking_subsystem_proxy_thread, home)) != 0) {
         fprintf(stderr, "qt_blocking_subsystem_init: pthread_create() failed (%d)\n", r);
         perror("qt_blocking_subsystem_init spawning proxy thread");
         abort();
     }
-    (void)qthread_incr(&io_worker_count, 1);
     pthread_detach(thr);
 } /*}}}*/
 
 void INTERNAL qt_blocking_subsystem_init(void)
 {   /*{{{*/
+    qthread_shepherd_id_t i;
+
 #if !defined(UNPOOLED)
     syscall_job_pool = qt_mpool_create(sizeof(qt_blocking_queue_node_t));
+    qt_mpool_set_name(syscall_job_pool, "syscall jobs");
 #endif
-    theQueue.head   = NULL;
-    theQueue.tail   = NULL;
+    nshards = qlib->nshepherds;
+    shards  = qt_internal_aligned_alloc(nshards * sizeof(qt_blocking_shard_t), CACHELINE_WIDTH);
+    assert(shards);
+    memset(shards, 0, nshards * sizeof(qt_blocking_shard_t));
+    for (i = 0; i < nshards; i++) {
+        qassert(pthread_mutex_init(&shards[i].lock, NULL), 0);
+        qassert(pthread_cond_init(&shards[i].notempty, NULL), 0);
+    }
     io_worker_count = 0;
+    proxy_exit      = 0;
     io_worker_max   = qt_internal_get_env_num("MAX_IO_WORKERS", 10, 1);
+    io_keepalive    = qt_internal_get_env_num("IO_KEEPALIVE", 1, 0);
     timeout         = qt_internal_get_env_num("IO_TIMEOUT", 100, 100);
+#if defined(HAVE_PREADV) && defined(HAVE_PWRITEV)
+    io_coalesce        = qt_internal_get_env_num("IO_COALESCE", 16, 1);
+    io_coalesce_window = qt_internal_get_env_num("IO_COALESCE_WINDOW", 0, 0);
+    if (io_coalesce > QT_IO_COALESCE_MAX) { io_coalesce = QT_IO_COALESCE_MAX; }
+# ifdef IOV_MAX
+    if (io_coalesce > IOV_MAX) { io_coalesce = IOV_MAX; }
+# endif
+    if (io_coalesce == 0) { io_coalesce = 1; }
+#endif
     TLS_INIT(IO_task_struct);
-    qassert(pthread_mutex_init(&theQueue.lock, NULL), 0);
-    qassert(pthread_cond_init(&theQueue.notempty, NULL), 0);
     /* thread(s) must be stopped *before* shepherds die, to keep them from
      * trying to push orphan threads into shepherd queues */
     qthread_internal_cleanup_early(qt_blocking_subsystem_internal_stopwork);
     /* must be torn down *after* shepherds die, because live shepherd might try
      * to enqueue into my queue during shutdown */
     qthread_internal_cleanup(qt_blocking_subsystem_internal_freemem);
+#ifdef QTHREAD_IO_URING
+    qt_io_uring_init();
+#endif
+#ifdef QTHREAD_IO_EPOLL
+    qt_io_epoll_init();
+#endif
+} /*}}}*/
+
+static void qt_blocking_shard_push(qt_blocking_shard_t      *s,
+                                   qt_blocking_queue_node_t *job)
+{   /*{{{*/
+    qt_blocking_queue_node_t *prev = qt_internal_atomic_swap_ptr((void **)&s->tail, job);
+
+    if (prev == NULL) {
+        s->head = job;
+    } else {
+        prev->next = job;
+    }
+    (void)qthread_incr(&s->length, 1);
+} /*}}}*/
+
+/* Gives up the processor to whoever the caller is waiting on. */
+static void qt_blocking_yield(void)
+{   /*{{{*/
+#ifdef HAVE_SCHED_YIELD
+    sched_yield();
+#else
+    SPINLOCK_BODY();
+#endif
 } /*}}}*/
 
-int INTERNAL qt_process_blocking_call(void)
+/* The caller holds s->lock. Returns NULL if the shard is empty, or if the
+ * first job's push has not finished linking it in. */
+static qt_blocking_queue_node_t *qt_blocking_shard_pop(qt_blocking_shard_t *s)
 {   /*{{{*/
     qt_blocking_queue_node_t *item;
 
-    QTHREAD_LOCK(&theQueue.lock);
-    while (theQueue.head == NULL) {
-        struct timeval  tv;
-        struct timespec ts;
-        int             ret;
+    if (s->shadow_head == NULL) {
+        if (s->head == NULL) {
+            return NULL;
+        }
+        s->shadow_head = s->head;
+        s->head        = NULL;
+    }
+    item = s->shadow_head;
+    if (item->next != NULL) {
+        s->shadow_head = item->next;
+    } else {
+        s->shadow_head = NULL;
+        if (qthread_cas_ptr(&s->tail, item, NULL) != item) {
+            /* a push is linking a job in after this one */
+            while (item->next == NULL) qt_blocking_yield();
+            s->shadow_head = item->next;
+        }
+    }
+    item->next = NULL;
+    (void)qthread_incr(&s->length, -1);
+    return item;
+} /*}}}*/
 
-        COMPILER_FENCE;
-        gettimeofday(&tv, NULL);
-        ts.tv_sec  = tv.tv_sec;
-        ts.tv_nsec = (tv.tv_usec + timeout) * 1000;
-        ret        = pthread_cond_timedwait(&theQueue.notempty, &theQueue.lock, &ts);
-        switch(ret) {
-            case ETIMEDOUT:
-                qthread_debug(IO_BEHAVIOR, "condwait timed out\n");
-                if (theQueue.head == NULL) {
-                    qthread_debug(IO_BEHAVIOR, "------------------------------------- exit()\n");
-                    QTHREAD_UNLOCK(&theQueue.lock);
-                    return 1;
-                } else {
-                    QTHREAD_UNLOCK(&theQueue.lock);
-                    return 0;
-                }
-
-            case EINVAL:
-                /* chances are, this is because ts is in the past */
-                qthread_debug(IO_DETAILS, "condwait returned EINVAL\n");
+/* Keeps trying while <s> is not empty: a shard may have no proxies of its
+ * own, so a job left behind here might wait for the next push. */
+static qt_blocking_queue_node_t *qt_blocking_shard_take(qt_blocking_shard_t *s)
+{   /*{{{*/
+    qt_blocking_queue_node_t *item = NULL;
+
+    COMPILER_FENCE;
+    if (s->tail == NULL) {
+        return NULL;
+    }
+    QTHREAD_LOCK(&s->lock);
+    while ((s->tail != NULL) && ((item = qt_blocking_shard_pop(s)) == NULL)) {
+        /* the push is not done; the worker making it may be preempted */
+        qt_blocking_yield();
+    }
+    QTHREAD_UNLOCK(&s->lock);
+    return item;
+} /*}}}*/
+
+/* A job from <home> or, failing that, from the nearest shard that has one;
+ * <from> says which. */
+static qt_blocking_queue_node_t *qt_blocking_subsystem_take(qt_blocking_shard_t  *home,
+                                                            qt_blocking_shard_t **from)
+{   /*{{{*/
+    const qthread_shepherd_id_t *near = qlib->shepherds[home - shards].sorted_sheplist;
+    qt_blocking_queue_node_t    *item;
+    qthread_shepherd_id_t        i;
+
+    if ((item = qt_blocking_shard_take(home)) != NULL) {
+        *from = home;
+        return item;
+    }
+    for (i = 0; i + 1 < nshards; i++) {
+        if ((item = qt_blocking_shard_take(&shards[near[i]])) != NULL) {
+            qthread_debug(IO_DETAILS, "stole job %p from shard %u\n", item, (unsigned)near[i]);
+            *from = &shards[near[i]];
+            return item;
+        }
+    }
+    return NULL;
+} /*}}}*/
+
+/* Whether any shard has a job waiting. */
+static int qt_blocking_subsystem_queued(void)
+{   /*{{{*/
+    qthread_shepherd_id_t i;
+
+    for (i = 0; i < nshards; i++) {
+        if (shards[i].tail != NULL) { return 1; }
+    }
+    return 0;
+} /*}}}*/
+
+/* Waits until a job is pushed onto <home>, another shard wants help, or the
+ * proxies are told to exit. A proxy beyond the keep-alive pool gives up after
+ * QT_IO_TIMEOUT; returns nonzero if it did. */
+static int qt_blocking_subsystem_sleep(qt_blocking_shard_t *home)
+{   /*{{{*/
+    int ret = 0;
+
+    QTHREAD_LOCK(&home->lock);
+    (void)qthread_incr(&home->idle, 1);
+    MACHINE_FENCE;
+    /* check every shard, not just <home>: qt_blocking_subsystem_help() may
+     * have looked for an idle proxy here before this one counted itself */
+    if (!qt_blocking_subsystem_queued() && (proxy_exit == 0)) {
+        if (home->proxies > io_keepalive) {
+            struct timeval  tv;
+            struct timespec ts;
+
+            gettimeofday(&tv, NULL);
+            ts.tv_sec  = tv.tv_sec + (tv.tv_usec + timeout) / 1000000;
+            ts.tv_nsec = ((tv.tv_usec + timeout) % 1000000) * 1000;
+            ret        = pthread_cond_timedwait(&home->notempty, &home->lock, &ts);
+        } else {
+            ret = pthread_cond_wait(&home->notempty, &home->lock);
+        }
+    }
+    (void)qthread_incr(&home->idle, -1);
+    QTHREAD_UNLOCK(&home->lock);
+    return ret == ETIMEDOUT;
+} /*}}}*/
+
+static QINLINE int qt_blocking_rw_fd(const qt_blocking_queue_node_t *job)
+{   /*{{{*/
+    int fd;
+
+    memcpy(&fd, &job->args[0], sizeof(int));
+    return fd;
+} /*}}}*/
+
+static QINLINE off_t qt_blocking_rw_offset(const qt_blocking_queue_node_t *job)
+{   /*{{{*/
+    off_t offset;
+
+    memcpy(&offset, &job->args[3], sizeof(off_t));
+    return offset;
+} /*}}}*/
+
+/* Makes the PREAD or PWRITE in <job>; the caller collects errno. */
+static void qt_blocking_rw(qt_blocking_queue_node_t *job)
+{   /*{{{*/
+    const int   fd     = qt_blocking_rw_fd(job);
+    const off_t offset = qt_blocking_rw_offset(job);
+
+    if (job->op == PREAD) {
+#if HAVE_SYSCALL && HAVE_DECL_SYS_PREAD
+        job->ret = syscall(SYS_pread,
+                           fd,
+                           (void *)job->args[1],
+                           (size_t)job->args[2],
+                           offset);
+#else
+        job->ret = pread(fd,
+                         (void *)job->args[1],
+                         (size_t)job->args[2],
+                         offset);
+#endif
+    } else {
+#if HAVE_SYSCALL && HAVE_DECL_SYS_PWRITE
+        job->ret = syscall(SYS_pwrite,
+                           fd,
+                           (const void *)job->args[1],
+                           (size_t)job->args[2],
+                           offset);
+#else
+        job->ret = pwrite(fd,
+                          (const void *)job->args[1],
+                          (size_t)job->args[2],
+                          offset);
+#endif
+    }
+} /*}}}*/
+
+#if defined(HAVE_PREADV) && defined(HAVE_PWRITEV)
+/* Pops the jobs behind batch[0] on <s> while they make the same call on the
+ * same descriptor, up to QT_IO_COALESCE jobs in all, waiting up to
+ * QT_IO_COALESCE_WINDOW for more to be pushed. Returns how many are in
+ * <batch>. */
+static size_t qt_blocking_shard_gather(qt_blocking_shard_t       *s,
+                                       qt_blocking_queue_node_t **batch)
+{   /*{{{*/
+    const int      fd = qt_blocking_rw_fd(batch[0]);
+    size_t         n  = 1;
+    struct timeval start, now;
+
+    if (io_coalesce_window > 0) { gettimeofday(&start, NULL); }
+    QTHREAD_LOCK(&s->lock);
+    while (n < io_coalesce) {
+        qt_blocking_queue_node_t *next = (s->shadow_head != NULL) ? s->shadow_head : s->head;
+
+        if (next == NULL) {
+            if (io_coalesce_window == 0) { break; }
+            gettimeofday(&now, NULL);
+            if ((unsigned long)((now.tv_sec - start.tv_sec) * 1000000 + (now.tv_usec - start.tv_usec)) >= io_coalesce_window) {
                 break;
+            }
+            QTHREAD_UNLOCK(&s->lock);
+            qt_blocking_yield();
+            QTHREAD_LOCK(&s->lock);
+            continue;
+        }
+        if ((next->op != batch[0]->op) || (qt_blocking_rw_fd(next) != fd)) { break; }
+        batch[n] = qt_blocking_shard_pop(s);
+        assert(batch[n] == next);
+        n++;
+    }
+    QTHREAD_UNLOCK(&s->lock);
+    return n;
+} /*}}}*/
 
-            default:
+/* Makes the calls in <batch> in order of offset, each run of adjacent ranges
+ * as one preadv() or pwritev(). A job the merged call did not reach (at the
+ * end of the file, say) makes its own call, so that every task gets what its
+ * own call would have returned. */
+static void qt_blocking_rw_batch(qt_blocking_queue_node_t **batch,
+                                 size_t                     n)
+{   /*{{{*/
+    const int    fd = qt_blocking_rw_fd(batch[0]);
+    struct iovec iov[QT_IO_COALESCE_MAX];
+    size_t       a, b, i;
+
+    for (i = 1; i < n; i++) {
+        qt_blocking_queue_node_t *job = batch[i];
+
+        for (b = i; b > 0 && qt_blocking_rw_offset(batch[b - 1]) > qt_blocking_rw_offset(job); b--) {
+            batch[b] = batch[b - 1];
+        }
+        batch[b] = job;
+    }
+    for (a = 0; a < n; a = b) {
+        ssize_t r;
+
+        iov[0].iov_base = (void *)batch[a]->args[1];
+        iov[0].iov_len  = (size_t)batch[a]->args[2];
+        for (b = a + 1; b < n; b++) {
+            if (qt_blocking_rw_offset(batch[b]) != qt_blocking_rw_offset(batch[b - 1]) + (off_t)batch[b - 1]->args[2]) {
                 break;
+            }
+            iov[b - a].iov_base = (void *)batch[b]->args[1];
+            iov[b - a].iov_len  = (size_t)batch[b]->args[2];
+        }
+        if (b - a == 1) {
+            qt_blocking_rw(batch[a]);
+            batch[a]->err = errno;
+            continue;
+        }
+        qthread_debug(IO_DETAILS, "merging %u jobs on fd %i at offset %li\n", (unsigned)(b - a), fd, (long)qt_blocking_rw_offset(batch[a]));
+        if (batch[a]->op == PREAD) {
+            r = preadv(fd, iov, (int)(b - a), qt_blocking_rw_offset(batch[a]));
+        } else {
+            r = pwritev(fd, iov, (int)(b - a), qt_blocking_rw_offset(batch[a]));
+        }
+        for (i = a; i < b; i++) {
+            if (r > 0) {
+                batch[i]->ret = (r < (ssize_t)batch[i]->args[2]) ? r : (ssize_t)batch[i]->args[2];
+                batch[i]->err = 0;
+                r            -= batch[i]->ret;
+            } else {
+                qt_blocking_rw(batch[i]);
+                batch[i]->err = errno;
+            }
         }
     }
-    item = theQueue.head;
-    assert(item != NULL);
-    theQueue.head = item->next;
-    if (theQueue.tail == item) {
-        theQueue.tail = theQueue.head;
+} /*}}}*/
+#endif /* if defined(HAVE_PREADV) && defined(HAVE_PWRITEV) */
+
+/* The call in <item> is done; hand it back. */
+static void qt_blocking_subsystem_finish(qt_blocking_queue_node_t *item)
+{   /*{{{*/
+    /* the task frees its own job, except for a user-defined action, whose
+     * job is ours */
+    (void)qthread_incr(&item->thread->rdata->shepherd_ptr->io_proxied, -1);
+    if (item->op == USER_DEFINED) {
+        qthread_t *t = item->thread;
+
+        FREE_SYSCALLJOB(item);
+        qt_threadqueue_enqueue(t->rdata->shepherd_ptr->ready, t);
+    } else {
+        qt_blocking_subsystem_complete(item);
     }
-    theQueue.length--;
-    qthread_debug(IO_DETAILS, "dequeue... theQueue.head = %p, .tail = %p, item:%p, thread:%p, rdata:%p\n", theQueue.head, theQueue.tail, item, item->thread, item->thread->rdata);
-    QTHREAD_UNLOCK(&theQueue.lock);
-    item->next = NULL;
+} /*}}}*/
+
+static int qt_process_blocking_call(qt_blocking_shard_t *home)
+{   /*{{{*/
+    qt_blocking_shard_t      *from = home;
+    qt_blocking_queue_node_t *item = qt_blocking_subsystem_take(home, &from);
+
+    if (item == NULL) {
+        const int timed_out = qt_blocking_subsystem_sleep(home);
+
+        item = qt_blocking_subsystem_take(home, &from);
+        if (item == NULL) {
+            saligned_t n = home->proxies;
+
+            if (timed_out && (n > io_keepalive) && (qthread_cas(&home->proxies, n, n - 1) == n)) {
+                qthread_debug(IO_BEHAVIOR, "------------------------------------- exit()\n");
+                return 1;
+            }
+            return 0;
+        }
+    }
+    qthread_debug(IO_DETAILS, "dequeue... item:%p, thread:%p, rdata:%p\n", item, item->thread, item->thread->rdata);
+#if defined(HAVE_PREADV) && defined(HAVE_PWRITEV)
+    if (((item->op == PREAD) || (item->op == PWRITE)) && (io_coalesce > 1)) {
+        qt_blocking_queue_node_t *batch[QT_IO_COALESCE_MAX];
+        size_t                    i, n;
+
+        batch[0] = item;
+        n        = qt_blocking_shard_gather(from, batch);
+        qt_blocking_rw_batch(batch, n);
+        for (i = 0; i < n; i++) {
+            qt_blocking_subsystem_finish(batch[i]);
+        }
+        return 0;
+    }
+#endif
     /* do something with <item> */
     switch(item->op) {
         default:
@@ -248,25 +646,9 @@ int INTERNAL qt_process_blocking_call(void)
             break;
         }
         case PREAD:
-        {
-            int   fd;
-            off_t offset;
-            memcpy(&fd, &item->args[0], sizeof(int));
-            memcpy(&offset, &item->args[3], sizeof(off_t));
-#if HAVE_SYSCALL && HAVE_DECL_SYS_PREAD
-            item->ret = syscall(SYS_pread,
-                                fd,
-                                (void *)item->args[1],
-                                (size_t)item->args[2],
-                                offset);
-#else
-            item->ret = pread(fd,
-                              (void *)item->args[1],
-                              (size_t)item->args[2],
-                              offset);
-#endif
+        case PWRITE:
+            qt_blocking_rw(item);
             break;
-        }
         /* case RECV:
          * case RECVFROM: */
         case SELECT:
@@ -330,19 +712,6 @@ int INTERNAL qt_process_blocking_call(void)
             item->ret = write((int)item->args[0],
                               (const void *)item->args[1],
                               (size_t)item->args[2]);
-#endif
-        case PWRITE:
-#if HAVE_SYSCALL && HAVE_DECL_SYS_PWRITE
-            item->ret = syscall(SYS_pwrite,
-                                (int)item->args[0],
-                                (const void *)item->args[1],
-                                (size_t)item->args[2],
-                                (off_t)item->args[3]);
-#else
-            item->ret = pwrite((int)item->args[0],
-                               (const void *)item->args[1],
-                               (size_t)item->args[2],
-                               (off_t)item->args[3]);
 #endif
             break;
         case USER_DEFINED:
@@ -360,39 +729,77 @@ int INTERNAL qt_process_blocking_call(void)
     /* preserve errno in item */
     item->err = errno;
     /* and now, re-queue */
-    qt_threadqueue_enqueue(item->thread->rdata->shepherd_ptr->ready, item->thread);
-    FREE_SYSCALLJOB(item);
+    qt_blocking_subsystem_finish(item);
     return 0;
 } /*}}}*/
 
+/* The call in <job> is done and its result is in job->ret and job->err; put
+ * its task back where it came from. The task may run, and free <job>, before
+ * this returns. */
+void INTERNAL qt_blocking_subsystem_complete(qt_blocking_queue_node_t *job)
+{   /*{{{*/
+    qthread_t *t = job->thread;
+
+    qthread_debug(IO_DETAILS, "job %p done (ret %li, err %i), thread:%p\n", job, (long)job->ret, job->err, t);
+    qt_threadqueue_enqueue(t->rdata->shepherd_ptr->ready, t);
+} /*}}}*/
+
+/* <s>'s proxies are all busy, and may be blocked for good (e.g. in a read
+ * that waits on a job still queued), so wake a proxy asleep on another shard
+ * to steal the job, and start another proxy if there are more jobs waiting
+ * than proxies asleep. */
+static void qt_blocking_subsystem_help(qt_blocking_shard_t *s)
+{   /*{{{*/
+    const qthread_shepherd_id_t *near    = qlib->shepherds[s - shards].sorted_sheplist;
+    qt_blocking_shard_t         *sleeper = NULL;
+    saligned_t                   idle    = s->idle;
+    saligned_t                   queued  = s->length;
+    qthread_shepherd_id_t        i;
+
+    for (i = 0; i + 1 < nshards; i++) {
+        qt_blocking_shard_t *o = &shards[near[i]];
+
+        if ((o->idle > 0) && (sleeper == NULL)) { sleeper = o; }
+        idle   += o->idle;
+        queued += o->length;
+    }
+    if (sleeper) {
+        qt_blocking_shard_wake(sleeper, 0);
+    }
+    if ((idle < queued) && (io_worker_count < io_worker_max)) {
+        qthread_debug(IO_DETAILS, "++++++++++++++++++++ I think I oughta spawn a worker\n");
+        qt_blocking_subsystem_spawnworker(s);
+    }
+} /*}}}*/
+
 void INTERNAL qt_blocking_subsystem_enqueue(qt_blocking_queue_node_t *job)
 {   /*{{{*/
-    qt_blocking_queue_node_t *prev;
+    qt_blocking_shard_t *s;
 
     qthread_debug(IO_FUNCTIONS, "entering, job = %p, thread:%p, rdata:%p\n", job, job->thread, job->thread->rdata);
     assert(job->next == NULL);
     assert(job->thread->rdata);
-    QTHREAD_LOCK(&theQueue.lock);
-    qthread_debug(IO_DETAILS, "1) theQueue.head = %p, .tail = %p, job = %p\n", theQueue.head, theQueue.tail, job);
-    prev          = theQueue.tail;
-    theQueue.tail = job;
-    if (prev == NULL) {
-        theQueue.head = job;
-    } else {
-        prev->next = job;
+    if (qt_io_epoll_submit(job)) {
+        qthread_debug(IO_FUNCTIONS, "exiting, job = %p waits for epoll\n", job);
+        return;
     }
-    theQueue.length++;
-    qthread_debug(IO_DETAILS, "2) theQueue.head = %p, .tail = %p, job = %p\n", theQueue.head, theQueue.tail, job);
-    if (io_worker_count < theQueue.length) {
-        if (io_worker_count < io_worker_max) {
-            qthread_debug(IO_DETAILS, "++++++++++++++++++++ I think I oughta spawn a worker\n");
-            qt_blocking_subsystem_spawnworker();
-        }
-    } else {
-        qthread_debug(IO_DETAILS, "Queue is %u long, there are %u workers\n", (unsigned)theQueue.length, (unsigned)io_worker_count);
-        QTHREAD_COND_SIGNAL(theQueue.notempty);
+    if (qt_io_uring_submit(job)) {
+        qthread_debug(IO_FUNCTIONS, "exiting, job = %p went to io_uring\n", job);
+        return;
+    }
+    s = &shards[job->thread->rdata->shepherd_ptr->shepherd_id];
+    (void)qthread_incr(&job->thread->rdata->shepherd_ptr->io_proxied, 1);
+    qt_blocking_shard_push(s, job);
+    /* pairs with the fence in qt_blocking_subsystem_sleep(): either the
+     * proxy sees the job or this sees the proxy */
+    MACHINE_FENCE;
+    if (s->idle > 0) {
+        qthread_debug(IO_DETAILS, "shard %u is %u long, %u of its %u proxies idle\n", (unsigned)(s - shards), (unsigned)s->length, (unsigned)s->idle, (unsigned)s->proxies);
+        qt_blocking_shard_wake(s, 0);
+    }
+    if (s->idle < s->length) {
+        qt_blocking_subsystem_help(s);
     }
-    QTHREAD_UNLOCK(&theQueue.lock);
     qthread_debug(IO_FUNCTIONS, "exiting, job = %p\n", job);
 } /*}}}*/
 
@@ -0,0 +1,499 @@
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+/* System Headers */
+#include <stdio.h>                     /* for fprintf() */
+#include <stdlib.h>                    /* for abort() */
+#include <string.h>                    /* for memset() and memcpy() */
+#include <errno.h>
+#include <fcntl.h>                     /* for fcntl() */
+#include <unistd.h>                    /* for close() and write() */
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>              /* for getrlimit() */
+#include <sys/socket.h>
+#ifdef HAVE_SYS_SYSCALL_H
+# include <sys/syscall.h>              /* for SYS_accept and SYS_connect */
+#endif
+
+/* Internal Headers */
+#include "qt_io.h"
+#include "qt_io_epoll.h"
+#include "qt_atomics.h"
+#include "qt_expect.h"
+#include "qt_asserts.h"
+#include "qt_debug.h"
+#include "qt_envariables.h"
+#include "qt_alloc.h"
+#include "qt_output_macros.h"
+#include "qthread_innards.h"           /* for qlib */
+#include "qt_qthread_mgmt.h"           /* for qthread_internal_self() */
+
+/* what the tasks waiting on one descriptor want, and whether epoll knows it */
+typedef struct {
+    pthread_mutex_t           lock;    /* held across system calls, so not a spinlock */
+    qt_blocking_queue_node_t *waiters; /* FD_READY jobs; args[1] is the events */
+    int                       added;
+} qt_io_fd_t;
+
+#define QT_IO_FDS_PER_CHUNK 1024
+#define QT_IO_EPOLL_BATCH   64
+#define QT_IO_EPOLL_WAKEUP  UINT64_MAX /* data of the poller's eventfd */
+
+aligned_t           qt_io_epoll_waiting = 0;
+static int          epfd                = -1;
+static int          wakefd              = -1;
+static qt_io_fd_t **fds                 = NULL; /* lazily allocated chunks */
+static size_t       fd_chunks           = 0;
+static pthread_t    poller;
+static int          poller_running = 0;
+static volatile int poller_exit    = 0;
+
+/* The entry for <fd>, or NULL if <fd> is out of the table's range. */
+static qt_io_fd_t *qt_io_epoll_fd(int fd)
+{   /*{{{*/
+    size_t      c = (size_t)fd / QT_IO_FDS_PER_CHUNK;
+    qt_io_fd_t *chunk;
+
+    if ((fd < 0) || (c >= fd_chunks)) { return NULL; }
+    chunk = fds[c];
+    if (QTHREAD_UNLIKELY(chunk == NULL)) {
+        qt_io_fd_t *mine = qt_calloc(QT_IO_FDS_PER_CHUNK, sizeof(qt_io_fd_t));
+        size_t      i;
+
+        assert(mine);
+        for (i = 0; i < QT_IO_FDS_PER_CHUNK; i++) {
+            qassert(pthread_mutex_init(&mine[i].lock, NULL), 0);
+        }
+        chunk = qthread_cas_ptr(&fds[c], NULL, mine);
+        if (chunk == NULL) {
+            chunk = mine;
+        } else {
+            for (i = 0; i < QT_IO_FDS_PER_CHUNK; i++) {
+                QTHREAD_DESTROYLOCK(&mine[i].lock);
+            }
+            qt_free(mine);
+        }
+    }
+    return &chunk[fd % QT_IO_FDS_PER_CHUNK];
+} /*}}}*/
+
+/* Arms <fd> one-shot for everything its waiters want. The caller holds the
+ * entry's lock. Epoll forgets descriptors that are closed, so a number that
+ * was added before may have to be added again. */
+static int qt_io_epoll_arm(int         fd,
+                           qt_io_fd_t *e)
+{   /*{{{*/
+    struct epoll_event        ev;
+    qt_blocking_queue_node_t *j;
+    int                       r;
+
+    memset(&ev, 0, sizeof(ev));
+    for (j = e->waiters; j != NULL; j = j->next) {
+        ev.events |= (uint32_t)j->args[1];
+    }
+    ev.events  |= EPOLLONESHOT;
+    ev.data.u64 = (uint64_t)fd;
+    if (e->added) {
+        r = epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev);
+        if ((r < 0) && (errno == ENOENT)) { r = epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev); }
+    } else {
+        r = epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+        if ((r < 0) && (errno == EEXIST)) { r = epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev); }
+    }
+    if (r == 0) { e->added = 1; }
+    return r;
+} /*}}}*/
+
+/* Called by a worker after the job's task has switched out, so that the
+ * task cannot be woken before it has stopped running. */
+int INTERNAL qt_io_epoll_submit(qt_blocking_queue_node_t *job)
+{   /*{{{*/
+    qt_io_fd_t *e;
+    int         fd;
+
+    if (job->op != FD_READY) { return 0; }
+    memcpy(&fd, &job->args[0], sizeof(int));
+    e = qt_io_epoll_fd(fd);
+    assert(e);                         /* the task checked */
+    QTHREAD_LOCK(&e->lock);
+    job->next  = e->waiters;
+    e->waiters = job;
+    qthread_incr(&qt_io_epoll_waiting, 1);
+    if (qt_io_epoll_arm(fd, e) < 0) {
+        e->waiters = job->next;
+        QTHREAD_UNLOCK(&e->lock);
+        qthread_incr(&qt_io_epoll_waiting, -1);
+        job->next = NULL;
+        job->ret  = -1;
+        job->err  = errno;
+        qt_blocking_subsystem_complete(job);
+        return 1;
+    }
+    QTHREAD_UNLOCK(&e->lock);
+    return 1;
+} /*}}}*/
+
+int INTERNAL qt_io_epoll_poll(int timeout)
+{   /*{{{*/
+    struct epoll_event evs[QT_IO_EPOLL_BATCH];
+    int                n, i, woken = 0;
+
+    n = epoll_wait(epfd, evs, QT_IO_EPOLL_BATCH, timeout);
+    for (i = 0; i < n; i++) {
+        const uint32_t            ready = evs[i].events;
+        qt_blocking_queue_node_t *wake  = NULL, **pp;
+        qt_io_fd_t               *e;
+        int                       fd;
+
+        if (evs[i].data.u64 == QT_IO_EPOLL_WAKEUP) { continue; }
+        fd = (int)evs[i].data.u64;
+        e  = qt_io_epoll_fd(fd);
+        QTHREAD_LOCK(&e->lock);
+        pp = &e->waiters;
+        while (*pp != NULL) {
+            qt_blocking_queue_node_t *j = *pp;
+
+            if ((j->args[1] & ready) || (ready & (EPOLLERR | EPOLLHUP))) {
+                *pp     = j->next;
+                j->next = wake;
+                wake    = j;
+            } else {
+                pp = &j->next;
+            }
+        }
+        if ((e->waiters != NULL) && (qt_io_epoll_arm(fd, e) < 0)) {
+            /* let the rest find out for themselves */
+            *pp        = wake;
+            wake       = e->waiters;
+            e->waiters = NULL;
+        }
+        QTHREAD_UNLOCK(&e->lock);
+        while (wake != NULL) {
+            qt_blocking_queue_node_t *j = wake;
+
+            wake    = j->next;
+            j->next = NULL;
+            j->ret  = 0;
+            j->err  = 0;
+            qthread_incr(&qt_io_epoll_waiting, -1);
+            qt_blocking_subsystem_complete(j);
+            woken++;
+        }
+    }
+    return woken;
+} /*}}}*/
+
+/* catches what the idle workers don't, so that none of them has to stay
+ * awake for a socket */
+static void *qt_io_epoll_poller(void *QUNUSED(arg))
+{   /*{{{*/
+    while (!poller_exit) {
+        qt_io_epoll_poll(-1);
+    }
+    return NULL;
+} /*}}}*/
+
+void INTERNAL qt_io_epoll_init(void)
+{   /*{{{*/
+    struct epoll_event ev;
+    struct rlimit      rl;
+    size_t             maxfds = 65536;
+    int                r;
+
+    qt_io_epoll_waiting = 0;
+    poller_exit         = 0;
+    poller_running      = 0;
+    if (!qt_internal_get_env_bool("IO_EPOLL", 1)) { return; }
+    if ((epfd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+        print_warning("epoll_create1() failed (%s); sockets use proxy threads\n", strerror(errno));
+        return;
+    }
+    if ((wakefd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) < 0) {
+        print_warning("eventfd() failed (%s); sockets use proxy threads\n", strerror(errno));
+        close(epfd);
+        epfd = -1;
+        return;
+    }
+    memset(&ev, 0, sizeof(ev));
+    ev.events   = EPOLLIN;
+    ev.data.u64 = QT_IO_EPOLL_WAKEUP;
+    qassert(epoll_ctl(epfd, EPOLL_CTL_ADD, wakefd, &ev), 0);
+    if ((getrlimit(RLIMIT_NOFILE, &rl) == 0) && (rl.rlim_cur != RLIM_INFINITY)) {
+        maxfds = rl.rlim_cur;
+    }
+    fd_chunks = (maxfds + QT_IO_FDS_PER_CHUNK - 1) / QT_IO_FDS_PER_CHUNK;
+    fds       = qt_calloc(fd_chunks, sizeof(qt_io_fd_t *));
+    assert(fds);
+    if ((r = pthread_create(&poller, NULL, qt_io_epoll_poller, NULL)) != 0) {
+        fprintf(stderr, "qt_io_epoll_init: pthread_create() failed (%d)\n", r);
+        abort();
+    }
+    poller_running = 1;
+} /*}}}*/
+
+void INTERNAL qt_io_epoll_stop(void)
+{   /*{{{*/
+    uint64_t one = 1;
+
+    if (!poller_running) { return; }
+    poller_exit = 1;
+    MACHINE_FENCE;
+    qassert(write(wakefd, &one, sizeof(one)), sizeof(one));
+    qassert(pthread_join(poller, NULL), 0);
+    poller_running = 0;
+} /*}}}*/
+
+void INTERNAL qt_io_epoll_finalize(void)
+{   /*{{{*/
+    size_t c, i;
+
+    for (c = 0; c < fd_chunks; c++) {
+        if (fds[c] == NULL) { continue; }
+        for (i = 0; i < QT_IO_FDS_PER_CHUNK; i++) {
+            QTHREAD_DESTROYLOCK(&fds[c][i].lock);
+        }
+        qt_free(fds[c]);
+    }
+    if (fds) { qt_free(fds); }
+    if (wakefd >= 0) { close(wakefd); }
+    if (epfd >= 0) { close(epfd); }
+    fds                 = NULL;
+    fd_chunks           = 0;
+    wakefd              = -1;
+    epfd                = -1;
+    qt_io_epoll_waiting = 0;
+} /*}}}*/
+
+/* errno belongs to the pthread, and a task can come back from
+ * qt_io_epoll_wait() on a different one than it left, while the compiler is
+ * free to keep errno's address across the call; so the code below touches
+ * errno only through these. */
+#ifdef __GNUC__
+# define QT_IO_NOINLINE __attribute__((noinline))
+#else
+# define QT_IO_NOINLINE
+#endif
+static QT_IO_NOINLINE int qt_io_errno(void)
+{   /*{{{*/
+    return errno;
+} /*}}}*/
+
+static QT_IO_NOINLINE void qt_io_set_errno(int err)
+{   /*{{{*/
+    errno = err;
+} /*}}}*/
+
+/* Blocks the calling task until <fd> has one of <events> (or an error or a
+ * hangup) pending. Returns 0, or -1 and sets errno if <fd> cannot be
+ * waited for this way. */
+static int qt_io_epoll_wait(int      fd,
+                            uint32_t events)
+{   /*{{{*/
+    qthread_t                *me  = qthread_internal_self();
+    qt_blocking_queue_node_t *job = ALLOC_SYSCALLJOB();
+    int                       ret;
+
+    assert(job);
+    job->next   = NULL;
+    job->thread = me;
+    job->op     = FD_READY;
+    memcpy(&job->args[0], &fd, sizeof(int));
+    job->args[1] = (uintptr_t)events;
+
+    assert(me->rdata);
+    me->rdata->blockedon.io = job;
+    me->thread_state        = QTHREAD_STATE_SYSCALL;
+    qthread_back_to_master(me);
+    ret = (int)job->ret;
+    if (ret < 0) { qt_io_set_errno(job->err); }
+    FREE_SYSCALLJOB(job);
+    return ret;
+} /*}}}*/
+
+static QINLINE int qt_io_epoll_usable(int fd)
+{   /*{{{*/
+    return (epfd >= 0) && (fd >= 0) && ((size_t)fd / QT_IO_FDS_PER_CHUNK < fd_chunks);
+} /*}}}*/
+
+/* a descriptor the program put in non-blocking mode gets EAGAIN, as it would
+ * from the system call */
+static QINLINE int qt_io_epoll_nonblocking(int fd)
+{   /*{{{*/
+    const int fl = fcntl(fd, F_GETFL);
+
+    return (fl >= 0) && (fl & O_NONBLOCK);
+} /*}}}*/
+
+int INTERNAL qt_io_epoll_read(int      fd,
+                              void    *buf,
+                              size_t   nbyte,
+                              ssize_t *ret)
+{   /*{{{*/
+    if (!qt_io_epoll_usable(fd)) { return 0; }
+    for (;;) {
+        ssize_t r = recv(fd, buf, nbyte, MSG_DONTWAIT);
+
+        if (r >= 0) {
+            *ret = r;
+            return 1;
+        }
+        switch (qt_io_errno()) {
+            case ENOTSOCK:
+                return 0;
+
+            case EINTR:
+                break;
+
+            case EAGAIN:
+#if EWOULDBLOCK != EAGAIN
+            case EWOULDBLOCK:
+#endif
+                if (qt_io_epoll_nonblocking(fd)) {
+                    *ret  = -1;
+                    qt_io_set_errno(EAGAIN);
+                    return 1;
+                }
+                if (qt_io_epoll_wait(fd, EPOLLIN) < 0) { return 0; }
+                break;
+
+            default:
+                *ret = -1;
+                return 1;
+        }
+    }
+} /*}}}*/
+
+/* Like a blocking write(), this writes everything unless it fails partway,
+ * in which case it reports how much it wrote. */
+int INTERNAL qt_io_epoll_write(int         fd,
+                               const void *buf,
+                               size_t      nbyte,
+                               ssize_t    *ret)
+{   /*{{{*/
+    size_t done = 0;
+
+    if (!qt_io_epoll_usable(fd)) { return 0; }
+    for (;;) {
+        ssize_t r = send(fd, (const char *)buf + done, nbyte - done, MSG_DONTWAIT);
+
+        if (r >= 0) {
+            done += (size_t)r;
+            if (done == nbyte) {
+                *ret = (ssize_t)done;
+                return 1;
+            }
+            continue;
+        }
+        switch (qt_io_errno()) {
+            case ENOTSOCK:
+                assert(done == 0);
+                return 0;
+
+            case EINTR:
+                break;
+
+            case EAGAIN:
+#if EWOULDBLOCK != EAGAIN
+            case EWOULDBLOCK:
+#endif
+                if (qt_io_epoll_nonblocking(fd)) {
+                    *ret = (done > 0) ? (ssize_t)done : -1;
+                    return 1;
+                }
+                if (qt_io_epoll_wait(fd, EPOLLOUT) < 0) {
+                    if (done == 0) { return 0; }
+                    *ret = (ssize_t)done;
+                    return 1;
+                }
+                break;
+
+            default:
+                *ret = (done > 0) ? (ssize_t)done : -1;
+                return 1;
+        }
+    }
+} /*}}}*/
+
+/* accept() and connect() have no per-call non-blocking flag, so the socket
+ * is put in non-blocking mode for the duration of each attempt, under the
+ * descriptor's lock so that tasks sharing a listening socket do not
+ * undo each other. */
+int INTERNAL qt_io_epoll_accept(int              fd,
+                                struct sockaddr *address,
+                                socklen_t       *address_len,
+                                int             *ret)
+{   /*{{{*/
+    qt_io_fd_t *e;
+
+    if (!qt_io_epoll_usable(fd)) { return 0; }
+    e = qt_io_epoll_fd(fd);
+    for (;;) {
+        int r, err, fl;
+
+        QTHREAD_LOCK(&e->lock);
+        if ((fl = fcntl(fd, F_GETFL)) < 0) {
+            QTHREAD_UNLOCK(&e->lock);
+            return 0;
+        }
+        if (!(fl & O_NONBLOCK)) { fcntl(fd, F_SETFL, fl | O_NONBLOCK); }
+#if HAVE_SYSCALL && HAVE_DECL_SYS_ACCEPT
+        r = (int)syscall(SYS_accept, fd, address, address_len);
+#else
+        r = accept(fd, address, address_len);
+#endif
+        err = qt_io_errno();
+        if (!(fl & O_NONBLOCK)) { fcntl(fd, F_SETFL, fl); }
+        QTHREAD_UNLOCK(&e->lock);
+        if ((r < 0) && ((err == EAGAIN) || (err == EWOULDBLOCK)) && !(fl & O_NONBLOCK)) {
+            if (qt_io_epoll_wait(fd, EPOLLIN) < 0) { return 0; }
+            continue;
+        }
+        if ((r < 0) && (err == EINTR)) { continue; }
+        *ret = r;
+        if (r < 0) { qt_io_set_errno(err); }
+        return 1;
+    }
+} /*}}}*/
+
+int INTERNAL qt_io_epoll_connect(int                    fd,
+                                 const struct sockaddr *address,
+                                 socklen_t              address_len,
+                                 int                   *ret)
+{   /*{{{*/
+    qt_io_fd_t *e;
+    int         r, err, fl;
+    socklen_t   len = sizeof(err);
+
+    if (!qt_io_epoll_usable(fd)) { return 0; }
+    e = qt_io_epoll_fd(fd);
+    QTHREAD_LOCK(&e->lock);
+    if ((fl = fcntl(fd, F_GETFL)) < 0) {
+        QTHREAD_UNLOCK(&e->lock);
+        return 0;
+    }
+    if (!(fl & O_NONBLOCK)) { fcntl(fd, F_SETFL, fl | O_NONBLOCK); }
+#if HAVE_SYSCALL && HAVE_DECL_SYS_CONNECT
+    r = (int)syscall(SYS_connect, fd, address, address_len);
+#else
+    r = connect(fd, address, address_len);
+#endif
+    err = qt_io_errno();
+    if (!(fl & O_NONBLOCK)) { fcntl(fd, F_SETFL, fl); }
+    QTHREAD_UNLOCK(&e->lock);
+    if ((r < 0) && (err == EINPROGRESS) && !(fl & O_NONBLOCK)) {
+        if (qt_io_epoll_wait(fd, EPOLLOUT) < 0) {
+            err = qt_io_errno();
+        } else if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0) {
+            err = qt_io_errno();
+        }
+        r = (err == 0) ? 0 : -1;
+    }
+    *ret = r;
+    if (r < 0) { qt_io_set_errno(err); }
+    return 1;
+} /*}}}*/
+
+/* vim:set expandtab: */
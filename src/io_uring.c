@@ -0,0 +1,360 @@
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+/* System Headers */
+#include <string.h>                    /* for memset() */
+#include <errno.h>
+#include <unistd.h>                    /* for syscall() and close() */
+#include <fcntl.h>                     /* for fcntl() */
+#include <sys/syscall.h>               /* for __NR_io_uring_* */
+#include <sys/mman.h>                  /* for mmap() */
+#include <linux/io_uring.h>
+
+/* Internal Headers */
+#include "qt_io.h"
+#include "qt_io_uring.h"
+#include "qt_atomics.h"
+#include "qt_asserts.h"
+#include "qt_debug.h"
+#include "qt_envariables.h"
+#include "qt_alloc.h"
+#include "qt_output_macros.h"
+#include "qthread_innards.h"           /* for qlib */
+#include "qt_shepherd_innards.h"       /* for qthread_internal_getshep() */
+
+typedef struct {
+    int                  fd;           /* -1 if this shepherd has no ring */
+    /* submission queue; submitters hold submit_lock */
+    volatile unsigned   *sq_head;
+    volatile unsigned   *sq_tail;
+    unsigned            *sq_array;
+    unsigned             sq_mask;
+    struct io_uring_sqe *sqes;
+    /* completion queue; reapers hold reaping */
+    volatile unsigned   *cq_head;
+    volatile unsigned   *cq_tail;
+    unsigned             cq_mask;
+    unsigned             cq_entries;
+    struct io_uring_cqe *cqes;
+
+    void                *sq_map;
+    size_t               sq_map_bytes;
+    void                *cq_map;       /* may be sq_map */
+    size_t               cq_map_bytes;
+    size_t               sqes_bytes;
+
+    aligned_t            inflight;     /* submitted and not yet reaped */
+    aligned_t            reaping;
+    QTHREAD_FASTLOCK_TYPE submit_lock;
+} qt_io_ring_t;
+
+aligned_t           qt_io_inflight = 0;
+static qt_io_ring_t *rings         = NULL;
+static unsigned int  nrings        = 0;
+static int           rw_cur_pos    = 0;      /* READ and WRITE can use the file position */
+static uint8_t       supported[IORING_OP_LAST];
+
+static int qt_io_uring_setup(unsigned int            entries,
+                             struct io_uring_params *p)
+{   /*{{{*/
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+} /*}}}*/
+
+static int qt_io_uring_enter(int          fd,
+                             unsigned int to_submit,
+                             unsigned int min_complete,
+                             unsigned int flags)
+{   /*{{{*/
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+} /*}}}*/
+
+static void qt_io_uring_internal_destroy(qt_io_ring_t *ring)
+{   /*{{{*/
+    if (ring->sqes) { munmap(ring->sqes, ring->sqes_bytes); }
+    if (ring->cq_map && (ring->cq_map != ring->sq_map)) { munmap(ring->cq_map, ring->cq_map_bytes); }
+    if (ring->sq_map) { munmap(ring->sq_map, ring->sq_map_bytes); }
+    if (ring->fd >= 0) {
+        close(ring->fd);
+        QTHREAD_FASTLOCK_DESTROY(ring->submit_lock);
+    }
+    memset(ring, 0, sizeof(qt_io_ring_t));
+    ring->fd = -1;
+} /*}}}*/
+
+/* returns 0 on success, or an errno value */
+static int qt_io_uring_internal_create(qt_io_ring_t *ring,
+                                       unsigned int  entries)
+{   /*{{{*/
+    struct io_uring_params p;
+    uint8_t               *sq, *cq;
+
+    memset(ring, 0, sizeof(qt_io_ring_t));
+    memset(&p, 0, sizeof(p));
+    ring->fd = qt_io_uring_setup(entries, &p);
+    if (ring->fd < 0) {
+        ring->fd = -1;
+        return errno;
+    }
+    QTHREAD_FASTLOCK_INIT(ring->submit_lock);
+    ring->sq_map_bytes = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ring->cq_map_bytes = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_map_bytes > ring->sq_map_bytes) { ring->sq_map_bytes = ring->cq_map_bytes; }
+        ring->cq_map_bytes = ring->sq_map_bytes;
+    }
+    ring->sq_map = mmap(NULL, ring->sq_map_bytes, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_map == MAP_FAILED) { ring->sq_map = NULL; goto fail; }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_map = ring->sq_map;
+    } else {
+        ring->cq_map = mmap(NULL, ring->cq_map_bytes, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_map == MAP_FAILED) { ring->cq_map = NULL; goto fail; }
+    }
+    ring->sqes_bytes = p.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes       = mmap(NULL, ring->sqes_bytes, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) { ring->sqes = NULL; goto fail; }
+
+    sq               = ring->sq_map;
+    cq               = ring->cq_map;
+    ring->sq_head    = (volatile unsigned *)(sq + p.sq_off.head);
+    ring->sq_tail    = (volatile unsigned *)(sq + p.sq_off.tail);
+    ring->sq_mask    = *(unsigned *)(sq + p.sq_off.ring_mask);
+    ring->sq_array   = (unsigned *)(sq + p.sq_off.array);
+    ring->cq_head    = (volatile unsigned *)(cq + p.cq_off.head);
+    ring->cq_tail    = (volatile unsigned *)(cq + p.cq_off.tail);
+    ring->cq_mask    = *(unsigned *)(cq + p.cq_off.ring_mask);
+    ring->cq_entries = p.cq_entries;
+    ring->cqes       = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    rw_cur_pos       = (p.features & IORING_FEAT_RW_CUR_POS) != 0;
+    return 0;
+
+fail:
+    {
+        const int err = errno;
+
+        qt_io_uring_internal_destroy(ring);
+        return err;
+    }
+} /*}}}*/
+
+/* which of our operations the kernel has */
+static void qt_io_uring_internal_probe(int fd)
+{   /*{{{*/
+    const size_t           bytes = sizeof(struct io_uring_probe) + IORING_OP_LAST * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = MALLOC(bytes);
+    unsigned int           i;
+
+    memset(supported, 0, sizeof(supported));
+    if (probe == NULL) { return; }
+    memset(probe, 0, bytes);
+    if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, IORING_OP_LAST) == 0) {
+        for (i = 0; (i < probe->ops_len) && (i < IORING_OP_LAST); i++) {
+            supported[i] = (probe->ops[i].flags & IO_URING_OP_SUPPORTED) != 0;
+        }
+    }
+    FREE(probe, bytes);
+} /*}}}*/
+
+void INTERNAL qt_io_uring_init(void)
+{   /*{{{*/
+    unsigned int entries;
+    unsigned int i;
+    int          err;
+
+    rings          = NULL;
+    nrings         = 0;
+    qt_io_inflight = 0;
+    if (!qt_internal_get_env_bool("IO_URING", 1)) { return; }
+    entries = qt_internal_get_env_num("IO_URING_ENTRIES", 256, 1);
+    rings   = qt_calloc(qlib->nshepherds, sizeof(qt_io_ring_t));
+    assert(rings);
+    for (i = 0; i < qlib->nshepherds; i++) {
+        if ((err = qt_io_uring_internal_create(&rings[i], entries)) != 0) {
+            if (i == 0) {
+                qthread_debug(IO_BEHAVIOR, "io_uring unavailable (%s); using proxy threads\n", strerror(err));
+            } else {
+                print_warning("io_uring_setup() for shepherd %u failed (%s); its calls go to proxy threads\n",
+                              i, strerror(err));
+            }
+            rings[i].fd = -1;
+            if (i == 0) {
+                qt_free(rings);
+                rings = NULL;
+                return;
+            }
+        }
+    }
+    nrings = qlib->nshepherds;
+    qt_io_uring_internal_probe(rings[0].fd);
+} /*}}}*/
+
+void INTERNAL qt_io_uring_finalize(void)
+{   /*{{{*/
+    unsigned int i;
+
+    for (i = 0; i < nrings; i++) {
+        qt_io_uring_internal_destroy(&rings[i]);
+    }
+    if (rings) {
+        qt_free(rings);
+    }
+    rings          = NULL;
+    nrings         = 0;
+    qt_io_inflight = 0;
+} /*}}}*/
+
+static int qt_io_uring_internal_reap(qt_io_ring_t *ring)
+{   /*{{{*/
+    unsigned head, tail;
+    int      n = 0;
+
+    if (qthread_cas(&ring->reaping, 0, 1) != 0) { return 0; }
+    head = *ring->cq_head;
+    tail = *ring->cq_tail;
+    MACHINE_FENCE;                     /* read the entries after the tail */
+    while (head != tail) {
+        const struct io_uring_cqe *cqe = &ring->cqes[head & ring->cq_mask];
+        qt_blocking_queue_node_t  *job = (qt_blocking_queue_node_t *)(uintptr_t)cqe->user_data;
+
+        if (cqe->res < 0) {
+            job->ret = -1;
+            job->err = -cqe->res;
+        } else {
+            job->ret = cqe->res;
+            job->err = 0;
+        }
+        head++;
+        n++;
+        qt_blocking_subsystem_complete(job);
+    }
+    if (n > 0) {
+        MACHINE_FENCE;                 /* done with the entries before handing them back */
+        *ring->cq_head = head;
+        qthread_incr(&ring->inflight, -n);
+        qthread_incr(&qt_io_inflight, -n);
+    }
+    ring->reaping = 0;
+    return n;
+} /*}}}*/
+
+int INTERNAL qt_io_uring_poll(void)
+{   /*{{{*/
+    unsigned int i;
+    int          n = 0;
+
+    for (i = 0; i < nrings; i++) {
+        if (rings[i].inflight != 0) {
+            n += qt_io_uring_internal_reap(&rings[i]);
+        }
+    }
+    return n;
+} /*}}}*/
+
+/* Called by a worker after the job's task has switched out, so that the
+ * task cannot be woken before it has stopped running. */
+int INTERNAL qt_io_uring_submit(qt_blocking_queue_node_t *job)
+{   /*{{{*/
+    qthread_shepherd_t  *shep = qthread_internal_getshep();
+    qt_io_ring_t        *ring;
+    struct io_uring_sqe *sqe;
+    unsigned             tail, idx;
+    int                  fd, ret;
+    off_t                offset;
+
+    if ((shep == NULL) || (shep->shepherd_id >= nrings)) { return 0; }
+    ring = &rings[shep->shepherd_id];
+    if (ring->fd < 0) { return 0; }
+    switch (job->op) {
+        case READ:
+        case WRITE:
+            if (!rw_cur_pos) { return 0; }
+        /* fall through */
+        case PREAD:
+        case PWRITE:
+            if (!supported[(job->op == READ || job->op == PREAD) ? IORING_OP_READ : IORING_OP_WRITE]) { return 0; }
+            break;
+        case ACCEPT:
+            if (!supported[IORING_OP_ACCEPT]) { return 0; }
+            break;
+        case CONNECT:
+            if (!supported[IORING_OP_CONNECT]) { return 0; }
+            break;
+        default:
+            return 0;
+    }
+    memcpy(&fd, &job->args[0], sizeof(int));
+    if ((job->op != PREAD) && (job->op != PWRITE)) {
+        /* the kernel waits for a socket to be ready even when the program
+         * made it non-blocking, where the system call would fail with
+         * EAGAIN; leave those to the proxies, which make the call */
+        const int fl = fcntl(fd, F_GETFL);
+
+        if ((fl < 0) || (fl & O_NONBLOCK)) { return 0; }
+    }
+    if (ring->inflight >= ring->cq_entries) {
+        /* never more in flight than the completion queue holds */
+        qt_io_uring_internal_reap(ring);
+        if (ring->inflight >= ring->cq_entries) { return 0; }
+    }
+
+    QTHREAD_FASTLOCK_LOCK(&ring->submit_lock);
+    tail = *ring->sq_tail;
+    idx  = tail & ring->sq_mask;
+    sqe  = &ring->sqes[idx];
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    sqe->fd        = fd;
+    sqe->user_data = (uint64_t)(uintptr_t)job;
+    switch (job->op) {
+        case READ:
+        case PREAD:
+        case WRITE:
+        case PWRITE:
+            sqe->opcode = (job->op == READ || job->op == PREAD) ? IORING_OP_READ : IORING_OP_WRITE;
+            sqe->addr   = (uint64_t)job->args[1];
+            sqe->len    = (uint32_t)job->args[2];
+            if ((job->op == PREAD) || (job->op == PWRITE)) {
+                memcpy(&offset, &job->args[3], sizeof(off_t));
+                sqe->off = (uint64_t)offset;
+            } else {
+                sqe->off = (uint64_t)-1; /* the file position, as read(2) and write(2) */
+            }
+            break;
+        case ACCEPT:
+            sqe->opcode = IORING_OP_ACCEPT;
+            sqe->addr   = (uint64_t)job->args[1];
+            sqe->off    = (uint64_t)job->args[2]; /* addr2: the socklen_t pointer */
+            break;
+        case CONNECT:
+            sqe->opcode = IORING_OP_CONNECT;
+            sqe->addr   = (uint64_t)job->args[1];
+            sqe->off    = (uint64_t)job->args[2]; /* the address length */
+            break;
+        default:
+            break;
+    }
+    ring->sq_array[idx] = idx;
+    qthread_incr(&ring->inflight, 1);
+    qthread_incr(&qt_io_inflight, 1);
+    MACHINE_FENCE;                     /* publish the entry before the tail */
+    *ring->sq_tail = tail + 1;
+    do {
+        ret = qt_io_uring_enter(ring->fd, 1, 0, 0);
+    } while ((ret < 0) && (errno == EINTR));
+    if ((ret < 1) && (*ring->sq_head == tail)) {
+        /* the kernel did not take it; take it back */
+        *ring->sq_tail = tail;
+        QTHREAD_FASTLOCK_UNLOCK(&ring->submit_lock);
+        qthread_incr(&ring->inflight, -1);
+        qthread_incr(&qt_io_inflight, -1);
+        qthread_debug(IO_BEHAVIOR, "io_uring_enter() failed (%s); job %p goes to a proxy\n", strerror(errno), job);
+        return 0;
+    }
+    QTHREAD_FASTLOCK_UNLOCK(&ring->submit_lock);
+    return 1;
+} /*}}}*/
+
+/* vim:set expandtab: */
@@ -11,9 +11,12 @@
 
 /* Internal Headers */
 #include "qt_asserts.h"
+#include "qt_atomics.h"
+#include "qt_expect.h"
 #include "qt_mpool.h"
 #include "qt_debug.h"
 #include "qt_subsystems.h"
+#include "qt_hazardptrs.h"
 
 /* The Internal API */
 #include "qt_hash.h"
@@ -24,13 +27,21 @@
  * paper "Split-Ordered Lists: Lock-Free Extensible Hash Tables", but has been
  * modified to support additional semantics.
  *
- * NOTE: I did not implement the Dynamic-Sized Array extension, because I don't
- * expect to support large numbers of entries in the table at the same time,
- * and I'm worried about state creep.
+ * The bucket array is the paper's two-level variant: a fixed directory of
+ * page-sized segments, each allocated the first time one of its buckets is
+ * initialized. A flat array capped every table at a page worth of buckets,
+ * which left the FEB tables with chains dozens of entries long once a few
+ * thousand addresses were live.
+ *
+ * Entries are reclaimed with Michael's hazard pointers: the traversal in
+ * qt_lf_list_find() protects prev and cur before it trusts them, and
+ * unlinked entries go through hazardous_release_node() rather than straight
+ * back to the pool. Freeing them on the spot let a concurrent reader follow
+ * a recycled entry into the wrong list.
  */
 
 #define MAX_LOAD     4
-//#define USE_HASHWORD 1
+#define MAX_SEGMENTS 1024
 
 /* internal types */
 typedef uint64_t lkey_t;
@@ -44,16 +55,18 @@ typedef uintptr_t marked_ptr_t;
 #define UNINITIALIZED ((marked_ptr_t)0)
 
 size_t   hard_max_buckets = 0;
+size_t   segment_size     = 0;
 qt_mpool hash_entry_pool  = NULL;
 
 typedef struct hash_entry_s {
     so_key_t     key;
     void        *value;
     marked_ptr_t next;
+    qt_key_t     ukey; /* the caller's key, for qt_hash_callback() */
 } hash_entry;
 
 struct qt_hash_s {
-    marked_ptr_t   *B;  // Buckets
+    marked_ptr_t *volatile *S; // Segments of buckets
     volatile size_t count;
     volatile size_t size;
 };
@@ -66,6 +79,37 @@ struct qt_hash_s {
 # define FREE_HASH_ENTRY(t) FREE(t, sizeof(hash_entry))
 #endif /* ifndef UNPOOLED */
 
+static void hash_entry_retire(void *e)
+{   /*{{{*/
+    FREE_HASH_ENTRY((hash_entry *)e);
+} /*}}}*/
+
+/* the fence orders publishing the hazard before re-reading the link */
+#define PROTECT(which, ptr) do {                   \
+        hazardous_ptr((which), (ptr));             \
+        MACHINE_FENCE;                             \
+} while (0)
+
+static marked_ptr_t *BUCKET(qt_hash h,
+                            size_t  bucket)
+{   /*{{{*/
+    const size_t  seg = bucket / segment_size;
+    marked_ptr_t *s   = h->S[seg];
+
+    if (QTHREAD_UNLIKELY(s == NULL)) {
+        marked_ptr_t *fresh = qt_calloc(segment_size, sizeof(marked_ptr_t));
+
+        assert(fresh);
+        s = qthread_cas_ptr((void **)&h->S[seg], NULL, fresh);
+        if (s == NULL) {
+            s = fresh;
+        } else {
+            FREE(fresh, segment_size * sizeof(marked_ptr_t));
+        }
+    }
+    return &s[bucket % segment_size];
+} /*}}}*/
+
 /* prototypes */
 static void *qt_lf_list_find(marked_ptr_t  *head,
                              so_key_t       key,
@@ -94,11 +138,23 @@ static void initialize_bucket(qt_hash h,
                      (REVERSE_BYTE((((so_key_t)(x)) >> 56) & 0xff) << 0))
 #endif /* if 0 */
 
-#ifdef USE_HASHWORD
-# define HASH_KEY(key) key = (qt_hash64(key) & (~MSB))
-#else /* ifdef USE_HASHWORD */
-# define HASH_KEY(key) key &= (~MSB)
-#endif /* ifdef USE_HASHWORD */
+/* Buckets are picked by the low bits of the key, but the keys are aligned
+ * addresses and the callers have already striped them across tables by some
+ * of those same bits, so the raw key would crowd a handful of buckets. This
+ * scrambles the bits and, unlike qt_hash64(), is a bijection on 63-bit keys,
+ * which the split ordering needs to tell keys apart. */
+static inline lkey_t qt_lf_mix_key(lkey_t k)
+{   /*{{{*/
+    k &= ~MSB;
+    k ^= k >> 31;
+    k  = (k * 0x7fb5d329728ea185ULL) & ~MSB;
+    k ^= k >> 27;
+    k  = (k * 0x81dadef4bc2dd44dULL) & ~MSB;
+    k ^= k >> 33;
+    return k;
+} /*}}}*/
+
+#define HASH_KEY(key) key = qt_lf_mix_key(key)
 
 static int qt_lf_list_insert(marked_ptr_t *head,
                              hash_entry   *node,
@@ -133,7 +189,7 @@ static int qt_lf_list_delete(marked_ptr_t *head,
         if (qt_lf_list_find(head, key, &lprev, &lcur, &lnext) == NULL) { return 0; }
         if (qthread_cas_ptr(&PTR_OF(lcur)->next, CONSTRUCT(0, lnext), CONSTRUCT(1, lnext)) != (void *)CONSTRUCT(0, lnext)) { continue; }
         if (qthread_cas(lprev, CONSTRUCT(0, lcur), CONSTRUCT(0, lnext)) == CONSTRUCT(0, lcur)) {
-            FREE_HASH_ENTRY(PTR_OF(lcur));
+            hazardous_release_node(hash_entry_retire, PTR_OF(lcur));
         } else {
             qt_lf_list_find(head, key, NULL, NULL, NULL);                       // needs to set cur/prev/next
         }
@@ -155,7 +211,7 @@ static void *qt_lf_list_find(marked_ptr_t  *head,
 
     while (1) {
         prev = head;
-        cur  = *prev;
+        cur  = *(volatile marked_ptr_t *)prev;
         while (1) {
             if (PTR_OF(cur) == NULL) {
                 if (oprev) { *oprev = prev; }
@@ -163,10 +219,14 @@ static void *qt_lf_list_find(marked_ptr_t  *head,
                 if (onext) { *onext = next; }
                 return 0;
             }
-            next = PTR_OF(cur)->next;
+            PROTECT(HAZARD_PTR_LF_CUR, PTR_OF(cur));
+            if (*(volatile marked_ptr_t *)prev != CONSTRUCT(0, cur)) {
+                break; // cur may have been unlinked before we protected it
+            }
+            next = ((volatile hash_entry *)PTR_OF(cur))->next;
             ckey = PTR_OF(cur)->key;
             cval = PTR_OF(cur)->value;
-            if (*prev != CONSTRUCT(0, cur)) {
+            if (*(volatile marked_ptr_t *)prev != CONSTRUCT(0, cur)) {
                 break; // this means someone mucked with the list; start over
             }
             if (!MARK_OF(next)) {  // if next pointer is not marked
@@ -178,13 +238,16 @@ static void *qt_lf_list_find(marked_ptr_t  *head,
                 }
                 // but if current key < key, the we don't know yet, keep looking
                 prev = &(PTR_OF(cur)->next);
+                hazardous_ptr(HAZARD_PTR_LF_PREV, PTR_OF(cur));
             } else {
                 if (qthread_cas(prev, CONSTRUCT(0, cur), CONSTRUCT(0, next)) == CONSTRUCT(0, cur)) {
-                    FREE_HASH_ENTRY(PTR_OF(cur));
+                    hazardous_release_node(hash_entry_retire, PTR_OF(cur));
                 } else {
                     break;
                 }
             }
+            /* next is not protected yet; the check at the top of the loop,
+             * against a prev that is, covers it */
             cur = next;
         }
     }
@@ -220,6 +283,7 @@ void INTERNAL qt_hash_initialize_subsystem(void)
 #ifndef UNPOOLED
     hash_entry_pool = qt_mpool_create(sizeof(hash_entry));
     assert(hash_entry_pool != NULL);
+    qt_mpool_set_name(hash_entry_pool, "hash entries");
     qthread_internal_cleanup_late(qt_hash_subsystem_shutdown);
 #endif
 }
@@ -240,11 +304,12 @@ int INTERNAL qt_hash_put(qt_hash  h,
     node->key   = so_regularkey(lkey);
     node->value = value;
     node->next  = UNINITIALIZED;
+    node->ukey  = key;
 
-    if (h->B[bucket] == UNINITIALIZED) {
+    if (*BUCKET(h, bucket) == UNINITIALIZED) {
         initialize_bucket(h, bucket);
     }
-    if (!qt_lf_list_insert(&(h->B[bucket]), node, NULL)) {
+    if (!qt_lf_list_insert(BUCKET(h, bucket), node, NULL)) {
         FREE_HASH_ENTRY(node);
         return 0;
     }
@@ -266,13 +331,13 @@ void INTERNAL *qt_hash_get(qt_hash        h,
     HASH_KEY(lkey);
     bucket = lkey % h->size;
 
-    if (h->B[bucket] == UNINITIALIZED) {
+    if (*BUCKET(h, bucket) == UNINITIALIZED) {
         // You'd think returning NULL at this point would be a good idea; but
         // if we do that, we risk losing key/value pairs (incorrectly reporting
         // them as absent) when the hash table resizes
         initialize_bucket(h, bucket);
     }
-    return qt_lf_list_find(&(h->B[bucket]), so_regularkey(lkey), NULL, NULL, NULL);
+    return qt_lf_list_find(BUCKET(h, bucket), so_regularkey(lkey), NULL, NULL, NULL);
 }
 
 int INTERNAL qt_hash_remove(qt_hash        h,
@@ -284,10 +349,10 @@ int INTERNAL qt_hash_remove(qt_hash        h,
     HASH_KEY(lkey);
     bucket = lkey % h->size;
 
-    if (h->B[bucket] == UNINITIALIZED) {
+    if (*BUCKET(h, bucket) == UNINITIALIZED) {
         initialize_bucket(h, bucket);
     }
-    if (!qt_lf_list_delete(&(h->B[bucket]), so_regularkey(lkey))) {
+    if (!qt_lf_list_delete(BUCKET(h, bucket), so_regularkey(lkey))) {
         return 0;
     }
     qthread_incr(&h->count, -1);
@@ -313,7 +378,7 @@ static void initialize_bucket(qt_hash h,
     size_t       parent = GET_PARENT(bucket);
     marked_ptr_t cur;
 
-    if (h->B[parent] == UNINITIALIZED) {
+    if (*BUCKET(h, parent) == UNINITIALIZED) {
         initialize_bucket(h, parent);
     }
     hash_entry *dummy = ALLOC_HASH_ENTRY();
@@ -321,12 +386,15 @@ static void initialize_bucket(qt_hash h,
     dummy->key   = so_dummykey((lkey_t)bucket);
     dummy->value = NULL;
     dummy->next  = UNINITIALIZED;
-    if (!qt_lf_list_insert(&(h->B[parent]), dummy, &cur)) {
+    dummy->ukey  = NULL;
+    if (!qt_lf_list_insert(BUCKET(h, parent), dummy, &cur)) {
         FREE_HASH_ENTRY(dummy);
         dummy = PTR_OF(cur);
-        while (h->B[bucket] != CONSTRUCT(0, dummy)) ;
+        while (*(volatile marked_ptr_t *)BUCKET(h, bucket) != CONSTRUCT(0, dummy)) {
+            SPINLOCK_BODY();
+        }
     } else {
-        h->B[bucket] = CONSTRUCT(0, dummy);
+        *BUCKET(h, bucket) = CONSTRUCT(0, dummy);
     }
 }
 
@@ -336,36 +404,47 @@ qt_hash INTERNAL qt_hash_create(int needSync)
 
     assert(tmp);
     if (hard_max_buckets == 0) {
-        hard_max_buckets = getpagesize() / sizeof(marked_ptr_t);
+        segment_size     = getpagesize() / sizeof(marked_ptr_t);
+        hard_max_buckets = segment_size * MAX_SEGMENTS;
     }
-    tmp->B = qt_calloc(hard_max_buckets, sizeof(marked_ptr_t));
-    assert(tmp->B);
+    tmp->S = qt_calloc(MAX_SEGMENTS, sizeof(marked_ptr_t *));
+    assert(tmp->S);
     tmp->size  = 2;
     tmp->count = 0;
     {
         hash_entry *dummy = ALLOC_HASH_ENTRY();
         assert(dummy);
         memset(dummy, 0, sizeof(hash_entry));
-        tmp->B[0] = CONSTRUCT(0, dummy);
+        *BUCKET(tmp, 0) = CONSTRUCT(0, dummy);
     }
     return tmp;
 }
 
+static void qt_hash_free_segments(qt_hash h)
+{   /*{{{*/
+    for (size_t i = 0; i < MAX_SEGMENTS; i++) {
+        if (h->S[i]) {
+            FREE(h->S[i], segment_size * sizeof(marked_ptr_t));
+        }
+    }
+    FREE((void *)h->S, MAX_SEGMENTS * sizeof(marked_ptr_t *));
+    FREE(h, sizeof(struct qt_hash_s));
+} /*}}}*/
+
 void INTERNAL qt_hash_destroy(qt_hash h)
 {
     marked_ptr_t cursor;
 
     assert(h);
-    assert(h->B);
-    cursor = h->B[0];
+    assert(h->S);
+    cursor = *BUCKET(h, 0);
     while (PTR_OF(cursor) != NULL) {
         hash_entry *tmp = PTR_OF(cursor);
         assert(MARK_OF(cursor) == 0);
         cursor = PTR_OF(cursor)->next;
         FREE_HASH_ENTRY(tmp);
     }
-    FREE(h->B, hard_max_buckets * sizeof(marked_ptr_t));
-    FREE(h, sizeof(struct qt_hash_s));
+    qt_hash_free_segments(h);
 }
 
 void INTERNAL qt_hash_destroy_deallocate(qt_hash                h,
@@ -374,8 +453,8 @@ void INTERNAL qt_hash_destroy_deallocate(qt_hash                h,
     marked_ptr_t cursor;
 
     assert(h);
-    assert(h->B);
-    cursor = h->B[0];
+    assert(h->S);
+    cursor = *BUCKET(h, 0);
     while (PTR_OF(cursor) != NULL) {
         hash_entry *he = PTR_OF(cursor);
         assert(MARK_OF(cursor) == 0);
@@ -385,14 +464,13 @@ void INTERNAL qt_hash_destroy_deallocate(qt_hash                h,
         cursor = he->next;
         FREE_HASH_ENTRY(he);
     }
-    FREE(h->B, hard_max_buckets * sizeof(marked_ptr_t));
-    FREE(h, sizeof(struct qt_hash_s));
+    qt_hash_free_segments(h);
 }
 
 size_t INTERNAL qt_hash_count(qt_hash h)
 {
     assert(h);
-    return h->size;
+    return h->count;
 }
 
 void INTERNAL qt_hash_callback(qt_hash             h,
@@ -402,12 +480,12 @@ void INTERNAL qt_hash_callback(qt_hash             h,
     marked_ptr_t cursor;
 
     assert(h);
-    assert(h->B);
-    cursor = h->B[0];
+    assert(h->S);
+    cursor = *BUCKET(h, 0);
     while (PTR_OF(cursor) != NULL) {
         so_key_t key = PTR_OF(cursor)->key;
         if (MARK_OF(key)) {
-            f((qt_key_t)(uintptr_t)REVERSE(key ^ 1), PTR_OF(cursor)->value, arg);
+            f(PTR_OF(cursor)->ukey, PTR_OF(cursor)->value, arg);
         } else {
             // f((qt_key_t)REVERSE(key), PTR_OF(cursor)->value, (void *)1);
         }
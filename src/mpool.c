@@ -6,8 +6,14 @@
 #include <pthread.h>
 
 #include <stddef.h>                    /* for size_t (according to C89) */
+#include <stdio.h>                     /* for snprintf() */
 #include <stdlib.h>                    /* for calloc() and malloc() */
 #include <string.h>
+#include <signal.h>                    /* for sigaction() */
+#include <unistd.h>                    /* for write() */
+#if (defined(HAVE_MMAP) && defined(HAVE_MUNMAP)) || defined(HAVE_MADVISE)
+# include <sys/mman.h>                 /* for mmap() and madvise() */
+#endif
 
 /* External Headers */
 #ifdef QTHREAD_USE_VALGRIND
@@ -34,33 +40,68 @@
 #include "qt_macros.h"
 #include "qt_visibility.h"
 #include "qt_alloc.h"
-#include "qt_subsystems.h"
+#include "qthread_innards.h"           /* for qlib */
+#include "qt_shepherd_innards.h"       /* for qthread_internal_getworker() */
+#include "qt_subsystems.h"             /* for qthread_internal_cleanup() */
+#include "qt_parking.h"                /* for QT_PARK_NOTIFY_ALL() */
+#include "qthread/qtimer.h"            /* for qtimer_wtime() */
 
-/* Seems SLIGHTLY faster without TLS, and a whole lot safer and cleaner */
-#ifdef TLS
-# undef TLS
-#endif
+/* Items move between a thread's cache and the pool's reuse_pool in
+ * magazines of (at most) this many, and a cache holds at most two of them. */
+#define QT_MPOOL_MAGAZINE 64
 
-typedef struct threadlocal_cache_s qt_mpool_threadlocal_cache_t;
+/* With QT_HUGEPAGES, the chunks of pools whose items need no more than
+ * sub-page alignment (pools with page-aligned items protect guard pages in
+ * them) are carved, one after another, out of huge-page regions shared by
+ * all such pools, so that small pools share a huge page rather than each
+ * taking one. A region is mmap()'d with MAP_HUGETLB if the system has
+ * explicit huge pages to spare; otherwise it is aligned to a huge page and
+ * madvise(MADV_HUGEPAGE)'d for transparent huge pages. A chunk bigger than
+ * a huge page gets a region of its own. Chunks of a destroyed pool are kept
+ * for the next pool that needs a chunk of the same size; the regions go
+ * back to the OS when the last such pool is destroyed. */
+#define QT_HUGEPAGE_SIZE (2 * 1024 * 1024)
 
-#ifdef TLS
-static TLS_DECL_INIT(qt_mpool_threadlocal_cache_t *, pool_caches);
-static TLS_DECL_INIT(uintptr_t, pool_cache_count);
-static aligned_t                      pool_cache_global_max = 1;
-static qt_mpool_threadlocal_cache_t **pool_cache_array      = NULL;
+#if defined(HAVE_MMAP) && defined(HAVE_MUNMAP) && \
+    (defined(MAP_HUGETLB) || defined(MADV_HUGEPAGE))
+# define QT_MPOOL_HUGEPAGES
+# if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#  define MAP_ANONYMOUS MAP_ANON
+# endif
 #endif
 
+typedef struct threadlocal_cache_s qt_mpool_threadlocal_cache_t;
+typedef union worker_cache_u       qt_mpool_worker_cache_t;
+
+/* Every worker has a cache in every pool created after the workers were
+ * counted, found by indexing the pool's worker_caches with the worker's
+ * packed id rather than through a pthread key. Threads that are not workers
+ * (and pools created before qthread_initialize()) still get theirs from a
+ * pthread key. Either way a thread only ever touches its own cache, so an
+ * item freed on a different worker than the one that allocated it simply
+ * joins the freeing worker's cache; no atomics are needed until a whole
+ * magazine goes to or comes from reuse_pool, under reuse_lock. */
 struct qt_mpool_s {
     size_t item_size;
     size_t alloc_size;
     size_t items_per_alloc;
+    size_t magazine;
     size_t alignment;
+    int    huge;                       /* chunks come from the huge-page regions */
 
-#ifdef TLS
-    size_t                        offset;
-#else
+    /* for statistics (see qthread_pool_stats()) */
+    const char *name;
+    qt_mpool    next_pool;             /* in the list of pools, if on it */
+    int         listed;
+    size_t      chunks;                /* under pool_lock */
+    size_t      chunks_hwm;
+    size_t      live_hwm;
+    size_t      shared;                /* magazines in reuse_pool, under reuse_lock */
+    aligned_t   compacting;            /* one qt_mpool_internal_compact() at a time */
+
+    qt_mpool_worker_cache_t      *worker_caches;
+    size_t                        nworker_caches;
     pthread_key_t                 threadlocal_cache;
-#endif
     qt_mpool_threadlocal_cache_t *caches;  // for cleanup
 
     QTHREAD_FASTLOCK_TYPE         reuse_lock;
@@ -83,48 +124,248 @@ struct threadlocal_cache_s {
     uint8_t                      *block;
     uint_fast32_t                 i;
     qt_mpool_threadlocal_cache_t *next;  // for cleanup
+#ifdef POOL_PROFILE
+    size_t                        allocs;
+    size_t                        frees;
+#endif
 };
 
-#ifdef TLS
-static void qt_mpool_subsystem_shutdown(void)
-{
-    qthread_debug(MPOOL_FUNCTIONS, "deleting pool_caches\n");
-    TLS_DELETE(pool_caches);
-    TLS_DELETE(pool_cache_count);
-    for (int i = 0; i < qthread_readstate(TOTAL_WORKERS); ++i) {
-        if (pool_cache_array[i]) {
-            qt_free(pool_cache_array[i]);
-        }
+union worker_cache_u {
+    qt_mpool_threadlocal_cache_t c;
+    uint8_t                      pad[CACHELINE_WIDTH]; /* no false sharing between workers */
+};
+
+typedef struct qt_mpool_region_s {
+    void                     *base;
+    size_t                    bytes;
+    struct qt_mpool_region_s *next;
+} qt_mpool_region_t;
+
+typedef struct qt_mpool_spare_s {      /* a chunk left by a destroyed pool */
+    struct qt_mpool_spare_s *next;
+    size_t                   bytes;
+} qt_mpool_spare_t;
+
+static QTHREAD_FASTLOCK_TYPE huge_lock;
+static size_t                huge_pools   = 0; /* live pools with huge set */
+static qt_mpool_region_t    *huge_regions = NULL;
+static uint8_t              *huge_next    = NULL; /* the shared region's unused part */
+static uint8_t              *huge_end     = NULL;
+static qt_mpool_spare_t     *huge_spares  = NULL;
+static aligned_t             pool_bytes   = 0; /* in chunks, over all pools */
+static aligned_t             huge_bytes   = 0; /* in regions backed by huge pages */
+
+/* Pools created while the library is initialized are listed, in order of
+ * creation, for qthread_pool_stats(). The dump on QT_POOL_STATS_SIGNAL walks
+ * the list without list_lock, which the interrupted thread may hold. */
+static QTHREAD_FASTLOCK_TYPE list_lock;
+static qt_mpool              list_head   = NULL;
+static int                   dump_signal = 0;
+static struct sigaction      prev_dump_action;
+
+/* Compaction (see qt_mpool_internal_compact()) is asked for by bumping
+ * compact_gen: by qthread_pool_compact(), or by an idle worker once
+ * QT_POOL_COMPACT_INTERVAL has gone by or the pools have grown past
+ * QT_POOL_COMPACT_THRESHOLD. Each worker compacts every pool the next time
+ * it is idle, which is the only way to get at the items in its caches. */
+static aligned_t compact_gen       = 0;
+static double    compact_interval  = 0; /* in seconds; 0 for never */
+static size_t    compact_threshold = 0; /* in bytes of chunks; 0 for none */
+static double    compact_last      = 0; /* when the interval last ran out */
+static size_t    compact_after     = 0; /* pool_bytes after the last compaction */
+
+static void qt_mpool_internal_dump_handler(int sig)
+{                                      /*{{{ */
+    qthread_pool_stats_dump(2);
+}                                      /*}}} */
+
+static void qt_mpool_subsystem_finalize(void)
+{                                      /*{{{ */
+    if (dump_signal > 0) {
+        sigaction(dump_signal, &prev_dump_action, NULL);
+        dump_signal = 0;
     }
-    FREE(pool_cache_array, sizeof(void *) * qthread_readstate(TOTAL_WORKERS));
-}
-#endif /* ifdef TLS */
+}                                      /*}}} */
 
 void INTERNAL qt_mpool_subsystem_init(void)
-{
-#ifdef TLS
-    assert(TLS_GET(pool_caches) == NULL);
-    assert(TLS_GET(pool_cache_count) == 0);
-    pool_cache_array = qt_calloc(sizeof(void *),
-                                 qthread_readstate(TOTAL_WORKERS));
-    qthread_internal_cleanup_late(qt_mpool_subsystem_shutdown);
-#endif
-}
+{                                      /*{{{ */
+    if (huge_pools == 0) {
+        QTHREAD_FASTLOCK_INIT(huge_lock);
+    }
+    if (list_head == NULL) {
+        QTHREAD_FASTLOCK_INIT(list_lock);
+    }
+    compact_interval  = qt_internal_get_env_num("POOL_COMPACT_INTERVAL", 0, 0) / 1000.0;
+    compact_threshold = qt_internal_get_env_num("POOL_COMPACT_THRESHOLD", 0, 0);
+    compact_last      = qtimer_wtime();
+    compact_after     = 0;
+    dump_signal       = qt_internal_get_env_num("POOL_STATS_SIGNAL", 0, 0);
+    if (dump_signal > 0) {
+        struct sigaction sa;
+
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = qt_mpool_internal_dump_handler;
+        sa.sa_flags   = SA_RESTART;
+        sigemptyset(&sa.sa_mask);
+        if (sigaction(dump_signal, &sa, &prev_dump_action) != 0) {
+            perror("sigaction for QT_POOL_STATS_SIGNAL");
+            dump_signal = 0;
+        } else {
+            qthread_internal_cleanup(qt_mpool_subsystem_finalize);
+        }
+    }
+}                                      /*}}} */
+
+size_t INTERNAL qt_mpool_bytes(void)
+{                                      /*{{{ */
+    return pool_bytes;
+}                                      /*}}} */
+
+size_t INTERNAL qt_mpool_hugepage_bytes(void)
+{                                      /*{{{ */
+    return huge_bytes;
+}                                      /*}}} */
+
+#ifdef QT_MPOOL_HUGEPAGES
+/* must hold huge_lock */
+static qt_mpool_region_t *qt_mpool_internal_huge_map(size_t bytes)
+{                                      /*{{{ */
+    qt_mpool_region_t *r = MALLOC(sizeof(qt_mpool_region_t));
+    uint8_t           *base;
+    int                huge = 0;
+
+    if (r == NULL) { return NULL; }
+    bytes = (bytes + QT_HUGEPAGE_SIZE - 1) & ~(size_t)(QT_HUGEPAGE_SIZE - 1);
+    base  = MAP_FAILED;
+# ifdef MAP_HUGETLB
+    base = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    huge = (base != MAP_FAILED);
+# endif
+    if (base == MAP_FAILED) {
+        /* over-map, then trim to a huge-page boundary */
+        uint8_t *raw = mmap(NULL, bytes + QT_HUGEPAGE_SIZE, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        size_t   head;
+
+        if (raw == MAP_FAILED) {
+            FREE(r, sizeof(qt_mpool_region_t));
+            return NULL;
+        }
+        base = (uint8_t *)(((uintptr_t)raw + QT_HUGEPAGE_SIZE - 1) & ~(uintptr_t)(QT_HUGEPAGE_SIZE - 1));
+        head = base - raw;
+        if (head) { munmap(raw, head); }
+        munmap(base + bytes, QT_HUGEPAGE_SIZE - head);
+# ifdef MADV_HUGEPAGE
+        huge = (madvise(base, bytes, MADV_HUGEPAGE) == 0);
+# endif
+    }
+    qthread_debug(MPOOL_BEHAVIOR, "mapped %lu bytes at %p, %s\n", (unsigned long)bytes, base,
+                  huge ? "huge pages" : "base pages");
+    r->base      = base;
+    r->bytes     = bytes;
+    r->next      = huge_regions;
+    huge_regions = r;
+    if (huge) { qthread_incr(&huge_bytes, bytes); }
+    return r;
+}                                      /*}}} */
+
+static void *qt_mpool_internal_huge_alloc(size_t alloc_size)
+{                                      /*{{{ */
+    const size_t       bytes = (alloc_size + pagesize - 1) & ~(pagesize - 1);
+    qt_mpool_spare_t **s;
+    void              *ret = NULL;
+
+    QTHREAD_FASTLOCK_LOCK(&huge_lock);
+    for (s = &huge_spares; *s != NULL; s = &(*s)->next) {
+        if ((*s)->bytes == bytes) {
+            ret = *s;
+            *s  = (*s)->next;
+            break;
+        }
+    }
+    if (ret == NULL) {
+        if (bytes >= QT_HUGEPAGE_SIZE) {
+            qt_mpool_region_t *r = qt_mpool_internal_huge_map(bytes);
+
+            if (r) { ret = r->base; }
+        } else {
+            if ((size_t)(huge_end - huge_next) < bytes) {
+                /* what is left of the old region is lost to it */
+                qt_mpool_region_t *r = qt_mpool_internal_huge_map(QT_HUGEPAGE_SIZE);
+
+                if (r) {
+                    huge_next = r->base;
+                    huge_end  = huge_next + r->bytes;
+                }
+            }
+            if ((size_t)(huge_end - huge_next) >= bytes) {
+                ret        = huge_next;
+                huge_next += bytes;
+            }
+        }
+    }
+    QTHREAD_FASTLOCK_UNLOCK(&huge_lock);
+    return ret;
+}                                      /*}}} */
+
+#endif /* ifdef QT_MPOOL_HUGEPAGES */
 
 /* local funcs */
-static QINLINE void *qt_mpool_internal_aligned_alloc(size_t alloc_size,
-                                                     size_t alignment)
+static QINLINE void *qt_mpool_internal_aligned_alloc(qt_mpool pool)
 {                                      /*{{{ */
-    void *ret = qt_internal_aligned_alloc(alloc_size, alignment);
+    void *ret;
 
-    VALGRIND_MAKE_MEM_NOACCESS(ret, alloc_size);
+#ifdef QT_MPOOL_HUGEPAGES
+    if (pool->huge) {
+        ret = qt_mpool_internal_huge_alloc(pool->alloc_size);
+    } else
+#endif
+    ret = qt_internal_aligned_alloc(pool->alloc_size, pool->alignment);
+    if (ret) { qthread_incr(&pool_bytes, pool->alloc_size); }
+    VALGRIND_MAKE_MEM_NOACCESS(ret, pool->alloc_size);
     return ret;
 }                                      /*}}} */
 
-static QINLINE void qt_mpool_internal_aligned_free(void  *freeme,
-                                                   size_t alignment)
+static QINLINE void qt_mpool_internal_aligned_free(qt_mpool pool,
+                                                   void    *freeme)
+{                                      /*{{{ */
+    qthread_incr(&pool_bytes, -pool->alloc_size);
+#ifdef QT_MPOOL_HUGEPAGES
+    if (pool->huge) {
+        qt_mpool_spare_t *s = freeme;
+
+        VALGRIND_MAKE_MEM_UNDEFINED(s, sizeof(qt_mpool_spare_t));
+        s->bytes = (pool->alloc_size + pagesize - 1) & ~(pagesize - 1);
+        QTHREAD_FASTLOCK_LOCK(&huge_lock);
+        s->next     = huge_spares;
+        huge_spares = s;
+        QTHREAD_FASTLOCK_UNLOCK(&huge_lock);
+        return;
+    }
+#endif
+    qt_internal_aligned_free(freeme, pool->alignment);
+}                                      /*}}} */
+
+/* the last pool with huge set is gone; give the regions back */
+static void qt_mpool_internal_huge_release(void)
 {                                      /*{{{ */
-    qt_internal_aligned_free(freeme, alignment);
+#ifdef QT_MPOOL_HUGEPAGES
+    QTHREAD_FASTLOCK_LOCK(&huge_lock);
+    if (--huge_pools == 0) {
+        while (huge_regions) {
+            qt_mpool_region_t *r = huge_regions;
+
+            huge_regions = r->next;
+            munmap(r->base, r->bytes);
+            FREE(r, sizeof(qt_mpool_region_t));
+        }
+        huge_next   = huge_end = NULL;
+        huge_spares = NULL;
+        huge_bytes  = 0;
+    }
+    QTHREAD_FASTLOCK_UNLOCK(&huge_lock);
+#endif
 }                                      /*}}} */
 
 // sync means lock-protected
@@ -201,15 +442,40 @@ qt_mpool INTERNAL qt_mpool_create_aligned(size_t item_size,
         }
     }
     pool->alloc_size      = alloc_size;
+    pool->huge            = 0;
+#ifdef QT_MPOOL_HUGEPAGES
+    if ((qlib != NULL) && qlib->hugepages && (alignment < pagesize)) {
+        pool->huge = 1;
+        QTHREAD_FASTLOCK_LOCK(&huge_lock);
+        huge_pools++;
+        QTHREAD_FASTLOCK_UNLOCK(&huge_lock);
+    }
+#endif
     pool->items_per_alloc = alloc_size / item_size;
+    pool->name            = NULL;
+    pool->next_pool       = NULL;
+    pool->listed          = 0;
+    pool->chunks          = 0;
+    pool->chunks_hwm      = 0;
+    pool->live_hwm        = 0;
+    pool->shared          = 0;
+    pool->compacting      = 0;
+    pool->magazine        = (pool->items_per_alloc < QT_MPOOL_MAGAZINE) ? pool->items_per_alloc : QT_MPOOL_MAGAZINE;
     pool->reuse_pool      = NULL;
     QTHREAD_FASTLOCK_INIT(pool->reuse_lock);
     QTHREAD_FASTLOCK_INIT(pool->pool_lock);
-#ifdef TLS
-    pool->offset = qthread_incr(&pool_cache_global_max, 1);
-#else
     pthread_key_create(&pool->threadlocal_cache, NULL);
-#endif
+    pool->nworker_caches = 0;
+    pool->worker_caches  = NULL;
+    if (qlib != NULL) {
+        const size_t bytes = qlib->nshepherds * qlib->nworkerspershep * sizeof(qt_mpool_worker_cache_t);
+
+        assert(sizeof(qt_mpool_threadlocal_cache_t) <= CACHELINE_WIDTH);
+        pool->worker_caches = qt_internal_aligned_alloc(bytes, CACHELINE_WIDTH);
+        qassert_goto((pool->worker_caches != NULL), errexit);
+        memset(pool->worker_caches, 0, bytes);
+        pool->nworker_caches = qlib->nshepherds * qlib->nworkerspershep;
+    }
     /* this assumes that pagesize is a multiple of sizeof(void*) */
     assert(pagesize % sizeof(void *) == 0);
     pool->alloc_list = qt_internal_aligned_alloc(pagesize, pagesize);
@@ -218,81 +484,35 @@ qt_mpool INTERNAL qt_mpool_create_aligned(size_t item_size,
     pool->alloc_list_pos = 0;
 
     pool->caches = NULL;
+    if (qlib != NULL) {
+        qt_mpool *tail;
+
+        QTHREAD_FASTLOCK_LOCK(&list_lock);
+        for (tail = &list_head; *tail != NULL; tail = &(*tail)->next_pool) ;
+        *tail        = pool;
+        pool->listed = 1;
+        QTHREAD_FASTLOCK_UNLOCK(&list_lock);
+    }
     return pool;
 
     qgoto(errexit);
     if (pool) {
+        if (pool->huge) {
+            qt_mpool_internal_huge_release();
+        }
+        if (pool->worker_caches) {
+            qt_internal_aligned_free(pool->worker_caches, CACHELINE_WIDTH);
+        }
         FREE(pool, sizeof(struct qt_mpool_s));
     }
     return NULL;
 }                                      /*}}} */
 
-static qt_mpool_threadlocal_cache_t *qt_mpool_internal_getcache(qt_mpool pool)
+/* for threads that are not workers */
+static qt_mpool_threadlocal_cache_t *qt_mpool_internal_getcache_slow(qt_mpool pool)
 {
     qt_mpool_threadlocal_cache_t *tc;
 
-#ifdef TLS
-    tc = TLS_GET(pool_caches);
-    {
-        uintptr_t count_caches = (uintptr_t)TLS_GET(pool_cache_count);
-        qthread_debug(MPOOL_DETAILS, "-> count_caches = %i, pool->offset = %i\n", (int)count_caches, (int)pool->offset);
-        if (count_caches < pool->offset) {
-# if !defined(QTHREAD_NO_ASSERTS) || defined(QTHREAD_DEBUG)
-            qthread_worker_id_t wkr = qthread_readstate(CURRENT_UNIQUE_WORKER);
-            /* I don't fully understand why this is necessary. I *suspect* that
-             * on thread 0, the initialization routine isn't happening
-             * properly, so pool_caches gets a bogus value. However, that makes
-             * no sense to me. */
-            if ((wkr == 0) && (pool_cache_array[0] == NULL) && (tc != NULL)) {
-                qthread_debug(MPOOL_DETAILS, "%u -> resetting tc to NULL (was %p)\n", wkr, tc);
-                tc = NULL;
-            }
-# endif
-            ASSERT_ONLY(if (wkr != NO_WORKER) {
-                            assert(pool_cache_array[wkr] == tc);
-                        }
-                        )
-            qthread_debug(MPOOL_DETAILS, "%u -> realloc-ing the tc (%p)\n", wkr, tc);
-            qt_mpool_threadlocal_cache_t *newtc = qt_realloc(tc,
-                                                             sizeof(qt_mpool_threadlocal_cache_t) * pool->offset);
-            qthread_debug(MPOOL_DETAILS, "%u ->     new tc (%p)\n", wkr, newtc);
-            assert(newtc);
-            if (tc != newtc) {
-                qthread_worker_id_t wkr = qthread_readstate(CURRENT_UNIQUE_WORKER);
-                tc = newtc;
-                TLS_SET(pool_caches, newtc);
-                if (wkr != NO_WORKER) {
-                    pool_cache_array[wkr] = newtc;
-                    qthread_debug(MPOOL_DETAILS, "setting pool_cache_array[%u] -> %p\n", wkr, pool_cache_array[wkr]);
-                } else {
-                    qthread_debug(MPOOL_DETAILS, "leaking memory (%p)\n", newtc);
-                }
-            }
-            memset(tc + count_caches, 0, sizeof(qt_mpool_threadlocal_cache_t) * (pool->offset - count_caches));
-            count_caches = pool->offset;
-            TLS_SET(pool_cache_count, count_caches);
-        } else if (tc == NULL) {
-            qthread_debug(MPOOL_DETAILS, "tc was NULL despite count_caches being big enough!?! (%p)\n", tc);
-# if !defined(QTHREAD_NO_ASSERTS)
-            qthread_worker_id_t wkr = qthread_readstate(CURRENT_UNIQUE_WORKER);
-            /* I don't fully understand why this is necessary. I *suspect* that
-             * on thread 0, the initialization routine isn't happening
-             * properly, so pool_caches gets a bogus value. However, that makes
-             * no sense to me. */
-            if ((wkr == 0) && (pool_cache_array[0] == NULL) && (tc != NULL)) {
-                qthread_debug(MPOOL_DETAILS, "%u -> resetting tc to NULL (was %p)\n", wkr, tc);
-                tc = NULL;
-            }
-            if (wkr != NO_WORKER) {
-                qthread_debug(MPOOL_DETAILS, "pool_cache_array[%u] -> %p\n", wkr, pool_cache_array[wkr]);
-                assert(pool_cache_array[wkr] == tc);
-            }
-# endif
-        }
-    }
-    assert(tc);
-    tc += (pool->offset - 1);
-#else /* ifdef TLS */
     tc = pthread_getspecific(pool->threadlocal_cache);
     if (NULL == tc) {
         tc = qt_internal_aligned_alloc(sizeof(qt_mpool_threadlocal_cache_t), CACHELINE_WIDTH);
@@ -301,16 +521,66 @@ static qt_mpool_threadlocal_cache_t *qt_mpool_internal_getcache(qt_mpool pool)
         tc->count = 0;
         tc->block = NULL;
         tc->i     = 0;
+#ifdef POOL_PROFILE
+        tc->allocs = 0;
+        tc->frees  = 0;
+#endif
         do {
             tc->next = pool->caches;
         } while (qthread_cas_ptr(&pool->caches, tc->next, tc) != tc->next);
         qthread_debug(MPOOL_DETAILS, "added %p to caches\n", tc);
         pthread_setspecific(pool->threadlocal_cache, tc);
     }
-#endif /* ifdef TLS */
     return tc;
 }
 
+static QINLINE qt_mpool_threadlocal_cache_t *qt_mpool_internal_getcache(qt_mpool pool)
+{
+    qthread_worker_t *w = qthread_internal_getworker();
+
+    if (QTHREAD_LIKELY(w != NULL) && (w->packed_worker_id < pool->nworker_caches)) {
+        return &pool->worker_caches[w->packed_worker_id].c;
+    }
+    return qt_mpool_internal_getcache_slow(pool);
+}
+
+/* Free items in a cache: those on its list and those left in its block.
+ * Read without synchronization, so only approximate for other threads. */
+static QINLINE size_t qt_mpool_internal_cache_free(const qt_mpool                      pool,
+                                                   const qt_mpool_threadlocal_cache_t *tc)
+{   /*{{{*/
+    const uint_fast32_t i = tc->i;
+
+    return tc->count + ((tc->block != NULL && i < pool->items_per_alloc) ? pool->items_per_alloc - i : 0);
+} /*}}}*/
+
+/* free items in all of the pool's caches */
+static size_t qt_mpool_internal_cached(const qt_mpool pool)
+{   /*{{{*/
+    const qt_mpool_threadlocal_cache_t *tc;
+    size_t                              cached = 0;
+    size_t                              w;
+
+    for (w = 0; w < pool->nworker_caches; w++) {
+        cached += qt_mpool_internal_cache_free(pool, &pool->worker_caches[w].c);
+    }
+    for (tc = pool->caches; tc != NULL; tc = tc->next) {
+        cached += qt_mpool_internal_cache_free(pool, tc);
+    }
+    return cached;
+} /*}}}*/
+
+/* items handed out and not yet freed: everything carved out of chunks that
+ * is neither cached nor in reuse_pool */
+static size_t qt_mpool_internal_live(const qt_mpool pool,
+                                     size_t         cached)
+{   /*{{{*/
+    const size_t carved = pool->chunks * pool->items_per_alloc;
+    const size_t idle   = cached + pool->shared * pool->magazine;
+
+    return (carved > idle) ? carved - idle : 0;
+} /*}}}*/
+
 void INTERNAL *qt_mpool_alloc(qt_mpool pool)
 {   /*{{{*/
     qt_mpool_threadlocal_cache_t *tc;
@@ -320,6 +590,9 @@ void INTERNAL *qt_mpool_alloc(qt_mpool pool)
     qassert_ret((pool != NULL), NULL);
 
     tc = qt_mpool_internal_getcache(pool);
+#ifdef POOL_PROFILE
+    tc->allocs++;
+#endif
     qthread_debug(MPOOL_BEHAVIOR, "->tc:%p cache:%p (bt:%p) cnt:%u\n", tc, tc->cache, tc->cache ? tc->cache->block_tail : NULL, (unsigned int)tc->count);
     if (tc->cache) {
         qt_mpool_cache_t *cache = tc->cache;
@@ -337,8 +610,8 @@ void INTERNAL *qt_mpool_alloc(qt_mpool pool)
         ALLOC_SCRIBBLE(ret, pool->item_size);
         return ret;
     } else {
-        const size_t      items_per_alloc = pool->items_per_alloc;
-        qt_mpool_cache_t *cache           = NULL;
+        const size_t      magazine = pool->magazine;
+        qt_mpool_cache_t *cache    = NULL;
 
         cnt = 0;
         /* cache is empty; need to fill it */
@@ -349,7 +622,8 @@ void INTERNAL *qt_mpool_alloc(qt_mpool pool)
                 cache                   = pool->reuse_pool;
                 pool->reuse_pool        = cache->block_tail->next;
                 cache->block_tail->next = NULL;
-                cnt                     = items_per_alloc;
+                cnt                     = magazine;
+                pool->shared--;
             }
             QTHREAD_FASTLOCK_UNLOCK(&pool->reuse_lock);
         }
@@ -359,8 +633,7 @@ void INTERNAL *qt_mpool_alloc(qt_mpool pool)
 
             /* need to allocate a new block and record that I did so in the central pool */
             qthread_debug(MPOOL_BEHAVIOR, "->...allocating new block\n");
-            p = qt_mpool_internal_aligned_alloc(pool->alloc_size,
-                                                pool->alignment);
+            p = qt_mpool_internal_aligned_alloc(pool);
             qassert_ret((p != NULL), NULL);
             assert(pool->alignment == 0 ||
                    (((uintptr_t)p) & (pool->alignment - 1)) == 0);
@@ -375,10 +648,20 @@ void INTERNAL *qt_mpool_alloc(qt_mpool pool)
             }
             pool->alloc_list[pool->alloc_list_pos] = p;
             pool->alloc_list_pos++;
+            if (++pool->chunks > pool->chunks_hwm) {
+                pool->chunks_hwm = pool->chunks;
+            }
             QTHREAD_FASTLOCK_UNLOCK(&pool->pool_lock);
             /* store the block for later allocation */
             tc->block = p;
             tc->i     = 1;
+            {
+                /* the pool only grows when nearly everything is live, so
+                 * this is when to look for a new high-water mark */
+                const size_t live = qt_mpool_internal_live(pool, qt_mpool_internal_cached(pool));
+
+                if ((live > pool->live_hwm) && !pool->compacting) { pool->live_hwm = live; }
+            }
             ALLOC_SCRIBBLE(p, pool->item_size);
             return p;
         } else {
@@ -400,13 +683,16 @@ void INTERNAL qt_mpool_free(qt_mpool pool,
     qt_mpool_cache_t             *cache = NULL;
     qt_mpool_cache_t             *n     = (qt_mpool_cache_t *)mem;
     size_t                        cnt;
-    const size_t                  items_per_alloc = pool->items_per_alloc;
+    const size_t                  magazine = pool->magazine;
 
     qthread_debug(MPOOL_CALLS, "pool=%p mem=%p\n", pool, mem);
     qassert_retvoid((mem != NULL));
     qassert_retvoid((pool != NULL));
     FREE_SCRIBBLE(mem, pool->item_size);
     tc    = qt_mpool_internal_getcache(pool);
+#ifdef POOL_PROFILE
+    tc->frees++;
+#endif
     cache = tc->cache;
     cnt   = tc->count;
     qthread_debug(MPOOL_DETAILS, "->cache:%p (bt:%p) cnt:%u\n", cache, cache ? cache->block_tail : NULL, (unsigned int)cnt);
@@ -420,7 +706,7 @@ void INTERNAL qt_mpool_free(qt_mpool pool,
         n->block_tail = n;
     }
     cnt++;
-    if (cnt >= (items_per_alloc * 2)) {
+    if (cnt >= (magazine * 2)) {
         qt_mpool_cache_t *toglobal;
         /* push to global */
         qthread_debug(MPOOL_BEHAVIOR, "->push to global! cnt:%u\n", (unsigned)cnt);
@@ -433,9 +719,10 @@ void INTERNAL qt_mpool_free(qt_mpool pool,
         QTHREAD_FASTLOCK_LOCK(&pool->reuse_lock);
         toglobal->block_tail->next = pool->reuse_pool;
         pool->reuse_pool           = toglobal;
+        pool->shared++;
         QTHREAD_FASTLOCK_UNLOCK(&pool->reuse_lock);
-        cnt -= items_per_alloc;
-    } else if (cnt == items_per_alloc + 1) {
+        cnt -= magazine;
+    } else if (cnt == magazine + 1) {
         qthread_debug(MPOOL_BEHAVIOR, "->chop_block\n");
         n->block_tail = n;
     }
@@ -449,14 +736,21 @@ void INTERNAL qt_mpool_destroy(qt_mpool pool)
 {                                      /*{{{ */
     qthread_debug(MPOOL_CALLS, "pool:%p\n", pool);
     qassert_retvoid((pool != NULL));
+    if (pool->listed) {
+        qt_mpool *prev;
+
+        QTHREAD_FASTLOCK_LOCK(&list_lock);
+        for (prev = &list_head; *prev != pool; prev = &(*prev)->next_pool) ;
+        *prev = pool->next_pool;
+        QTHREAD_FASTLOCK_UNLOCK(&list_lock);
+    }
     while (pool->alloc_list) {
         unsigned int i = 0;
 
         void *p = pool->alloc_list[0];
 
         while (p && i < (pagesize / sizeof(void *) - 1)) {
-            qt_mpool_internal_aligned_free(p,
-                                           pool->alignment);
+            qt_mpool_internal_aligned_free(pool, p);
             i++;
             p = pool->alloc_list[i];
         }
@@ -472,13 +766,492 @@ void INTERNAL qt_mpool_destroy(qt_mpool pool)
         qt_internal_aligned_free(freeme, CACHELINE_WIDTH);
     }
     qthread_debug(MPOOL_DETAILS, "done freeing TLS caches\n");
-#ifndef TLS
+    if (pool->huge) {
+        qt_mpool_internal_huge_release();
+    }
+    if (pool->worker_caches) {
+        qt_internal_aligned_free(pool->worker_caches, CACHELINE_WIDTH);
+    }
     pthread_key_delete(pool->threadlocal_cache);
-#endif
     QTHREAD_FASTLOCK_DESTROY(pool->pool_lock);
     QTHREAD_FASTLOCK_DESTROY(pool->reuse_lock);
     VALGRIND_DESTROY_MEMPOOL(pool);
     FREE(pool, sizeof(struct qt_mpool_s));
 }                                      /*}}} */
 
+/* A chunk of a pool being compacted, and the free items found in it */
+typedef struct {
+    uint8_t          *base;
+    size_t            free;
+    qt_mpool_cache_t *items;           /* linked through next */
+    qt_mpool_cache_t *last;
+} qt_mpool_chunk_t;
+
+static int qt_mpool_internal_by_address(const void *a,
+                                        const void *b)
+{                                      /*{{{ */
+    const uint8_t *x = ((const qt_mpool_chunk_t *)a)->base;
+    const uint8_t *y = ((const qt_mpool_chunk_t *)b)->base;
+
+    return (x < y) ? -1 : (x > y);
+}                                      /*}}} */
+
+static int qt_mpool_internal_by_free(const void *a,
+                                     const void *b)
+{                                      /*{{{ */
+    const size_t x = ((const qt_mpool_chunk_t *)a)->free;
+    const size_t y = ((const qt_mpool_chunk_t *)b)->free;
+
+    return (x < y) ? -1 : (x > y);
+}                                      /*}}} */
+
+/* the chunk (sorted by address) that p is in, or NULL */
+static qt_mpool_chunk_t *qt_mpool_internal_find_chunk(const qt_mpool    pool,
+                                                      qt_mpool_chunk_t *chunks,
+                                                      size_t            nchunks,
+                                                      const void       *p)
+{                                      /*{{{ */
+    size_t lo = 0, hi = nchunks;
+
+    while (hi - lo > 1) {
+        const size_t mid = (lo + hi) / 2;
+
+        if (chunks[mid].base <= (const uint8_t *)p) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    if ((nchunks == 0) || ((const uint8_t *)p < chunks[lo].base) ||
+        ((const uint8_t *)p >= chunks[lo].base + pool->alloc_size)) {
+        return NULL;
+    }
+    return &chunks[lo];
+}                                      /*}}} */
+
+/* hands an empty chunk's pages back to the OS, then frees it */
+static void qt_mpool_internal_release_chunk(qt_mpool pool,
+                                            uint8_t *chunk)
+{                                      /*{{{ */
+#if defined(HAVE_MADVISE) && defined(MADV_DONTNEED)
+    /* free() keeps small blocks, and spare chunks of the huge-page regions
+     * are kept, so drop the pages themselves; the first page of the chunk
+     * is left alone for the allocator's (or the spare list's) bookkeeping */
+    const uintptr_t lo = ((uintptr_t)chunk + pagesize) & ~(uintptr_t)(pagesize - 1);
+    const uintptr_t hi = ((uintptr_t)chunk + pool->alloc_size) & ~(uintptr_t)(pagesize - 1);
+
+    if (hi > lo) {
+        madvise((void *)lo, hi - lo, MADV_DONTNEED);
+    }
+#endif
+    qt_mpool_internal_aligned_free(pool, chunk);
+}                                      /*}}} */
+
+/* Gives the pool's empty chunks back to the OS, and returns how many bytes
+ * that was. Only the free items that the calling thread can take are
+ * considered: those in reuse_pool and in its own cache, including what is
+ * left of its block. They are sorted into the chunks they belong to; chunks
+ * that turn out to be entirely free are released, and the items of the rest
+ * are handed back out with the fullest chunks first, so that new items
+ * come from nearly full chunks and the emptiest chunks get a chance to
+ * drain by the next compaction. Items in other threads' caches stay put;
+ * workers compact the pools themselves when they are next idle (see
+ * qt_mpool_idle()). Nothing that allocates from or frees to the pool waits
+ * for this, except that a thread that needs a new chunk waits for the two
+ * short stretches under pool_lock. */
+static size_t qt_mpool_internal_compact(qt_mpool pool)
+{                                      /*{{{ */
+    const size_t                  per_page = pagesize / sizeof(void *) - 1;
+    const size_t                  magazine = pool->magazine;
+    qt_mpool_threadlocal_cache_t *tc;
+    qt_mpool_chunk_t             *chunks  = NULL;
+    qt_mpool_cache_t             *items, *shared, *it, *next;
+    size_t                        nitems, nchunks = 0, nempty = 0, released = 0;
+    size_t                        i, pos;
+    void                        **page;
+
+    if (qthread_cas(&pool->compacting, 0, 1) != 0) { return 0; }
+
+    /* collect the free items */
+    tc        = qt_mpool_internal_getcache(pool);
+    items     = tc->cache;
+    nitems    = tc->count;
+    tc->cache = NULL;
+    tc->count = 0;
+    if (tc->block) {
+        for (i = tc->i; i < pool->items_per_alloc; i++) {
+            it       = (qt_mpool_cache_t *)(tc->block + i * pool->item_size);
+            it->next = items;
+            items    = it;
+            nitems++;
+        }
+        tc->block = NULL;
+    }
+    QTHREAD_FASTLOCK_LOCK(&pool->reuse_lock);
+    shared           = pool->reuse_pool;
+    nitems          += pool->shared * magazine;
+    pool->reuse_pool = NULL;
+    pool->shared     = 0;
+    QTHREAD_FASTLOCK_UNLOCK(&pool->reuse_lock);
+    for (it = shared; it != NULL; it = next) {
+        next     = it->next;
+        it->next = items;
+        items    = it;
+    }
+    if (items == NULL) {
+        pool->compacting = 0;
+        return 0;
+    }
+
+    /* sort them into their chunks */
+    QTHREAD_FASTLOCK_LOCK(&pool->pool_lock);
+    chunks = MALLOC(pool->chunks * sizeof(qt_mpool_chunk_t));
+    if (chunks != NULL) {
+        for (page = pool->alloc_list, pos = pool->alloc_list_pos; page != NULL;
+             page = page[per_page], pos = per_page) {
+            for (i = 0; i < pos; i++) {
+                chunks[nchunks].base  = page[i];
+                chunks[nchunks].free  = 0;
+                chunks[nchunks].items = NULL;
+                chunks[nchunks].last  = NULL;
+                nchunks++;
+            }
+        }
+        assert(nchunks == pool->chunks);
+    }
+    QTHREAD_FASTLOCK_UNLOCK(&pool->pool_lock);
+    if (chunks == NULL) { goto hand_back; }
+    qsort(chunks, nchunks, sizeof(qt_mpool_chunk_t), qt_mpool_internal_by_address);
+    for (it = items; it != NULL; it = next) {
+        qt_mpool_chunk_t *c = qt_mpool_internal_find_chunk(pool, chunks, nchunks, it);
+
+        assert(c != NULL);
+        next     = it->next;
+        it->next = c->items;
+        if (c->items == NULL) { c->last = it; }
+        c->items = it;
+        c->free++;
+    }
+    for (i = 0; i < nchunks; i++) {
+        if (chunks[i].free == pool->items_per_alloc) { nempty++; }
+    }
+
+    /* take the empty chunks off alloc_list, which may have grown since */
+    if (nempty > 0) {
+        void  **spare = NULL, **old, **old_next;
+        size_t  need, oldpos;
+
+        QTHREAD_FASTLOCK_LOCK(&pool->pool_lock);
+        need = (pool->chunks - nempty + per_page - 1) / per_page;
+        for (need = need ? need : 1; need > 0; need--) {
+            void **tmp = qt_internal_aligned_alloc(pagesize, pagesize);
+
+            if (tmp == NULL) { break; }
+            memset(tmp, 0, pagesize);
+            tmp[per_page] = spare;
+            spare         = tmp;
+        }
+        if (need == 0) {
+            old                        = pool->alloc_list;
+            oldpos                     = pool->alloc_list_pos;
+            pool->alloc_list           = spare;
+            spare                      = spare[per_page];
+            pool->alloc_list[per_page] = NULL;
+            pool->alloc_list_pos       = 0;
+            for (page = old, pos = oldpos; page != NULL; page = old_next, pos = per_page) {
+                old_next = page[per_page];
+                for (i = 0; i < pos; i++) {
+                    qt_mpool_chunk_t *c = qt_mpool_internal_find_chunk(pool, chunks, nchunks, page[i]);
+
+                    if ((c != NULL) && (c->free == pool->items_per_alloc)) { continue; }
+                    if (pool->alloc_list_pos == per_page) {
+                        void **tmp = spare;
+
+                        spare                = spare[per_page];
+                        tmp[per_page]        = pool->alloc_list;
+                        pool->alloc_list     = tmp;
+                        pool->alloc_list_pos = 0;
+                    }
+                    pool->alloc_list[pool->alloc_list_pos++] = page[i];
+                }
+                qt_internal_aligned_free(page, pagesize);
+            }
+            pool->chunks -= nempty;
+        } else {
+            nempty = 0;                /* out of memory; keep everything */
+        }
+        QTHREAD_FASTLOCK_UNLOCK(&pool->pool_lock);
+        while (spare != NULL) {
+            void **tmp = spare;
+
+            spare = spare[per_page];
+            qt_internal_aligned_free(tmp, pagesize);
+        }
+    }
+    if (nempty > 0) {
+        for (i = 0; i < nchunks; i++) {
+            if (chunks[i].free == pool->items_per_alloc) {
+                qt_mpool_internal_release_chunk(pool, chunks[i].base);
+                released        += pool->alloc_size;
+                nitems          -= chunks[i].free;
+                chunks[i].free   = 0;
+                chunks[i].items  = NULL;
+            }
+        }
+    }
+
+    /* line the rest up, fullest chunks first */
+    qsort(chunks, nchunks, sizeof(qt_mpool_chunk_t), qt_mpool_internal_by_free);
+    items = NULL;
+    for (i = nchunks; i > 0; i--) {
+        if (chunks[i - 1].items != NULL) {
+            chunks[i - 1].last->next = items;
+            items                    = chunks[i - 1].items;
+        }
+    }
+    FREE(chunks, nchunks * sizeof(qt_mpool_chunk_t));
+
+hand_back:
+    /* the odd items go back into this thread's cache, the rest to
+     * reuse_pool as magazines */
+    if (nitems % magazine) {
+        qt_mpool_cache_t *tail = items;
+
+        for (i = 1; i < nitems % magazine; i++) { tail = tail->next; }
+        for (it = items; it != tail; it = it->next) { it->block_tail = tail; }
+        tail->block_tail = tail;
+        tc->cache        = items;
+        tc->count        = nitems % magazine;
+        items            = tail->next;
+        tail->next       = NULL;
+        nitems          -= tc->count;
+    }
+    if (items != NULL) {
+        qt_mpool_cache_t *first = items, *tail = NULL;
+
+        while (items != NULL) {
+            qt_mpool_cache_t *head = items;
+
+            for (tail = head, i = 1; i < magazine; i++) { tail = tail->next; }
+            for (it = head; it != tail; it = it->next) { it->block_tail = tail; }
+            tail->block_tail = tail;
+            items            = tail->next;
+        }
+        QTHREAD_FASTLOCK_LOCK(&pool->reuse_lock);
+        tail->next        = pool->reuse_pool;
+        pool->reuse_pool  = first;
+        pool->shared     += nitems / magazine;
+        QTHREAD_FASTLOCK_UNLOCK(&pool->reuse_lock);
+    }
+    MACHINE_FENCE;
+    pool->compacting = 0;
+    qthread_debug(MPOOL_BEHAVIOR, "pool:%p released %lu bytes\n", pool, (unsigned long)released);
+    return released;
+}                                      /*}}} */
+
+static size_t qt_mpool_internal_compact_all(void)
+{                                      /*{{{ */
+    qt_mpool pool;
+    size_t   released = 0;
+
+    QTHREAD_FASTLOCK_LOCK(&list_lock);
+    for (pool = list_head; pool != NULL; pool = pool->next_pool) {
+        released += qt_mpool_internal_compact(pool);
+    }
+    QTHREAD_FASTLOCK_UNLOCK(&list_lock);
+    compact_after = pool_bytes;
+    return released;
+}                                      /*}}} */
+
+size_t API_FUNC qthread_pool_compact(void)
+{                                      /*{{{ */
+    qthread_worker_t *w = qthread_internal_getworker();
+    size_t            released;
+
+    if (qlib == NULL) { return 0; }
+    released = qt_mpool_internal_compact_all();
+    /* and have every worker give back what it has cached */
+    if (w != NULL) {
+        w->pool_compact_gen = qthread_incr(&compact_gen, 1) + 1;
+    } else {
+        qthread_incr(&compact_gen, 1);
+    }
+    QT_PARK_NOTIFY_ALL();
+    return released;
+}                                      /*}}} */
+
+/* Called by workers that have been idle for a while (see QT_PARK_IDLE()),
+ * so it must be cheap when there is nothing to do. */
+void INTERNAL qt_mpool_idle(void)
+{                                      /*{{{ */
+    qthread_worker_t *w   = qthread_internal_getworker();
+    aligned_t         gen = compact_gen;
+
+    if (w == NULL) { return; }
+    if ((compact_interval > 0) || (compact_threshold > 0)) {
+        const size_t bytes = pool_bytes;
+        double       now   = 0;
+        int          ask   = 0;
+
+        if ((compact_threshold > 0) && (bytes > compact_threshold) && (bytes > compact_after)) {
+            ask = 1;
+        } else if (compact_interval > 0) {
+            now = qtimer_wtime();
+            ask = (now - compact_last >= compact_interval);
+        }
+        /* one worker asks on behalf of all of them */
+        if (ask && (qthread_cas(&compact_gen, gen, gen + 1) == gen)) {
+            gen++;
+            compact_after = bytes;
+            if (now > 0) { compact_last = now; }
+        }
+    }
+    if (w->pool_compact_gen == gen) { return; }
+    w->pool_compact_gen = gen;
+    qt_mpool_internal_compact_all();
+}                                      /*}}} */
+
+void INTERNAL qt_mpool_set_name(qt_mpool    pool,
+                               const char *name)
+{                                      /*{{{ */
+    qassert_retvoid((pool != NULL));
+    pool->name = name;
+}                                      /*}}} */
+
+unsigned int API_FUNC qthread_pools(void)
+{                                      /*{{{ */
+    unsigned int n = 0;
+    qt_mpool     pool;
+
+    if (qlib == NULL) { return 0; }
+    QTHREAD_FASTLOCK_LOCK(&list_lock);
+    for (pool = list_head; pool != NULL; pool = pool->next_pool) {
+        n++;
+    }
+    QTHREAD_FASTLOCK_UNLOCK(&list_lock);
+    return n;
+}                                      /*}}} */
+
+/* must hold list_lock, or be the dump */
+static void qt_mpool_internal_stats(qt_mpool              pool,
+                                    qthread_pool_stats_t *stats)
+{                                      /*{{{ */
+    const size_t cached = qt_mpool_internal_cached(pool);
+
+    memset(stats, 0, sizeof(qthread_pool_stats_t));
+    stats->name         = pool->name ? pool->name : "unnamed";
+    stats->item_size    = pool->item_size;
+    stats->reserved     = pool->chunks * pool->alloc_size;
+    stats->reserved_hwm = pool->chunks_hwm * pool->alloc_size;
+    stats->live         = qt_mpool_internal_live(pool, cached);
+    /* mid-compaction, the items being sorted look live */
+    if ((stats->live > pool->live_hwm) && !pool->compacting) { pool->live_hwm = stats->live; }
+    stats->live_hwm     = pool->live_hwm;
+    stats->cached       = cached;
+    stats->shared       = pool->shared * pool->magazine;
+#ifdef POOL_PROFILE
+    {
+        const qt_mpool_threadlocal_cache_t *tc;
+        size_t                              w;
+
+        /* a thread that freed more than it allocated was handed at least
+         * the difference by other threads */
+        for (w = 0; w < pool->nworker_caches; w++) {
+            tc             = &pool->worker_caches[w].c;
+            stats->allocs += tc->allocs;
+            stats->frees  += tc->frees;
+            if (tc->frees > tc->allocs) { stats->remote_frees += tc->frees - tc->allocs; }
+        }
+        for (tc = pool->caches; tc != NULL; tc = tc->next) {
+            stats->allocs += tc->allocs;
+            stats->frees  += tc->frees;
+            if (tc->frees > tc->allocs) { stats->remote_frees += tc->frees - tc->allocs; }
+        }
+    }
+#endif
+}                                      /*}}} */
+
+int API_FUNC qthread_pool_stats(unsigned int          which,
+                                qthread_pool_stats_t *stats)
+{                                      /*{{{ */
+    qt_mpool pool;
+
+    qassert_ret(stats, QTHREAD_BADARGS);
+    qassert_ret(qlib, QTHREAD_BADARGS);
+    QTHREAD_FASTLOCK_LOCK(&list_lock);
+    for (pool = list_head; pool != NULL && which > 0; pool = pool->next_pool) {
+        which--;
+    }
+    if (pool != NULL) {
+        qt_mpool_internal_stats(pool, stats);
+    }
+    QTHREAD_FASTLOCK_UNLOCK(&list_lock);
+    return (pool != NULL) ? QTHREAD_SUCCESS : QTHREAD_BADARGS;
+}                                      /*}}} */
+
+size_t API_FUNC qthread_pool_cached(unsigned int which,
+                                    unsigned int worker)
+{                                      /*{{{ */
+    qt_mpool pool;
+    size_t   cached = 0;
+
+    if (qlib == NULL) { return 0; }
+    QTHREAD_FASTLOCK_LOCK(&list_lock);
+    for (pool = list_head; pool != NULL && which > 0; pool = pool->next_pool) {
+        which--;
+    }
+    if ((pool != NULL) && (worker < pool->nworker_caches)) {
+        cached = qt_mpool_internal_cache_free(pool, &pool->worker_caches[worker].c);
+    }
+    QTHREAD_FASTLOCK_UNLOCK(&list_lock);
+    return cached;
+}                                      /*}}} */
+
+/* Writes one line per pool, plus what each worker has cached, to fd with
+ * write(2) so that it can run in a signal handler; does not take list_lock
+ * for the same reason. */
+void API_FUNC qthread_pool_stats_dump(int fd)
+{                                      /*{{{ */
+    char     buf[256];
+    qt_mpool pool;
+    int      len;
+
+    len = snprintf(buf, sizeof(buf), "qthread memory pools: %lu kB in chunks, %lu kB of it in huge pages\n",
+                   (unsigned long)(pool_bytes / 1024), (unsigned long)(huge_bytes / 1024));
+    if (write(fd, buf, len) < 0) { return; }
+    for (pool = list_head; pool != NULL; pool = pool->next_pool) {
+        qthread_pool_stats_t s;
+        size_t               w;
+
+        qt_mpool_internal_stats(pool, &s);
+        len = snprintf(buf, sizeof(buf),
+                       "%-20s %6lu B/item %9lu kB (peak %lu kB) %9lu live (peak %lu) %7lu cached %7lu shared",
+                       s.name, (unsigned long)s.item_size,
+                       (unsigned long)(s.reserved / 1024), (unsigned long)(s.reserved_hwm / 1024),
+                       (unsigned long)s.live, (unsigned long)s.live_hwm,
+                       (unsigned long)s.cached, (unsigned long)s.shared);
+        if ((size_t)len >= sizeof(buf)) { len = sizeof(buf) - 1; }
+#ifdef POOL_PROFILE
+        len += snprintf(buf + len, sizeof(buf) - len, " %lu allocs %lu frees %lu remote",
+                        (unsigned long)s.allocs, (unsigned long)s.frees,
+                        (unsigned long)s.remote_frees);
+#endif
+        if ((size_t)len >= sizeof(buf) - 1) { len = sizeof(buf) - 2; }
+        buf[len++] = '\n';
+        if (write(fd, buf, len) < 0) { return; }
+        if (s.reserved == 0) { continue; }
+        len = snprintf(buf, sizeof(buf), "%20s", "cached by worker:");
+        for (w = 0; w < pool->nworker_caches; w++) {
+            if (len > (int)sizeof(buf) - 24) {
+                if (write(fd, buf, len) < 0) { return; }
+                len = 0;
+            }
+            len += snprintf(buf + len, sizeof(buf) - len, " %lu",
+                            (unsigned long)qt_mpool_internal_cache_free(pool, &pool->worker_caches[w].c));
+        }
+        buf[len++] = '\n';
+        if (write(fd, buf, len) < 0) { return; }
+    }
+}                                      /*}}} */
+
 /* vim:set expandtab: */
@@ -0,0 +1,155 @@
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+/* System Headers */
+#include <time.h>        /* for struct timespec */
+#include <unistd.h>      /* for syscall() */
+#include <sys/syscall.h> /* for SYS_futex */
+#include <linux/futex.h> /* for FUTEX_WAIT_PRIVATE and FUTEX_WAKE_PRIVATE */
+
+/* Internal Headers */
+#include "qt_visibility.h"
+#include "qt_debug.h"
+#include "qt_asserts.h"
+#include "qt_atomics.h"
+#include "qt_envariables.h"
+#include "qthread_innards.h"
+#include "qt_shepherd_innards.h"
+#include "qt_parking.h"
+
+#define QT_PARK_RUNNING 0
+#define QT_PARK_PARKED  1
+
+/* Globals */
+aligned_t qt_park_sleepers = 0; /* workers whose park_word is PARKED */
+uint32_t  qt_park_spins    = 16384;
+static struct timespec park_timeout;
+static int             park_timeout_set = 0;
+
+/* Static Functions */
+static QINLINE long qt_futex(uint32_t              *uaddr,
+                             int                    op,
+                             uint32_t               val,
+                             const struct timespec *timeout)
+{   /*{{{*/
+    return syscall(SYS_futex, uaddr, op, val, timeout, NULL, 0);
+} /*}}}*/
+
+/* Whoever moves a worker from PARKED to RUNNING owns the decrement of
+ * qt_park_sleepers, so the counter never includes a worker that has already
+ * been claimed by a waker. */
+static QINLINE int qt_park_claim(qthread_worker_t *w)
+{   /*{{{*/
+    if ((w->park_word == QT_PARK_PARKED) &&
+        (qthread_cas32(&w->park_word, QT_PARK_PARKED, QT_PARK_RUNNING) == QT_PARK_PARKED)) {
+        (void)qthread_incr(&qt_park_sleepers, -1);
+        return 1;
+    }
+    return 0;
+} /*}}}*/
+
+static int qt_park_wake_shepherd(qthread_shepherd_t *shep)
+{   /*{{{*/
+    qthread_worker_id_t w;
+
+    for (w = 0; w < qlib->nworkerspershep; w++) {
+        qthread_worker_t *worker = &shep->workers[w];
+
+        if (qt_park_claim(worker)) {
+            qthread_debug(THREADQUEUE_DETAILS, "waking worker %i:%i\n",
+                          (int)shep->shepherd_id, (int)w);
+            (void)qt_futex(&worker->park_word, FUTEX_WAKE_PRIVATE, 1, NULL);
+            return 1;
+        }
+    }
+    return 0;
+} /*}}}*/
+
+/* Internal Functions */
+void INTERNAL qt_park_init(void)
+{   /*{{{*/
+    unsigned long timeout;
+
+    qt_park_spins = qt_internal_get_env_num("PARK_SPINS", qt_park_spins, 0);
+    timeout       = qt_internal_get_env_num("PARK_TIMEOUT", 10000, 0);
+    if (timeout) {
+        park_timeout.tv_sec  = timeout / 1000000;
+        park_timeout.tv_nsec = (timeout % 1000000) * 1000;
+        park_timeout_set     = 1;
+    } else {
+        park_timeout_set = 0;
+    }
+    qthread_debug(CORE_DETAILS, "park after %u spins, timeout %lu usecs\n",
+                  (unsigned)qt_park_spins, timeout);
+} /*}}}*/
+
+void INTERNAL qt_park_prepare(void)
+{   /*{{{*/
+    qthread_worker_t *me = qthread_internal_getworker();
+
+    assert(me);
+    assert(me->park_word == QT_PARK_RUNNING);
+    me->park_word = QT_PARK_PARKED;
+    /* full barrier: the caller's re-check of its queues happens after this */
+    (void)qthread_incr(&qt_park_sleepers, 1);
+} /*}}}*/
+
+void INTERNAL qt_park_cancel(void)
+{   /*{{{*/
+    (void)qt_park_claim(qthread_internal_getworker());
+} /*}}}*/
+
+void INTERNAL qt_park_commit(void)
+{   /*{{{*/
+    qthread_worker_t *me = qthread_internal_getworker();
+
+    assert(me);
+    if (me->park_word == QT_PARK_PARKED) {
+        (void)qt_futex(&me->park_word, FUTEX_WAIT_PRIVATE, QT_PARK_PARKED,
+                       park_timeout_set ? &park_timeout : NULL);
+    }
+    /* Woken, timed out, or interrupted: in the latter two cases nobody has
+     * claimed us yet, so withdraw from the sleeper count ourselves. */
+    (void)qt_park_claim(me);
+} /*}}}*/
+
+void INTERNAL qt_park_wake(qt_threadqueue_t *q,
+                           int               anywhere)
+{   /*{{{*/
+    qthread_shepherd_t   *shepherds = qlib->shepherds;
+    qthread_shepherd_id_t nshepherds = qlib->nshepherds;
+    qthread_shepherd_id_t owner, i;
+
+    for (owner = 0; owner < nshepherds; owner++) {
+        if (shepherds[owner].ready == q) { break; }
+#ifdef QTHREAD_LOCAL_PRIORITY
+        if (shepherds[owner].local_priority_queue == q) { break; }
+#endif
+    }
+    if (owner == nshepherds) {
+        /* not a shepherd's queue; anybody can have it */
+        for (i = 0; i < nshepherds; i++) {
+            if (qt_park_wake_shepherd(&shepherds[i])) { return; }
+        }
+        return;
+    }
+    if (qt_park_wake_shepherd(&shepherds[owner]) || !anywhere) { return; }
+    if (shepherds[owner].sorted_sheplist) {
+        /* nearest shepherds first */
+        for (i = 0; i < nshepherds - 1; i++) {
+            if (qt_park_wake_shepherd(&shepherds[shepherds[owner].sorted_sheplist[i]])) { return; }
+        }
+    }
+} /*}}}*/
+
+void INTERNAL qt_park_wake_all(void)
+{   /*{{{*/
+    qthread_shepherd_id_t i;
+
+    for (i = 0; i < qlib->nshepherds; i++) {
+        while (qt_park_wake_shepherd(&qlib->shepherds[i])) ;
+    }
+} /*}}}*/
+
+/* vim:set expandtab: */
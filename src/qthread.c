@@ -67,11 +67,14 @@
 #include "qt_threadqueue_scheduler.h"
 #include "qt_affinity.h"
 #include "qt_io.h"
+#include "qt_io_poll.h"
 #include "qt_debug.h"
 #include "qt_envariables.h"
 #include "qt_queue.h"
 #include "qt_feb.h"
 #include "qt_syncvar.h"
+#include "qt_spinwait.h"
+#include "qt_stacks.h"
 #include "qt_spawncache.h"
 #ifdef QTHREAD_MULTINODE
 # include "qt_multinode_innards.h"
@@ -81,6 +84,9 @@
 #ifdef QTHREAD_USE_EUREKAS
 # include "qt_eurekas.h"
 #endif /* QTHREAD_USE_EUREKAS */
+#ifdef QTHREAD_PARKING
+# include "qt_parking.h"
+#endif /* QTHREAD_PARKING */
 #include "qt_subsystems.h"
 #include "qt_output_macros.h"
 #include "qt_int_log.h"
@@ -161,45 +167,53 @@ void qthread_thread_free(qthread_t *t);
 
 
 #if defined(UNPOOLED_QTHREAD_T) || defined(UNPOOLED)
-# define ALLOC_QTHREAD()     (qthread_t *)MALLOC(sizeof(qthread_t) + sizeof(void *) + qlib->qthread_tasklocal_size)
-# define ALLOC_BIG_QTHREAD() (qthread_t *)MALLOC(sizeof(qthread_t) + qlib->qthread_argcopy_size + qlib->qthread_tasklocal_size)
-# define FREE_QTHREAD(t)     FREE(t, sizeof(qthread_t) + sizeof(void *) + qlib->qthread_tasklocal_size)
-# define FREE_BIG_QTHREAD(t) FREE(t, sizeof(qthread_t) + qlib->qthread_argcopy_size + qlib->qthread_tasklocal_size)
+# define ALLOC_QTHREAD()      (qthread_t *)MALLOC(sizeof(qthread_t) + sizeof(void *) + qlib->qthread_tasklocal_size)
+# define ALLOC_BIG_QTHREAD(c) (qthread_t *)MALLOC(sizeof(qthread_t) + qlib->task_class_args[c] + qlib->qthread_tasklocal_size)
+# define FREE_QTHREAD(t)      FREE(t, sizeof(qthread_t) + sizeof(void *) + qlib->qthread_tasklocal_size)
+# define FREE_BIG_QTHREAD(t)  FREE(t, sizeof(qthread_t) + qlib->task_class_args[(t)->size_class] + qlib->qthread_tasklocal_size)
 #else /* if defined(UNPOOLED_QTHREAD_T) || defined(UNPOOLED) */
-qt_mpool generic_qthread_pool     = NULL;
-qt_mpool generic_big_qthread_pool = NULL;
-# define ALLOC_QTHREAD()     (qthread_t *)qt_mpool_alloc(generic_qthread_pool)
-# define ALLOC_BIG_QTHREAD() (qthread_t *)qt_mpool_alloc(generic_big_qthread_pool)
-# define FREE_QTHREAD(t)     qt_mpool_free(generic_qthread_pool, t)
-# define FREE_BIG_QTHREAD(t) qt_mpool_free(generic_big_qthread_pool, t)
+qt_mpool        generic_qthread_pool = NULL;
+static qt_mpool generic_big_qthread_pools[QTHREAD_TASK_CLASSES]; /* [0] unused */
+# define ALLOC_QTHREAD()      (qthread_t *)qt_mpool_alloc(generic_qthread_pool)
+# define ALLOC_BIG_QTHREAD(c) (qthread_t *)qt_mpool_alloc(generic_big_qthread_pools[c])
+# define FREE_QTHREAD(t)      qt_mpool_free(generic_qthread_pool, t)
+# define FREE_BIG_QTHREAD(t)  qt_mpool_free(generic_big_qthread_pools[(t)->size_class], t)
 #endif /* if defined(UNPOOLED_QTHREAD_T) || defined(UNPOOLED) */
 
+/* Stacks come in QTHREAD_STACK_CLASSES size classes (see qthread_spawn()'s
+ * QTHREAD_SPAWN_STACK()), each with a pool of its own; a task's class is in
+ * its stack_class. */
 #if defined(UNPOOLED_STACKS) || defined(UNPOOLED)
 # ifdef QTHREAD_GUARD_PAGES
-static QINLINE void *ALLOC_STACK(void)
+static QINLINE void *ALLOC_STACK(unsigned int cls)
 {                      /*{{{ */
+    const size_t size = qlib->stack_class_size[cls];
+
     if (GUARD_PAGES) {
-        uint8_t *tmp = qt_internal_aligned_alloc(qlib->qthread_stack_size + sizeof(struct qthread_runtime_data_s) + (2 * getpagesize()), getpagesize());
+        uint8_t *tmp = qt_internal_aligned_alloc(size + sizeof(struct qthread_runtime_data_s) + (2 * getpagesize()), getpagesize());
 
         assert(tmp != NULL);
         if (tmp == NULL) {
             return NULL;
         }
-        ALLOC_SCRIBBLE(tmp, qlib->qthread_stack_size + sizeof(struct qthread_runtime_data_s) + (2 * getpagesize()));
+        ALLOC_SCRIBBLE(tmp, size + sizeof(struct qthread_runtime_data_s) + (2 * getpagesize()));
         if (mprotect(tmp, getpagesize(), PROT_NONE) != 0) {
             perror("mprotect in ALLOC_STACK (1)");
         }
-        if (mprotect(tmp + qlib->qthread_stack_size + getpagesize(), getpagesize(), PROT_NONE) != 0) {
+        if (mprotect(tmp + size + getpagesize(), getpagesize(), PROT_NONE) != 0) {
             perror("mprotect in ALLOC_STACK (2)");
         }
         return tmp + getpagesize();
     } else {
-        return MALLOC(qlib->qthread_stack_size + sizeof(struct qthread_runtime_data_s));
+        return MALLOC(size + sizeof(struct qthread_runtime_data_s));
     }
 }                      /*}}} */
 
-static QINLINE void FREE_STACK(void *t)
+static QINLINE void FREE_STACK(void        *t,
+                               unsigned int cls)
 {                      /*{{{ */
+    const size_t size = qlib->stack_class_size[cls];
+
     if (GUARD_PAGES) {
         uint8_t *tmp = t;
 
@@ -208,28 +222,31 @@ static QINLINE void FREE_STACK(void *t)
         if (mprotect(tmp, getpagesize(), PROT_READ | PROT_WRITE) != 0) {
             perror("mprotect in FREE_STACK (1)");
         }
-        if (mprotect(tmp + qlib->qthread_stack_size + getpagesize(),
+        if (mprotect(tmp + size + getpagesize(),
                     getpagesize(),
                     PROT_READ | PROT_WRITE) != 0) {
             perror("mprotect in FREE_STACK (2)");
         }
-        FREE(tmp, qlib->qthread_stack_size + sizeof(struct qthread_runtime_data_s) + (2 * getpagesize()));
+        FREE(tmp, size + sizeof(struct qthread_runtime_data_s) + (2 * getpagesize()));
     } else {
-        FREE(t, qlib->qthread_stack_size); /* XXX: this size seems wrong */
+        FREE(t, size); /* XXX: this size seems wrong */
     }
 }                      /*}}} */
 
 # else /* ifdef QTHREAD_GUARD_PAGES */
-#  define ALLOC_STACK() MALLOC(qlib->qthread_stack_size + sizeof(struct qthread_runtime_data_s))
-#  define FREE_STACK(t) FREE(t, qlib->qthread_stack_size) /* XXX: this size seems wrong */
+#  define ALLOC_STACK(c)    MALLOC(qlib->stack_class_size[c] + sizeof(struct qthread_runtime_data_s))
+#  define FREE_STACK(t, c)  FREE(t, qlib->stack_class_size[c]) /* XXX: this size seems wrong */
 # endif /* ifdef QTHREAD_GUARD_PAGES */
+#elif defined(QTHREAD_STACK_ARENAS)
+# define ALLOC_STACK(c)    qt_stack_alloc(c)
+# define FREE_STACK(t, c)  qt_stack_free((t), (c))
 #else /* if defined(UNPOOLED_STACKS) || defined(UNPOOLED) */
-static qt_mpool generic_stack_pool = NULL;
+static qt_mpool generic_stack_pools[QTHREAD_STACK_CLASSES];
 # ifdef QTHREAD_GUARD_PAGES
-static QINLINE void *ALLOC_STACK(void)
+static QINLINE void *ALLOC_STACK(unsigned int cls)
 {                      /*{{{ */
     if (GUARD_PAGES) {
-        uint8_t *tmp = qt_mpool_alloc(generic_stack_pool);
+        uint8_t *tmp = qt_mpool_alloc(generic_stack_pools[cls]);
 
         assert(tmp);
         if (tmp == NULL) {
@@ -238,18 +255,19 @@ static QINLINE void *ALLOC_STACK(void)
         if (mprotect(tmp, getpagesize(), PROT_NONE) != 0) {
             perror("mprotect in ALLOC_STACK (1)");
         }
-        if (mprotect(tmp + qlib->qthread_stack_size + getpagesize(),
+        if (mprotect(tmp + qlib->stack_class_size[cls] + getpagesize(),
                     getpagesize(),
                     PROT_NONE) != 0) {
             perror("mprotect in ALLOC_STACK (2)");
         }
         return tmp + getpagesize();
     } else {
-        return qt_mpool_alloc(generic_stack_pool);
+        return qt_mpool_alloc(generic_stack_pools[cls]);
     }
 }                      /*}}} */
 
-static QINLINE void FREE_STACK(void *t)
+static QINLINE void FREE_STACK(void        *t,
+                               unsigned int cls)
 {                      /*{{{ */
     if (GUARD_PAGES) {
         assert(t);
@@ -257,18 +275,18 @@ static QINLINE void FREE_STACK(void *t)
         if (mprotect(t, getpagesize(), PROT_READ | PROT_WRITE) != 0) {
             perror("mprotect in FREE_STACK (1)");
         }
-        if (mprotect(((uint8_t*)t) + qlib->qthread_stack_size + getpagesize(),
+        if (mprotect(((uint8_t*)t) + qlib->stack_class_size[cls] + getpagesize(),
                     getpagesize(),
                     PROT_READ | PROT_WRITE) != 0) {
             perror("mprotect in FREE_STACK (2)");
         }
     }
-    qt_mpool_free(generic_stack_pool, t);
+    qt_mpool_free(generic_stack_pools[cls], t);
 }                      /*}}} */
 
 # else /* ifdef QTHREAD_GUARD_PAGES */
-#  define ALLOC_STACK() qt_mpool_alloc(generic_stack_pool)
-#  define FREE_STACK(t) qt_mpool_free(generic_stack_pool, t)
+#  define ALLOC_STACK(c)    qt_mpool_alloc(generic_stack_pools[c])
+#  define FREE_STACK(t, c)  qt_mpool_free(generic_stack_pools[c], (t))
 # endif /* ifdef QTHREAD_GUARD_PAGES */
 #endif  /* if defined(UNPOOLED_STACKS) || defined(UNPOOLED) */
 
@@ -281,6 +299,141 @@ static qt_mpool generic_rdata_pool = NULL;
 # define FREE_RDATA(r) qt_mpool_free(generic_rdata_pool, (r))
 #endif /* if defined(UNPOOLED) */
 
+#if defined(UNPOOLED_STACKS) || defined(UNPOOLED)
+# define alloc_stack(w, c)        ((void)(w), ALLOC_STACK(c))
+# define free_stack(w, s, o, c)   do { (void)(w); FREE_STACK((s), (c)); } while (0)
+# define qthread_internal_drain_stack_cache(w)
+#else
+/* Every worker keeps a LIFO of the last few stacks freed on it (QT_STACK_CACHE
+ * of them, for each stack class) in front of the stack pool, so that the
+ * next task to start there gets the stack most likely to still be in that
+ * worker's cache (and, with guard pages, one that is still protected). Since
+ * stacks are only bound when a task first runs, a stolen task gets a stack
+ * from its thief.
+ *
+ * A task that finishes on a worker other than the one it started on donates
+ * its stack: to the worker it finished on, which is where the stack is now
+ * hot, if that worker has room for it (and, with stack arenas, is on the
+ * stack's NUMA node); otherwise back to the worker that allocated it, through
+ * that worker's inbox, which it empties the next time its cache runs dry.
+ * Without the inbox, a worker that only ever finishes migrated tasks would
+ * pile up stacks that the worker spawning them has to keep replacing. */
+static unsigned int stack_cache_max = 8;
+
+# ifdef QTHREAD_STACK_ARENAS
+#  define STACK_IS_LOCAL(s, c) qt_stack_is_local((s), (c))
+# else
+#  define STACK_IS_LOCAL(s, c) 1
+# endif
+/* a free stack's rdata is dead, so the inbox links through it */
+# define STACK_LINK(s, c) (*(void **)((uint8_t *)(s) + qlib->stack_class_size[c] + \
+                                      (GUARD_PAGES ? getpagesize() : 0)))
+
+static QINLINE void *alloc_stack(qthread_worker_t *w,
+                                 unsigned int      cls)
+{   /*{{{*/
+    if (w) {
+        void **cache = w->stack_cache + cls * stack_cache_max;
+        void  *inbox;
+
+        if (w->stack_cache_len[cls] > 0) {
+            w->stack_hits++;
+            return cache[--w->stack_cache_len[cls]];
+        }
+        inbox = w->stack_inbox[cls];
+        while (inbox != NULL) {
+            void *tmp = qthread_cas_ptr(&w->stack_inbox[cls], inbox, NULL);
+
+            if (tmp == inbox) {
+                void *next = STACK_LINK(inbox, cls);
+
+                w->stack_inbox_len[cls] = 0; /* racy; the bound is approximate */
+                while (next != NULL) {
+                    void *stack = next;
+
+                    next = STACK_LINK(stack, cls);
+                    if (w->stack_cache_len[cls] < stack_cache_max) {
+                        cache[w->stack_cache_len[cls]++] = stack;
+                    } else {
+                        FREE_STACK(stack, cls);
+                    }
+                }
+                w->stack_hits++;
+                return inbox;
+            }
+            inbox = tmp;
+        }
+        w->stack_misses++;
+    }
+    return ALLOC_STACK(cls);
+} /*}}}*/
+
+static QINLINE void free_stack(qthread_worker_t *w,
+                               void             *stack,
+                               qthread_worker_t *owner,
+                               unsigned int      cls)
+{   /*{{{*/
+    if (w && (stack_cache_max > 0)) {
+        void    **cache = w->stack_cache + cls * stack_cache_max;
+        const int local = STACK_IS_LOCAL(stack, cls);
+
+        if ((owner != w) && (owner != NULL) &&
+            (!local || (w->stack_cache_len[cls] == stack_cache_max)) &&
+            (owner->stack_inbox_len[cls] < stack_cache_max)) {
+            void *head = owner->stack_inbox[cls];
+            void *tmp;
+
+            do {
+                STACK_LINK(stack, cls) = head;
+                tmp                    = head;
+            } while ((head = qthread_cas_ptr(&owner->stack_inbox[cls], tmp, stack)) != tmp);
+            qthread_incr(&owner->stack_inbox_len[cls], 1);
+            w->stack_donations++;
+            return;
+        }
+        if (local) {
+            if (w->stack_cache_len[cls] == stack_cache_max) {
+                /* spill the colder half of the cache */
+                const unsigned int spill = (stack_cache_max + 1) / 2;
+                unsigned int       i;
+
+                for (i = 0; i < spill; i++) {
+                    FREE_STACK(cache[i], cls);
+                }
+                w->stack_cache_len[cls] -= spill;
+                memmove(cache, cache + spill,
+                        w->stack_cache_len[cls] * sizeof(void *));
+            }
+            if (owner != w) { w->stack_donations++; }
+            cache[w->stack_cache_len[cls]++] = stack;
+            return;
+        }
+    }
+    FREE_STACK(stack, cls);
+} /*}}}*/
+
+static void qthread_internal_drain_stack_cache(qthread_worker_t *w)
+{   /*{{{*/
+    unsigned int cls;
+
+    for (cls = 0; cls < QTHREAD_STACK_CLASSES; cls++) {
+        while (w->stack_inbox[cls] != NULL) {
+            void *stack = w->stack_inbox[cls];
+
+            w->stack_inbox[cls] = STACK_LINK(stack, cls);
+            FREE_STACK(stack, cls);
+        }
+        while (w->stack_cache_len[cls] > 0) {
+            FREE_STACK(w->stack_cache[cls * stack_cache_max + --w->stack_cache_len[cls]], cls);
+        }
+    }
+    if (w->stack_cache) {
+        FREE(w->stack_cache, QTHREAD_STACK_CLASSES * stack_cache_max * sizeof(void *));
+        w->stack_cache = NULL;
+    }
+} /*}}}*/
+#endif /* if defined(UNPOOLED_STACKS) || defined(UNPOOLED) */
+
 #ifdef NEED_RLIMIT
 # define RLIMIT_TO_NORMAL(thr) do {                                              \
         qthread_debug(THREAD_DETAILS,                                            \
@@ -301,7 +454,7 @@ static qt_mpool generic_rdata_pool = NULL;
         if ((thr)->flags & QTHREAD_REAL_MCCOY) {                                                            \
             rlp.rlim_cur = qlib->master_stack_size;                                                         \
         } else {                                                                                            \
-            rlp.rlim_cur = qlib->qthread_stack_size;                                                        \
+            rlp.rlim_cur = qlib->stack_class_size[(thr)->stack_class];                                      \
         }                                                                                                   \
         rlp.rlim_max = qlib->max_stack_size;                                                                \
         qassert(setrlimit(RLIMIT_STACK, &rlp), 0);                                                          \
@@ -345,15 +498,28 @@ static QINLINE void alloc_rdata(qthread_shepherd_t *me,
     struct qthread_runtime_data_s *rdata;
 
     if (t->flags & QTHREAD_SIMPLE) {
-        rdata = t->rdata = ALLOC_RDATA();
+        /* Simple tasks run to completion on the worker's own stack, so a
+         * worker never has more than one of them going; let them share one
+         * rdata rather than allocating a fresh one each time. */
+        qthread_worker_t *w = qthread_internal_getworker();
+
+        if (w && w->simple_rdata) {
+            rdata           = t->rdata = w->simple_rdata;
+            w->simple_rdata = NULL;
+        } else {
+            rdata = t->rdata = ALLOC_RDATA();
+        }
     } else {
-        stack = ALLOC_STACK();
+        qthread_worker_t *w = qthread_internal_getworker();
+
+        stack = alloc_stack(w, t->stack_class);
         assert(stack);
         if (GUARD_PAGES) {
-            rdata = t->rdata = (struct qthread_runtime_data_s *)(((uint8_t *)stack) + getpagesize() + qlib->qthread_stack_size);
+            rdata = t->rdata = (struct qthread_runtime_data_s *)(((uint8_t *)stack) + getpagesize() + qlib->stack_class_size[t->stack_class]);
         } else {
-            rdata = t->rdata = (struct qthread_runtime_data_s *)(((uint8_t *)stack) + qlib->qthread_stack_size);
+            rdata = t->rdata = (struct qthread_runtime_data_s *)(((uint8_t *)stack) + qlib->stack_class_size[t->stack_class]);
         }
+        rdata->stack_owner = w;
     }
     rdata->tasklocal_size = 0;
     rdata->criticalsect   = 0;
@@ -362,7 +528,7 @@ static QINLINE void alloc_rdata(qthread_shepherd_t *me,
     rdata->blockedon.io   = NULL;
 #ifdef QTHREAD_USE_VALGRIND
     if (stack) {
-        rdata->valgrind_stack_id = VALGRIND_STACK_REGISTER(stack, qlib->qthread_stack_size);
+        rdata->valgrind_stack_id = VALGRIND_STACK_REGISTER(stack, qlib->stack_class_size[t->stack_class]);
     }
 #endif
 #ifdef QTHREAD_PERFORMANCE
@@ -435,6 +601,7 @@ static void *qthread_master(void *arg)
     /* Initialize myself                                                           */
     /*******************************************************************************/
     TLS_SET(shepherd_structs, arg);
+    qt_stacks_worker_init(me_worker);
 #ifdef QTHREAD_USE_SPAWNCACHE
     localqueue = qt_init_local_spawncache();
 #endif
@@ -471,11 +638,18 @@ static void *qthread_master(void *arg)
         while (!QTHREAD_CASLOCK_READ_UI(me_worker->active)) {
             SPINLOCK_BODY();
         }
+        QT_IO_POLL();
+        if (me_worker->handoff) {
+            /* a task woken by the one that just ran here; see qthread_internal_handoff() */
+            t                  = me_worker->handoff;
+            me_worker->handoff = NULL;
+        } else {
 #ifdef QTHREAD_LOCAL_PRIORITY
-        t = qt_scheduler_get_thread(threadqueue, localpriorityqueue, localqueue, QTHREAD_CASLOCK_READ_UI(me->active));
+            t = qt_scheduler_get_thread(threadqueue, localpriorityqueue, localqueue, QTHREAD_CASLOCK_READ_UI(me->active));
 #else
-        t = qt_scheduler_get_thread(threadqueue, localqueue, QTHREAD_CASLOCK_READ_UI(me->active));
+            t = qt_scheduler_get_thread(threadqueue, localqueue, QTHREAD_CASLOCK_READ_UI(me->active));
 #endif /* ifdef QTHREAD_LOCAL_PRIORITY */
+        }
         assert(t);
 #ifdef QTHREAD_SHEPHERD_PROFILING
         qtimer_stop(idle);
@@ -569,7 +743,10 @@ static void *qthread_master(void *arg)
                 *current = t;
 
 #ifdef HAVE_NATIVE_MAKECONTEXT
-                getcontext(&my_context);
+                /* simple tasks are plain calls; they never return to it */
+                if ((t->flags & QTHREAD_SIMPLE) == 0) {
+                    getcontext(&my_context);
+                }
 #endif
                 qthread_debug(THREAD_DETAILS, "id(%u): about to exec thread. shepherd context is %p\n", my_id, &my_context);
                 qthread_exec(t, &my_context);
@@ -740,6 +917,72 @@ void qthread_default_agg_f (int count, qthread_f* f, void** arg, void** ret, uin
     }
 }
 
+/* Tasks that carry their arguments inline are allocated from one of several
+ * size classes, so that a task with a few words of arguments does not pay
+ * for a full ARGCOPY_SIZE buffer. The data[] of each class (arguments, then
+ * the default task-local storage) holds 64, 128, 256, ... bytes, and the last
+ * class has room for at least ARGCOPY_SIZE bytes of arguments. Class 0 is the plain
+ * task structure, for tasks without inline arguments. */
+static void qthread_internal_task_classes_init(void)
+{                      /*{{{ */
+    const unsigned int tasklocal = (qlib->qthread_tasklocal_size + 7) & ~7u;
+    unsigned int       largest   = 0;
+    unsigned int       data, c = 1;
+
+    if (qlib->qthread_argcopy_size > 0) {
+        /* the last class gets whatever is left of its final cache line */
+        largest = ((qlib->qthread_argcopy_size + tasklocal + 63) & ~63u) - tasklocal;
+    }
+
+    qlib->task_class_args[0] = 0;
+    for (data = 64; 2 * data <= largest + tasklocal && c < QTHREAD_TASK_CLASSES - 1; data *= 2) {
+        if (data > tasklocal) {
+            qlib->task_class_args[c++] = data - tasklocal;
+        }
+    }
+    if (largest > 0) {
+        qlib->task_class_args[c++] = largest;
+    }
+    qlib->task_classes = c;
+    for (c = 0; c < qlib->task_classes; c++) {
+        qlib->task_class_allocs[c] = 0;
+        qlib->task_class_frees[c]  = 0;
+        qthread_debug(CORE_DETAILS, "task class %u: %u argument bytes\n",
+                      c, qlib->task_class_args[c]);
+    }
+}                      /*}}} */
+
+/* Every task gets a stack of one of a few size classes, picked when it is
+ * spawned (QTHREAD_SPAWN_STACK()). The default class is QT_STACK_SIZE; the
+ * small, large and huge ones default to a quarter of it (but at least 4kB),
+ * eight times it and 64 times it. All are rounded up to a multiple of 16
+ * bytes, or of the page size with guard pages. With growable stacks,
+ * qt_stacks_init() widens them to the address space each one reserves. */
+static void qthread_internal_stack_classes_init(void)
+{                      /*{{{ */
+    static const char *const names[QTHREAD_STACK_CLASSES] = {
+        "STACK_SIZE", "STACK_SIZE_SMALL", "STACK_SIZE_LARGE", "STACK_SIZE_HUGE"
+    };
+    const unsigned int round = GUARD_PAGES ? pagesize : 16;
+    unsigned int       dflt[QTHREAD_STACK_CLASSES];
+    unsigned int       c;
+
+    dflt[QTHREAD_STACK_DEFAULT] = qt_internal_get_env_num("STACK_SIZE",
+                                                          QTHREAD_DEFAULT_STACK_SIZE,
+                                                          QTHREAD_DEFAULT_STACK_SIZE);
+    dflt[QTHREAD_STACK_SMALL] = (dflt[QTHREAD_STACK_DEFAULT] / 4 > 4096) ? dflt[QTHREAD_STACK_DEFAULT] / 4 : 4096;
+    dflt[QTHREAD_STACK_LARGE] = dflt[QTHREAD_STACK_DEFAULT] * 8;
+    dflt[QTHREAD_STACK_HUGE]  = dflt[QTHREAD_STACK_DEFAULT] * 64;
+    for (c = 0; c < QTHREAD_STACK_CLASSES; c++) {
+        unsigned int size = (c == QTHREAD_STACK_DEFAULT) ? dflt[c]
+                            : qt_internal_get_env_num(names[c], dflt[c], dflt[c]);
+
+        qlib->stack_class_size[c] = (size + round - 1) / round * round;
+        qthread_debug(CORE_DETAILS, "stack class %u: %u bytes\n", c, qlib->stack_class_size[c]);
+    }
+    qlib->qthread_stack_size = qlib->stack_class_size[QTHREAD_STACK_DEFAULT];
+}                      /*}}} */
+
 int API_FUNC qthread_init(qthread_shepherd_id_t nshepherds)
 {                      /*{{{ */
     char newenv[100];
@@ -831,6 +1074,8 @@ int API_FUNC qthread_initialize(void)
 #endif
 
     qt_internal_alignment_init();
+    qlib->hugepages = qt_internal_get_env_bool("HUGEPAGES", 0);
+    qt_mpool_subsystem_init();
     qt_hash_initialize_subsystem();
 
 #ifndef QTHREAD_NO_ASSERTS
@@ -885,12 +1130,6 @@ int API_FUNC qthread_initialize(void)
     QTHREAD_FASTLOCK_INIT(qlib->nworkers_active_lock);
 #endif
 
-    qt_mpool_subsystem_init();
-
-    qlib->qthread_stack_size = qt_internal_get_env_num("STACK_SIZE",
-                                                       QTHREAD_DEFAULT_STACK_SIZE,
-                                                       QTHREAD_DEFAULT_STACK_SIZE);
-    qthread_debug(CORE_DETAILS, "qthread stack size: %u\n", qlib->qthread_stack_size);
 #ifdef QTHREAD_GUARD_PAGES
     GUARD_PAGES = qt_internal_get_env_bool("GUARD_PAGES", 1);
 #endif
@@ -898,12 +1137,8 @@ int API_FUNC qthread_initialize(void)
         if (print_info) {
             print_status("Guard Pages Enabled\n");
         }
-        /* round stack size to nearest page */
-        if (qlib->qthread_stack_size % pagesize) {
-            qlib->qthread_stack_size +=
-                pagesize - (qlib->qthread_stack_size % pagesize);
-        }
     }
+    qthread_internal_stack_classes_init();
     if (print_info) {
         print_status("Using %u byte stack size.\n", qlib->qthread_stack_size);
     }
@@ -954,6 +1189,7 @@ int API_FUNC qthread_initialize(void)
         }
         assert(qlib->shepherds[0].sorted_sheplist);
         assert(qlib->shepherds[0].shep_dists);
+        qt_shepherd_steal_levels_init(qlib->shepherds, nshepherds);
     }
 
     // Set task argument buffer size
@@ -965,24 +1201,56 @@ int API_FUNC qthread_initialize(void)
                                                            TASKLOCAL_DEFAULT,
                                                            sizeof(void *));
     qthread_debug(CORE_DETAILS, "qthread task-local size: %u\n", qlib->qthread_tasklocal_size);
+    qthread_internal_task_classes_init();
+
+    qlib->wake_handoff = qt_internal_get_env_bool("WAKE_HANDOFF", 0);
+    qt_spinwait_init(nshepherds * nworkerspershep);
 
 #ifndef UNPOOLED
     generic_qthread_pool     = qt_mpool_create_aligned(sizeof(qthread_t) + sizeof(void *) + qlib->qthread_tasklocal_size, qthread_cacheline());
-    generic_big_qthread_pool = qt_mpool_create(sizeof(qthread_t) + qlib->qthread_argcopy_size + qlib->qthread_tasklocal_size);
-    if (GUARD_PAGES) {
-        generic_stack_pool =
-            qt_mpool_create_aligned(qlib->qthread_stack_size + sizeof(struct qthread_runtime_data_s) +
-                                    (2 * getpagesize()), getpagesize());
-    } else {
-        generic_stack_pool = qt_mpool_create_aligned(qlib->qthread_stack_size + sizeof(struct qthread_runtime_data_s), QTHREAD_STACK_ALIGNMENT);     // stacks on most platforms must be 16-byte aligned (or less)
+    qt_mpool_set_name(generic_qthread_pool, "tasks");
+    for (i = 1; i < qlib->task_classes; i++) {
+        static const char *const names[QTHREAD_TASK_CLASSES] = {
+            "tasks", "tasks (args 1)", "tasks (args 2)", "tasks (args 3)",
+            "tasks (args 4)", "tasks (args 5)", "tasks (args 6)", "tasks (args 7)"
+        };
+
+        generic_big_qthread_pools[i] = qt_mpool_create_aligned(sizeof(qthread_t) + qlib->task_class_args[i] + qlib->qthread_tasklocal_size,
+                                                               qthread_cacheline());
+        qt_mpool_set_name(generic_big_qthread_pools[i], names[i]);
+    }
+    stack_cache_max          = qt_internal_get_env_num("STACK_CACHE", stack_cache_max, 0);
+# ifdef QTHREAD_STACK_ARENAS
+    qt_stacks_init(sizeof(struct qthread_runtime_data_s), GUARD_PAGES);
+# else
+    for (i = 0; i < QTHREAD_STACK_CLASSES; i++) {
+        if (GUARD_PAGES) {
+            generic_stack_pools[i] =
+                qt_mpool_create_aligned(qlib->stack_class_size[i] + sizeof(struct qthread_runtime_data_s) +
+                                        (2 * getpagesize()), getpagesize());
+        } else {
+            generic_stack_pools[i] = qt_mpool_create_aligned(qlib->stack_class_size[i] + sizeof(struct qthread_runtime_data_s), QTHREAD_STACK_ALIGNMENT);     // stacks on most platforms must be 16-byte aligned (or less)
+        }
+        {
+            static const char *const names[QTHREAD_STACK_CLASSES] = {
+                "stacks", "stacks (small)", "stacks (large)", "stacks (huge)"
+            };
+
+            qt_mpool_set_name(generic_stack_pools[i], names[i]);
+        }
     }
+# endif
     generic_rdata_pool = qt_mpool_create(sizeof(struct qthread_runtime_data_s));
+    qt_mpool_set_name(generic_rdata_pool, "runtime data");
 #endif /* ifndef UNPOOLED */
     initialize_hazardptrs();
     qt_internal_teams_init();
     qthread_queue_subsystem_init();
     qt_feb_subsystem_init(need_sync);
     qt_syncvar_subsystem_init(need_sync);
+#ifdef QTHREAD_PARKING
+    qt_park_init();
+#endif /* QTHREAD_PARKING */
     qt_threadqueue_subsystem_init();
     qt_blocking_subsystem_init();
 
@@ -1131,6 +1399,11 @@ int API_FUNC qthread_initialize(void)
                                                                     sizeof(qthread_t *));
             qlib->shepherds[i].workers[j].stealbuffer = qt_calloc(STEAL_BUFFER_LENGTH,
                                                                   sizeof(qthread_t *));
+#if !defined(UNPOOLED_STACKS) && !defined(UNPOOLED)
+            if (stack_cache_max > 0) {
+                qlib->shepherds[i].workers[j].stack_cache = MALLOC(QTHREAD_STACK_CLASSES * stack_cache_max * sizeof(void *));
+            }
+#endif
             # ifdef QTHREAD_PERFORMANCE
             QTPERF_ASSERT(((qtperf_should_instrument_workers != 0 &&  (qtperf_workers_group != NULL)) ||
                            (qtperf_should_instrument_workers == 0 && (qtperf_workers_group == NULL))));
@@ -1496,10 +1769,23 @@ void API_FUNC qthread_finalize(void)
             }
             FREE(shep->workers[j].nostealbuffer, STEAL_BUFFER_LENGTH * sizeof(qthread_t *));
             FREE(shep->workers[j].stealbuffer, STEAL_BUFFER_LENGTH * sizeof(qthread_t *));
+            if (shep->workers[j].simple_rdata) {
+                FREE_RDATA(shep->workers[j].simple_rdata);
+            }
+            qthread_internal_drain_stack_cache(&shep->workers[j]);
+            qt_stacks_worker_finalize(&shep->workers[j]);
         }
         if (i == 0) {
             FREE(shep0->workers[0].nostealbuffer, STEAL_BUFFER_LENGTH * sizeof(qthread_t *));
             FREE(shep0->workers[0].stealbuffer, STEAL_BUFFER_LENGTH * sizeof(qthread_t *));
+            if (shep0->workers[0].simple_rdata) {
+                FREE_RDATA(shep0->workers[0].simple_rdata);
+            }
+            qthread_internal_drain_stack_cache(&shep0->workers[0]);
+            qt_stacks_worker_finalize(&shep0->workers[0]);
+            /* no longer a worker; keep anything that looks up its worker
+             * from here on (the memory pools, for one) off the freed array */
+            TLS_SET(shepherd_structs, NULL);
         }
         FREE(qlib->shepherds[i].workers, qlib->nworkerspershep * sizeof(qthread_worker_t));
         if (i == 0) { continue; }
@@ -1553,6 +1839,9 @@ void API_FUNC qthread_finalize(void)
                           shep->febwait_maxtime);
         shep0->febwait_time  += shep->febwait_time;
         shep0->febwait_count += shep->febwait_count;
+        shep0->spinwait_hits   += shep->spinwait_hits;
+        shep0->spinwait_misses += shep->spinwait_misses;
+        shep0->spinwait_skips  += shep->spinwait_skips;
         QTHREAD_ACCUM_MAX(shep0->empty_maxtime, shep->empty_maxtime);
         shep0->empty_time  += shep->empty_time;
         shep0->empty_count += shep->empty_count;
@@ -1603,16 +1892,19 @@ void API_FUNC qthread_finalize(void)
                  (unsigned long long)shep0->febwait_count,
                  (shep0->febwait_count == 0) ? 0 : (shep0->febwait_time / shep0->febwait_count),
                  shep0->febwait_maxtime);
+    if (qt_spinwait_max > 0.0) {
+        print_status("%llu FEB/syncvar reads spun until full, %llu spun and blocked, %llu blocked without spinning\n",
+                     (unsigned long long)shep0->spinwait_hits,
+                     (unsigned long long)shep0->spinwait_misses,
+                     (unsigned long long)shep0->spinwait_skips);
+    }
     print_status("%llu FEB bits emptied, stayed empty average %g secs, max %g secs\n",
                  (unsigned long long)shep0->empty_count,
                  (shep0->empty_count == 0) ? 0 : (shep0->empty_time /
                                                   shep0->empty_count), shep0->empty_maxtime);
 #endif /* ifdef QTHREAD_FEB_PROFILING */
 
-#ifdef LOCK_FREE_FEBS
-    extern unsigned int QTHREAD_LOCKING_STRIPES;
-    QTHREAD_LOCKING_STRIPES = 1;
-#elif defined(QTHREAD_MUTEX_INCREMENT) || (QTHREAD_ASSEMBLY_ARCH == QTHREAD_POWERPC32)
+#if defined(QTHREAD_MUTEX_INCREMENT) || (QTHREAD_ASSEMBLY_ARCH == QTHREAD_POWERPC32)
     extern unsigned int QTHREAD_LOCKING_STRIPES;
     for (i = 0; i < QTHREAD_LOCKING_STRIPES; i++) {
         QTHREAD_FASTLOCK_DESTROY(qlib->atomic_locks[i]);
@@ -1669,16 +1961,27 @@ void API_FUNC qthread_finalize(void)
         if (qlib->shepherds[i].sorted_sheplist) {
             FREE(qlib->shepherds[i].sorted_sheplist, (qlib->nshepherds - 1) * sizeof(qthread_shepherd_id_t));
         }
+        if (qlib->shepherds[i].steal_victims) {
+            FREE(qlib->shepherds[i].steal_victims, (qlib->nshepherds - 1) * sizeof(qthread_shepherd_id_t));
+        }
     }
 
 #ifndef UNPOOLED
     qthread_debug(CORE_DETAILS, "destroy global memory pools\n");
     qt_mpool_destroy(generic_qthread_pool);
     generic_qthread_pool = NULL;
-    qt_mpool_destroy(generic_big_qthread_pool);
-    generic_big_qthread_pool = NULL;
-    qt_mpool_destroy(generic_stack_pool);
-    generic_stack_pool = NULL;
+    for (i = 1; i < qlib->task_classes; i++) {
+        qt_mpool_destroy(generic_big_qthread_pools[i]);
+        generic_big_qthread_pools[i] = NULL;
+    }
+# ifdef QTHREAD_STACK_ARENAS
+    qt_stacks_finalize();
+# else
+    for (i = 0; i < QTHREAD_STACK_CLASSES; i++) {
+        qt_mpool_destroy(generic_stack_pools[i]);
+        generic_stack_pools[i] = NULL;
+    }
+# endif
     qt_mpool_destroy(generic_rdata_pool);
     generic_rdata_pool = NULL;
 #endif /* ifndef UNPOOLED */
@@ -1728,14 +2031,14 @@ void API_FUNC *qthread_get_tasklocal(unsigned int size)
         if ((0 == tl_sz) && (size <= qlib->qthread_tasklocal_size)) {
             // Use default space
             if (f->flags & QTHREAD_BIG_STRUCT) {
-                return &f->data[qlib->qthread_argcopy_size];
+                return &f->data[qlib->task_class_args[f->size_class]];
             } else {
                 return &f->data;
             }
         } else {
             void **data_blob;
             if (f->flags & QTHREAD_BIG_STRUCT) {
-                data_blob = (void **)&f->data[qlib->qthread_argcopy_size];
+                data_blob = (void **)&f->data[qlib->task_class_args[f->size_class]];
             } else {
                 data_blob = (void **)&f->data[0];
             }
@@ -1791,28 +2094,23 @@ API_FUNC void* qthread_bos(void)
 {
     const qthread_t *f = qthread_internal_self();
 
-    return f->rdata->stack + qlib->qthread_stack_size;
+    return f->rdata->stack + qlib->stack_class_size[f->stack_class];
 }
 
 size_t API_FUNC qthread_stackleft(void)
 {                      /*{{{ */
     const qthread_t *f = qthread_internal_self();
 
-    if ((f != NULL) && (f->rdata->stack != NULL)) {
-        assert((size_t)&f > (size_t)f->rdata->stack &&
-               (size_t)&f < ((size_t)f->rdata->stack + qlib->qthread_stack_size));
-#ifdef STACK_GROWS_DOWN
-        /* not tested */
-        assert(((size_t)(f->rdata->stack) + qlib->qthread_stack_size) -
-               (size_t)(&f) < qlib->qthread_stack_size);
-        return ((size_t)(f->rdata->stack) + qlib->qthread_stack_size) -
-               (size_t)(&f);
+    /* Stacks grow down, so what is left is the distance from here to the
+     * bottom of the task's stack, in its own size class; a growable stack
+     * can use all of it, committed yet or not. */
+    if ((f != NULL) && (f->rdata != NULL) && (f->rdata->stack != NULL)) {
+        const size_t bottom = (size_t)f->rdata->stack;
+        const size_t here   = (size_t)&f;
 
-#else
-        assert((size_t)(&f) - (size_t)(f->rdata->stack) <
-               qlib->qthread_stack_size);
-        return (size_t)(&f) - (size_t)(f->rdata->stack);
-#endif
+        assert(here > bottom &&
+               here < bottom + qlib->stack_class_size[f->stack_class]);
+        return here - bottom;
     } else {
         return 0;
     }
@@ -1919,11 +2217,89 @@ size_t API_FUNC qthread_readstate(const enum introspective_state type)
                 return 0;
             }
 
+        case STACK_CACHE_HITS:
+        case STACK_CACHE_MISSES:
+        case STACK_DONATIONS:
+        {
+            size_t count = 0;
+            const qthread_shepherd_t *sheps = qlib->shepherds;
+            for (qthread_shepherd_id_t s=0; s<qlib->nshepherds; s++) {
+                const qthread_worker_t *wkrs = sheps[s].workers;
+                for (qthread_worker_id_t w=0; w<qlib->nworkerspershep; w++) {
+                    count += (type == STACK_CACHE_HITS) ? wkrs[w].stack_hits :
+                             (type == STACK_CACHE_MISSES) ? wkrs[w].stack_misses :
+                             wkrs[w].stack_donations;
+                }
+            }
+            return count;
+        }
+
+        case STACK_GROWTHS:
+#ifdef QTHREAD_GROWABLE_STACKS
+            return qt_stacks_growths();
+#else
+            return 0;
+#endif
+
+        case POOL_BYTES:
+            return qt_mpool_bytes();
+
+        case POOL_HUGEPAGE_BYTES:
+            return qt_mpool_hugepage_bytes();
+
         default:
             return (size_t)(-1);
     }
 }                      /*}}} */
 
+size_t API_FUNC qthread_stack_class_size(unsigned int stack_class)
+{                      /*{{{ */
+    assert(qlib);
+    qassert_ret(stack_class < QTHREAD_STACK_CLASSES, 0);
+    return qlib->stack_class_size[stack_class];
+}                      /*}}} */
+
+unsigned int API_FUNC qthread_task_classes(void)
+{                      /*{{{ */
+    assert(qlib);
+    return qlib->task_classes;
+}                      /*}}} */
+
+int API_FUNC qthread_task_class_stats(unsigned int                cls,
+                                      qthread_task_class_stats_t *stats)
+{                      /*{{{ */
+    const qthread_shepherd_t *sheps;
+    size_t                    allocs, frees;
+
+    assert(qlib);
+    qassert_ret(stats, QTHREAD_BADARGS);
+    qassert_ret(cls < qlib->task_classes, QTHREAD_BADARGS);
+
+    /* a task is usually freed by a different worker than allocated it, so
+     * only the totals mean anything */
+    allocs = qlib->task_class_allocs[cls];
+    frees  = qlib->task_class_frees[cls];
+    sheps  = qlib->shepherds;
+    for (qthread_shepherd_id_t s = 0; s < qlib->nshepherds; s++) {
+        const qthread_worker_t *wkrs = sheps[s].workers;
+        for (qthread_worker_id_t w = 0; w < qlib->nworkerspershep; w++) {
+            allocs += wkrs[w].task_allocs[cls];
+            frees  += wkrs[w].task_frees[cls];
+        }
+    }
+    stats->args   = qlib->task_class_args[cls];
+    stats->bytes  = sizeof(qthread_t) + qlib->qthread_tasklocal_size +
+                    ((cls == 0) ? sizeof(void *) : stats->args);
+#if !defined(UNPOOLED_QTHREAD_T) && !defined(UNPOOLED)
+    /* the pools hand out whole cache lines */
+    stats->bytes = (stats->bytes + qthread_cacheline() - 1) & ~(size_t)(qthread_cacheline() - 1);
+#endif
+    stats->allocs = allocs;
+    /* the counters are read while other workers update them */
+    stats->live = (allocs > frees) ? (allocs - frees) : 0;
+    return QTHREAD_SUCCESS;
+}                      /*}}} */
+
 aligned_t API_FUNC *qthread_retloc(void)
 {                      /*{{{ */
     qthread_t *me = qthread_internal_self();
@@ -1945,14 +2321,26 @@ static QINLINE qthread_t *qthread_thread_new(const qthread_f f,
                                              qt_team_t      *team,
                                              int             team_leader)
 {                      /*{{{ */
-    qthread_t *t;
+    qthread_t        *t;
+    qthread_worker_t *w = qthread_internal_getworker();
+    unsigned int      c = 0;
 
     if ((arg_size > 0) && (arg_size <= qlib->qthread_argcopy_size)) {
-        t = ALLOC_BIG_QTHREAD();
+        /* the smallest class the arguments fit in */
+        for (c = 1; qlib->task_class_args[c] < arg_size; c++) ;
+        assert(c < qlib->task_classes);
+        t = ALLOC_BIG_QTHREAD(c);
     } else {
         t = ALLOC_QTHREAD();
     }
-    qthread_debug(THREAD_DETAILS, "t = %p\n", t);
+    t->size_class  = c;
+    t->stack_class = QTHREAD_STACK_DEFAULT;
+    if (w) {
+        w->task_allocs[c]++;
+    } else {
+        qthread_incr(&qlib->task_class_allocs[c], 1);
+    }
+    qthread_debug(THREAD_DETAILS, "t = %p (class %u)\n", t, c);
 
     t->f     = f;
     t->arg   = (void *)arg;
@@ -2012,6 +2400,8 @@ static QINLINE qthread_t *qthread_thread_new(const qthread_f f,
 
 void qthread_thread_free(qthread_t *t)
 {                      /*{{{ */
+    qthread_worker_t *w;
+
     assert(t != NULL);
 
     qthread_debug(THREAD_FUNCTIONS, "t(%p): destroying thread id %i\n", t, t->thread_id);
@@ -2019,8 +2409,8 @@ void qthread_thread_free(qthread_t *t)
         if (t->rdata->tasklocal_size > 0) {
             qthread_debug(THREAD_DETAILS, "t(%p,%i): destroying %u bytes of task-local storage\n", t, t->thread_id, t->rdata->tasklocal_size);
             if (t->flags & QTHREAD_BIG_STRUCT) {
-                FREE(*(void **)&t->data[qlib->qthread_argcopy_size], t->rdata->tasklocal_size);
-                *(void **)&t->data[qlib->qthread_argcopy_size] = NULL;
+                FREE(*(void **)&t->data[qlib->task_class_args[t->size_class]], t->rdata->tasklocal_size);
+                *(void **)&t->data[qlib->task_class_args[t->size_class]] = NULL;
             } else {
                 FREE(*(void **)&t->data[0], t->rdata->tasklocal_size);
                 *(void **)&t->data[0] = NULL;
@@ -2030,12 +2420,18 @@ void qthread_thread_free(qthread_t *t)
         VALGRIND_STACK_DEREGISTER(t->rdata->valgrind_stack_id);
 #endif
         if (t->flags & QTHREAD_SIMPLE) {
+            w = qthread_internal_getworker();
             qthread_debug(THREAD_DETAILS, "t(%p): releasing rdata %p\n", t, t->rdata);
-            FREE_RDATA(t->rdata);
+            if (w && (w->simple_rdata == NULL)) {
+                w->simple_rdata = t->rdata;
+            } else {
+                FREE_RDATA(t->rdata);
+            }
         } else {
             assert(t->rdata->stack);
             qthread_debug(THREAD_DETAILS, "t(%p): releasing stack %p\n", t, t->rdata->stack);
-            FREE_STACK(t->rdata->stack);
+            free_stack(qthread_internal_getworker(), t->rdata->stack,
+                       t->rdata->stack_owner, t->stack_class);
         }
 
         t->rdata = NULL;
@@ -2046,6 +2442,12 @@ void qthread_thread_free(qthread_t *t)
         t->arg = NULL;
     }
     qthread_debug(THREAD_DETAILS, "t(%p): releasing thread handle %p\n", t, t);
+    w = qthread_internal_getworker();
+    if (w) {
+        w->task_frees[t->size_class]++;
+    } else {
+        qthread_incr(&qlib->task_class_frees[t->size_class], 1);
+    }
     if (t->flags & QTHREAD_BIG_STRUCT) {
         FREE_BIG_QTHREAD(t);
     } else {
@@ -2067,7 +2469,7 @@ extern void *qthread_fence2;
 void API_FUNC qthread_call_method(qthread_f f, void*arg, void* ret, uint16_t flags){
     if (ret) {
         if (flags & QTHREAD_RET_IS_SINC) {
-            if (flags & QTHREAD_RET_IS_VOID_SINC) {
+            if ((flags & QTHREAD_RET_IS_VOID_SINC) == QTHREAD_RET_IS_VOID_SINC) {
                 (f)(arg);
                 qt_sinc_submit((qt_sinc_t *)ret, NULL);
             } else {
@@ -2132,7 +2534,7 @@ static void qthread_wrapper(void *ptr)
                   t->thread_id, t->f, t->arg);
     if ((t->flags & QTHREAD_SIMPLE) == 0) {
         assert((size_t)&t > (size_t)t->rdata->stack &&
-               (size_t)&t < ((size_t)t->rdata->stack + qlib->qthread_stack_size));
+               (size_t)&t < ((size_t)t->rdata->stack + qlib->stack_class_size[t->stack_class]));
     }
 #ifdef QTHREAD_COUNT_THREADS
     QTHREAD_FASTLOCK_LOCK(&effconcurrentthreads_lock);
@@ -2169,7 +2571,7 @@ static void qthread_wrapper(void *ptr)
     else if (t->ret) {
         qthread_debug(THREAD_DETAILS, "tid %u, with flags %u, handling retval\n", t->thread_id, t->flags);
         if (t->flags & QTHREAD_RET_IS_SINC) {
-            if (t->flags & QTHREAD_RET_IS_VOID_SINC) {
+            if ((t->flags & QTHREAD_RET_IS_VOID_SINC) == QTHREAD_RET_IS_VOID_SINC) {
                 (t->f)(t->arg);
                 if (NULL != t->team) { qt_internal_teamfinish(t->team, t->flags); }
                 qt_sinc_submit((qt_sinc_t *)t->ret, NULL);
@@ -2258,7 +2660,7 @@ void INTERNAL qthread_exec(qthread_t    *t,
             QTPERF_QTHREAD_ENTER_STATE(t->rdata->performance_data, QTHREAD_STATE_RUNNING);
 #endif /*  ifdef QTHREAD_PERFORMANCE */
             qthread_makecontext(&t->rdata->context,
-                                t->rdata->stack, qlib->qthread_stack_size,
+                                t->rdata->stack, qlib->stack_class_size[t->stack_class],
                                 (void (*)(void))qthread_wrapper, t, c);
 #ifdef HAVE_NATIVE_MAKECONTEXT
         } else {
@@ -2318,7 +2720,8 @@ void API_FUNC qthread_yield_(int k)
     assert(qthread_library_initialized);
     qthread_t *t = qthread_internal_self();
 
-    if (t != NULL) {
+    /* a simple task has no context to yield; it just keeps running */
+    if ((t != NULL) && ((t->flags & QTHREAD_SIMPLE) == 0)) {
         qthread_debug(THREAD_CALLS,
                       "tid %u yielding...\n", t->thread_id);
         switch (k) {
@@ -2344,7 +2747,7 @@ void API_FUNC qthread_yield_(int k)
                         nt->thread_state = QTHREAD_STATE_YIELDED; // special indicator state for qthread_wrapper()
                         QTPERF_QTHREAD_ENTER_STATE(nt->rdata->performance_data, QTHREAD_STATE_YIELDED);
                         nt->rdata->blockedon.thread = t;
-                        qthread_makecontext(&nt->rdata->context, nt->rdata->stack, qlib->qthread_stack_size, (void(*)(void))qthread_wrapper, nt, t->rdata->return_context);
+                        qthread_makecontext(&nt->rdata->context, nt->rdata->stack, qlib->stack_class_size[nt->stack_class], (void(*)(void))qthread_wrapper, nt, t->rdata->return_context);
                         nt->rdata->return_context = t->rdata->return_context;
                         RLIMIT_TO_TASK(t);
                         /* SWAP! */
@@ -2547,6 +2950,14 @@ int API_FUNC qthread_spawn(qthread_f             f,
     if (feature_flag & QTHREAD_SPAWN_SIMPLE) {
         t->flags |= QTHREAD_SIMPLE;
     }
+    t->stack_class = (feature_flag & QTHREAD_SPAWN_STACK_MASK) >> QTHREAD_SPAWN_STACK_SHIFT;
+    if (feature_flag & QTHREAD_SPAWN_PRIORITY_MASK) {
+#ifdef QTHREAD_LOCAL_PRIORITY
+        if (!(feature_flag & QTHREAD_SPAWN_LOCAL_PRIORITY))
+#endif
+        t->flags |= (((feature_flag & QTHREAD_SPAWN_PRIORITY_MASK) >> QTHREAD_SPAWN_PRIORITY_SHIFT)
+                     << QTHREAD_PRIORITY_SHIFT);
+    }
     qthread_debug(THREAD_BEHAVIOR, "new-tid %u shep %u\n", t->thread_id, dest_shep);
        /* Step 4: Prepare the return value location (if necessary) */
     if (ret) {
@@ -2913,9 +3324,49 @@ int API_FUNC qthread_fork_syncvar_to(qthread_f             f,
                          QTHREAD_SPAWN_RET_SYNCVAR_T);
 } /*}}}*/
 
+/* With QT_WAKE_HANDOFF, give t, a blocked task that the calling task has
+ * just released, to the caller's worker to run as soon as the caller blocks,
+ * yields or finishes, skipping the ready queue (and any steal). The worker
+ * holds one such task; an older one goes to the ready queue. Returns 0, and
+ * leaves scheduling t to the caller, if t cannot run here. */
+int INTERNAL qthread_internal_handoff(qthread_t *t)
+{                      /*{{{ */
+    qthread_worker_t *me = qthread_internal_getworker();
+    qthread_t        *prev;
+
+    if (!qlib->wake_handoff || (me == NULL) || (me->current == NULL)) {
+        return 0;
+    }
+    if ((t->flags & QTHREAD_REAL_MCCOY) ||
+        ((t->flags & QTHREAD_UNSTEALABLE) && (t->rdata->shepherd_ptr != me->shepherd))) {
+        return 0;
+    }
+    qthread_debug(THREAD_DETAILS, "tid %u handing off to tid %u\n", me->current->thread_id, t->thread_id);
+    prev        = me->handoff;
+    me->handoff = t;
+    if (prev) {
+        qt_threadqueue_enqueue(me->shepherd->ready, prev);
+    }
+    return 1;
+}                      /*}}} */
+
+/* A QTHREAD_SIMPLE task runs as a plain call on its worker's stack, with no
+ * context of its own to save, so it cannot be suspended. Blocking calls that
+ * can do without suspending (yields, blocking syscalls) already do; anything
+ * else that gets here is a broken promise, and carrying on would jump through
+ * a context that was never made. */
+static void qthread_simple_blocked(qthread_t *t)
+{                      /*{{{ */
+    print_error("task %u (f=%p) was spawned with QTHREAD_SPAWN_SIMPLE but tried to block (state %i)\n",
+                t->thread_id, (void *)(uintptr_t)t->f, (int)t->thread_state);
+    abort();
+}                      /*}}} */
+
 void INTERNAL qthread_back_to_master(qthread_t *t)
 {                      /*{{{ */
-    assert((t->flags & QTHREAD_SIMPLE) == 0);
+    if (QTHREAD_UNLIKELY(t->flags & QTHREAD_SIMPLE)) {
+        qthread_simple_blocked(t);
+    }
     RLIMIT_TO_NORMAL(t);
 #ifdef QTHREAD_PERFORMANCE
     QTPERF_WORKER_ENTER_STATE(qthread_internal_getworker()->performance_data, WKR_SHEPHERD);
@@ -2940,7 +3391,9 @@ void INTERNAL qthread_back_to_master(qthread_t *t)
 
 void INTERNAL qthread_back_to_master2(qthread_t *t)
 {                      /*{{{ */
-    assert((t->flags & QTHREAD_SIMPLE) == 0);
+    if (QTHREAD_UNLIKELY(t->flags & QTHREAD_SIMPLE)) {
+        qthread_simple_blocked(t);
+    }
     RLIMIT_TO_NORMAL(t);
     //qtlog(WKR_DBG, "qthread_back_to_master2 called!!!");
 #ifdef QTHREAD_PERFORMANCE
@@ -2955,6 +3408,8 @@ void INTERNAL qthread_back_to_master2(qthread_t *t)
 #endif
 #ifdef HAVE_NATIVE_MAKECONTEXT
     setcontext(t->rdata->return_context);
+#elif defined(QTHREAD_MINIMAL_CONTEXT)
+    qt_minimal_setctxt(t->rdata->return_context);
 #else
     qt_setmctxt(&t->rdata->return_context->mc);
 #endif
@@ -19,6 +19,8 @@
 #include "qt_qthread_struct.h"
 #include "qt_qthread_mgmt.h"
 #include "qt_macros.h"
+#include "qt_alloc.h"
+#include "qt_envariables.h"
 
 /* Shared Globals */
 TLS_DECL_INIT(qthread_shepherd_t *, shepherd_structs);
@@ -281,4 +283,57 @@ qthread_shepherd_t INTERNAL *qthread_find_active_shepherd(qthread_shepherd_id_t
     }
 }                      /*}}} */
 
+/* Group each shepherd's sorted_sheplist by the steal levels the affinity
+ * layer reported (nearest level first) and set the per-level probe budgets.
+ * Without level information, every victim is remote, so a sweep is a single
+ * randomized pass over all of them. */
+void INTERNAL qt_shepherd_steal_levels_init(qthread_shepherd_t   *sheps,
+                                            qthread_shepherd_id_t nshepherds)
+{                      /*{{{ */
+    static const char *const budget_names[QT_STEAL_NUM_LEVELS] = {
+        "STEAL_PROBES_CACHE", "STEAL_PROBES_NUMA", "STEAL_PROBES_REMOTE"
+    };
+    unsigned long budget[QT_STEAL_NUM_LEVELS];
+
+    for (int l = 0; l < QT_STEAL_NUM_LEVELS; l++) {
+        budget[l] = qt_internal_get_env_num(budget_names[l], 0, 0);
+    }
+    for (qthread_shepherd_id_t i = 0; i < nshepherds; i++) {
+        qthread_shepherd_t *const s = &sheps[i];
+        qthread_shepherd_id_t     k = 0;
+
+        s->steal_seed = (uint32_t)(i + 1) * 2654435761u;
+        if ((nshepherds > 1) && s->sorted_sheplist) {
+            s->steal_victims = qt_calloc(nshepherds - 1, sizeof(qthread_shepherd_id_t));
+            assert(s->steal_victims);
+        }
+        for (int l = 0; l < QT_STEAL_NUM_LEVELS; l++) {
+            qthread_shepherd_id_t const start = k;
+
+            if (s->steal_victims) {
+                for (qthread_shepherd_id_t j = 0; j < nshepherds - 1; j++) {
+                    qthread_shepherd_id_t const v  = s->sorted_sheplist[j];
+                    int const                   vl = s->steal_levels ? s->steal_levels[v] : QT_STEAL_LEVEL_REMOTE;
+                    if (vl == l) {
+                        s->steal_victims[k++] = v;
+                    }
+                }
+            }
+            s->steal_level_end[l] = k;
+            if ((budget[l] == 0) || (budget[l] > (unsigned long)(k - start))) {
+                s->steal_budget[l] = k - start;
+            } else {
+                s->steal_budget[l] = budget[l];
+            }
+            qthread_debug(SHEPHERD_DETAILS, "shep %i: %i victims at steal level %i, %i probes per sweep\n",
+                          (int)i, (int)(k - start), l, (int)s->steal_budget[l]);
+        }
+        assert(s->steal_victims == NULL || k == nshepherds - 1);
+        if (s->steal_levels) {
+            FREE(s->steal_levels, nshepherds * sizeof(unsigned char));
+            s->steal_levels = NULL;
+        }
+    }
+}                      /*}}} */
+
 /* vim:set expandtab: */
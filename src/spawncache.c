@@ -18,6 +18,7 @@
 #include "qt_alloc.h"
 #include "qt_subsystems.h"
 #include "qt_atomics.h"
+#include "qt_qthread_struct.h"
 
 /* Globals */
 TLS_DECL_INIT(qt_threadqueue_private_t *, spawn_cache);
@@ -70,6 +71,9 @@ int INTERNAL qt_spawncache_spawn(qthread_t        *t,
 {
     qt_threadqueue_private_t *cache = TLS_GET(spawn_cache);
 
+    if (t->flags & QTHREAD_PRIORITY_MASK) {
+        return 0; // the cache has no priority levels; use the real queue
+    }
     if (cache) {
         int ret = qt_threadqueue_private_enqueue(cache, q, t);
         if( !ret) {
@@ -85,6 +89,9 @@ int INTERNAL qt_spawncache_yield(qthread_t *t)
 {
     qt_threadqueue_private_t *cache = TLS_GET(spawn_cache);
 
+    if (t->flags & QTHREAD_PRIORITY_MASK) {
+        return 0;
+    }
     if (cache) {
         return qt_threadqueue_private_enqueue_yielded(cache, t);
     } else {
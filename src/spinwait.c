@@ -0,0 +1,123 @@
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+/* API Headers */
+#include "qthread/qthread.h"
+#include "qthread/qtimer.h"
+
+/* Internal Headers */
+#include "qt_visibility.h"
+#include "qt_debug.h"
+#include "qt_atomics.h"
+#include "qt_envariables.h"
+#include "qt_spinwait.h"
+#ifdef QTHREAD_FEB_PROFILING
+# include "qt_shepherd_innards.h"
+#endif
+
+/* The wait history is direct-mapped and unsynchronized: two addresses that
+ * share a slot just take turns owning it, and a torn update costs at worst
+ * one badly-sized spin. */
+#define QT_SPINWAIT_SLOTS 256
+
+typedef struct {
+    const void *addr;
+    double      est;  /* running average of the waits on addr, in seconds */
+} qt_spinwait_slot_t;
+
+/* Globals */
+double qt_spinwait_max = 0.0;
+
+static qt_spinwait_slot_t spinwait_history[QT_SPINWAIT_SLOTS];
+
+/* Static Functions */
+static QINLINE qt_spinwait_slot_t *qt_spinwait_slot(const void *addr)
+{   /*{{{*/
+    uintptr_t a = (uintptr_t)addr / sizeof(aligned_t);
+
+    return &spinwait_history[(a ^ (a >> 8) ^ (a >> 16)) % QT_SPINWAIT_SLOTS];
+} /*}}}*/
+
+/* Internal Functions */
+void INTERNAL qt_spinwait_init(unsigned long nworkers)
+{   /*{{{*/
+    unsigned long usecs = qt_internal_get_env_num("SPIN_WAIT", 0, 0);
+
+    /* with one worker, nothing can fill the word while we spin */
+    if (nworkers < 2) {
+        usecs = 0;
+    }
+    qt_spinwait_max = usecs / 1e6;
+    qthread_debug(CORE_DETAILS, "readers spin for at most %lu usecs\n", usecs);
+} /*}}}*/
+
+int INTERNAL qt_spinwait_again(qt_spinwait_t *s,
+                               const void    *addr)
+{   /*{{{*/
+    uint32_t i;
+
+    if (s->start == 0.0) {
+        const qt_spinwait_slot_t *slot = qt_spinwait_slot(addr);
+
+        s->start = qtimer_wtime();
+        if (slot->addr != addr) {
+            s->budget = qt_spinwait_max;
+        } else if (slot->est * 2 <= qt_spinwait_max) {
+            s->budget = slot->est * 2;
+        } else if (slot->est <= qt_spinwait_max) {
+            s->budget = qt_spinwait_max;
+        } else {
+            s->budget = 0.0; /* waits here are long; go straight to sleep */
+        }
+    }
+    if (qtimer_wtime() - s->start >= s->budget) {
+        return 0;
+    }
+    for (i = 0; i < s->round; i++) {
+        SPINLOCK_BODY();
+    }
+    if (s->round < QT_SPINWAIT_MAX_ROUND) {
+        s->round <<= 1;
+    }
+    return 1;
+} /*}}}*/
+
+void INTERNAL qt_spinwait_done(qt_spinwait_t *s,
+                               const void    *addr,
+                               int            blocked)
+{   /*{{{*/
+    qt_spinwait_slot_t *slot   = qt_spinwait_slot(addr);
+    double              sample = qtimer_wtime() - s->start;
+
+#ifdef QTHREAD_FEB_PROFILING
+    {
+        qthread_shepherd_t *shep = qthread_internal_getshep();
+
+        if (shep) {
+            if (!blocked) {
+                shep->spinwait_hits++;
+            } else if (s->round > 1) {
+                shep->spinwait_misses++;
+            } else {
+                shep->spinwait_skips++;
+            }
+        }
+    }
+#endif
+    /* A wait far longer than we would ever spin says all we need to know;
+     * capping it keeps one long sleep from drowning out later short waits. */
+    if (sample > 4 * qt_spinwait_max) {
+        sample = 4 * qt_spinwait_max;
+    }
+    if (slot->addr != addr) {
+        slot->addr = addr;
+        slot->est  = sample;
+    } else {
+        slot->est += (sample - slot->est) / 4;
+    }
+    s->start = 0.0;
+    s->round = 1;
+} /*}}}*/
+
+/* vim:set expandtab: */
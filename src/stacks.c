@@ -0,0 +1,522 @@
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+/* System Headers */
+#include <stdio.h>     /* for perror() */
+#include <sys/types.h> /* for mmap() */
+#include <sys/mman.h>  /* for mmap(), mprotect() and madvise() */
+#ifdef QTHREAD_GROWABLE_STACKS
+# include <signal.h>   /* for sigaction() and sigaltstack() */
+# include <unistd.h>   /* for write() */
+#endif
+
+/* Internal Headers */
+#include "qt_visibility.h"
+#include "qt_debug.h"
+#include "qt_asserts.h"
+#include "qt_atomics.h"
+#include "qt_alloc.h" /* for pagesize */
+#include "qt_envariables.h"
+#include "qthread_innards.h"
+#include "qt_shepherd_innards.h"
+#include "qt_affinity.h"
+#include "qt_stacks.h"
+#ifdef QTHREAD_GROWABLE_STACKS
+# include "qt_qthread_struct.h"
+# include "qt_qthread_mgmt.h"
+#endif
+
+#ifndef MAP_NORESERVE
+# define MAP_NORESERVE 0
+#endif
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+# define MAP_ANONYMOUS MAP_ANON
+#endif
+
+/* slots carved per mmap() */
+#define QT_STACK_REGION_SLOTS 64
+
+#ifdef QTHREAD_GROWABLE_STACKS
+/* per worker, for the fault handler and anything it chains to */
+# define QT_SIGSTACK_SIZE (64 * 1024)
+#endif
+
+typedef struct qt_stack_hdr_s {
+    struct qt_stack_hdr_s *next;
+    unsigned int           arena;
+    unsigned int           cold; /* pages have been handed back to the OS */
+#ifdef QTHREAD_GROWABLE_STACKS
+    size_t                 committed; /* bytes at the top of the stack that are accessible */
+#endif
+} qt_stack_hdr_t;
+
+/* the layout of every slot of one stack class */
+typedef struct {
+    size_t stack_bytes;  /* usable stack */
+    size_t commit_bytes; /* accessible from the start; all of it unless growable */
+    size_t slot_bytes;   /* the whole slot, page-rounded */
+    size_t stack_offset; /* from the slot to its stack */
+    size_t hdr_offset;   /* from the stack to its slot header */
+} qt_stack_class_t;
+
+typedef struct qt_stack_region_s {
+    void                     *base;
+    size_t                    bytes;
+    struct qt_stack_region_s *next;
+} qt_stack_region_t;
+
+typedef struct {
+    QTHREAD_FASTLOCK_TYPE lock;
+    qt_stack_hdr_t       *warm;
+    qt_stack_hdr_t       *cold;
+    size_t                nwarm;
+    uint8_t              *next;    /* the uncarved rest of the newest region */
+    uint8_t              *end;
+    qt_stack_region_t    *regions;
+    unsigned int          node;
+    size_t                carved;  /* slots ever carved */
+    size_t                released; /* times a stack's pages went back to the OS */
+} qt_stack_arena_t;
+
+/* Globals */
+static qt_stack_class_t  classes[QTHREAD_STACK_CLASSES];
+static size_t            guard_lo;       /* guard page below each stack, or 0 */
+static size_t            guard_hi;       /* guard page above each stack, or 0 */
+static size_t            stack_retain    = 64;
+static qt_stack_arena_t *arenas          = NULL; /* by class, then node */
+static unsigned int      narenas         = 0;    /* per class */
+static unsigned int     *shep_arena      = NULL;
+#ifdef QTHREAD_GROWABLE_STACKS
+static size_t            stack_reserve   = 1024 * 1024;
+static aligned_t         stack_growths   = 0;
+static struct sigaction  prev_segv;
+static struct sigaction  prev_bus;
+#endif
+
+/* Static Functions */
+#define HDR_OF(stack, c) ((qt_stack_hdr_t *)((uint8_t *)(stack) + (c)->hdr_offset))
+#define STACK_OF(hdr, c) ((void *)((uint8_t *)(hdr) - (c)->hdr_offset))
+#define CLASS_OF(hdr)    (&classes[(hdr)->arena / narenas])
+#ifdef QTHREAD_GROWABLE_STACKS
+# define COMMITTED(hdr, c) ((hdr)->committed)
+#else
+# define COMMITTED(hdr, c) ((c)->stack_bytes)
+#endif
+
+static QINLINE unsigned int qt_stack_my_arena(qthread_worker_t *w,
+                                              unsigned int      cls)
+{   /*{{{*/
+    return cls * narenas + (w ? shep_arena[w->shepherd->shepherd_id] : 0);
+} /*}}}*/
+
+/* must hold a->lock */
+static qt_stack_hdr_t *qt_stack_carve(qt_stack_arena_t *a,
+                                      unsigned int      idx)
+{   /*{{{*/
+    const qt_stack_class_t *c = &classes[idx / narenas];
+    uint8_t                *slot;
+    qt_stack_hdr_t         *h;
+
+    if (a->next == a->end) {
+        const size_t       bytes  = c->slot_bytes * QT_STACK_REGION_SLOTS;
+        qt_stack_region_t *region = MALLOC(sizeof(qt_stack_region_t));
+        void              *base;
+
+        if (region == NULL) { return NULL; }
+        base = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (base == MAP_FAILED) {
+            perror("mmap in qt_stack_carve");
+            FREE(region, sizeof(qt_stack_region_t));
+            return NULL;
+        }
+#ifdef QTHREAD_HAVE_MEM_AFFINITY
+        if (a->node != QTHREAD_NO_NODE) {
+            qt_affinity_mem_tonode(base, bytes, a->node);
+        }
+#endif
+#ifdef MADV_HUGEPAGE
+        /* guard pages and growable stacks would only split huge pages */
+        if (qlib->hugepages && (guard_lo == 0)) {
+            (void)madvise(base, bytes, MADV_HUGEPAGE);
+        }
+#endif
+        region->base  = base;
+        region->bytes = bytes;
+        region->next  = a->regions;
+        a->regions    = region;
+        a->next       = base;
+        a->end        = a->next + bytes;
+        qthread_debug(CORE_DETAILS, "arena %u reserved %lu bytes at %p\n",
+                      idx, (unsigned long)bytes, base);
+    }
+    slot     = a->next;
+    a->next += c->slot_bytes;
+    a->carved++;
+    h        = HDR_OF(slot + c->stack_offset, c);
+    h->arena = idx;
+    h->cold  = 0;
+#ifdef QTHREAD_GROWABLE_STACKS
+    h->committed = c->commit_bytes;
+#endif
+    /* the low guard page and, with growable stacks, the uncommitted reserve */
+    if (guard_lo + c->stack_bytes - c->commit_bytes) {
+        if (mprotect(slot, guard_lo + c->stack_bytes - c->commit_bytes, PROT_NONE) != 0) {
+#ifdef QTHREAD_GROWABLE_STACKS
+            /* Every growable stack costs two mappings, so this is most
+             * likely vm.max_map_count running out. The stack is still good,
+             * just all of it accessible and without a guard page. */
+            static int warned = 0;
+
+            if (!warned) {
+                warned = 1;
+                perror("mprotect in qt_stack_carve (1); stacks carved from here on cannot grow");
+            }
+            h->committed = c->stack_bytes;
+#else
+            perror("mprotect in qt_stack_carve (1)");
+#endif
+        }
+    }
+    if (guard_hi) {
+        if (mprotect(slot + guard_lo + c->stack_bytes, guard_hi, PROT_NONE) != 0) {
+            perror("mprotect in qt_stack_carve (2)");
+        }
+    }
+    return h;
+} /*}}}*/
+
+static void qt_stack_release(qt_stack_hdr_t *h)
+{   /*{{{*/
+    qt_stack_arena_t       *a = &arenas[h->arena];
+    const qt_stack_class_t *c = CLASS_OF(h);
+
+#ifdef QTHREAD_GROWABLE_STACKS
+    if (h->committed > c->commit_bytes) {
+        /* hand back what the stack grew by, and make it fault again */
+        uint8_t *lo = (uint8_t *)STACK_OF(h, c) + c->stack_bytes - h->committed;
+
+        if (madvise(lo, h->committed - c->commit_bytes, MADV_DONTNEED) != 0) {
+            perror("madvise in qt_stack_release");
+        }
+        if (mprotect(lo, h->committed - c->commit_bytes, PROT_NONE) == 0) {
+            h->committed = c->commit_bytes;
+        }
+    }
+#endif
+    /* racy, but a few stacks too many or too few kept warm does no harm */
+    if (a->nwarm >= stack_retain) {
+        if (!h->cold) {
+            /* only the whole committed pages in the stack; the top one may
+             * hold rdata */
+            uintptr_t lo = ((uintptr_t)STACK_OF(h, c) + c->stack_bytes - COMMITTED(h, c) + pagesize - 1) & ~(uintptr_t)(pagesize - 1);
+            uintptr_t hi = ((uintptr_t)STACK_OF(h, c) + c->stack_bytes) & ~(uintptr_t)(pagesize - 1);
+
+            if ((hi > lo) && (madvise((void *)lo, hi - lo, MADV_DONTNEED) != 0)) {
+                perror("madvise in qt_stack_release");
+            }
+            h->cold = 1;
+        }
+        QTHREAD_FASTLOCK_LOCK(&a->lock);
+        h->next = a->cold;
+        a->cold = h;
+        a->released++;
+        QTHREAD_FASTLOCK_UNLOCK(&a->lock);
+    } else {
+        QTHREAD_FASTLOCK_LOCK(&a->lock);
+        h->next = a->warm;
+        a->warm = h;
+        a->nwarm++;
+        QTHREAD_FASTLOCK_UNLOCK(&a->lock);
+    }
+} /*}}}*/
+
+#ifdef QTHREAD_GROWABLE_STACKS
+static void qt_stack_fault_chain(int        sig,
+                                 siginfo_t *info,
+                                 void      *ctx)
+{   /*{{{*/
+    const struct sigaction *prev = (sig == SIGBUS) ? &prev_bus : &prev_segv;
+
+    if (prev->sa_flags & SA_SIGINFO) {
+        prev->sa_sigaction(sig, info, ctx);
+    } else if ((prev->sa_handler == SIG_DFL) || (prev->sa_handler == SIG_IGN)) {
+        /* a fault cannot be ignored; returning re-raises it, now fatally */
+        signal(sig, SIG_DFL);
+    } else {
+        prev->sa_handler(sig);
+    }
+} /*}}}*/
+
+/* Runs on the worker's alternate signal stack, so it must stick to what is
+ * safe in a signal handler: the current task comes from thread-local
+ * storage, and growing is a single mprotect(). */
+static void qt_stack_fault(int        sig,
+                           siginfo_t *info,
+                           void      *ctx)
+{   /*{{{*/
+    qthread_t     *t    = qthread_internal_self();
+    const uint8_t *addr = info->si_addr;
+
+    if ((t != NULL) && (t->rdata != NULL) && (t->rdata->stack != NULL) &&
+        !(t->flags & QTHREAD_SIMPLE)) {
+        const qt_stack_class_t *c     = &classes[t->stack_class];
+        uint8_t                *stack = t->rdata->stack;
+        uint8_t                *top   = stack + c->stack_bytes;
+        qt_stack_hdr_t         *h     = HDR_OF(stack, c);
+
+        if ((addr >= stack) && (addr < top - h->committed)) {
+            /* commit down to the faulting page, and at least twice what
+             * was there, so that a deep recursion only faults a few times */
+            const uintptr_t lo   = (uintptr_t)(top - h->committed);
+            uintptr_t       want = (uintptr_t)addr & ~(uintptr_t)(pagesize - 1);
+
+            if ((uintptr_t)top - (uintptr_t)stack < 2 * h->committed) {
+                want = (uintptr_t)stack;
+            } else if (want > (((uintptr_t)top - 2 * h->committed) & ~(uintptr_t)(pagesize - 1))) {
+                want = ((uintptr_t)top - 2 * h->committed) & ~(uintptr_t)(pagesize - 1);
+            }
+            if (want < (uintptr_t)stack) { want = (uintptr_t)stack; }
+            if (mprotect((void *)want, lo - want, PROT_READ | PROT_WRITE) == 0) {
+                h->committed = (uintptr_t)top - want;
+                qthread_incr(&stack_growths, 1);
+                return;
+            }
+        } else if ((addr >= stack - guard_lo) && (addr < stack)) {
+            static const char msg[] = "qthreads: a task overflowed its stack (see QT_STACK_RESERVE and QTHREAD_SPAWN_STACK())\n";
+
+            if (write(2, msg, sizeof(msg) - 1) < 0) {}
+        }
+    }
+    qt_stack_fault_chain(sig, info, ctx);
+} /*}}}*/
+
+#endif /* ifdef QTHREAD_GROWABLE_STACKS */
+
+/* Internal Functions */
+void INTERNAL qt_stacks_init(size_t rdata_size,
+                             int    guard_pages)
+{   /*{{{*/
+    qthread_shepherd_id_t nshepherds = qlib->nshepherds;
+    unsigned int         *nodes;
+    qthread_shepherd_id_t i;
+    unsigned int          j, cls;
+
+    stack_retain    = qt_internal_get_env_num("STACK_RETAIN", stack_retain, 0);
+
+    guard_hi = guard_pages ? pagesize : 0;
+#ifdef QTHREAD_GROWABLE_STACKS
+    /* the page below the reserve is what tells growth from overflow */
+    guard_lo      = pagesize;
+    stack_reserve = qt_internal_get_env_num("STACK_RESERVE", stack_reserve, 0);
+    stack_reserve = (stack_reserve + pagesize - 1) & ~(pagesize - 1);
+#else
+    guard_lo = guard_hi;
+#endif
+    for (cls = 0; cls < QTHREAD_STACK_CLASSES; cls++) {
+        qt_stack_class_t *c    = &classes[cls];
+        const size_t      tail = ((rdata_size + 15) & ~(size_t)15) + sizeof(qt_stack_hdr_t);
+
+        c->stack_bytes = qlib->stack_class_size[cls];
+#ifdef QTHREAD_GROWABLE_STACKS
+        if (stack_reserve > c->stack_bytes) {
+            c->stack_bytes = stack_reserve;
+        }
+#endif
+        c->slot_bytes = guard_lo + c->stack_bytes + guard_hi + tail;
+        c->slot_bytes = (c->slot_bytes + pagesize - 1) & ~(pagesize - 1);
+        /* A stack between guard pages has to be page-aligned. Otherwise
+         * push the top of the stack to the end of its slot so that rdata
+         * and the header share the page holding the top of the stack, which
+         * is touched anyway, rather than taking one of their own; above a
+         * lone guard page (growable stacks), the stack takes up the slack. */
+        if (guard_hi) {
+            c->stack_offset = guard_lo;
+        } else if (guard_lo) {
+            c->stack_offset = guard_lo;
+            c->stack_bytes  = (c->slot_bytes - tail - guard_lo) & ~(size_t)15;
+        } else {
+            c->stack_offset = (c->slot_bytes - tail - c->stack_bytes) & ~(size_t)15;
+        }
+        c->hdr_offset   = c->stack_bytes + guard_hi + tail - sizeof(qt_stack_hdr_t);
+        c->commit_bytes = c->stack_bytes;
+#ifdef QTHREAD_GROWABLE_STACKS
+        {
+            /* the class's size, rounded out to where a page starts */
+            const size_t top = c->stack_offset + c->stack_bytes;
+            size_t       lo  = (top - qlib->stack_class_size[cls]) & ~(pagesize - 1);
+
+            if (lo < c->stack_offset) { lo = c->stack_offset; }
+            c->commit_bytes = top - lo;
+        }
+        qlib->stack_class_size[cls] = c->stack_bytes;
+#endif
+        qthread_debug(CORE_DETAILS, "stack class %u: %lu-byte stacks (%lu committed), %lu-byte slots\n",
+                      cls, (unsigned long)c->stack_bytes, (unsigned long)c->commit_bytes,
+                      (unsigned long)c->slot_bytes);
+    }
+    qlib->qthread_stack_size = qlib->stack_class_size[QTHREAD_STACK_DEFAULT];
+
+    /* one arena per distinct node and stack class; shepherds without a node
+     * share the first */
+    shep_arena = MALLOC(nshepherds * sizeof(unsigned int));
+    nodes      = MALLOC(nshepherds * sizeof(unsigned int));
+    assert(shep_arena && nodes);
+    narenas = 0;
+    for (i = 0; i < nshepherds; i++) {
+        const unsigned int node = qthread_internal_shep_to_node(i);
+
+        for (j = 0; j < narenas; j++) {
+            if (nodes[j] == node) { break; }
+        }
+        if (j == narenas) {
+            nodes[narenas++] = node;
+        }
+        shep_arena[i] = j;
+    }
+    arenas = qt_calloc(QTHREAD_STACK_CLASSES * narenas, sizeof(qt_stack_arena_t));
+    assert(arenas);
+    for (j = 0; j < QTHREAD_STACK_CLASSES * narenas; j++) {
+        QTHREAD_FASTLOCK_INIT(arenas[j].lock);
+        arenas[j].node = nodes[j % narenas];
+    }
+    FREE(nodes, nshepherds * sizeof(unsigned int));
+    qthread_debug(CORE_DETAILS, "%u stack arenas per class, %lu kept warm per arena\n",
+                  narenas, (unsigned long)stack_retain);
+
+#ifdef QTHREAD_GROWABLE_STACKS
+    {
+        struct sigaction sa;
+
+        sa.sa_sigaction = qt_stack_fault;
+        sa.sa_flags     = SA_SIGINFO | SA_ONSTACK;
+        sigemptyset(&sa.sa_mask);
+        if ((sigaction(SIGSEGV, &sa, &prev_segv) != 0) ||
+            (sigaction(SIGBUS, &sa, &prev_bus) != 0)) {
+            perror("sigaction in qt_stacks_init");
+        }
+    }
+#endif
+} /*}}}*/
+
+void INTERNAL qt_stacks_finalize(void)
+{   /*{{{*/
+    unsigned int i;
+
+#ifdef QTHREAD_GROWABLE_STACKS
+    sigaction(SIGSEGV, &prev_segv, NULL);
+    sigaction(SIGBUS, &prev_bus, NULL);
+    qthread_debug(CORE_DETAILS, "stacks grew %lu times\n", (unsigned long)stack_growths);
+#endif
+    for (i = 0; i < QTHREAD_STACK_CLASSES * narenas; i++) {
+        qt_stack_arena_t *a = &arenas[i];
+
+        qthread_debug(CORE_DETAILS, "arena %u carved %lu stacks, released %lu\n",
+                      i, (unsigned long)a->carved, (unsigned long)a->released);
+        while (a->regions) {
+            qt_stack_region_t *r = a->regions;
+
+            a->regions = r->next;
+            munmap(r->base, r->bytes);
+            FREE(r, sizeof(qt_stack_region_t));
+        }
+        QTHREAD_FASTLOCK_DESTROY(a->lock);
+    }
+    FREE(arenas, QTHREAD_STACK_CLASSES * narenas * sizeof(qt_stack_arena_t));
+    FREE(shep_arena, qlib->nshepherds * sizeof(unsigned int));
+    arenas     = NULL;
+    shep_arena = NULL;
+    narenas    = 0;
+} /*}}}*/
+
+void INTERNAL *qt_stack_alloc(unsigned int cls)
+{   /*{{{*/
+    qthread_worker_t *w   = qthread_internal_getworker();
+    unsigned int      idx = qt_stack_my_arena(w, cls);
+    qt_stack_arena_t *a   = &arenas[idx];
+    qt_stack_hdr_t   *h;
+
+    QTHREAD_FASTLOCK_LOCK(&a->lock);
+    if (a->warm) {
+        h       = a->warm;
+        a->warm = h->next;
+        a->nwarm--;
+    } else if (a->cold) {
+        h       = a->cold;
+        a->cold = h->next;
+    } else {
+        h = qt_stack_carve(a, idx);
+    }
+    QTHREAD_FASTLOCK_UNLOCK(&a->lock);
+    if (h == NULL) { return NULL; }
+    h->cold = 0; /* it is about to be touched */
+    return STACK_OF(h, &classes[cls]);
+} /*}}}*/
+
+void INTERNAL qt_stack_free(void        *stack,
+                            unsigned int cls)
+{   /*{{{*/
+    assert(stack);
+    assert(cls < QTHREAD_STACK_CLASSES);
+    assert(HDR_OF(stack, &classes[cls])->arena / narenas == cls);
+    qt_stack_release(HDR_OF(stack, &classes[cls]));
+} /*}}}*/
+
+int INTERNAL qt_stack_is_local(void        *stack,
+                               unsigned int cls)
+{   /*{{{*/
+    qthread_worker_t *w = qthread_internal_getworker();
+
+    return w && (HDR_OF(stack, &classes[cls])->arena == qt_stack_my_arena(w, cls));
+} /*}}}*/
+
+#ifdef QTHREAD_GROWABLE_STACKS
+void INTERNAL qt_stacks_worker_init(qthread_worker_t *w)
+{   /*{{{*/
+    stack_t ss;
+
+    w->sigstack = NULL;
+    /* leave a thread that already has one (the program's main thread,
+     * perhaps) with its own */
+    if ((sigaltstack(NULL, &ss) == 0) && !(ss.ss_flags & SS_DISABLE)) {
+        return;
+    }
+    ss.ss_sp = mmap(NULL, QT_SIGSTACK_SIZE, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ss.ss_sp == MAP_FAILED) {
+        perror("mmap in qt_stacks_worker_init");
+        return;
+    }
+    ss.ss_size  = QT_SIGSTACK_SIZE;
+    ss.ss_flags = 0;
+    if (sigaltstack(&ss, NULL) != 0) {
+        perror("sigaltstack in qt_stacks_worker_init");
+        munmap(ss.ss_sp, QT_SIGSTACK_SIZE);
+        return;
+    }
+    w->sigstack = ss.ss_sp;
+} /*}}}*/
+
+/* the worker's thread has exited, or is the one calling this */
+void INTERNAL qt_stacks_worker_finalize(qthread_worker_t *w)
+{   /*{{{*/
+    stack_t ss;
+
+    if (w->sigstack == NULL) { return; }
+    if ((sigaltstack(NULL, &ss) == 0) && (ss.ss_sp == w->sigstack)) {
+        ss.ss_flags = SS_DISABLE;
+        sigaltstack(&ss, NULL);
+    }
+    munmap(w->sigstack, QT_SIGSTACK_SIZE);
+    w->sigstack = NULL;
+} /*}}}*/
+
+aligned_t INTERNAL qt_stacks_growths(void)
+{   /*{{{*/
+    return stack_growths;
+} /*}}}*/
+
+#endif /* ifdef QTHREAD_GROWABLE_STACKS */
+
+/* vim:set expandtab: */
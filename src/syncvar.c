@@ -25,6 +25,7 @@
 #include "qt_qthread_struct.h"
 #include "qt_qthread_mgmt.h"
 #include "qt_threadqueues.h"
+#include "qt_spinwait.h"
 #include "qt_debug.h"
 #ifdef QTHREAD_USE_EUREKAS
 #include "qt_eurekas.h"
@@ -365,6 +366,7 @@ int API_FUNC qthread_syncvar_readFF(uint64_t *restrict  dest,
     eflags_t   e = { 0, 0, 0, 0, 0 };
     uint64_t   ret;
     qthread_t *me = qthread_internal_self();
+    qt_spinwait_t spin = QT_SPINWAIT_INITIALIZER;
     QTHREAD_FEB_TIMER_DECLARATION(febblock);
 
     assert(src);
@@ -397,6 +399,15 @@ int API_FUNC qthread_syncvar_readFF(uint64_t *restrict  dest,
     }
 #endif /* if ((QTHREAD_ASSEMBLY_ARCH == QTHREAD_AMD64) || (QTHREAD_ASSEMBLY_ARCH == QTHREAD_IA64) || (QTHREAD_ASSEMBLY_ARCH == QTHREAD_POWERPC64) || (QTHREAD_ASSEMBLY_ARCH == QTHREAD_SPARCV9_64)) */
     ret = qthread_mwaitc(src, SYNCFEB_FULL, INITIAL_TIMEOUT, &e);
+    while (e.cf && QT_SPINWAIT_AGAIN(spin, src)) {
+        /* the writer may be close; watch the word before going to sleep */
+        syncvar_t peek;
+
+        peek.u.w = *(volatile uint64_t *)&src->u.w;
+        if ((peek.u.s.state & 2) == 0) {
+            ret = qthread_mwaitc(src, SYNCFEB_FULL, INITIAL_TIMEOUT, &e);
+        }
+    }
     qthread_debug(SYNCVAR_DETAILS, "2 src(%p) = %x, ret = %x\n", src,
                   (uintptr_t)src->u.w, ret);
     if (e.cf) {                        /* there was a timeout */
@@ -470,6 +481,7 @@ got_m:
         QTHREAD_WAIT_TIMER_START();
         qthread_back_to_master(me);
         QTHREAD_WAIT_TIMER_STOP(me, febwait);
+        QT_SPINWAIT_DONE(spin, src, 1);
 #ifdef QTHREAD_USE_EUREKAS
         qt_eureka_check(0);
 #endif /* QTHREAD_USE_EUREKAS */
@@ -482,6 +494,7 @@ locked_full:
         UNLOCK_THIS_MODIFIED_SYNCVAR(src, ret, e.sf);
         if (dest) { *dest = ret; }
     }
+    QT_SPINWAIT_DONE(spin, src, 0);
     QTHREAD_FEB_TIMER_STOP(febblock, me);
     return QTHREAD_SUCCESS;
 }                                      /*}}} */
@@ -701,6 +714,7 @@ int API_FUNC qthread_syncvar_readFE(uint64_t *restrict  dest,
     uint64_t   ret;
     const int  lockbin = QTHREAD_CHOOSE_STRIPE(src);
     qthread_t *me      = qthread_internal_self();
+    qt_spinwait_t spin = QT_SPINWAIT_INITIALIZER;
     QTHREAD_FEB_TIMER_DECLARATION(febblock);
 
     assert(src);
@@ -719,6 +733,15 @@ int API_FUNC qthread_syncvar_readFE(uint64_t *restrict  dest,
     QTHREAD_FEB_UNIQUERECORD(feb, src, me);
     QTHREAD_FEB_TIMER_START(febblock);
     ret = qthread_mwaitc(src, SYNCFEB_FULL, INITIAL_TIMEOUT, &e);
+    while (e.cf && QT_SPINWAIT_AGAIN(spin, src)) {
+        /* the writer may be close; watch the word before going to sleep */
+        syncvar_t peek;
+
+        peek.u.w = *(volatile uint64_t *)&src->u.w;
+        if ((peek.u.s.state & 2) == 0) {
+            ret = qthread_mwaitc(src, SYNCFEB_FULL, INITIAL_TIMEOUT, &e);
+        }
+    }
     qthread_debug(SYNCVAR_DETAILS, "2 src(%p) = %x\n", src,
                   (uintptr_t)src->u.w);
     if (e.cf) {                        /* there was a timeout */
@@ -799,6 +822,7 @@ got_m:
         QTHREAD_WAIT_TIMER_START();
         qthread_back_to_master(me);
         QTHREAD_WAIT_TIMER_STOP(me, febwait);
+        QT_SPINWAIT_DONE(spin, src, 1);
 #ifdef QTHREAD_USE_EUREKAS
         qt_eureka_check(0);
 #endif /* QTHREAD_USE_EUREKAS */
@@ -861,6 +885,7 @@ locked_full:
     if (dest) {
         *dest = ret;
     }
+    QT_SPINWAIT_DONE(spin, src, 0);
     QTHREAD_FEB_TIMER_STOP(febblock, me);
     qthread_debug(SYNCVAR_DETAILS, "src(%p) exiting\n", src);
     return QTHREAD_SUCCESS;
@@ -955,12 +980,16 @@ got_m:
 }                                      /*}}} */
 
 static QINLINE void qthread_syncvar_schedule(qthread_t          *waiter,
-                                             qthread_shepherd_t *shep)
+                                             qthread_shepherd_t *shep,
+                                             const int           handoff)
 {   /*{{{*/
     assert(waiter);
     assert(shep);
     waiter->thread_state = QTHREAD_STATE_RUNNING;
     QTPERF_QTHREAD_ENTER_STATE(waiter->rdata->performance_data, QTHREAD_STATE_RUNNING);
+    if (handoff && qthread_internal_handoff(waiter)) {
+        return;
+    }
     if (waiter->flags & QTHREAD_UNSTEALABLE) {
         qt_threadqueue_enqueue(waiter->rdata->shepherd_ptr->ready, waiter);
     } else {
@@ -1057,7 +1086,7 @@ static QINLINE void qthread_syncvar_gotlock_empty(qthread_shepherd_t *shep,
         if (maddr && (maddr != (syncvar_t *)X->addr)) {
             UNLOCK_THIS_MODIFIED_SYNCVAR(maddr, *((uint64_t *)X->addr), sf);
         }
-        qthread_syncvar_schedule(X->waiter, shep);
+        qthread_syncvar_schedule(X->waiter, shep, 0);
         FREE_ADDRRES(X);
     }
     if ((m->EFQ == NULL) && (m->FEQ == NULL) && (m->FFQ == NULL)) {
@@ -1079,6 +1108,12 @@ static QINLINE void qthread_syncvar_gotlock_fill(qthread_shepherd_t *shep,
     qthread_addrres_t *X = NULL;
     int                removeable;
 
+    /* a fill that releases exactly one reader may hand it straight to this
+     * worker (QT_WAKE_HANDOFF) */
+    const int lone = qlib->wake_handoff &&
+                     (((m->FFQ != NULL) && (m->FFQ->next == NULL) && (m->FEQ == NULL)) ||
+                      ((m->FFQ == NULL) && (m->FEQ != NULL)));
+
     qthread_debug(SYNCVAR_FUNCTIONS, "m(%p), addr(%p)\n", m, maddr);
     m->full = 1;
     QTHREAD_EMPTY_TIMER_STOP(m);
@@ -1093,7 +1128,7 @@ static QINLINE void qthread_syncvar_gotlock_fill(qthread_shepherd_t *shep,
             *(uint64_t *)X->addr = ret;
         }
         /* schedule */
-        qthread_syncvar_schedule(X->waiter, shep);
+        qthread_syncvar_schedule(X->waiter, shep, lone);
         FREE_ADDRRES(X);
     }
     if (m->FEQ != NULL) {
@@ -1105,7 +1140,7 @@ static QINLINE void qthread_syncvar_gotlock_fill(qthread_shepherd_t *shep,
         if (X->addr) {
             *(uint64_t *)X->addr = ret;
         }
-        qthread_syncvar_schedule(X->waiter, shep);
+        qthread_syncvar_schedule(X->waiter, shep, lone);
         FREE_ADDRRES(X);
     }
     if ((m->EFQ == NULL) && (m->FEQ == NULL) && (m->FFQ == NULL)) {
@@ -1546,17 +1581,9 @@ static filter_code qt_syncvar_tf_call_cb(const qt_key_t            addr,
     void                 *tls;
 
     if (waiter->rdata->tasklocal_size <= qlib->qthread_tasklocal_size) {
-        if (waiter->flags & QTHREAD_BIG_STRUCT) {
-            tls = &waiter->data[qlib->qthread_argcopy_size];
-        } else {
-            tls = waiter->data;
-        }
+        tls = &waiter->data[QTHREAD_TASKLOCAL_OFFSET(waiter)];
     } else {
-        if (waiter->flags & QTHREAD_BIG_STRUCT) {
-            tls = *(void **)&waiter->data[qlib->qthread_argcopy_size];
-        } else {
-            tls = *(void **)&waiter->data[0];
-        }
+        tls = *(void **)&waiter->data[QTHREAD_TASKLOCAL_OFFSET(waiter)];
     }
     f((void *)addr, waiter->f, waiter->arg, waiter->ret, waiter->thread_id, tls, f_arg);
     return IGNORE_AND_CONTINUE;
@@ -15,6 +15,7 @@
 
 /* Internal Headers */
 #include "qt_io.h"
+#include "qt_io_epoll.h"
 #include "qt_asserts.h"
 #include "qthread_innards.h" /* for qlib */
 #include "qt_qthread_mgmt.h"
@@ -23,10 +24,14 @@ int qt_connect(int                    socket,
                const struct sockaddr *address,
                socklen_t              address_len)
 {
-    qthread_t                *me  = qthread_internal_self();
-    qt_blocking_queue_node_t *job = ALLOC_SYSCALLJOB();
+    qthread_t                *me = qthread_internal_self();
+    qt_blocking_queue_node_t *job;
     int                       ret;
 
+#ifdef QTHREAD_IO_EPOLL
+    if (qt_io_epoll_connect(socket, address, address_len, &ret)) { return ret; }
+#endif
+    job = ALLOC_SYSCALLJOB();
     assert(job);
     job->next   = NULL;
     job->thread = me;
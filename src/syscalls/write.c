@@ -17,6 +17,7 @@
 
 /* Internal Headers */
 #include "qt_io.h"
+#include "qt_io_epoll.h"
 #include "qt_asserts.h"
 #include "qthread_innards.h" /* for qlib */
 #include "qt_qthread_mgmt.h"
@@ -25,10 +26,14 @@ ssize_t qt_write(int         filedes,
                  const void *buf,
                  size_t      nbyte)
 {
-    qthread_t                *me  = qthread_internal_self();
-    qt_blocking_queue_node_t *job = ALLOC_SYSCALLJOB();
+    qthread_t                *me = qthread_internal_self();
+    qt_blocking_queue_node_t *job;
     ssize_t                   ret;
 
+#ifdef QTHREAD_IO_EPOLL
+    if (qt_io_epoll_write(filedes, buf, nbyte, &ret)) { return ret; }
+#endif
+    job = ALLOC_SYSCALLJOB();
     assert(job);
     job->next   = NULL;
     job->thread = me;
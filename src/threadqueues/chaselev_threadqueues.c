@@ -0,0 +1,768 @@
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+/* System Headers */
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+
+/* Public Headers */
+#include "qthread/qthread.h"
+#include "qthread/cacheline.h"
+
+/* Internal Headers */
+#include "qt_alloc.h"
+#include "qt_visibility.h"
+#include "qthread_innards.h"           /* for qlib */
+#include "qt_shepherd_innards.h"
+#include "qt_qthread_struct.h"
+#include "qt_qthread_mgmt.h"             /* for qthread_thread_free() */
+#include "qt_asserts.h"
+#include "qt_atomics.h"
+#include "qt_threadqueues.h"
+#include "qt_envariables.h"
+#include "qt_debug.h"
+#ifdef QTHREAD_USE_EUREKAS
+#include "qt_eurekas.h" /* for qt_eureka_check() */
+#endif /* QTHREAD_USE_EUREKAS */
+#include "qt_expect.h"
+#include "qt_subsystems.h"
+#include "qt_steal.h"
+#include "qt_parking.h"
+
+/* This thread queueing is the Chase-Lev work-stealing deque
+ * (http://doi.acm.org/10.1145/1073970.1073974), using the fence placement
+ * from Le et al. (http://doi.acm.org/10.1145/2442516.2442524).
+ *
+ * Every shepherd has exactly one worker, and that worker owns the shepherd's
+ * deque: only the owner pushes and pops at the bottom, which needs no atomic
+ * read-modify-write except when racing a thief for the last item. Thieves
+ * take from the top with a single CAS. When the deque fills, the owner copies
+ * the live range into an array twice the size and publishes it; a thief still
+ * reading the old array sees the same contents, so nobody has to pause. Old
+ * arrays are kept until the queue is freed.
+ *
+ * Nobody but the owner may touch the bottom of the deque, so enqueues from
+ * anywhere else (other shepherds, FEB wakeups, I/O proxies) are pushed onto a
+ * lock-free inbox that the owner drains into the deque. Unstealable tasks and
+ * yielded tasks live on owner-private lists that thieves never see. */
+
+/* Data Structures */
+struct _qt_threadqueue_node {
+    struct _qt_threadqueue_node *next;
+    qthread_t                   *value;
+} /* qt_threadqueue_node_t */;
+
+typedef struct _qt_cl_array {
+    saligned_t           mask;    /* size - 1; size is always a power of two */
+    struct _qt_cl_array *retired; /* the (smaller) array this one replaced */
+    qthread_t           *buf[];
+} qt_cl_array_t;
+
+typedef struct {
+    qt_threadqueue_node_t *head;
+    qt_threadqueue_node_t *tail;
+    long                   len;
+} qt_cl_list_t;
+
+struct _qt_threadqueue {
+    /* The First Cacheline: written by thieves */
+    volatile saligned_t top;
+    uint8_t             pad1[CACHELINE_WIDTH - sizeof(saligned_t)];
+    /* The Second Cacheline: written only by the owner */
+    volatile saligned_t     bottom;
+    qt_cl_array_t *volatile array;
+    uint8_t                 pad2[CACHELINE_WIDTH - sizeof(saligned_t) - sizeof(void *)];
+    /* The Third Cacheline: written by remote enqueuers */
+    qt_threadqueue_node_t *volatile inbox;
+    saligned_t                      inbox_len;
+    uint8_t                         pad3[CACHELINE_WIDTH - sizeof(void *) - sizeof(saligned_t)];
+    /* Owner-private */
+    qt_cl_list_t pinned;  /* unstealable tasks; run before the deque */
+    qt_cl_list_t yielded; /* yielded tasks; run once the deque is empty */
+#ifdef STEAL_PROFILE
+    aligned_t steal_amount_stolen;
+#endif
+} /* qt_threadqueue_t */;
+
+/* returned by qt_cl_steal() when it lost a race */
+#define CL_ABORT ((qthread_t *)(uintptr_t)1)
+
+static aligned_t  steal_disable = 0;
+static saligned_t deque_size    = 0;
+
+#ifdef STEAL_PROFILE
+# define STEAL_CALLED(shep)     qthread_incr( & ((shep)->steal_called), 1)
+# define STEAL_ELECTED(shep)    qthread_incr( & ((shep)->steal_elected), 1)
+# define STEAL_ATTEMPTED(shep)  qthread_incr( & ((shep)->steal_attempted), 1)
+# define STEAL_SUCCESSFUL(shep) do {} while (0)
+# define STEAL_FAILED(shep)     qthread_incr( & ((shep)->steal_failed), 1)
+# define STEAL_AMOUNT(q, ct)    qthread_incr( & ((q)->steal_amount_stolen), ct)
+# define STEAL_LEVEL(shep, l)   qthread_incr( & ((shep)->steal_level_successful[l]), 1)
+#else
+# define STEAL_CALLED(shep)     do {} while(0)
+# define STEAL_ELECTED(shep)    do {} while(0)
+# define STEAL_ATTEMPTED(shep)  do {} while(0)
+# define STEAL_SUCCESSFUL(shep) do {} while(0)
+# define STEAL_FAILED(shep)     do {} while(0)
+# define STEAL_AMOUNT(q, ct)    do {} while(0)
+# define STEAL_LEVEL(shep, l)   do {} while(0)
+#endif /* ifdef STEAL_PROFILE */
+
+/* Memory Management */
+#if defined(UNPOOLED_QUEUES) || defined(UNPOOLED)
+# define ALLOC_THREADQUEUE() (qt_threadqueue_t *)MALLOC(sizeof(qt_threadqueue_t))
+# define FREE_THREADQUEUE(t) FREE(t, sizeof(qt_threadqueue_t))
+# define ALLOC_TQNODE()      (qt_threadqueue_node_t *)MALLOC(sizeof(qt_threadqueue_node_t))
+# define FREE_TQNODE(t)      FREE(t, sizeof(qt_threadqueue_node_t))
+static void qt_threadqueue_subsystem_shutdown(void)
+{}
+#else /* if defined(UNPOOLED_QUEUES) || defined(UNPOOLED) */
+qt_threadqueue_pools_t generic_threadqueue_pools = { NULL, NULL };
+# define ALLOC_THREADQUEUE() (qt_threadqueue_t *)qt_mpool_alloc(generic_threadqueue_pools.queues)
+# define FREE_THREADQUEUE(t) qt_mpool_free(generic_threadqueue_pools.queues, t)
+# define ALLOC_TQNODE()      (qt_threadqueue_node_t *)qt_mpool_alloc(generic_threadqueue_pools.nodes)
+# define FREE_TQNODE(t)      qt_mpool_free(generic_threadqueue_pools.nodes, t)
+
+static void qt_threadqueue_subsystem_shutdown(void)
+{   /*{{{*/
+    qt_mpool_destroy(generic_threadqueue_pools.queues);
+    qt_mpool_destroy(generic_threadqueue_pools.nodes);
+} /*}}}*/
+#endif /* if defined(UNPOOLED_QUEUES) || defined(UNPOOLED) */
+
+void INTERNAL qt_threadqueue_subsystem_init(void)
+{   /*{{{*/
+    saligned_t req = qt_internal_get_env_num("DEQUE_SIZE", 256, 256);
+
+    /* round up to a power of two */
+    deque_size = 2;
+    while (deque_size < req) {
+        deque_size <<= 1;
+    }
+#if !(defined(UNPOOLED_QUEUES) || defined(UNPOOLED))
+    generic_threadqueue_pools.queues = qt_mpool_create_aligned(sizeof(qt_threadqueue_t),
+                                                               qthread_cacheline());
+    qt_mpool_set_name(generic_threadqueue_pools.queues, "ready queues");
+    generic_threadqueue_pools.nodes = qt_mpool_create_aligned(sizeof(qt_threadqueue_node_t), 8);
+    qt_mpool_set_name(generic_threadqueue_pools.nodes, "ready queue nodes");
+#endif
+    qthread_internal_cleanup(qt_threadqueue_subsystem_shutdown);
+} /*}}}*/
+
+/*****************************************/
+/* the deque itself                      */
+/*****************************************/
+
+static qt_cl_array_t *qt_cl_array_new(saligned_t size)
+{   /*{{{*/
+    qt_cl_array_t *a = qt_internal_aligned_alloc(sizeof(qt_cl_array_t) + size * sizeof(qthread_t *),
+                                                 qthread_cacheline());
+
+    assert(a);
+    assert((size & (size - 1)) == 0);
+    a->mask    = size - 1;
+    a->retired = NULL;
+    return a;
+} /*}}}*/
+
+/* Owner only: replace a full array with one twice the size. The old array is
+ * left intact (thieves may still be reading it) and chained off the new one. */
+static qt_cl_array_t *qt_cl_grow(qt_threadqueue_t *q,
+                                 qt_cl_array_t    *a,
+                                 saligned_t        top,
+                                 saligned_t        bottom)
+{   /*{{{*/
+    qt_cl_array_t *n = qt_cl_array_new((a->mask + 1) << 1);
+
+    for (saligned_t i = top; i < bottom; i++) {
+        n->buf[i & n->mask] = a->buf[i & a->mask];
+    }
+    n->retired = a;
+    COMPILER_FENCE;
+    THREAD_FENCE_MEM_RELEASE;
+    q->array = n;
+    qthread_debug(THREADQUEUE_DETAILS, "q(%p) grew to %ld entries\n", q, (long)(n->mask + 1));
+    return n;
+} /*}}}*/
+
+/* Owner only: push at the bottom */
+static QINLINE void qt_cl_push(qt_threadqueue_t *q,
+                               qthread_t        *t)
+{   /*{{{*/
+    saligned_t     b   = q->bottom;
+    saligned_t     top = q->top;
+    qt_cl_array_t *a   = q->array;
+
+    THREAD_FENCE_MEM_ACQUIRE;
+    if (QTHREAD_UNLIKELY(b - top > a->mask)) {
+        a = qt_cl_grow(q, a, top, b);
+    }
+    a->buf[b & a->mask] = t;
+    COMPILER_FENCE;
+    THREAD_FENCE_MEM_RELEASE;
+    q->bottom = b + 1;
+} /*}}}*/
+
+/* Owner only: pop at the bottom */
+static QINLINE qthread_t *qt_cl_take(qt_threadqueue_t *q)
+{   /*{{{*/
+    saligned_t     b = q->bottom - 1;
+    qt_cl_array_t *a = q->array;
+    saligned_t     t;
+    qthread_t     *ret = NULL;
+
+    q->bottom = b;
+    MACHINE_FENCE;
+    t = q->top;
+    if (t <= b) {
+        ret = a->buf[b & a->mask];
+        if (t == b) {
+            /* last one; race the thieves for it */
+            if (qthread_cas(&q->top, t, t + 1) != t) {
+                ret = NULL;
+            }
+            q->bottom = b + 1;
+        }
+    } else {
+        q->bottom = b + 1;
+    }
+    return ret;
+} /*}}}*/
+
+/* Anyone: take from the top. Returns NULL if the deque looked empty and
+ * CL_ABORT if another thread got there first. */
+static QINLINE qthread_t *qt_cl_steal(qt_threadqueue_t *q)
+{   /*{{{*/
+    saligned_t t = q->top;
+    saligned_t b;
+
+    THREAD_FENCE_MEM_ACQUIRE;
+    MACHINE_FENCE;
+    b = q->bottom;
+    if (t < b) {
+        qt_cl_array_t *a;
+        qthread_t     *ret;
+
+        THREAD_FENCE_MEM_ACQUIRE;
+        a   = q->array;
+        ret = a->buf[t & a->mask];
+        if (qthread_cas(&q->top, t, t + 1) != t) {
+            return CL_ABORT;
+        }
+        return ret;
+    }
+    return NULL;
+} /*}}}*/
+
+static QINLINE int qt_cl_looks_empty(const qt_threadqueue_t *q)
+{   /*{{{*/
+    return (q->bottom - q->top) <= 0;
+} /*}}}*/
+
+static QINLINE void qt_cl_list_append(qt_cl_list_t          *l,
+                                      qt_threadqueue_node_t *node)
+{   /*{{{*/
+    node->next = NULL;
+    if (l->tail) {
+        l->tail->next = node;
+    } else {
+        l->head = node;
+    }
+    l->tail = node;
+    l->len++;
+} /*}}}*/
+
+static QINLINE qthread_t *qt_cl_list_pop(qt_cl_list_t *l)
+{   /*{{{*/
+    qt_threadqueue_node_t *node = l->head;
+    qthread_t             *t;
+
+    if (node == NULL) { return NULL; }
+    l->head = node->next;
+    if (l->head == NULL) {
+        l->tail = NULL;
+    }
+    l->len--;
+    t = node->value;
+    FREE_TQNODE(node);
+    return t;
+} /*}}}*/
+
+static QINLINE int qt_threadqueue_isstealable(qthread_t *t)
+{   /*{{{*/
+    return ((t->flags & QTHREAD_UNSTEALABLE) == 0) ? 1 : 0;
+} /*}}}*/
+
+static QINLINE int qt_cl_isowner(const qt_threadqueue_t *q)
+{   /*{{{*/
+    qthread_shepherd_t *me = qthread_internal_getshep();
+
+    if (me == NULL) { return 0; }
+#ifdef QTHREAD_LOCAL_PRIORITY
+    if (me->local_priority_queue == q) { return 1; }
+#endif /* ifdef QTHREAD_LOCAL_PRIORITY */
+    return me->ready == q;
+} /*}}}*/
+
+/* Anyone but the owner */
+static void qt_cl_inbox_push(qt_threadqueue_t *q,
+                             qthread_t        *t)
+{   /*{{{*/
+    qt_threadqueue_node_t *node = ALLOC_TQNODE();
+    qt_threadqueue_node_t *old;
+
+    assert(node != NULL);
+    node->value = t;
+    do {
+        old        = q->inbox;
+        node->next = old;
+    } while (qthread_cas_ptr(&q->inbox, old, node) != old);
+    (void)qthread_incr(&q->inbox_len, 1);
+} /*}}}*/
+
+/* Owner only: move everything in the inbox onto the deque (or the pinned
+ * list, for unstealable tasks) in the order it arrived. */
+static void qt_cl_inbox_drain(qt_threadqueue_t *q)
+{   /*{{{*/
+    qt_threadqueue_node_t *node = qt_internal_atomic_swap_ptr((void **)&q->inbox, NULL);
+    qt_threadqueue_node_t *fifo = NULL;
+    saligned_t             ct   = 0;
+
+    /* the inbox is a stack; reverse it */
+    while (node) {
+        qt_threadqueue_node_t *next = node->next;
+        node->next = fifo;
+        fifo       = node;
+        node       = next;
+        ct++;
+    }
+    while (fifo) {
+        qt_threadqueue_node_t *next = fifo->next;
+        if (qt_threadqueue_isstealable(fifo->value)) {
+            qt_cl_push(q, fifo->value);
+            FREE_TQNODE(fifo);
+        } else {
+            qt_cl_list_append(&q->pinned, fifo);
+        }
+        fifo = next;
+    }
+    (void)qthread_incr(&q->inbox_len, -ct);
+} /*}}}*/
+
+/* Owner only */
+static QINLINE qthread_t *qt_cl_local_dequeue(qt_threadqueue_t *q)
+{   /*{{{*/
+    qthread_t *t;
+
+    if (q->inbox) {
+        qt_cl_inbox_drain(q);
+    }
+    if (q->pinned.head) {
+        return qt_cl_list_pop(&q->pinned);
+    }
+    if (!qt_cl_looks_empty(q) && ((t = qt_cl_take(q)) != NULL)) {
+        return t;
+    }
+    return qt_cl_list_pop(&q->yielded);
+} /*}}}*/
+
+/*****************************************/
+/* functions to manage the thread queues */
+/*****************************************/
+
+qt_threadqueue_t INTERNAL *qt_threadqueue_new(void)
+{   /*{{{*/
+    qt_threadqueue_t *q = ALLOC_THREADQUEUE();
+
+    qassert_ret(q != NULL, NULL);
+
+    q->top          = 0;
+    q->bottom       = 0;
+    q->array        = qt_cl_array_new(deque_size);
+    q->inbox        = NULL;
+    q->inbox_len    = 0;
+    q->pinned.head  = q->pinned.tail = NULL;
+    q->pinned.len   = 0;
+    q->yielded.head = q->yielded.tail = NULL;
+    q->yielded.len  = 0;
+#ifdef STEAL_PROFILE
+    q->steal_amount_stolen = 0;
+#endif
+
+    return q;
+} /*}}}*/
+
+void INTERNAL qt_threadqueue_free(qt_threadqueue_t *q)
+{   /*{{{*/
+    qt_threadqueue_node_t *node;
+    qt_cl_array_t         *a;
+    qthread_t             *t;
+
+    assert(q);
+    /* by now, nobody else can be looking at this queue */
+    node = q->inbox;
+    while (node) {
+        qt_threadqueue_node_t *next = node->next;
+        qthread_thread_free(node->value);
+        FREE_TQNODE(node);
+        node = next;
+    }
+    while ((t = qt_cl_list_pop(&q->pinned)) != NULL) {
+        qthread_thread_free(t);
+    }
+    while ((t = qt_cl_list_pop(&q->yielded)) != NULL) {
+        qthread_thread_free(t);
+    }
+    a = q->array;
+    for (saligned_t i = q->top; i < q->bottom; i++) {
+        qthread_thread_free(a->buf[i & a->mask]);
+    }
+    while (a) {
+        qt_cl_array_t *retired = a->retired;
+        qt_internal_aligned_free(a, qthread_cacheline());
+        a = retired;
+    }
+    FREE_THREADQUEUE(q);
+} /*}}}*/
+
+ssize_t INTERNAL qt_threadqueue_advisory_queuelen(qt_threadqueue_t *q)
+{   /*{{{*/
+    ssize_t len;
+
+    assert(q);
+    len = (q->bottom - q->top) + q->inbox_len + q->pinned.len + q->yielded.len;
+    return (len > 0) ? len : 0;
+} /*}}}*/
+
+void INTERNAL qt_threadqueue_enqueue(qt_threadqueue_t *restrict q,
+                                     qthread_t *restrict        t)
+{   /*{{{*/
+    assert(q != NULL);
+    assert(t != NULL);
+
+    qthread_debug(THREADQUEUE_CALLS, "q(%p), t(%p->%u)\n", q, t, t->thread_id);
+    if (qt_cl_isowner(q)) {
+        if (qt_threadqueue_isstealable(t)) {
+            qt_cl_push(q, t);
+            QT_PARK_NOTIFY(q, 1); /* the owner is awake; wake a thief */
+        } else {
+            qt_threadqueue_node_t *node = ALLOC_TQNODE();
+            assert(node != NULL);
+            node->value = t;
+            qt_cl_list_append(&q->pinned, node);
+        }
+    } else {
+        qt_cl_inbox_push(q, t);
+        QT_PARK_NOTIFY(q, 0);
+    }
+} /*}}}*/
+
+/* no cheaper way to publish several at once */
+void INTERNAL qt_threadqueue_enqueue_batch(qt_threadqueue_t *restrict q,
+                                           qthread_t *const          *t,
+                                           size_t                     n)
+{   /*{{{*/
+    for (size_t i = 0; i < n; i++) {
+        qt_threadqueue_enqueue(q, t[i]);
+    }
+} /*}}}*/
+
+void INTERNAL qt_threadqueue_enqueue_yielded(qt_threadqueue_t *restrict q,
+                                             qthread_t *restrict        t)
+{   /*{{{*/
+    assert(q != NULL);
+    assert(t != NULL);
+
+    if (qt_cl_isowner(q)) {
+        qt_threadqueue_node_t *node = ALLOC_TQNODE();
+        assert(node != NULL);
+        node->value = t;
+        qt_cl_list_append(&q->yielded, node);
+    } else {
+        qt_cl_inbox_push(q, t);
+        QT_PARK_NOTIFY(q, 0);
+    }
+} /*}}}*/
+
+#ifdef QTHREAD_USE_SPAWNCACHE
+qthread_t INTERNAL *qt_threadqueue_private_dequeue(qt_threadqueue_private_t *c)
+{   /*{{{*/
+    return NULL;
+} /*}}}*/
+
+int INTERNAL qt_threadqueue_private_enqueue(qt_threadqueue_private_t *restrict pq,
+                                            qt_threadqueue_t *restrict         q,
+                                            qthread_t *restrict                t)
+{   /*{{{*/
+    return 0;
+} /*}}}*/
+
+int INTERNAL qt_threadqueue_private_enqueue_yielded(qt_threadqueue_private_t *restrict q,
+                                                    qthread_t *restrict                t)
+{   /*{{{*/
+    return 0;
+} /*}}}*/
+
+void INTERNAL qt_threadqueue_enqueue_cache(qt_threadqueue_t         *q,
+                                           qt_threadqueue_private_t *cache)
+{}
+
+void INTERNAL qt_threadqueue_private_filter(qt_threadqueue_private_t *restrict c,
+                                            qt_threadqueue_filter_f            f)
+{}
+#endif /* ifdef QTHREAD_USE_SPAWNCACHE */
+
+/*  Steal work from another shepherd's deque
+ *  Returns the work stolen
+ */
+static qthread_t *qthread_steal(qthread_shepherd_t *thief_shepherd)
+{   /*{{{*/
+    qthread_shepherd_t *const shepherds = qlib->shepherds;
+    qt_threadqueue_t *const   myqueue   = thief_shepherd->ready;
+    qt_steal_cursor_t         cursor;
+    qthread_shepherd_id_t     victim;
+
+    assert(thief_shepherd->steal_victims);
+
+    /* every shepherd has a single worker, so there is no election */
+    STEAL_CALLED(thief_shepherd);
+    STEAL_ELECTED(thief_shepherd);
+    qt_steal_sweep_begin(thief_shepherd, &cursor);
+    while (qt_steal_next_victim(thief_shepherd, &cursor, &victim)) {
+        qt_threadqueue_t *victim_queue = shepherds[victim].ready;
+        qthread_t        *t;
+
+        if (qt_cl_looks_empty(victim_queue)) { continue; }
+        STEAL_ATTEMPTED(thief_shepherd);
+        t = qt_cl_steal(victim_queue);
+        if ((t != NULL) && (t != CL_ABORT)) {
+            STEAL_SUCCESSFUL(thief_shepherd);
+            STEAL_LEVEL(thief_shepherd, cursor.level);
+            STEAL_AMOUNT(victim_queue, 1);
+            return t;
+        }
+        STEAL_FAILED(thief_shepherd);
+        if (myqueue->inbox || steal_disable) {  // work at home quit steal attempt
+            return NULL;
+        }
+    }
+#ifdef QTHREAD_USE_EUREKAS
+    qt_eureka_check(1);
+#endif /* QTHREAD_USE_EUREKAS */
+#ifdef HAVE_PTHREAD_YIELD
+    pthread_yield();
+#elif defined(HAVE_SCHED_YIELD)
+    sched_yield();
+#endif
+    return NULL;
+} /*}}}*/
+
+#ifdef QTHREAD_PARKING
+/* Checked by the owner after it has announced that it is about to park, so
+ * anything enqueued before the announcement is seen here and anything
+ * enqueued after it comes with a wakeup. */
+static int qt_cl_has_work(qt_threadqueue_t *q,
+                          int               steal)
+{   /*{{{*/
+    qthread_shepherd_id_t i;
+
+    if ((q->inbox != NULL) || !qt_cl_looks_empty(q)) { return 1; }
+    if (steal) {
+        for (i = 0; i < qlib->nshepherds; i++) {
+            if (!qt_cl_looks_empty(qlib->shepherds[i].ready)) { return 1; }
+        }
+    }
+    return 0;
+} /*}}}*/
+
+# ifdef QTHREAD_LOCAL_PRIORITY
+#  define CL_HAS_WORK(steal) (qt_cl_has_work(lpq, 0) || qt_cl_has_work(q, (steal)))
+# else
+#  define CL_HAS_WORK(steal) qt_cl_has_work(q, (steal))
+# endif
+#endif /* ifdef QTHREAD_PARKING */
+
+qthread_t INTERNAL *qt_scheduler_get_thread(qt_threadqueue_t         *q,
+#ifdef QTHREAD_LOCAL_PRIORITY
+                                            qt_threadqueue_t         *lpq,
+#endif /* ifdef QTHREAD_LOCAL_PRIORITY */
+                                            qt_threadqueue_private_t *QUNUSED(qc),
+                                            uint_fast8_t              active)
+{   /*{{{*/
+    qthread_shepherd_t *my_shepherd = qthread_internal_getshep();
+    qthread_t          *t;
+    qt_park_backoff_t   idle = QT_PARK_BACKOFF_INITIALIZER;
+
+    assert(q != NULL);
+    assert(my_shepherd);
+    assert(my_shepherd->ready == q);
+
+#ifdef QTHREAD_USE_EUREKAS
+    qt_eureka_disable();
+#endif /* QTHREAD_USE_EUREKAS */
+    while (1) {
+#ifdef QTHREAD_LOCAL_PRIORITY
+        /* First check local priority queue */
+        if ((t = qt_cl_local_dequeue(lpq)) != NULL) { break; }
+#endif /* ifdef QTHREAD_LOCAL_PRIORITY */
+        if ((t = qt_cl_local_dequeue(q)) != NULL) { break; }
+        if (active && (qlib->nshepherds > 1) && !steal_disable) {
+            if ((t = qthread_steal(my_shepherd)) != NULL) { break; }
+#ifdef QTHREAD_PARKING
+            QT_PARK_IDLE(idle, CL_HAS_WORK(1));
+#else
+            QT_IDLE_HOOK(idle);
+#endif
+        } else {
+            QT_PARK_IDLE(idle, CL_HAS_WORK(0));
+        }
+    }
+    qthread_debug(THREADQUEUE_DETAILS, "q(%p) returning t(%p->%u)\n", q, t, t->thread_id);
+    return t;
+} /*}}}*/
+
+/* walk queue removing all tasks matching this description */
+void INTERNAL qt_threadqueue_filter(qt_threadqueue_t       *q,
+                                    qt_threadqueue_filter_f f)
+{   /*{{{*/
+    qt_cl_list_t tmp     = { NULL, NULL, 0 };
+    qt_cl_list_t keep    = { NULL, NULL, 0 };
+    int          isowner = qt_cl_isowner(q);
+    qthread_t   *t;
+
+    assert(q != NULL);
+    qthread_debug(THREADQUEUE_FUNCTIONS, "begin q:%p f:%p\n", q, f);
+
+    /* Anyone may steal, so pull everything off the deque the way a thief
+     * would (oldest first), then put back whatever survives. Only the owner
+     * can see the inbox and its private lists. */
+    if (isowner) {
+        if (q->inbox) {
+            qt_cl_inbox_drain(q);
+        }
+        while ((t = qt_cl_list_pop(&q->pinned)) != NULL) {
+            qt_threadqueue_node_t *node = ALLOC_TQNODE();
+            node->value = t;
+            qt_cl_list_append(&tmp, node);
+        }
+    }
+    while ((t = qt_cl_steal(q)) != NULL) {
+        if (t != CL_ABORT) {
+            qt_threadqueue_node_t *node = ALLOC_TQNODE();
+            node->value = t;
+            qt_cl_list_append(&tmp, node);
+        }
+    }
+    if (isowner) {
+        while ((t = qt_cl_list_pop(&q->yielded)) != NULL) {
+            qt_threadqueue_node_t *node = ALLOC_TQNODE();
+            node->value = t;
+            qt_cl_list_append(&tmp, node);
+        }
+    }
+
+    while (tmp.head) {
+        qt_threadqueue_node_t *node = tmp.head;
+        tmp.head = node->next;
+        t        = node->value;
+        switch (f(t)) {
+            case IGNORE_AND_CONTINUE: // ignore, move on
+                qt_cl_list_append(&keep, node);
+                break;
+            case IGNORE_AND_STOP: // ignore, stop looking
+                qt_cl_list_append(&keep, node);
+                goto pushback;
+            case REMOVE_AND_CONTINUE: // remove, move on
+#ifdef QTHREAD_USE_EUREKAS
+                qthread_internal_assassinate(t);
+#endif /* QTHREAD_USE_EUREKAS */
+                FREE_TQNODE(node);
+                break;
+            case REMOVE_AND_STOP: // remove, stop looking
+#ifdef QTHREAD_USE_EUREKAS
+                qthread_internal_assassinate(t);
+#endif /* QTHREAD_USE_EUREKAS */
+                FREE_TQNODE(node);
+                goto pushback;
+        }
+    }
+pushback:
+    /* everything not yet examined goes back too, in the same order */
+    if (tmp.head) {
+        if (keep.tail) {
+            keep.tail->next = tmp.head;
+        } else {
+            keep.head = tmp.head;
+        }
+    }
+    while ((t = qt_cl_list_pop(&keep)) != NULL) {
+        qt_threadqueue_enqueue(q, t);
+    }
+    qthread_debug(THREADQUEUE_FUNCTIONS, "end q:%p f:%p\n", q, f);
+} /*}}}*/
+
+/* this is only used by the touch code, which cannot pull a specific task out
+ * of the middle of a work-stealing deque */
+qthread_t INTERNAL *qt_threadqueue_dequeue_specific(qt_threadqueue_t *q,
+                                                    void             *value)
+{   /*{{{*/
+    return NULL;
+} /*}}}*/
+
+#ifdef STEAL_PROFILE                   // should give mechanism to make steal profiling optional
+void INTERNAL qthread_steal_stat(void)
+{   /*{{{*/
+    int i;
+
+    assert(qlib);
+    for (i = 0; i < qlib->nshepherds; i++) {
+        fprintf(stdout,
+                "QTHREADS: shepherd %d - steals called:%ld elected:%ld attempted:%ld(failed:%ld successful:%ld cache:%ld numa:%ld remote:%ld) tasks-stolen:%ld\n",
+                qlib->shepherds[i].shepherd_id,
+                qlib->shepherds[i].steal_called,
+                qlib->shepherds[i].steal_elected,
+                qlib->shepherds[i].steal_attempted,
+                qlib->shepherds[i].steal_failed,
+                qlib->shepherds[i].steal_attempted - qlib->shepherds[i].steal_failed,
+                qlib->shepherds[i].steal_level_successful[QT_STEAL_LEVEL_CACHE],
+                qlib->shepherds[i].steal_level_successful[QT_STEAL_LEVEL_NUMA],
+                qlib->shepherds[i].steal_level_successful[QT_STEAL_LEVEL_REMOTE],
+                qlib->shepherds[i].ready->steal_amount_stolen);
+    }
+} /*}}}*/
+#endif  /* ifdef STEAL_PROFILE */
+
+void INTERNAL qthread_steal_enable(void)
+{   /*{{{*/
+    steal_disable = 0;
+} /*}}}*/
+
+void INTERNAL qthread_steal_disable(void)
+{   /*{{{*/
+    steal_disable = 1;
+} /*}}}*/
+
+qthread_shepherd_id_t INTERNAL qt_threadqueue_choose_dest(qthread_shepherd_t * curr_shep)
+{
+    if (curr_shep) {
+        return curr_shep->shepherd_id;
+    } else {
+        return (qthread_shepherd_id_t)0;
+    }
+}
+
+size_t INTERNAL qt_threadqueue_policy(const enum threadqueue_policy policy)
+{
+    switch (policy) {
+        case SINGLE_WORKER:
+            return THREADQUEUE_POLICY_TRUE;
+        default:
+            return THREADQUEUE_POLICY_UNSUPPORTED;
+    }
+}
+
+/* vim:set expandtab: */
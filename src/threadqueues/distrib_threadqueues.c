@@ -27,6 +27,7 @@
 #endif /* QTHREAD_USE_EUREKAS */
 #include "qt_expect.h"
 #include "qt_subsystems.h"
+#include "qt_parking.h"
 
 // Non portable
 typedef uint8_t cacheline[CACHELINE_WIDTH];
@@ -169,8 +170,10 @@ void INTERNAL qt_threadqueue_subsystem_init(){
   finalizing = 0;
   generic_threadqueue_pools.queues = qt_mpool_create_aligned(sizeof(qt_threadqueue_t),
                                                              qthread_cacheline());
+  qt_mpool_set_name(generic_threadqueue_pools.queues, "ready queues");
   generic_threadqueue_pools.nodes = qt_mpool_create_aligned(sizeof(qt_threadqueue_node_t),
                                                             qthread_cacheline());
+  qt_mpool_set_name(generic_threadqueue_pools.nodes, "ready queue nodes");
   qthread_internal_cleanup(qt_threadqueue_subsystem_shutdown);
 }
 
@@ -211,6 +214,13 @@ void INTERNAL qt_threadqueue_enqueue_tail(qt_threadqueue_t *restrict qe,
   }
   // we need to wake up all threads when finalizing and if pushing the mccoy
   // thread to make sure we get worker 0
+#ifdef QTHREAD_PARKING
+  if(finalizing || t->flags & QTHREAD_REAL_MCCOY){
+    QT_PARK_NOTIFY_ALL();
+  } else {
+    QT_PARK_NOTIFY(qe, steal_ratio > 0);
+  }
+#else
   if(finalizing || t->flags & QTHREAD_REAL_MCCOY){
     QTHREAD_COND_LOCK(qe->cond);
     QTHREAD_COND_BCAST(qe->cond);
@@ -220,6 +230,7 @@ void INTERNAL qt_threadqueue_enqueue_tail(qt_threadqueue_t *restrict qe,
     if(qe->numwaiters) QTHREAD_COND_SIGNAL(qe->cond);
     QTHREAD_COND_UNLOCK(qe->cond);
   }
+#endif
 } 
 
 void INTERNAL qt_threadqueue_enqueue_head(qt_threadqueue_t *restrict qe,
@@ -249,6 +260,9 @@ void INTERNAL qt_threadqueue_enqueue_head(qt_threadqueue_t *restrict qe,
   }
   q->qlength++;
   QTHREAD_TRYLOCK_UNLOCK(&q->qlock);
+#ifdef QTHREAD_PARKING
+  QT_PARK_NOTIFY(qe, steal_ratio > 0);
+#else
   if(qe->numwaiters){
     QTHREAD_COND_LOCK(qe->cond);
     if(qe->numwaiters) {
@@ -256,6 +270,7 @@ void INTERNAL qt_threadqueue_enqueue_head(qt_threadqueue_t *restrict qe,
     }
     QTHREAD_COND_UNLOCK(qe->cond);
   }
+#endif
 } 
 
 qt_threadqueue_node_t INTERNAL *qt_threadqueue_dequeue_tail(qt_threadqueue_t *qe){                                     
@@ -309,6 +324,16 @@ void INTERNAL qt_threadqueue_enqueue(qt_threadqueue_t *restrict q,
   return qt_threadqueue_enqueue_tail(q, t);
 }
 
+/* no cheaper way to publish several at once */
+void INTERNAL qt_threadqueue_enqueue_batch(qt_threadqueue_t *restrict q,
+                                           qthread_t *const          *t,
+                                           size_t                     n)
+{   /*{{{*/
+    for (size_t i = 0; i < n; i++) {
+        qt_threadqueue_enqueue(q, t[i]);
+    }
+} /*}}}*/
+
 void INTERNAL qt_threadqueue_enqueue_yielded(qt_threadqueue_t *restrict q,
                                              qthread_t *restrict        t){
   return qt_threadqueue_enqueue_head(q, t);
@@ -343,6 +368,15 @@ int INTERNAL qt_threadqueue_private_enqueue_yielded(qt_threadqueue_private_t *re
                                                     qthread_t *restrict                t)
 { return 0; } 
 
+#ifdef QTHREAD_PARKING
+static int qt_threadqueue_has_work(qt_threadqueue_t *qe){
+  for(size_t i = 0; i < qe->num_queues; i++){
+    if(qe->t[i].qlength) return 1;
+  }
+  return (mccoy != NULL && qthread_worker(NULL) == 0);
+}
+#endif
+
 // We try and dequeue locally, if that fails we should do some stealing
 qthread_t INTERNAL *qt_scheduler_get_thread(qt_threadqueue_t         *qe,
                                             qt_threadqueue_private_t *qc,
@@ -351,6 +385,9 @@ qthread_t INTERNAL *qt_scheduler_get_thread(qt_threadqueue_t         *qe,
   qt_threadqueue_node_t *node = NULL;
   qthread_t* t;
   qthread_shepherd_t *my_shepherd = qthread_internal_getshep();
+#ifdef QTHREAD_PARKING
+  qt_park_backoff_t idle = QT_PARK_BACKOFF_INITIALIZER;
+#endif
 
   for(int numwaits = 0; !node; numwaits ++){
     node = qt_threadqueue_dequeue_tail(qe);
@@ -373,7 +410,16 @@ qthread_t INTERNAL *qt_scheduler_get_thread(qt_threadqueue_t         *qe,
       mccoy = NULL;
       return t; 
     } else if(!node){
-      if(numwaits > condwait_backoff && !finalizing){
+#ifdef QTHREAD_PARKING
+      if(finalizing){
+        SPINLOCK_BODY();
+      } else {
+        QT_PARK_IDLE(idle, qt_threadqueue_has_work(qe));
+      }
+#else
+      QT_IO_IDLE();
+      if(numwaits > condwait_backoff && !finalizing && !QT_IO_PENDING()){
+        qt_mpool_idle();
         QTHREAD_COND_LOCK(qe->cond);
         qe->numwaiters++;
         MACHINE_FENCE;
@@ -384,6 +430,7 @@ qthread_t INTERNAL *qt_scheduler_get_thread(qt_threadqueue_t         *qe,
       } else {
         SPINLOCK_BODY();
       }
+#endif
     }
   }
   t = node->value;
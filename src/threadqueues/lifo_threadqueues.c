@@ -22,6 +22,7 @@
 #include "qt_eurekas.h"
 #endif /* QTHREAD_USE_EUREKAS */
 #include "qt_subsystems.h"
+#include "qt_parking.h"
 
 /* Note: this queue is SAFE to use with multiple de-queuers, with the caveat
  * that if you have multiple dequeuer's, you'll need to solve the ABA problem.
@@ -69,7 +70,9 @@ static void qt_threadqueue_subsystem_shutdown(void)
 void INTERNAL qt_threadqueue_subsystem_init(void)
 {
     generic_threadqueue_pools.queues = qt_mpool_create(sizeof(qt_threadqueue_t));
+    qt_mpool_set_name(generic_threadqueue_pools.queues, "ready queues");
     generic_threadqueue_pools.nodes  = qt_mpool_create_aligned(sizeof(qt_threadqueue_node_t), sizeof(void *));
+    qt_mpool_set_name(generic_threadqueue_pools.nodes, "ready queue nodes");
     qthread_internal_cleanup(qt_threadqueue_subsystem_shutdown);
 }
 #endif /* if defined(UNPOOLED_QUEUES) || defined(UNPOOLED) */
@@ -195,6 +198,17 @@ void INTERNAL qt_threadqueue_enqueue(qt_threadqueue_t *restrict q,
         QTHREAD_COND_UNLOCK(q->trigger);
     }
 #endif
+    QT_PARK_NOTIFY(q, 0);
+} /*}}}*/
+
+/* no cheaper way to publish several at once */
+void INTERNAL qt_threadqueue_enqueue_batch(qt_threadqueue_t *restrict q,
+                                           qthread_t *const          *t,
+                                           size_t                     n)
+{   /*{{{*/
+    for (size_t i = 0; i < n; i++) {
+        qt_threadqueue_enqueue(q, t[i]);
+    }
 } /*}}}*/
 
 void INTERNAL qt_threadqueue_enqueue_yielded(qt_threadqueue_t *restrict q,
@@ -249,12 +263,15 @@ qthread_t INTERNAL *qt_scheduler_get_thread(qt_threadqueue_t         *q,
 
     qthread_debug(THREADQUEUE_CALLS, "q(%p)\n", q);
     if (retval == NULL) {
+#ifndef QTHREAD_CONDWAIT_BLOCKING_QUEUE
+        qt_park_backoff_t idle = QT_PARK_BACKOFF_INITIALIZER;
+#endif
 #ifdef QTHREAD_USE_EUREKAS
         qt_eureka_check(0);
 #endif /* QTHREAD_USE_EUREKAS */
         while (q->stack == NULL) {
 #ifndef QTHREAD_CONDWAIT_BLOCKING_QUEUE
-            SPINLOCK_BODY();
+            QT_PARK_IDLE(idle, q->stack != NULL);
 #else
             COMPILER_FENCE;
             if (qthread_incr(&q->frustration, 1) > 1000) {
@@ -24,6 +24,7 @@
 #include "qt_eurekas.h"
 #endif /* QTHREAD_USE_EUREKAS */
 #include "qt_subsystems.h"
+#include "qt_parking.h"
 
 /* Data Structures */
 struct _qt_threadqueue_node {
@@ -89,7 +90,9 @@ static void qt_threadqueue_subsystem_shutdown(void)
 void INTERNAL qt_threadqueue_subsystem_init(void)
 {
     generic_threadqueue_pools.nodes  = qt_mpool_create_aligned(sizeof(qt_threadqueue_node_t), 16);
+    qt_mpool_set_name(generic_threadqueue_pools.nodes, "ready queue nodes");
     generic_threadqueue_pools.queues = qt_mpool_create(sizeof(qt_threadqueue_t));
+    qt_mpool_set_name(generic_threadqueue_pools.queues, "ready queues");
     qthread_internal_cleanup(qt_threadqueue_subsystem_shutdown);
 }
 
@@ -277,9 +280,20 @@ void INTERNAL qt_threadqueue_enqueue(qt_threadqueue_t *restrict q,
         QTHREAD_COND_UNLOCK(q->trigger);
     }
 #endif
+    QT_PARK_NOTIFY(q, 0);
     hazardous_ptr(0, NULL); // release the ptr (avoid hazardptr resource exhaustion)
 }                           /*}}} */
 
+/* no cheaper way to publish several at once */
+void INTERNAL qt_threadqueue_enqueue_batch(qt_threadqueue_t *restrict q,
+                                           qthread_t *const          *t,
+                                           size_t                     n)
+{   /*{{{*/
+    for (size_t i = 0; i < n; i++) {
+        qt_threadqueue_enqueue(q, t[i]);
+    }
+} /*}}}*/
+
 void qt_threadqueue_enqueue_yielded(qt_threadqueue_t *restrict q,
                                     qthread_t *restrict        t)
 {   /*{{{*/
@@ -295,6 +309,9 @@ qthread_t INTERNAL *qt_scheduler_get_thread(qt_threadqueue_t         *q,
     qt_threadqueue_node_t *head;
     qt_threadqueue_node_t *tail;
     qt_threadqueue_node_t *next_ptr;
+#ifndef QTHREAD_CONDWAIT_BLOCKING_QUEUE
+    qt_park_backoff_t idle = QT_PARK_BACKOFF_INITIALIZER;
+#endif
 
     assert(q != NULL);
     qthread_debug(THREADQUEUE_CALLS, "q(%p): began\n", q);
@@ -321,6 +338,7 @@ qthread_t INTERNAL *qt_scheduler_get_thread(qt_threadqueue_t         *q,
 # ifdef QTHREAD_USE_EUREKAS
                 qt_eureka_check(0);
 # endif /* QTHREAD_USE_EUREKAS */
+                qt_mpool_idle();
                 QTHREAD_COND_LOCK(q->trigger);
                 while (q->fruitless > 1000) {
                     QTHREAD_COND_WAIT(q->trigger);
@@ -346,7 +364,7 @@ qthread_t INTERNAL *qt_scheduler_get_thread(qt_threadqueue_t         *q,
 # ifdef QTHREAD_USE_EUREKAS
             qt_eureka_check(1);
 # endif /* QTHREAD_USE_EUREKAS */
-            SPINLOCK_BODY();
+            QT_PARK_IDLE(idle, head->next != NULL);
 #endif              /* ifdef QTHREAD_CONDWAIT_BLOCKING_QUEUE */
             continue;
         }
@@ -25,6 +25,7 @@
 #include "qt_eurekas.h"
 #endif /* QTHREAD_USE_EUREKAS */
 #include "qt_subsystems.h"
+#include "qt_parking.h"
 
 /* Data Structures */
 struct _qt_threadqueue_node {
@@ -66,7 +67,9 @@ static void qt_threadqueue_subsystem_shutdown(void)
 void INTERNAL qt_threadqueue_subsystem_init(void)
 {   /*{{{*/
     generic_threadqueue_pools.nodes  = qt_mpool_create(sizeof(qt_threadqueue_node_t));
+    qt_mpool_set_name(generic_threadqueue_pools.nodes, "ready queue nodes");
     generic_threadqueue_pools.queues = qt_mpool_create(sizeof(qt_threadqueue_t));
+    qt_mpool_set_name(generic_threadqueue_pools.queues, "ready queues");
     qthread_internal_cleanup(qt_threadqueue_subsystem_shutdown);
 } /*}}}*/
 #endif /* if defined(UNPOOLED_QUEUES) || defined(UNPOOLED) */
@@ -193,8 +196,19 @@ void INTERNAL qt_threadqueue_enqueue(qt_threadqueue_t *restrict q,
     }
     QTHREAD_FASTLOCK_UNLOCK(&q->tail_lock);
     (void)qthread_internal_incr_s(&q->advisory_queuelen, &q->advisory_queuelen_m, 1);
+    QT_PARK_NOTIFY(q, 0);
 }                                      /*}}} */
 
+/* no cheaper way to publish several at once */
+void INTERNAL qt_threadqueue_enqueue_batch(qt_threadqueue_t *restrict q,
+                                           qthread_t *const          *t,
+                                           size_t                     n)
+{   /*{{{*/
+    for (size_t i = 0; i < n; i++) {
+        qt_threadqueue_enqueue(q, t[i]);
+    }
+} /*}}}*/
+
 void qt_threadqueue_enqueue_yielded(qt_threadqueue_t *restrict q,
                                     qthread_t *restrict        t)
 {   /*{{{*/
@@ -209,7 +223,8 @@ qthread_t INTERNAL *qt_scheduler_get_thread(qt_threadqueue_t         *q,
                                             qt_threadqueue_private_t *QUNUSED(qc),
                                             uint_fast8_t              QUNUSED(active))
 {                                      /*{{{ */
-    qthread_t *p = NULL;
+    qthread_t        *p    = NULL;
+    qt_park_backoff_t idle = QT_PARK_BACKOFF_INITIALIZER;
 
 #ifdef QTHREAD_USE_EUREKAS
     qt_eureka_disable();
@@ -218,7 +233,7 @@ qthread_t INTERNAL *qt_scheduler_get_thread(qt_threadqueue_t         *q,
 #ifdef QTHREAD_USE_EUREKAS
         qt_eureka_check(1);
 #endif /* QTHREAD_USE_EUREKAS */
-        SPINLOCK_BODY();
+        QT_PARK_IDLE(idle, q->head->next != NULL);
     }
     return p;
 }                                      /*}}} */
@@ -25,6 +25,7 @@
 #include "qt_eurekas.h"
 #endif /* QTHREAD_USE_EUREKAS */
 #include "qt_subsystems.h"
+#include "qt_parking.h"
 #include "qt_qthread_mgmt.h"             /* for qthread_thread_free() */
 
 /* This thread queueing uses the NEMESIS lock-free queue protocol from
@@ -96,7 +97,9 @@ void INTERNAL qt_threadqueue_subsystem_init(void)
     num_spins_before_condwait = qt_internal_get_env_num("SPINCOUNT", DEFAULT_SPINCOUNT, 0);
 
     generic_threadqueue_pools.queues = qt_mpool_create(sizeof(qt_threadqueue_t));
+    qt_mpool_set_name(generic_threadqueue_pools.queues, "ready queues");
     generic_threadqueue_pools.nodes  = qt_mpool_create_aligned(sizeof(qt_threadqueue_node_t), 8);
+    qt_mpool_set_name(generic_threadqueue_pools.nodes, "ready queue nodes");
     qthread_internal_cleanup(qt_threadqueue_subsystem_shutdown);
 } /*}}}*/
 #endif /* if defined(UNPOOLED_QUEUES) || defined(UNPOOLED) */
@@ -345,8 +348,19 @@ void INTERNAL qt_threadqueue_enqueue(qt_threadqueue_t *restrict q,
         QTHREAD_COND_UNLOCK(q->trigger);
     }
 #endif /* ifdef QTHREAD_CONDWAIT_BLOCKING_QUEUE */
+    QT_PARK_NOTIFY(q, 0);
 }                                      /*}}} */
 
+/* no cheaper way to publish several at once */
+void INTERNAL qt_threadqueue_enqueue_batch(qt_threadqueue_t *restrict q,
+                                           qthread_t *const          *t,
+                                           size_t                     n)
+{   /*{{{*/
+    for (size_t i = 0; i < n; i++) {
+        qt_threadqueue_enqueue(q, t[i]);
+    }
+} /*}}}*/
+
 void INTERNAL qt_threadqueue_enqueue_yielded(qt_threadqueue_t *restrict q,
                                              qthread_t *restrict        t)
 {                                      /*{{{ */
@@ -375,6 +389,9 @@ qthread_t INTERNAL *qt_scheduler_get_thread(qt_threadqueue_t         *q,
     qthread_debug(THREADQUEUE_DETAILS, "q(%p)->q {head:%p tail:%p sh:%p} q->advisory_queuelen:%u\n", q, q->q.head, q->q.tail, q->q.shadow_head, q->advisory_queuelen);
     PARANOIA(sanity_check_tq(&q->q));
     if (node == NULL) {
+#ifndef QTHREAD_CONDWAIT_BLOCKING_QUEUE
+        qt_park_backoff_t idle = QT_PARK_BACKOFF_INITIALIZER;
+#endif
 #ifdef QTHREAD_USE_EUREKAS
         qt_eureka_check(0);
 #endif /* QTHREAD_USE_EUREKAS */
@@ -389,9 +406,10 @@ qthread_t INTERNAL *qt_scheduler_get_thread(qt_threadqueue_t         *q,
 
         while (q->q.shadow_head == NULL && q->q.head == NULL) {
 #ifndef QTHREAD_CONDWAIT_BLOCKING_QUEUE
-            SPINLOCK_BODY();
+            QT_PARK_IDLE(idle, q->q.shadow_head != NULL || q->q.head != NULL);
 #else
             if (qthread_incr(&q->frustration, 1) > 1000) {
+                qt_mpool_idle();
                 QTHREAD_COND_LOCK(q->trigger);
                 if (q->frustration > 1000) {
                     QTHREAD_COND_WAIT(q->trigger);
@@ -21,6 +21,7 @@
 #include "qt_prefetch.h"
 #include "qt_threadqueues.h"
 #include "qt_envariables.h"
+#include "qt_io_poll.h"
 
 #ifndef NOINLINE
 # define NOINLINE __attribute__ ((noinline))
@@ -288,6 +289,16 @@ void INTERNAL qt_threadqueue_enqueue(qt_threadqueue_t *restrict q,
     cas_profile_update(id, cycles - 1);
 } /*}}}*/
 
+/* no cheaper way to publish several at once */
+void INTERNAL qt_threadqueue_enqueue_batch(qt_threadqueue_t *restrict q,
+                                           qthread_t *const          *t,
+                                           size_t                     n)
+{   /*{{{*/
+    for (size_t i = 0; i < n; i++) {
+        qt_threadqueue_enqueue(q, t[i]);
+    }
+} /*}}}*/
+
 /* enqueue multiple (from steal) */
 void INTERNAL qt_threadqueue_enqueue_multiple(qt_threadqueue_t   *q,
                                               int                 stealcount,
@@ -493,6 +504,7 @@ qthread_t INTERNAL *qt_scheduler_get_thread(qt_threadqueue_t         *q,
 
         if (oldtop.entry.index == q->bottom) {
             rwlock_rdunlock(rwlock, id);
+            QT_IO_IDLE();
             if (active) {
                 t = qt_threadqueue_dequeue_helper(q);
                 if (t != NULL) {
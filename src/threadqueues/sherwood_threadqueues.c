@@ -6,6 +6,7 @@
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/types.h>
 
 /* Public Headers */
@@ -29,6 +30,13 @@
 #endif /* QTHREAD_USE_EUREKAS */
 #include "qt_expect.h"
 #include "qt_subsystems.h"
+#include "qt_steal.h"
+#include "qt_parking.h"
+#ifdef STEAL_PROFILE
+# include "qt_int_log.h"
+#endif
+
+#define STEAL_HIST_BUCKETS 8
 
 /* Data Structures */
 struct _qt_threadqueue_node {
@@ -45,15 +53,25 @@ struct _qt_threadqueue {
     long                   qlength_stealable;                   /* number of stealable tasks on queue - stop steal attempts
                                                                  * that will fail because tasks cannot be moved - 4/1/11 AKP
                                                                  */
+    uint8_t *steal_history; /* adaptive stealing: per-victim outcome of this queue's last 8 steals, newest in bit 0 */
+    struct _qt_threadqueue **levels; /* priority levels 1 and up (NULL if there are none); this queue is level 0 */
+    uint32_t                 age;    /* times this level was passed over for a higher one since it was last served */
 #ifdef STEAL_PROFILE
     aligned_t steal_amount_stolen;
+    aligned_t steal_amount_hist[STEAL_HIST_BUCKETS]; /* batches taken from this queue, bucketed by log2(size) */
 #endif
 
     QTHREAD_TRYLOCK_TYPE qlock;
 } /* qt_threadqueue_t */;
 
-static aligned_t steal_disable   = 0;
-static long      steal_chunksize = 0;
+static aligned_t    steal_disable   = 0;
+static long         steal_chunksize = 0;
+static uint_fast8_t steal_adaptive  = 0;
+static unsigned int prio_levels     = 1;
+static unsigned int prio_aging      = 0;
+
+/* level l of a shepherd's queue */
+#define QT_LEVEL(q, l) ((l) ? (q)->levels[(l) - 1] : (q))
 
 #ifdef STEAL_PROFILE
 # define STEAL_CALLED(shep)     qthread_incr( & ((shep)->steal_called), 1)
@@ -61,7 +79,8 @@ static long      steal_chunksize = 0;
 # define STEAL_ATTEMPTED(shep)  qthread_incr( & ((shep)->steal_attempted), 1)
 # define STEAL_SUCCESSFUL(shep) do {} while (0)
 # define STEAL_FAILED(shep)     qthread_incr( & ((shep)->steal_failed), 1)
-# define STEAL_AMOUNT(q, ct)    qthread_incr( & ((q)->steal_amount_stolen), ct)
+# define STEAL_AMOUNT(q, ct)    steal_amount_record((q), (ct))
+# define STEAL_LEVEL(shep, l)   qthread_incr( & ((shep)->steal_level_successful[l]), 1)
 #else
 # define STEAL_CALLED(shep)     do {} while(0)
 # define STEAL_ELECTED(shep)    do {} while(0)
@@ -69,11 +88,27 @@ static long      steal_chunksize = 0;
 # define STEAL_SUCCESSFUL(shep) do {} while(0)
 # define STEAL_FAILED(shep)     do {} while(0)
 # define STEAL_AMOUNT(q, ct)    do {} while(0)
+# define STEAL_LEVEL(shep, l)   do {} while(0)
+#endif /* ifdef STEAL_PROFILE */
+
+#ifdef STEAL_PROFILE
+static QINLINE void steal_amount_record(qt_threadqueue_t *q,
+                                        long              ct)
+{   /*{{{*/
+    if (ct > 0) {
+        uint32_t bucket = QT_INT_LOG((uint32_t)ct);
+
+        if (bucket >= STEAL_HIST_BUCKETS) { bucket = STEAL_HIST_BUCKETS - 1; }
+        qthread_incr(&q->steal_amount_stolen, ct);
+        qthread_incr(&q->steal_amount_hist[bucket], 1);
+    }
+} /*}}}*/
 #endif /* ifdef STEAL_PROFILE */
 
 // Forward declarations
 qt_threadqueue_node_t INTERNAL *qt_threadqueue_dequeue_steal(qt_threadqueue_t *h,
-                                                             qt_threadqueue_t *v);
+                                                             qt_threadqueue_t *v,
+                                                             uint8_t          *history);
 
 void INTERNAL qt_threadqueue_enqueue_multiple(qt_threadqueue_t      *q,
                                               qt_threadqueue_node_t *first);
@@ -178,6 +213,10 @@ void INTERNAL qt_threadqueue_subsystem_init(void)
 {
     init_agged_tasks();
     steal_chunksize = qt_internal_get_env_num("STEAL_CHUNK", 0, 0);
+    steal_adaptive  = qt_internal_get_env_bool("STEAL_ADAPTIVE", 0);
+    prio_levels     = qt_internal_get_env_num("PRIORITY_LEVELS", 1, 1);
+    if (prio_levels > QTHREAD_PRIORITY_LEVELS_MAX) { prio_levels = QTHREAD_PRIORITY_LEVELS_MAX; }
+    prio_aging = qt_internal_get_env_num("PRIORITY_AGING", 16, 0);
     qthread_internal_cleanup(qt_threadqueue_subsystem_shutdown);
 }
 
@@ -205,14 +244,20 @@ void INTERNAL qt_threadqueue_subsystem_init(void)
     init_agged_tasks();
     generic_threadqueue_pools.queues = qt_mpool_create_aligned(sizeof(qt_threadqueue_t),
                                                                qthread_cacheline());
+    qt_mpool_set_name(generic_threadqueue_pools.queues, "ready queues");
     generic_threadqueue_pools.nodes = qt_mpool_create_aligned(sizeof(qt_threadqueue_node_t),
                                                               qthread_cacheline());
+    qt_mpool_set_name(generic_threadqueue_pools.nodes, "ready queue nodes");
     steal_chunksize = qt_internal_get_env_num("STEAL_CHUNK", 0, 0);
+    steal_adaptive  = qt_internal_get_env_bool("STEAL_ADAPTIVE", 0);
+    prio_levels     = qt_internal_get_env_num("PRIORITY_LEVELS", 1, 1);
+    if (prio_levels > QTHREAD_PRIORITY_LEVELS_MAX) { prio_levels = QTHREAD_PRIORITY_LEVELS_MAX; }
+    prio_aging = qt_internal_get_env_num("PRIORITY_AGING", 16, 0);
     qthread_internal_cleanup(qt_threadqueue_subsystem_shutdown);
 } /*}}}*/
 #endif /* if defined(UNPOOLED_QUEUES) || defined(UNPOOLED) */
 
-ssize_t INTERNAL qt_threadqueue_advisory_queuelen(qt_threadqueue_t *q)
+static QINLINE ssize_t qt_threadqueue_level_queuelen(qt_threadqueue_t *q)
 {   /*{{{*/
 #if ((QTHREAD_ASSEMBLY_ARCH == QTHREAD_AMD64) ||    \
     (QTHREAD_ASSEMBLY_ARCH == QTHREAD_IA64) ||      \
@@ -231,13 +276,36 @@ ssize_t INTERNAL qt_threadqueue_advisory_queuelen(qt_threadqueue_t *q)
 #endif /* if ((QTHREAD_ASSEMBLY_ARCH == QTHREAD_AMD64) || (QTHREAD_ASSEMBLY_ARCH == QTHREAD_IA64) || (QTHREAD_ASSEMBLY_ARCH == QTHREAD_POWERPC64) || (QTHREAD_ASSEMBLY_ARCH == QTHREAD_SPARCV9_64)) */
 } /*}}}*/
 
+ssize_t INTERNAL qt_threadqueue_advisory_queuelen(qt_threadqueue_t *q)
+{   /*{{{*/
+    ssize_t      len = qt_threadqueue_level_queuelen(q);
+    unsigned int l;
+
+    for (l = 1; l < prio_levels; l++) {
+        len += qt_threadqueue_level_queuelen(q->levels[l - 1]);
+    }
+    return len;
+} /*}}}*/
+
+/* Does any priority level of q hold a task? */
+static QINLINE int qt_threadqueue_ready(qt_threadqueue_t *q)
+{   /*{{{*/
+    unsigned int l;
+
+    if (q->head != NULL) { return 1; }
+    for (l = 1; l < prio_levels; l++) {
+        if (q->levels[l - 1]->head != NULL) { return 1; }
+    }
+    return 0;
+} /*}}}*/
+
 /*****************************************/
 /* functions to manage the thread queues */
 /*****************************************/
 
 static QINLINE qt_threadqueue_node_t *qthread_steal(qthread_shepherd_t *thief_shepherd);
 
-qt_threadqueue_t INTERNAL *qt_threadqueue_new(void)
+static qt_threadqueue_t *qt_threadqueue_new_level(void)
 {   /*{{{*/
     qt_threadqueue_t *q = ALLOC_THREADQUEUE();
 
@@ -246,12 +314,45 @@ qt_threadqueue_t INTERNAL *qt_threadqueue_new(void)
         q->tail              = NULL;
         q->qlength           = 0;
         q->qlength_stealable = 0;
+        q->steal_history     = NULL;
+        q->levels            = NULL;
+        q->age               = 0;
+#ifdef STEAL_PROFILE
+        q->steal_amount_stolen = 0;
+        memset(q->steal_amount_hist, 0, sizeof(q->steal_amount_hist));
+#endif
         QTHREAD_TRYLOCK_INIT(q->qlock);
     }
 
     return q;
 } /*}}}*/
 
+qt_threadqueue_t INTERNAL *qt_threadqueue_new(void)
+{   /*{{{*/
+    qt_threadqueue_t *q = qt_threadqueue_new_level();
+
+    if (q != NULL) {
+        if (steal_adaptive && (qlib->nshepherds > 1)) {
+            /* start out trusting every victim, i.e. plain steal-half */
+            q->steal_history = MALLOC(qlib->nshepherds);
+            assert(q->steal_history);
+            memset(q->steal_history, 0xff, qlib->nshepherds);
+        }
+        if (prio_levels > 1) {
+            unsigned int l;
+
+            q->levels = MALLOC((prio_levels - 1) * sizeof(qt_threadqueue_t *));
+            assert(q->levels);
+            for (l = 0; l < prio_levels - 1; l++) {
+                q->levels[l] = qt_threadqueue_new_level();
+                assert(q->levels[l]);
+            }
+        }
+    }
+
+    return q;
+} /*}}}*/
+
 #if defined(UNPOOLED_QTHREAD_T) || defined(UNPOOLED)
 # define ALLOC_QTHREAD() MALLOC(sizeof(qthread_t) + qlib->qthread_argcopy_size + qlib->qthread_tasklocal_size)
 # define FREE_QTHREAD(t) FREE(t, sizeof(qthread_t) + qlib->qthread_argcopy_size + qlib->qthread_tasklocal_size)
@@ -288,6 +389,17 @@ void INTERNAL qt_threadqueue_free(qt_threadqueue_t *q)
         QTHREAD_TRYLOCK_UNLOCK(&q->qlock);
     }
     assert(q->head == q->tail);
+    if (q->steal_history) {
+        FREE(q->steal_history, qlib->nshepherds);
+    }
+    if (q->levels) {
+        unsigned int l;
+
+        for (l = 0; l < prio_levels - 1; l++) {
+            qt_threadqueue_free(q->levels[l]);
+        }
+        FREE(q->levels, (prio_levels - 1) * sizeof(qt_threadqueue_t *));
+    }
     QTHREAD_TRYLOCK_DESTROY(q->qlock);
     FREE_THREADQUEUE(q);
 } /*}}}*/
@@ -297,6 +409,50 @@ static QINLINE int qt_threadqueue_isstealable(qthread_t *t)
     return ((t->flags & QTHREAD_UNSTEALABLE) == 0) ? 1 : 0;
 } /*}}}*/
 
+#ifdef QTHREAD_PARKING
+/* flags are the task's, read before it was published */
+static QINLINE void qt_threadqueue_wake(qt_threadqueue_t *q,
+                                        uint16_t          flags)
+{   /*{{{*/
+    if (flags & QTHREAD_REAL_MCCOY) {
+        QT_PARK_NOTIFY_ALL(); /* it has to reach worker 0 */
+    } else {
+        QT_PARK_NOTIFY(q, (flags & QTHREAD_UNSTEALABLE) == 0);
+    }
+} /*}}}*/
+
+/* Anything this worker could run, checked after it has announced that it
+ * is about to park. */
+static int qt_threadqueue_has_work(qt_threadqueue_t *q,
+                                   int               steal)
+{   /*{{{*/
+    qthread_shepherd_id_t i;
+    unsigned int          l;
+
+    if (qt_threadqueue_ready(q)) { return 1; }
+    if (steal) {
+        for (i = 0; i < qlib->nshepherds; i++) {
+            for (l = 0; l < prio_levels; l++) {
+                if (QT_LEVEL(qlib->shepherds[i].ready, l)->qlength_stealable > 0) { return 1; }
+            }
+        }
+    }
+    return 0;
+} /*}}}*/
+#endif /* ifdef QTHREAD_PARKING */
+
+/* The level of q that t is queued on: its priority, clamped to the levels
+ * this run was configured with. */
+static QINLINE qt_threadqueue_t *qt_threadqueue_level_for(qt_threadqueue_t *q,
+                                                          const qthread_t  *t)
+{   /*{{{*/
+    unsigned int l = QTHREAD_PRIORITY_OF(t->flags);
+
+    if ((l == 0) || (q->levels == NULL)) { return q; }
+    if (l >= prio_levels) { l = prio_levels - 1; }
+    return q->levels[l - 1];
+} /*}}}*/
+
 /* enqueue at tail */
 void INTERNAL qt_threadqueue_enqueue(qt_threadqueue_t *restrict q,
                                      qthread_t *restrict        t)
@@ -311,20 +467,77 @@ void INTERNAL qt_threadqueue_enqueue(qt_threadqueue_t *restrict q,
 
     assert(q != NULL);
     assert(t != NULL);
+#ifdef QTHREAD_PARKING
+    uint16_t const flags = t->flags;
+#endif
+    qt_threadqueue_t *lq = qt_threadqueue_level_for(q, t);
 
-    QTHREAD_TRYLOCK_LOCK(&q->qlock);
-    PARANOIA_ONLY(sanity_check_queue(q));
+    QTHREAD_TRYLOCK_LOCK(&lq->qlock);
+    PARANOIA_ONLY(sanity_check_queue(lq));
     node->next = NULL;
-    node->prev = q->tail;
-    q->tail    = node;
-    if (q->head == NULL) {
-        q->head = node;
+    node->prev = lq->tail;
+    lq->tail   = node;
+    if (lq->head == NULL) {
+        lq->head = node;
     } else {
         node->prev->next = node;
     }
-    q->qlength++;
-    q->qlength_stealable += node->stealable;
-    QTHREAD_TRYLOCK_UNLOCK(&q->qlock);
+    lq->qlength++;
+    lq->qlength_stealable += node->stealable;
+    QTHREAD_TRYLOCK_UNLOCK(&lq->qlock);
+#ifdef QTHREAD_PARKING
+    qt_threadqueue_wake(q, flags);
+#endif
+} /*}}}*/
+
+/* enqueue at tail, taking each level's lock once per run of tasks bound for
+ * that level rather than once per task */
+void INTERNAL qt_threadqueue_enqueue_batch(qt_threadqueue_t *restrict q,
+                                           qthread_t *const          *t,
+                                           size_t                     n)
+{   /*{{{*/
+#ifdef QTHREAD_PARKING
+    int mccoy = 0, anywhere = 0;
+#endif
+    size_t i = 0;
+
+    assert(q != NULL);
+    while (i < n) {
+        qt_threadqueue_t *const lq    = qt_threadqueue_level_for(q, t[i]);
+        qt_threadqueue_node_t  *first = NULL, *last = NULL;
+
+        for (; i < n && qt_threadqueue_level_for(q, t[i]) == lq; i++) {
+            qt_threadqueue_node_t *node = ALLOC_TQNODE();
+
+            assert(node != NULL);
+            assert(t[i] != NULL);
+#ifdef QTHREAD_PARKING
+            mccoy    |= (t[i]->flags & QTHREAD_REAL_MCCOY) != 0;
+            anywhere |= (t[i]->flags & QTHREAD_UNSTEALABLE) == 0;
+#endif
+            node->value     = t[i];
+            node->stealable = qt_threadqueue_isstealable(t[i]);
+            node->next      = NULL;
+            node->prev      = last;
+            if (last) {
+                last->next = node;
+            } else {
+                first = node;
+            }
+            last = node;
+        }
+        qt_threadqueue_enqueue_multiple(lq, first);
+    }
+#ifdef QTHREAD_PARKING
+    /* enqueue_multiple() woke one parked worker; wake one per task */
+    if (mccoy) {
+        QT_PARK_NOTIFY_ALL();
+    } else {
+        for (i = 1; i < n && qt_park_sleepers != 0; i++) {
+            QT_PARK_NOTIFY(q, anywhere);
+        }
+    }
+#endif
 } /*}}}*/
 
 #ifdef QTHREAD_USE_SPAWNCACHE
@@ -450,20 +663,27 @@ void INTERNAL qt_threadqueue_enqueue_yielded(qt_threadqueue_t *restrict q,
 
     assert(q != NULL);
     assert(t != NULL);
+#ifdef QTHREAD_PARKING
+    uint16_t const flags = t->flags;
+#endif
+    qt_threadqueue_t *lq = qt_threadqueue_level_for(q, t);
 
-    QTHREAD_TRYLOCK_LOCK(&q->qlock);
-    PARANOIA_ONLY(sanity_check_queue(q));
+    QTHREAD_TRYLOCK_LOCK(&lq->qlock);
+    PARANOIA_ONLY(sanity_check_queue(lq));
     node->prev = NULL;
-    node->next = q->head;
-    q->head    = node;
-    if (q->tail == NULL) {
-        q->tail = node;
+    node->next = lq->head;
+    lq->head   = node;
+    if (lq->tail == NULL) {
+        lq->tail = node;
     } else {
         node->next->prev = node;
     }
-    q->qlength++;
-    if (node->stealable) { q->qlength_stealable++; }
-    QTHREAD_TRYLOCK_UNLOCK(&q->qlock);
+    lq->qlength++;
+    if (node->stealable) { lq->qlength_stealable++; }
+    QTHREAD_TRYLOCK_UNLOCK(&lq->qlock);
+#ifdef QTHREAD_PARKING
+    qt_threadqueue_wake(q, flags);
+#endif
 } /*}}}*/
 
 #define QTHREAD_TASK_IS_AGGREGABLE(f) (0 &&                                                \
@@ -477,7 +697,15 @@ void INTERNAL qt_threadqueue_enqueue_yielded(qt_threadqueue_t *restrict q,
 
 qthread_t INTERNAL *qt_init_agg_task() // partly a duplicate from qthread.c
 {
-    qthread_t *t = ALLOC_QTHREAD();
+    qthread_t        *t = ALLOC_QTHREAD();
+    qthread_worker_t *w = qthread_internal_getworker();
+
+    t->size_class = 0;
+    if (w) {
+        w->task_allocs[0]++;
+    } else {
+        qthread_incr(&qlib->task_class_allocs[0], 1);
+    }
 
 #ifdef QTHREAD_NONLAZY_THREADIDS
     /* give the thread an ID number */
@@ -693,7 +921,73 @@ void INTERNAL qt_add_first_agg_task(qthread_t             *agg_task,
     *curr_cost = (qlib->agg_cost)(1, list_of_f, (void **)agg_task->arg);
 }
 
+/* owner's dequeue from the tail of one priority level */
+static QINLINE qt_threadqueue_node_t *qt_threadqueue_dequeue_level(qt_threadqueue_t *q)
+{   /*{{{*/
+    qt_threadqueue_node_t *node;
+
+    QTHREAD_TRYLOCK_LOCK(&q->qlock);
+    PARANOIA_ONLY(sanity_check_queue(q));
+    node = q->tail;
+    if (node != NULL) {
+        assert(q->qlength > 0);
+        q->tail = node->prev;
+        if (q->tail == NULL) {
+            q->head = NULL;
+        } else {
+            q->tail->next = NULL;
+        }
+        q->qlength--;
+        q->qlength_stealable -= node->stealable;
+    }
+    QTHREAD_TRYLOCK_UNLOCK(&q->qlock);
+    return node;
+} /*}}}*/
+
+/* The level the owner serves next: the highest non-empty one, unless a lower
+ * non-empty level has now been passed over prio_aging times, in which case
+ * the lowest such level goes first. Returns q itself (level 0, which
+ * includes the worker's spawn cache) when no higher level has work. The age
+ * counters are shared by the shepherd's workers without a lock; a lost
+ * update only delays the aging by a task. */
+static QINLINE qt_threadqueue_t *qt_threadqueue_pick_level(qt_threadqueue_t               *q,
+                                                           const qt_threadqueue_private_t *qc)
+{   /*{{{*/
+    qt_threadqueue_t *lq;
+    unsigned int      top, l;
+
+    for (top = prio_levels - 1; top > 0; top--) {
+        if (q->levels[top - 1]->head != NULL) { break; }
+    }
+    if (top == 0) {
+        if (q->age) { q->age = 0; }
+        return q;
+    }
+    if (prio_aging) {
+        for (l = 0; l < top; l++) {
+            lq = QT_LEVEL(q, l);
+            if ((lq->head != NULL) || ((l == 0) && qc && (qc->on_deck != NULL))) {
+                if (++lq->age >= prio_aging) {
+                    lq->age = 0;
+                    return lq;
+                }
+            }
+        }
+    }
+    lq = q->levels[top - 1];
+    if (lq->age) { lq->age = 0; }
+    return lq;
+} /*}}}*/
+
 /* dequeue at tail */
+#ifdef QTHREAD_PARKING
+# ifdef QTHREAD_LOCAL_PRIORITY
+#  define SHERWOOD_HAS_WORK(steal) ((lpq->head != NULL) || qt_threadqueue_has_work(q, (steal)))
+# else
+#  define SHERWOOD_HAS_WORK(steal) qt_threadqueue_has_work(q, (steal))
+# endif
+#endif /* ifdef QTHREAD_PARKING */
+
 qthread_t INTERNAL *qt_scheduler_get_thread(qt_threadqueue_t         *q,
 #ifdef QTHREAD_LOCAL_PRIORITY
                                             qt_threadqueue_t         *lpq,
@@ -705,6 +999,7 @@ qthread_t INTERNAL *qt_scheduler_get_thread(qt_threadqueue_t         *q,
     qthread_t          *t;
     qthread_worker_id_t worker_id = NO_WORKER;
     int                 curr_cost, max_t, ret_agg_task;
+    qt_park_backoff_t   idle = QT_PARK_BACKOFF_INITIALIZER;
 
     assert(q != NULL);
     assert(my_shepherd);
@@ -719,6 +1014,7 @@ qthread_t INTERNAL *qt_scheduler_get_thread(qt_threadqueue_t         *q,
 #endif /* QTHREAD_USE_EUREKAS */
     while (1) {
         qt_threadqueue_node_t *node = NULL;
+        qt_threadqueue_t      *lq;
 #ifdef QTHREAD_TASK_AGGREGATION
         curr_cost = 0; ret_agg_task = 0;
 #endif
@@ -748,6 +1044,9 @@ qthread_t INTERNAL *qt_scheduler_get_thread(qt_threadqueue_t         *q,
         else
 #endif /* ifdef QTHREAD_LOCAL_PRIORITY */
 
+        if ((prio_levels > 1) && ((lq = qt_threadqueue_pick_level(q, qc)) != q)) {
+            node = qt_threadqueue_dequeue_level(lq);
+        } else
         // printf("Total number of items: %d+%d\n", (qc?(qc->on_deck?(1+qc->qlength):0):0), q->qlength);
         if (qc && (qc->on_deck != NULL)) {
             assert(qc->tail == NULL || qc->tail->next == NULL);
@@ -840,6 +1139,7 @@ qthread_t INTERNAL *qt_scheduler_get_thread(qt_threadqueue_t         *q,
                 QTHREAD_TRYLOCK_UNLOCK(&q->qlock);
                 qc->head    = qc->tail = NULL;
                 qc->qlength = qc->qlength_stealable = 0;
+                QT_PARK_NOTIFY(q, 1);
 #endif          /* if 0 */
             }
         } else if (q->head) {
@@ -902,11 +1202,19 @@ qthread_t INTERNAL *qt_scheduler_get_thread(qt_threadqueue_t         *q,
                 if (!steal_disable) {
                     node = qthread_steal(my_shepherd); // TODO: same agg behavior when stealing
                 } else {
-                    while (NULL == q->head) SPINLOCK_BODY();
+                    while (!qt_threadqueue_ready(q)) QT_PARK_IDLE(idle, qt_threadqueue_ready(q));
                     continue;
                 }
             }
         }
+#ifdef QTHREAD_PARKING
+        if (node == NULL) {
+            QT_PARK_IDLE(idle, SHERWOOD_HAS_WORK(active && (qlib->nshepherds > 1) && !steal_disable));
+            continue;
+        }
+#else
+        if (node == NULL) { QT_IDLE_HOOK(idle); }
+#endif
         if (node) {
 #ifdef QTHREAD_TASK_AGGREGATION
             qthread_thread_free(t); // free agg task; only reallocate it if mccoy found
@@ -944,20 +1252,23 @@ qthread_t INTERNAL *qt_scheduler_get_thread(qt_threadqueue_t         *q,
     return (t);
 } /*}}}*/
 
-/* enqueue multiple (from steal) */
+/* enqueue multiple (from steal, or from qt_threadqueue_enqueue_batch()) */
 void INTERNAL qt_threadqueue_enqueue_multiple(qt_threadqueue_t      *q,
                                               qt_threadqueue_node_t *first)
 {   /*{{{*/
     qt_threadqueue_node_t *last;
     size_t                 addCnt = 1;
+    long                   stealable;
 
     assert(first != NULL);
     assert(q != NULL);
 
     last = first;
+    stealable = first->stealable;
     while (last->next) {
         last = last->next;
         addCnt++;
+        stealable += last->stealable;
     }
 
     QTHREAD_TRYLOCK_LOCK(&q->qlock);
@@ -971,8 +1282,9 @@ void INTERNAL qt_threadqueue_enqueue_multiple(qt_threadqueue_t      *q,
         first->prev->next = first;
     }
     q->qlength           += addCnt;
-    q->qlength_stealable += addCnt;
+    q->qlength_stealable += stealable;
     QTHREAD_TRYLOCK_UNLOCK(&q->qlock);
+    QT_PARK_NOTIFY(q, 1);
 } /*}}}*/
 
 #ifdef QTHREAD_USE_SPAWNCACHE
@@ -1014,12 +1326,29 @@ void INTERNAL qt_threadqueue_enqueue_cache(qt_threadqueue_t         *q,
     QTHREAD_TRYLOCK_UNLOCK(&q->qlock);
     cache->qlength           = 0;
     cache->qlength_stealable = 0;
+    QT_PARK_NOTIFY(q, 1);
 } /*}}}*/
 #endif /* ifdef QTHREAD_USE_SPAWNCACHE */
 
-/* dequeue stolen threads at head, skip yielded threads */
+/* Adaptive batch size: steal-half, scaled down by how often the thief's
+ * recent steals from this victim came back empty (lock contention, or work
+ * gone by the time the lock was taken). A victim that always delivers gets
+ * the full half; one that rarely does gets about a ninth of that, which
+ * leaves work behind for its own workers and the other thieves. */
+static QINLINE long qt_threadqueue_steal_batch(long    stealable,
+                                               uint8_t history)
+{   /*{{{*/
+    long hits = 0;
+
+    for (; history; history &= history - 1) hits++;
+    return (stealable / 2) * (hits + 1) / 9;
+} /*}}}*/
+
+/* dequeue stolen threads at head, skip yielded threads; history, if not NULL,
+ * is the thief's record of its steals from v (see qt_threadqueue_steal_batch) */
 qt_threadqueue_node_t INTERNAL *qt_threadqueue_dequeue_steal(qt_threadqueue_t *h,
-                                                             qt_threadqueue_t *v)
+                                                             qt_threadqueue_t *v,
+                                                             uint8_t          *history)
 {                                      /*{{{ */
     qt_threadqueue_node_t *node;
     qt_threadqueue_node_t *first     = NULL;
@@ -1027,20 +1356,24 @@ qt_threadqueue_node_t INTERNAL *qt_threadqueue_dequeue_steal(qt_threadqueue_t *h
     long                   amtStolen = 0;
     long                   desired_stolen;
 
-    if (steal_chunksize == 0) {
-        desired_stolen = v->qlength_stealable / 2;
-    } else {
-        desired_stolen = steal_chunksize;
-    }
-
     assert(h != NULL);
     assert(v != NULL);
 
-    if (desired_stolen == 0) { desired_stolen = 1; }
-
     if (!QTHREAD_TRYLOCK_TRY(&v->qlock)) {
+        if (history) { *history <<= 1; }
         return NULL;
     }
+    if (history) {
+        desired_stolen = qt_threadqueue_steal_batch(v->qlength_stealable, *history);
+        if ((steal_chunksize != 0) && (desired_stolen > steal_chunksize)) {
+            desired_stolen = steal_chunksize;
+        }
+    } else if (steal_chunksize == 0) {
+        desired_stolen = v->qlength_stealable / 2;
+    } else {
+        desired_stolen = steal_chunksize;
+    }
+    if (desired_stolen == 0) { desired_stolen = 1; }
     PARANOIA_ONLY(sanity_check_queue(v));
     while (v->qlength_stealable > 0 && amtStolen < desired_stolen) {
         node = (qt_threadqueue_node_t *)v->head;
@@ -1112,6 +1445,7 @@ qt_threadqueue_node_t INTERNAL *qt_threadqueue_dequeue_steal(qt_threadqueue_t *h
         break;
     }
     QTHREAD_TRYLOCK_UNLOCK(&v->qlock);
+    if (history) { *history = (uint8_t)((*history << 1) | (amtStolen > 0)); }
     STEAL_AMOUNT(v, amtStolen);
 
     return (first);
@@ -1147,56 +1481,74 @@ static QINLINE qt_threadqueue_node_t *qthread_steal(qthread_shepherd_t *thief_sh
     }
     STEAL_ELECTED(thief_shepherd);
 
-    qthread_shepherd_id_t        i               = 0;
-    qthread_shepherd_t *const    shepherds       = qlib->shepherds;
-    qthread_shepherd_id_t *const sorted_sheplist = thief_shepherd->sorted_sheplist;
-    assert(sorted_sheplist);
+    qthread_shepherd_t *const shepherds = qlib->shepherds;
+    qt_steal_cursor_t         cursor;
+    qthread_shepherd_id_t     victim;
+
+    assert(thief_shepherd->steal_victims);
 
     qt_threadqueue_t *myqueue = thief_shepherd->ready;
 
 #ifdef QTHREAD_LOCAL_PRIORITY
     qt_threadqueue_t *mypriorityqueue = thief_shepherd->local_priority_queue;
 #endif /* ifdef QTHREAD_LOCAL_PRIORITY */
+    qt_steal_sweep_begin(thief_shepherd, &cursor);
     while (stolen == NULL) {
-        qt_threadqueue_t *victim_queue = shepherds[sorted_sheplist[i]].ready;
-        if (0 != victim_queue->qlength_stealable) {
-            STEAL_ATTEMPTED(thief_shepherd);
-            stolen = qt_threadqueue_dequeue_steal(myqueue, victim_queue);
-            if (stolen) {
-                qt_threadqueue_node_t *surplus = stolen->next;
-                if (surplus) {
-                    stolen->next  = NULL;
-                    surplus->prev = NULL;
-                    qt_threadqueue_enqueue_multiple(myqueue, surplus);
+        if (!qt_steal_next_victim(thief_shepherd, &cursor, &victim)) {
+            // swept every level without finding work
+#ifdef QTHREAD_USE_EUREKAS
+            qt_eureka_check(1);
+#endif /* QTHREAD_USE_EUREKAS */
+#ifdef QTHREAD_PARKING
+            break; // give up the election; the caller backs off and parks
+#else
+# ifdef HAVE_PTHREAD_YIELD
+            pthread_yield();
+# elif defined(HAVE_SCHED_YIELD)
+            sched_yield();
+# endif
+            QT_IO_IDLE();
+            qt_mpool_idle(); // the thief only comes back with work
+            qt_steal_sweep_begin(thief_shepherd, &cursor);
+            continue;
+#endif /* ifdef QTHREAD_PARKING */
+        }
+        qt_threadqueue_t *victim_queue = shepherds[victim].ready;
+        unsigned int      l            = prio_levels;
+        while (l-- > 0) { // highest priority level first, into the same level here
+            qt_threadqueue_t *vq = QT_LEVEL(victim_queue, l);
+            qt_threadqueue_t *mq = QT_LEVEL(myqueue, l);
+            if (0 != vq->qlength_stealable) {
+                STEAL_ATTEMPTED(thief_shepherd);
+                stolen = qt_threadqueue_dequeue_steal(mq, vq,
+                                                      myqueue->steal_history ? &myqueue->steal_history[victim] : NULL);
+                if (stolen) {
+                    qt_threadqueue_node_t *surplus = stolen->next;
+                    if (surplus) {
+                        stolen->next  = NULL;
+                        surplus->prev = NULL;
+                        qt_threadqueue_enqueue_multiple(mq, surplus);
+                    }
+                    STEAL_SUCCESSFUL(thief_shepherd);
+                    STEAL_LEVEL(thief_shepherd, cursor.level);
+                    break;
+                } else {
+                    STEAL_FAILED(thief_shepherd);
                 }
-                STEAL_SUCCESSFUL(thief_shepherd);
-                break;
-            } else {
-                STEAL_FAILED(thief_shepherd);
             }
         }
+        if (stolen) {
+            break;
+        }
 #ifdef QTHREAD_LOCAL_PRIORITY
         if ((0 < mypriorityqueue->qlength)){
           break;
         }
 #endif /* ifdef QTHREAD_LOCAL_PRIORITY */
        
-        if ((0 < myqueue->qlength) || steal_disable) {  // work at home quit steal attempt
+        if (qt_threadqueue_ready(myqueue) || steal_disable) {  // work at home quit steal attempt
             break;
         }
-
-        i++;
-        i *= (i < qlib->nshepherds - 1);
-        if (i == 0) {
-#ifdef QTHREAD_USE_EUREKAS
-            qt_eureka_check(1);
-#endif /* QTHREAD_USE_EUREKAS */
-#ifdef HAVE_PTHREAD_YIELD
-            pthread_yield();
-#elif defined(HAVE_SCHED_YIELD)
-            sched_yield();
-#endif
-        }
         SPINLOCK_BODY();
     }
     thief_shepherd->stealing = 0;
@@ -1211,14 +1563,28 @@ void INTERNAL qthread_steal_stat(void)
     assert(qlib);
     for (i = 0; i < qlib->nshepherds; i++) {
         fprintf(stdout,
-                "QTHREADS: shepherd %d - steals called:%ld elected:%ld attempted:%ld(failed:%ld successful:%ld) tasks-stolen:%ld\n",
+                "QTHREADS: shepherd %d - steals called:%ld elected:%ld attempted:%ld(failed:%ld successful:%ld cache:%ld numa:%ld remote:%ld) tasks-stolen:%ld\n",
                 qlib->shepherds[i].shepherd_id,
                 qlib->shepherds[i].steal_called,
                 qlib->shepherds[i].steal_elected,
                 qlib->shepherds[i].steal_attempted,
                 qlib->shepherds[i].steal_failed,
                 qlib->shepherds[i].steal_attempted - qlib->shepherds[i].steal_failed,
+                qlib->shepherds[i].steal_level_successful[QT_STEAL_LEVEL_CACHE],
+                qlib->shepherds[i].steal_level_successful[QT_STEAL_LEVEL_NUMA],
+                qlib->shepherds[i].steal_level_successful[QT_STEAL_LEVEL_REMOTE],
                 qlib->shepherds[i].ready->steal_amount_stolen);
+        fprintf(stdout, "QTHREADS: shepherd %d - batches stolen from it, by size:", qlib->shepherds[i].shepherd_id);
+        for (int b = 0; b < STEAL_HIST_BUCKETS; b++) {
+            if (b == 0) {
+                fprintf(stdout, " 1:%lu", (unsigned long)qlib->shepherds[i].ready->steal_amount_hist[b]);
+            } else if (b == STEAL_HIST_BUCKETS - 1) {
+                fprintf(stdout, " %d+:%lu", 1 << b, (unsigned long)qlib->shepherds[i].ready->steal_amount_hist[b]);
+            } else {
+                fprintf(stdout, " %d-%d:%lu", 1 << b, (2 << b) - 1, (unsigned long)qlib->shepherds[i].ready->steal_amount_hist[b]);
+            }
+        }
+        fprintf(stdout, "\n");
     }
 } /*}}}*/
 #endif  /* ifdef STEAL_PROFILE */
@@ -1371,6 +1737,13 @@ void INTERNAL qt_threadqueue_filter(qt_threadqueue_t       *q,
     qthread_t             *t    = NULL;
 
     assert(q != NULL);
+    if (q->levels) {
+        unsigned int l;
+
+        for (l = 0; l < prio_levels - 1; l++) {
+            qt_threadqueue_filter(q->levels[l], f);
+        }
+    }
     /* For reference:
      *
      * dequeue (and filtering) starts at the tail and proceeds to follow the prev ptrs until the head is reached.
@@ -1480,6 +1853,13 @@ qthread_t INTERNAL *qt_threadqueue_dequeue_specific(qt_threadqueue_t *q,
         }
     }
     QTHREAD_TRYLOCK_UNLOCK(&q->qlock);
+    if ((t == NULL) && q->levels) {
+        unsigned int l;
+
+        for (l = 0; (t == NULL) && (l < prio_levels - 1); l++) {
+            t = qt_threadqueue_dequeue_specific(q->levels[l], value);
+        }
+    }
 
     return (t);
 }     /*}}}*/
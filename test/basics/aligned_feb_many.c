@@ -0,0 +1,116 @@
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <qthread/qthread.h>
+#include "argparsing.h"
+
+/* The vectored FEB operations must do what the equivalent sequence of
+ * single-word operations would, including releasing every task waiting on
+ * any of the words. More words than fit the functions' on-stack buffers are
+ * used, in no particular address order. */
+
+#define WORDS 300
+
+static aligned_t  words[WORDS];
+static aligned_t *addrs[WORDS];
+static aligned_t  vals[WORDS];
+static aligned_t  got[WORDS];
+
+static aligned_t reader(void *arg)
+{
+    const uintptr_t i = (uintptr_t)arg;
+
+    qthread_readFF(&got[i], addrs[i]);
+    return 0;
+}
+
+static aligned_t taker(void *arg)
+{
+    const uintptr_t i = (uintptr_t)arg;
+
+    qthread_readFE(&got[i], addrs[i]);
+    return 0;
+}
+
+static aligned_t late_filler(void *arg)
+{
+    uintptr_t i;
+
+    for (i = 0; i < WORDS; i += 2) {
+        qthread_writeEF_const(addrs[i], 1000 + i);
+    }
+    return 0;
+}
+
+int main(int   argc,
+         char *argv[])
+{
+    aligned_t rets[WORDS];
+    aligned_t t;
+    uintptr_t i;
+
+    assert(qthread_initialize() == QTHREAD_SUCCESS);
+    CHECK_VERBOSE();
+
+    for (i = 0; i < WORDS; i++) {
+        addrs[i] = &words[(i * 7) % WORDS];
+        vals[i]  = i + 1;
+    }
+    assert(qthread_empty_many(addrs, 0) == QTHREAD_SUCCESS);
+    assert(qthread_writeF_many(NULL, vals, 1) == QTHREAD_BADARGS);
+
+    /* writeF_many releases every reader */
+    assert(qthread_empty_many(addrs, WORDS) == QTHREAD_SUCCESS);
+    for (i = 0; i < WORDS; i++) {
+        assert(qthread_feb_status(addrs[i]) == 0);
+    }
+    for (i = 0; i < WORDS; i++) {
+        assert(qthread_fork(reader, (void *)i, &rets[i]) == QTHREAD_SUCCESS);
+    }
+    qthread_yield();
+    assert(qthread_writeF_many(addrs, vals, WORDS) == QTHREAD_SUCCESS);
+    for (i = 0; i < WORDS; i++) {
+        qthread_readFF(NULL, &rets[i]);
+        assert(got[i] == i + 1);
+        assert(*addrs[i] == i + 1);
+        assert(qthread_feb_status(addrs[i]) == 1);
+    }
+    iprintf("writeF_many released %u readers\n", (unsigned)WORDS);
+
+    /* fill_many hands each word to one readFE, leaving it empty */
+    assert(qthread_empty_many(addrs, WORDS) == QTHREAD_SUCCESS);
+    for (i = 0; i < WORDS; i++) {
+        got[i] = 0;
+        assert(qthread_fork(taker, (void *)i, &rets[i]) == QTHREAD_SUCCESS);
+    }
+    qthread_yield();
+    assert(qthread_fill_many(addrs, WORDS) == QTHREAD_SUCCESS);
+    for (i = 0; i < WORDS; i++) {
+        qthread_readFF(NULL, &rets[i]);
+        assert(got[i] == i + 1);
+        assert(qthread_feb_status(addrs[i]) == 0);
+    }
+    assert(qthread_fill_many(addrs, WORDS) == QTHREAD_SUCCESS);
+    iprintf("fill_many released %u readFE's\n", (unsigned)WORDS);
+
+    /* readFF_many waits for the words that are not full yet */
+    for (i = 0; i < WORDS; i += 2) {
+        qthread_empty(addrs[i]);
+    }
+    assert(qthread_fork(late_filler, NULL, &t) == QTHREAD_SUCCESS);
+    assert(qthread_readFF_many(got, addrs, WORDS) == QTHREAD_SUCCESS);
+    for (i = 0; i < WORDS; i++) {
+        assert(got[i] == ((i % 2) ? i + 1 : 1000 + i));
+    }
+    assert(qthread_readFF_many(NULL, addrs, WORDS) == QTHREAD_SUCCESS);
+    qthread_readFF(NULL, &t);
+
+    iprintf("Success!\n");
+    return 0;
+}
+
+/* vim:set expandtab */
@@ -0,0 +1,148 @@
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <qthread/qthread.h>
+#include "argparsing.h"
+
+/* FEB operations on words in a registered region (see
+ * qthread_feb_region_register()) must behave exactly as on any other word,
+ * whether they are handled in the region's own state map or have to wait in
+ * the hash table, and the state of every word has to survive registering and
+ * unregistering. */
+
+#define WORDS  64
+#define CHAINS 8
+
+static aligned_t words[WORDS];
+static aligned_t ring[CHAINS + 1];
+
+static aligned_t passer(void *arg)
+{
+    const uintptr_t i = (uintptr_t)arg;
+    aligned_t       v;
+
+    qthread_readFE(&v, &ring[i]);
+    qthread_writeEF_const(&ring[i + 1], v + 1);
+    return 0;
+}
+
+static aligned_t reader(void *arg)
+{
+    aligned_t v;
+
+    qthread_readFF(&v, (aligned_t *)arg);
+    return v;
+}
+
+static aligned_t after_precond(void *arg)
+{
+    return *(aligned_t *)arg;
+}
+
+int main(int   argc,
+         char *argv[])
+{
+    aligned_t rets[CHAINS];
+    aligned_t t, v;
+    int       registered;
+    uintptr_t i;
+
+    assert(qthread_initialize() == QTHREAD_SUCCESS);
+    CHECK_VERBOSE();
+
+    /* state from before registration carries over */
+    qthread_empty(&words[3]);
+    qthread_empty(&words[40]);
+    registered = qthread_feb_region_register(words, WORDS);
+    if (registered == QTHREAD_NOT_ALLOWED) {
+        iprintf("regions not available; testing plain FEBs\n");
+    } else {
+        assert(registered == QTHREAD_SUCCESS);
+        assert(qthread_feb_region_register(words + WORDS - 1, 2) == QTHREAD_BADARGS);
+        assert(qthread_feb_region_register((aligned_t *)((char *)ring + 1), 1) == QTHREAD_BADARGS);
+        assert(qthread_feb_region_unregister(ring) == QTHREAD_BADARGS);
+    }
+    assert(qthread_feb_status(&words[3]) == 0);
+    assert(qthread_feb_status(&words[40]) == 0);
+    assert(qthread_feb_status(&words[4]) == 1);
+
+    /* operations that don't have to wait */
+    assert(qthread_writeEF_const(&words[3], 7) == QTHREAD_SUCCESS);
+    assert(qthread_feb_status(&words[3]) == 1);
+    assert(qthread_readFF(&v, &words[3]) == QTHREAD_SUCCESS && v == 7);
+    assert(qthread_writeFF_const(&words[3], 9) == QTHREAD_SUCCESS);
+    assert(qthread_readFE(&v, &words[3]) == QTHREAD_SUCCESS && v == 9);
+    assert(qthread_feb_status(&words[3]) == 0);
+    assert(qthread_writeF_const(&words[3], 10) == QTHREAD_SUCCESS);
+    assert(qthread_feb_status(&words[3]) == 1);
+    assert(qthread_purge_to_const(&words[3], 11) == QTHREAD_SUCCESS);
+    assert(qthread_feb_status(&words[3]) == 0 && words[3] == 11);
+    assert(qthread_fill(&words[3]) == QTHREAD_SUCCESS);
+    assert(qthread_fill(&words[3]) == QTHREAD_SUCCESS);
+    assert(qthread_readFE(&v, &words[3]) == QTHREAD_SUCCESS && v == 11);
+    assert(qthread_empty(&words[3]) == QTHREAD_SUCCESS);
+    assert(qthread_feb_status(&words[3]) == 0);
+
+    /* readers that have to wait, and a precondition on an empty word */
+    qthread_empty(&words[10]);
+    for (i = 0; i < CHAINS; i++) {
+        assert(qthread_fork(reader, &words[10], &rets[i]) == QTHREAD_SUCCESS);
+    }
+    assert(qthread_fork_precond(after_precond, &words[40], &t, 1, &words[40]) == QTHREAD_SUCCESS);
+    qthread_yield();
+    assert(qthread_writeEF_const(&words[10], 42) == QTHREAD_SUCCESS);
+    assert(qthread_writeEF_const(&words[40], 43) == QTHREAD_SUCCESS);
+    for (i = 0; i < CHAINS; i++) {
+        qthread_readFF(NULL, &rets[i]);
+        assert(rets[i] == 42);
+    }
+    qthread_readFF(NULL, &t);
+    assert(t == 43);
+    /* once nobody waits the words are full as usual */
+    assert(qthread_feb_status(&words[10]) == 1);
+    assert(qthread_readFE(&v, &words[10]) == QTHREAD_SUCCESS && v == 42);
+    assert(qthread_writeEF_const(&words[10], 1) == QTHREAD_SUCCESS);
+
+    /* a chain of tasks handing a token along, started before the token */
+    if (registered == QTHREAD_SUCCESS) {
+        assert(qthread_feb_region_register(ring, CHAINS + 1) == QTHREAD_SUCCESS);
+    }
+    for (i = 0; i <= CHAINS; i++) {
+        qthread_empty(&ring[i]);
+    }
+    for (i = CHAINS; i > 0; i--) {
+        assert(qthread_fork(passer, (void *)(i - 1), &rets[i - 1]) == QTHREAD_SUCCESS);
+    }
+    qthread_writeEF_const(&ring[0], 100);
+    qthread_readFF(&v, &ring[CHAINS]);
+    iprintf("token came back as %lu\n", (unsigned long)v);
+    assert(v == 100 + CHAINS);
+    for (i = 0; i < CHAINS; i++) {
+        qthread_readFF(NULL, &rets[i]);
+        assert(qthread_feb_status(&ring[i]) == 0);
+    }
+
+    /* and carries over when unregistering */
+    if (registered == QTHREAD_SUCCESS) {
+        assert(qthread_feb_region_unregister(ring) == QTHREAD_SUCCESS);
+        assert(qthread_feb_region_unregister(words) == QTHREAD_SUCCESS);
+        assert(qthread_feb_region_unregister(words) == QTHREAD_BADARGS);
+    }
+    assert(qthread_feb_status(&words[3]) == 0);
+    assert(qthread_feb_status(&words[4]) == 1);
+    assert(qthread_feb_status(&ring[0]) == 0);
+    assert(qthread_feb_status(&ring[CHAINS]) == 1);
+    qthread_fill(&words[3]);
+    for (i = 0; i < CHAINS; i++) {
+        qthread_fill(&ring[i]);
+    }
+
+    iprintf("Success!\n");
+    return 0;
+}
+
+/* vim:set expandtab */
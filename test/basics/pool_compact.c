@@ -0,0 +1,94 @@
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <qthread/qthread.h>
+#include "argparsing.h"
+
+/* Pools give memory back after a burst. Park COUNT tasks on an empty FEB so
+ * that the task pool has to grow to hold them all, let them go, and compact
+ * the pools: the task pool must shrink. Then do it again, to make sure that
+ * what compaction put back into the pool can be handed out and freed. */
+
+static size_t    COUNT = 20000;
+static aligned_t gate;
+
+static aligned_t parked(void *arg)
+{
+    qthread_readFF(NULL, &gate);
+    return 1;
+}
+
+static int find_pool(const char           *name,
+                     qthread_pool_stats_t *stats)
+{
+    unsigned int i;
+
+    for (i = 0; i < qthread_pools(); i++) {
+        assert(qthread_pool_stats(i, stats) == QTHREAD_SUCCESS);
+        if (strcmp(stats->name, name) == 0) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+static void burst(aligned_t *rets)
+{
+    size_t i;
+
+    qthread_empty(&gate);
+    for (i = 0; i < COUNT; i++) {
+        assert(qthread_fork(parked, NULL, &rets[i]) == QTHREAD_SUCCESS);
+    }
+    qthread_fill(&gate);
+    for (i = 0; i < COUNT; i++) {
+        qthread_readFF(NULL, &rets[i]);
+        assert(rets[i] == 1);
+    }
+}
+
+int main(int   argc,
+         char *argv[])
+{
+    qthread_pool_stats_t before, after;
+    aligned_t           *rets;
+    size_t               released;
+    int                  tasks, r;
+
+    assert(qthread_initialize() == QTHREAD_SUCCESS);
+
+    CHECK_VERBOSE();
+    NUMARG(COUNT, "COUNT");
+
+    tasks = find_pool("tasks", &before);
+    if (tasks < 0) {
+        iprintf("no task pool (built without pools?)\n");
+        return 0;
+    }
+    rets = malloc(sizeof(aligned_t) * COUNT);
+    assert(rets);
+
+    for (r = 0; r < 2; r++) {
+        burst(rets);
+        assert(qthread_pool_stats(tasks, &before) == QTHREAD_SUCCESS);
+        released = qthread_pool_compact();
+        assert(qthread_pool_stats(tasks, &after) == QTHREAD_SUCCESS);
+        iprintf("round %i: %lu kB released; tasks: %lu kB -> %lu kB, %lu live\n", r,
+                (unsigned long)(released / 1024), (unsigned long)(before.reserved / 1024),
+                (unsigned long)(after.reserved / 1024), (unsigned long)after.live);
+        assert(released > 0);
+        assert(after.reserved < before.reserved);
+        assert(after.reserved_hwm == before.reserved_hwm);
+        assert(after.live <= before.live);
+    }
+
+    free(rets);
+    return 0;
+}
+
+/* vim:set expandtab */
@@ -0,0 +1,115 @@
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <qthread/qthread.h>
+#include "argparsing.h"
+
+/* The runtime's memory pools report what they hold. Park COUNT tasks on an
+ * empty FEB, make sure the task pool counts them as live and holds enough
+ * memory for them, let them go, and check that the high-water mark remembers
+ * them. Then dump every pool and look for the task pool in the output. */
+
+static size_t    COUNT = 2000;
+static aligned_t gate;
+
+static aligned_t parked(void *arg)
+{
+    qthread_readFF(NULL, &gate);
+    return 1;
+}
+
+static int find_pool(const char           *name,
+                     qthread_pool_stats_t *stats)
+{
+    unsigned int i;
+
+    for (i = 0; i < qthread_pools(); i++) {
+        assert(qthread_pool_stats(i, stats) == QTHREAD_SUCCESS);
+        if (strcmp(stats->name, name) == 0) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+int main(int   argc,
+         char *argv[])
+{
+    qthread_pool_stats_t stats;
+    aligned_t           *rets;
+    size_t               i, cached;
+    unsigned int         w;
+    int                  tasks;
+    FILE                *dump;
+    char                 line[512];
+    int                  seen = 0;
+
+    assert(qthread_initialize() == QTHREAD_SUCCESS);
+
+    CHECK_VERBOSE();
+    NUMARG(COUNT, "COUNT");
+
+    tasks = find_pool("tasks", &stats);
+    if (tasks < 0) {
+        iprintf("no task pool (built without pools?)\n");
+        return 0;
+    }
+    assert(qthread_pool_stats(qthread_pools(), &stats) == QTHREAD_BADARGS);
+
+    rets = malloc(sizeof(aligned_t) * COUNT);
+    assert(rets);
+    qthread_empty(&gate);
+    for (i = 0; i < COUNT; i++) {
+        assert(qthread_fork(parked, NULL, &rets[i]) == QTHREAD_SUCCESS);
+    }
+    /* none of them can finish, whether or not it has run yet */
+    assert(qthread_pool_stats(tasks, &stats) == QTHREAD_SUCCESS);
+    iprintf("%s: %lu B/item, %lu B reserved, %lu live, %lu cached, %lu shared\n",
+            stats.name, (unsigned long)stats.item_size, (unsigned long)stats.reserved,
+            (unsigned long)stats.live, (unsigned long)stats.cached,
+            (unsigned long)stats.shared);
+    assert(stats.live >= COUNT);
+    assert(stats.reserved >= stats.live * stats.item_size);
+    assert(stats.reserved_hwm >= stats.reserved);
+    if (stats.allocs > 0) {
+        /* built with --enable-profiling=pools */
+        assert(stats.allocs >= COUNT);
+        assert(stats.allocs >= stats.frees);
+    }
+    cached = 0;
+    for (w = 0; w < qthread_readstate(TOTAL_WORKERS); w++) {
+        cached += qthread_pool_cached(tasks, w);
+    }
+    assert(cached <= stats.cached);
+
+    qthread_fill(&gate);
+    for (i = 0; i < COUNT; i++) {
+        qthread_readFF(NULL, &rets[i]);
+        assert(rets[i] == 1);
+    }
+    assert(qthread_pool_stats(tasks, &stats) == QTHREAD_SUCCESS);
+    iprintf("after: %lu live (peak %lu)\n", (unsigned long)stats.live,
+            (unsigned long)stats.live_hwm);
+    assert(stats.live_hwm >= COUNT);
+
+    dump = tmpfile();
+    assert(dump);
+    qthread_pool_stats_dump(fileno(dump));
+    rewind(dump);
+    while (fgets(line, sizeof(line), dump)) {
+        if (verbose) { fputs(line, stdout); }
+        if (strncmp(line, "tasks ", 6) == 0) { seen = 1; }
+    }
+    fclose(dump);
+    assert(seen);
+
+    free(rets);
+    return 0;
+}
+
+/* vim:set expandtab */
@@ -0,0 +1,100 @@
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <qthread/qthread.h>
+#include <qthread/sinc.h>
+#include "argparsing.h"
+
+/* Tasks spawned with QTHREAD_SPAWN_SIMPLE run as plain calls on their
+ * worker's stack and share their worker's spare rdata. Run a lot of them,
+ * interleaved with ordinary tasks, through each kind of return value;
+ * have them yield (which must simply return) and grow their task-local
+ * storage past the default (which must be freed and not leak into the next
+ * simple task on that worker). */
+
+static size_t COUNT = 10000;
+
+#define BIG_TASKLOCAL 1024
+
+static aligned_t simple_task(void *arg)
+{
+    const aligned_t i = (aligned_t)(uintptr_t)arg;
+    unsigned char  *tl;
+
+    /* the last simple task on this worker grew its task-local storage */
+    assert(qthread_size_tasklocal() < BIG_TASKLOCAL);
+    qthread_yield();
+    tl = qthread_get_tasklocal(BIG_TASKLOCAL);
+    assert(tl);
+    memset(tl, (int)(i & 0xff), BIG_TASKLOCAL);
+    qthread_yield();
+    assert(tl[BIG_TASKLOCAL - 1] == (unsigned char)(i & 0xff));
+    return i * 2;
+}
+
+static aligned_t full_task(void *arg)
+{
+    qthread_yield();
+    return (aligned_t)(uintptr_t)arg * 2;
+}
+
+static void sum_op(void       *tgt,
+                   const void *src)
+{
+    *(aligned_t *)tgt += *(const aligned_t *)src;
+}
+
+int main(int   argc,
+         char *argv[])
+{
+    aligned_t *rets;
+    aligned_t  sum = 0, zero = 0;
+    qt_sinc_t *sinc;
+    size_t     i;
+
+    assert(qthread_initialize() == QTHREAD_SUCCESS);
+
+    CHECK_VERBOSE();
+    NUMARG(COUNT, "COUNT");
+    iprintf("%u workers, %u tasks\n", qthread_num_workers(), (unsigned)COUNT);
+
+    rets = malloc(sizeof(aligned_t) * COUNT);
+    assert(rets);
+
+    /* aligned_t returns, simple and full tasks alternating */
+    for (i = 0; i < COUNT; i++) {
+        const int simple = (i % 4) != 3;
+
+        assert(qthread_spawn(simple ? simple_task : full_task,
+                             (void *)(uintptr_t)i, 0, &rets[i], 0, NULL,
+                             NO_SHEPHERD,
+                             simple ? QTHREAD_SPAWN_SIMPLE : 0) == QTHREAD_SUCCESS);
+    }
+    for (i = 0; i < COUNT; i++) {
+        qthread_readFF(NULL, &rets[i]);
+        assert(rets[i] == 2 * i);
+    }
+    iprintf("aligned_t returns done\n");
+
+    /* sinc returns */
+    sinc = qt_sinc_create(sizeof(aligned_t), &zero, sum_op, COUNT);
+    for (i = 0; i < COUNT; i++) {
+        assert(qthread_spawn(simple_task, (void *)(uintptr_t)i, 0, sinc, 0,
+                             NULL, NO_SHEPHERD,
+                             QTHREAD_SPAWN_SIMPLE | QTHREAD_SPAWN_RET_SINC) == QTHREAD_SUCCESS);
+    }
+    qt_sinc_wait(sinc, &sum);
+    qt_sinc_destroy(sinc);
+    assert(sum == COUNT * (COUNT - 1));
+    iprintf("sinc returns done\n");
+
+    free(rets);
+    return 0;
+}
+
+/* vim:set expandtab */
@@ -0,0 +1,189 @@
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <assert.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <qthread/qthread.h>
+#include <qthread/qt_syscalls.h>
+#include "argparsing.h"
+
+/* Socket calls from tasks behave like the blocking calls they wrap, however
+ * the runtime waits for them. SLOW clients connect and go quiet, leaving a
+ * server task waiting in read() for each; with them waiting, a client
+ * writes BIG bytes in one write(), which must all arrive, and gets a reply.
+ * Then the quiet clients hang up and their servers must see end-of-file.
+ * Finally, a connect() to a closed port fails with ECONNREFUSED, and a read
+ * from a socket the program made non-blocking fails with EAGAIN. */
+
+static size_t SLOW = 4;
+static size_t BIG  = 1 << 20;
+
+/* one for the quiet clients, one for the rest */
+static int                listener[2];
+static struct sockaddr_in addr[2];
+
+static int dial(int l)
+{
+    int s = socket(AF_INET, SOCK_STREAM, 0);
+
+    assert(s >= 0);
+    assert(qt_connect(s, (struct sockaddr *)&addr[l], sizeof(addr[l])) == 0);
+    return s;
+}
+
+static aligned_t quiet_server(void *arg)
+{
+    int  s = qt_accept(listener[(intptr_t)arg], NULL, NULL);
+    char c;
+
+    assert(s >= 0);
+    assert(qt_read(s, &c, 1) == 0);
+    close(s);
+    return 1;
+}
+
+static aligned_t bulk_server(void *arg)
+{
+    int    s   = qt_accept(listener[1], NULL, NULL);
+    char  *buf = malloc(65536);
+    size_t got = 0;
+
+    assert(s >= 0 && buf);
+    while (got < BIG) {
+        ssize_t r = qt_read(s, buf, 65536);
+
+        assert(r > 0);
+        got += (size_t)r;
+    }
+    assert(got == BIG);
+    assert(qt_write(s, "k", 1) == 1);
+    close(s);
+    free(buf);
+    return 1;
+}
+
+static aligned_t bulk_client(void *arg)
+{
+    int   s   = dial(1);
+    char *buf = malloc(BIG);
+    char  c;
+
+    assert(buf);
+    memset(buf, 'q', BIG);
+    assert(qt_write(s, buf, BIG) == (ssize_t)BIG);
+    assert(qt_read(s, &c, 1) == 1);
+    assert(c == 'k');
+    close(s);
+    free(buf);
+    return 1;
+}
+
+static aligned_t refused(void *arg)
+{
+    struct sockaddr_in dead;
+    socklen_t          len = sizeof(dead);
+    int                s   = socket(AF_INET, SOCK_STREAM, 0);
+    int                t   = socket(AF_INET, SOCK_STREAM, 0);
+
+    assert(s >= 0 && t >= 0);
+    memset(&dead, 0, sizeof(dead));
+    dead.sin_family      = AF_INET;
+    dead.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    assert(bind(t, (struct sockaddr *)&dead, sizeof(dead)) == 0);
+    assert(getsockname(t, (struct sockaddr *)&dead, &len) == 0);
+    close(t);                          /* nobody listens there now */
+    assert(qt_connect(s, (struct sockaddr *)&dead, sizeof(dead)) == -1);
+    assert(errno == ECONNREFUSED);
+    close(s);
+    return 1;
+}
+
+static aligned_t nonblocking(void *arg)
+{
+    int  s = dial(1);
+    char c;
+
+    assert(fcntl(s, F_SETFL, fcntl(s, F_GETFL) | O_NONBLOCK) == 0);
+    assert(qt_read(s, &c, 1) == -1);
+    assert(errno == EAGAIN || errno == EWOULDBLOCK);
+    close(s);
+    return 1;
+}
+
+int main(int   argc,
+         char *argv[])
+{
+    aligned_t *rets, bulk[2], ret;
+    int       *quiet;
+    socklen_t  len;
+    size_t     i;
+
+    assert(qthread_initialize() == QTHREAD_SUCCESS);
+
+    CHECK_VERBOSE();
+    NUMARG(SLOW, "SLOW");
+    NUMARG(BIG, "BIG");
+
+    for (i = 0; i < 2; i++) {
+        listener[i] = socket(AF_INET, SOCK_STREAM, 0);
+        assert(listener[i] >= 0);
+        memset(&addr[i], 0, sizeof(addr[i]));
+        addr[i].sin_family      = AF_INET;
+        addr[i].sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        assert(bind(listener[i], (struct sockaddr *)&addr[i], sizeof(addr[i])) == 0);
+        assert(listen(listener[i], (int)SLOW + 2) == 0);
+        len = sizeof(addr[i]);
+        assert(getsockname(listener[i], (struct sockaddr *)&addr[i], &len) == 0);
+    }
+
+    rets  = malloc(sizeof(aligned_t) * SLOW);
+    quiet = malloc(sizeof(int) * SLOW);
+    assert(rets && quiet);
+    for (i = 0; i < SLOW; i++) {
+        assert(qthread_fork(quiet_server, (void *)0, &rets[i]) == QTHREAD_SUCCESS);
+        quiet[i] = socket(AF_INET, SOCK_STREAM, 0);
+        assert(quiet[i] >= 0);
+        assert(connect(quiet[i], (struct sockaddr *)&addr[0], sizeof(addr[0])) == 0);
+    }
+    iprintf("%lu quiet clients connected\n", (unsigned long)SLOW);
+
+    assert(qthread_fork(bulk_server, NULL, &bulk[0]) == QTHREAD_SUCCESS);
+    assert(qthread_fork(bulk_client, NULL, &bulk[1]) == QTHREAD_SUCCESS);
+    qthread_readFF(NULL, &bulk[0]);
+    qthread_readFF(NULL, &bulk[1]);
+    iprintf("%lu bytes in one write\n", (unsigned long)BIG);
+
+    for (i = 0; i < SLOW; i++) {
+        close(quiet[i]);
+    }
+    for (i = 0; i < SLOW; i++) {
+        qthread_readFF(NULL, &rets[i]);
+    }
+    iprintf("quiet clients hung up\n");
+
+    assert(qthread_fork(refused, NULL, &ret) == QTHREAD_SUCCESS);
+    qthread_readFF(NULL, &ret);
+    assert(qthread_fork(nonblocking, NULL, &ret) == QTHREAD_SUCCESS);
+    qthread_readFF(NULL, &ret);
+    /* take the connection nonblocking() left behind */
+    assert(qthread_fork(quiet_server, (void *)1, &ret) == QTHREAD_SUCCESS);
+    qthread_readFF(NULL, &ret);
+    iprintf("errors came back\n");
+
+    close(listener[0]);
+    close(listener[1]);
+    free(quiet);
+    free(rets);
+    return 0;
+}
+
+/* vim:set expandtab */
@@ -0,0 +1,107 @@
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <qthread/qthread.h>
+#include "argparsing.h"
+
+/* With QT_SPIN_WAIT set, readFF and readFE spin on a word that is not full
+ * before blocking. Bounce a counter back and forth through FEBs and through
+ * syncvars, so that readers find their words both full and empty, and make
+ * sure no value is lost or seen twice either way. */
+
+static size_t ROUNDS = 2000;
+
+static aligned_t ping, pong;
+static syncvar_t sping = SYNCVAR_STATIC_INITIALIZER;
+static syncvar_t spong = SYNCVAR_STATIC_INITIALIZER;
+
+static aligned_t feb_player(void *arg)
+{
+    aligned_t *const in  = arg ? &pong : &ping;
+    aligned_t *const out = arg ? &ping : &pong;
+    aligned_t        v   = 0;
+    size_t           i;
+
+    for (i = 0; i < ROUNDS; i++) {
+        aligned_t peek;
+
+        qthread_readFF(&peek, in);
+        qthread_readFE(&v, in);
+        assert(peek == v);
+        assert(v == 2 * i + (arg ? 1 : 0));
+        v++;
+        qthread_writeEF(out, &v);
+    }
+    return v;
+}
+
+static aligned_t syncvar_player(void *arg)
+{
+    syncvar_t *const in  = arg ? &spong : &sping;
+    syncvar_t *const out = arg ? &sping : &spong;
+    uint64_t         v   = 0;
+    size_t           i;
+
+    for (i = 0; i < ROUNDS; i++) {
+        uint64_t peek;
+
+        qthread_syncvar_readFF(&peek, in);
+        qthread_syncvar_readFE(&v, in);
+        assert(peek == v);
+        assert(v == 2 * i + (arg ? 1 : 0));
+        v++;
+        qthread_syncvar_writeEF(out, &v);
+    }
+    return (aligned_t)v;
+}
+
+#ifdef __INTEL_COMPILER
+int setenv(const char *name,
+           const char *value,
+           int         overwrite);
+#endif
+
+int main(int   argc,
+         char *argv[])
+{
+    aligned_t r0, r1;
+
+    setenv("QT_SPIN_WAIT", "100", 1);
+    /* spinning is off with a single worker */
+    setenv("QT_NUM_SHEPHERDS", "2", 0);
+    assert(qthread_initialize() == QTHREAD_SUCCESS);
+
+    CHECK_VERBOSE();
+    NUMARG(ROUNDS, "ROUNDS");
+    iprintf("%u workers, %u rounds\n", qthread_num_workers(), (unsigned)ROUNDS);
+
+    qthread_empty(&ping);
+    qthread_empty(&pong);
+    assert(qthread_fork(feb_player, (void *)1, &r1) == QTHREAD_SUCCESS);
+    assert(qthread_fork(feb_player, NULL, &r0) == QTHREAD_SUCCESS);
+    qthread_writeEF_const(&ping, 0);
+    qthread_readFF(NULL, &r0);
+    qthread_readFF(NULL, &r1);
+    assert(r0 == 2 * ROUNDS - 1);
+    assert(r1 == 2 * ROUNDS);
+    iprintf("FEB ping-pong done\n");
+
+    qthread_syncvar_empty(&sping);
+    qthread_syncvar_empty(&spong);
+    assert(qthread_fork(syncvar_player, (void *)1, &r1) == QTHREAD_SUCCESS);
+    assert(qthread_fork(syncvar_player, NULL, &r0) == QTHREAD_SUCCESS);
+    qthread_syncvar_writeEF_const(&sping, 0);
+    qthread_readFF(NULL, &r0);
+    qthread_readFF(NULL, &r1);
+    assert(r0 == 2 * ROUNDS - 1);
+    assert(r1 == 2 * ROUNDS);
+    iprintf("syncvar ping-pong done\n");
+
+    return 0;
+}
+
+/* vim:set expandtab */
@@ -0,0 +1,126 @@
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+#include <qthread/qthread.h>
+#include "argparsing.h"
+
+/* Tasks can ask for a stack from one of several size classes. Spawn tasks in
+ * every class, make sure each one's stack is the size of its class and that
+ * qthread_stackleft() agrees, then have one task per class recurse until
+ * only an eighth of its stack is left, checking on the way down that the
+ * headroom shrinks and on the way back up that every frame is intact. With
+ * growable stacks this runs well past the part committed up front. */
+
+static size_t COUNT = 200;
+
+static size_t dive(size_t floor,
+                   size_t level,
+                   size_t above)
+{
+    volatile unsigned char frame[256];
+    const size_t           left    = qthread_stackleft();
+    size_t                 deepest = level;
+    size_t                 i;
+
+    assert(left < above);
+    for (i = 0; i < sizeof(frame); i++) {
+        frame[i] = (unsigned char)level;
+    }
+    if (left > floor) {
+        deepest = dive(floor, level + 1, left);
+    }
+    for (i = 0; i < sizeof(frame); i++) {
+        assert(frame[i] == (unsigned char)level);
+    }
+    return deepest;
+}
+
+static aligned_t check_stack(void *arg)
+{
+    const unsigned int cls  = (unsigned int)(uintptr_t)arg;
+    const size_t       size = qthread_stack_class_size(cls);
+    const size_t       left = qthread_stackleft();
+
+    assert((size_t)((char *)qthread_bos() - (char *)qthread_tos()) == size);
+    assert(left > 0 && left < size);
+    qthread_yield();
+    assert(qthread_stackleft() == left);
+    return 1;
+}
+
+static aligned_t deep(void *arg)
+{
+    const unsigned int cls   = (unsigned int)(uintptr_t)arg;
+    const size_t       size  = qthread_stack_class_size(cls);
+    const size_t       floor = (size / 8 > 2048) ? size / 8 : 2048;
+    size_t             levels;
+
+    levels = dive(floor, 0, size);
+    iprintf("class %u: %lu levels deep in %lu bytes\n", cls,
+            (unsigned long)levels, (unsigned long)size);
+    return levels;
+}
+
+static aligned_t simple(void *arg)
+{
+    /* runs on its worker's stack, not one of its own */
+    return qthread_stackleft() == 0;
+}
+
+int main(int   argc,
+         char *argv[])
+{
+    aligned_t   *rets;
+    aligned_t    ret;
+    unsigned int cls;
+    size_t       i;
+
+    assert(qthread_initialize() == QTHREAD_SUCCESS);
+
+    CHECK_VERBOSE();
+    NUMARG(COUNT, "COUNT");
+
+    assert(qthread_stack_class_size(QTHREAD_STACK_DEFAULT) == qthread_readstate(STACK_SIZE));
+    for (cls = 0; cls < QTHREAD_STACK_CLASSES; cls++) {
+        iprintf("class %u: %lu-byte stacks\n", cls,
+                (unsigned long)qthread_stack_class_size(cls));
+        assert(qthread_stack_class_size(cls) > 0);
+    }
+
+    rets = malloc(sizeof(aligned_t) * COUNT * QTHREAD_STACK_CLASSES);
+    assert(rets);
+    for (i = 0; i < COUNT; i++) {
+        for (cls = 0; cls < QTHREAD_STACK_CLASSES; cls++) {
+            assert(qthread_spawn(check_stack, (void *)(uintptr_t)cls, 0,
+                                 &rets[i * QTHREAD_STACK_CLASSES + cls], 0, NULL,
+                                 NO_SHEPHERD, QTHREAD_SPAWN_STACK(cls)) == QTHREAD_SUCCESS);
+        }
+    }
+    for (i = 0; i < COUNT * QTHREAD_STACK_CLASSES; i++) {
+        qthread_readFF(NULL, &rets[i]);
+        assert(rets[i] == 1);
+    }
+
+    for (cls = 0; cls < QTHREAD_STACK_CLASSES; cls++) {
+        assert(qthread_spawn(deep, (void *)(uintptr_t)cls, 0, &ret, 0, NULL,
+                             NO_SHEPHERD, QTHREAD_SPAWN_STACK(cls)) == QTHREAD_SUCCESS);
+        qthread_readFF(NULL, &ret);
+        assert(ret > 0);
+    }
+
+    assert(qthread_spawn(simple, NULL, 0, &ret, 0, NULL, NO_SHEPHERD,
+                         QTHREAD_SPAWN_SIMPLE | QTHREAD_SPAWN_STACK(QTHREAD_STACK_HUGE)) == QTHREAD_SUCCESS);
+    qthread_readFF(NULL, &ret);
+    assert(ret == 1);
+
+    iprintf("stacks grew %lu times\n", (unsigned long)qthread_readstate(STACK_GROWTHS));
+    free(rets);
+    return 0;
+}
+
+/* vim:set expandtab */
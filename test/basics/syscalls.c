@@ -0,0 +1,186 @@
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <qthread/qthread.h>
+#include <qthread/qt_syscalls.h>
+#include "argparsing.h"
+
+/* Tasks make blocking system calls through the runtime, which hands them to
+ * io_uring or to proxy threads. COUNT tasks each pwrite a block of a
+ * temporary file and pread it back; then COUNT + 1 tasks each pread a block's
+ * worth straddling two blocks, all at once so that the proxies may merge the
+ * adjacent reads, and the last two get a short read and end-of-file; then a
+ * task appends to the file with
+ * write() twice and reads it back with read(), which checks that each call
+ * happens exactly once and moves the file position; then PAIRS pairs of
+ * tasks connect over loopback and bounce a message ROUNDS times. */
+
+static size_t COUNT  = 64;
+static size_t PAIRS  = 2;
+static size_t ROUNDS = 16;
+
+#define BLOCK 512
+
+static int fd;
+
+static aligned_t block_rw(void *arg)
+{
+    size_t        i = (size_t)(uintptr_t)arg;
+    unsigned char out[BLOCK], in[BLOCK];
+
+    memset(out, (int)(i & 0xff), BLOCK);
+    memset(in, ~(int)(i & 0xff), BLOCK);
+    assert(qt_pwrite(fd, out, BLOCK, (off_t)(i * BLOCK)) == BLOCK);
+    assert(qt_pread(fd, in, BLOCK, (off_t)(i * BLOCK)) == BLOCK);
+    assert(memcmp(in, out, BLOCK) == 0);
+    return 1;
+}
+
+static aligned_t straddle(void *arg)
+{
+    size_t        i = (size_t)(uintptr_t)arg;
+    unsigned char in[BLOCK], want[BLOCK];
+    ssize_t       expect = (i + 1 < COUNT) ? BLOCK : (i + 1 == COUNT) ? BLOCK / 2 : 0;
+
+    memset(want, (int)(i & 0xff), BLOCK / 2);
+    memset(want + BLOCK / 2, (int)((i + 1) & 0xff), BLOCK / 2);
+    assert(qt_pread(fd, in, BLOCK, (off_t)(i * BLOCK + BLOCK / 2)) == expect);
+    assert(memcmp(in, want, (size_t)expect) == 0);
+    return 1;
+}
+
+static aligned_t sequential(void *arg)
+{
+    char buf[16];
+
+    assert(ftruncate(fd, 0) == 0);
+    assert(lseek(fd, 0, SEEK_SET) == 0);
+    assert(qt_write(fd, "hello", 5) == 5);
+    assert(qt_write(fd, "world", 5) == 5);
+    assert(lseek(fd, 0, SEEK_CUR) == 10);
+    assert(lseek(fd, 0, SEEK_SET) == 0);
+    memset(buf, 0, sizeof(buf));
+    assert(qt_read(fd, buf, sizeof(buf)) == 10);
+    assert(strcmp(buf, "helloworld") == 0);
+    assert(qt_read(fd, buf, sizeof(buf)) == 0);
+    /* errors come back in errno */
+    assert(qt_read(-1, buf, 1) == -1);
+    assert(errno == EBADF);
+    return 1;
+}
+
+static int                listener;
+static struct sockaddr_in addr;
+
+static aligned_t server(void *arg)
+{
+    int    s;
+    size_t r;
+    char   buf[8];
+
+    s = qt_accept(listener, NULL, NULL);
+    assert(s >= 0);
+    for (r = 0; r < ROUNDS; r++) {
+        assert(qt_read(s, buf, sizeof(buf)) == sizeof(buf));
+        assert(qt_write(s, buf, sizeof(buf)) == sizeof(buf));
+    }
+    close(s);
+    return 1;
+}
+
+static aligned_t client(void *arg)
+{
+    int    s;
+    size_t r;
+    char   out[8], in[8];
+
+    s = socket(AF_INET, SOCK_STREAM, 0);
+    assert(s >= 0);
+    assert(qt_connect(s, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+    for (r = 0; r < ROUNDS; r++) {
+        snprintf(out, sizeof(out), "%lu", (unsigned long)r);
+        assert(qt_write(s, out, sizeof(out)) == sizeof(out));
+        assert(qt_read(s, in, sizeof(in)) == sizeof(in));
+        assert(memcmp(in, out, sizeof(in)) == 0);
+    }
+    close(s);
+    return 1;
+}
+
+int main(int   argc,
+         char *argv[])
+{
+    char       filename[] = "test_qthread_syscalls.XXXXXX";
+    aligned_t *rets;
+    socklen_t  len = sizeof(addr);
+    size_t     i;
+
+    assert(qthread_initialize() == QTHREAD_SUCCESS);
+
+    CHECK_VERBOSE();
+    NUMARG(COUNT, "COUNT");
+    NUMARG(PAIRS, "PAIRS");
+    NUMARG(ROUNDS, "ROUNDS");
+
+    fd = mkstemp(filename);
+    assert(fd >= 0);
+    unlink(filename);
+    rets = malloc(sizeof(aligned_t) * (COUNT + 1 + 2 * PAIRS));
+    assert(rets);
+
+    for (i = 0; i < COUNT; i++) {
+        assert(qthread_fork(block_rw, (void *)(uintptr_t)i, &rets[i]) == QTHREAD_SUCCESS);
+    }
+    for (i = 0; i < COUNT; i++) {
+        qthread_readFF(NULL, &rets[i]);
+    }
+    iprintf("%lu blocks written and read back\n", (unsigned long)COUNT);
+
+    for (i = 0; i <= COUNT; i++) {
+        assert(qthread_fork(straddle, (void *)(uintptr_t)i, &rets[i]) == QTHREAD_SUCCESS);
+    }
+    for (i = 0; i <= COUNT; i++) {
+        qthread_readFF(NULL, &rets[i]);
+    }
+    iprintf("%lu reads across block boundaries\n", (unsigned long)COUNT + 1);
+
+    assert(qthread_fork(sequential, NULL, &rets[0]) == QTHREAD_SUCCESS);
+    qthread_readFF(NULL, &rets[0]);
+    close(fd);
+    iprintf("write() and read() moved the file position\n");
+
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    assert(listener >= 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port        = 0;
+    assert(bind(listener, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+    assert(listen(listener, (int)PAIRS) == 0);
+    assert(getsockname(listener, (struct sockaddr *)&addr, &len) == 0);
+    for (i = 0; i < PAIRS; i++) {
+        assert(qthread_fork(server, NULL, &rets[2 * i]) == QTHREAD_SUCCESS);
+        assert(qthread_fork(client, NULL, &rets[2 * i + 1]) == QTHREAD_SUCCESS);
+    }
+    for (i = 0; i < 2 * PAIRS; i++) {
+        qthread_readFF(NULL, &rets[i]);
+    }
+    close(listener);
+    iprintf("%lu loopback pairs bounced %lu messages each\n", (unsigned long)PAIRS,
+            (unsigned long)ROUNDS);
+
+    free(rets);
+    return 0;
+}
+
+/* vim:set expandtab */
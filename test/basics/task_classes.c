@@ -0,0 +1,125 @@
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <qthread/qthread.h>
+#include "argparsing.h"
+
+/* Task structures that carry copied arguments come from several size
+ * classes. Spawn tasks with argument blocks of many sizes, some of them
+ * larger than any class (and so copied into a separate buffer), and make
+ * sure every task sees its own arguments intact and that its default
+ * task-local storage does not overlap them. Then check that the class
+ * statistics add up. */
+
+static size_t COUNT = 1000;
+
+static const size_t arg_sizes[] = { 0, 16, 48, 100, 200, 400, 1000, 2000 };
+#define NUM_SIZES (sizeof(arg_sizes) / sizeof(arg_sizes[0]))
+
+typedef struct {
+    size_t        size;
+    unsigned char seed;
+    unsigned char bytes[];
+} arg_t;
+
+static aligned_t checker(void *arg)
+{
+    arg_t         *a = arg;
+    unsigned char *tl;
+    size_t         i, n;
+
+    if (a == NULL) { return 1; }
+    n = a->size - sizeof(arg_t);
+    for (i = 0; i < n; i++) {
+        assert(a->bytes[i] == (unsigned char)(a->seed + i));
+    }
+    /* scribble over the default task-local storage... */
+    tl = qthread_get_tasklocal(qthread_size_tasklocal());
+    if (tl) {
+        memset(tl, 0xa5, qthread_size_tasklocal());
+    }
+    qthread_yield();
+    /* ...which must not have touched the arguments */
+    for (i = 0; i < n; i++) {
+        assert(a->bytes[i] == (unsigned char)(a->seed + i));
+    }
+    return 1;
+}
+
+int main(int   argc,
+         char *argv[])
+{
+    aligned_t                 *rets;
+    arg_t                     *args[NUM_SIZES];
+    qthread_task_class_stats_t stats;
+    size_t                     i, j, before = 0, after = 0, prev_args = 0;
+    unsigned int               cls;
+
+    assert(qthread_initialize() == QTHREAD_SUCCESS);
+
+    CHECK_VERBOSE();
+    NUMARG(COUNT, "COUNT");
+    iprintf("%u workers, %u task classes\n", qthread_num_workers(),
+            qthread_task_classes());
+
+    assert(qthread_task_classes() >= 1);
+    for (cls = 0; cls < qthread_task_classes(); cls++) {
+        assert(qthread_task_class_stats(cls, &stats) == QTHREAD_SUCCESS);
+        iprintf("class %u: %lu bytes, %lu argument bytes\n", cls,
+                (unsigned long)stats.bytes, (unsigned long)stats.args);
+        assert(cls == 0 || stats.args > prev_args);
+        prev_args = stats.args;
+        before   += stats.allocs;
+    }
+    assert(qthread_task_class_stats(qthread_task_classes(), &stats) == QTHREAD_BADARGS);
+
+    for (j = 0; j < NUM_SIZES; j++) {
+        if (arg_sizes[j] == 0) {
+            args[j] = NULL;
+            continue;
+        }
+        args[j] = malloc(arg_sizes[j]);
+        assert(args[j]);
+        args[j]->size = arg_sizes[j];
+        args[j]->seed = (unsigned char)(j * 37);
+        for (i = 0; i < arg_sizes[j] - sizeof(arg_t); i++) {
+            args[j]->bytes[i] = (unsigned char)(args[j]->seed + i);
+        }
+    }
+
+    rets = malloc(sizeof(aligned_t) * COUNT * NUM_SIZES);
+    assert(rets);
+    for (i = 0; i < COUNT; i++) {
+        for (j = 0; j < NUM_SIZES; j++) {
+            assert(qthread_fork_copyargs(checker, args[j], arg_sizes[j],
+                                         &rets[i * NUM_SIZES + j]) == QTHREAD_SUCCESS);
+        }
+    }
+    for (i = 0; i < COUNT * NUM_SIZES; i++) {
+        qthread_readFF(NULL, &rets[i]);
+        assert(rets[i] == 1);
+    }
+    iprintf("%lu tasks done\n", (unsigned long)(COUNT * NUM_SIZES));
+
+    for (cls = 0; cls < qthread_task_classes(); cls++) {
+        assert(qthread_task_class_stats(cls, &stats) == QTHREAD_SUCCESS);
+        iprintf("class %u: %lu allocs, %lu live\n", cls,
+                (unsigned long)stats.allocs, (unsigned long)stats.live);
+        assert(stats.live <= stats.allocs);
+        after += stats.allocs;
+    }
+    assert(after - before >= COUNT * NUM_SIZES);
+
+    for (j = 0; j < NUM_SIZES; j++) {
+        free(args[j]);
+    }
+    free(rets);
+    return 0;
+}
+
+/* vim:set expandtab */
@@ -0,0 +1,47 @@
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+/* time_context_switch's measurement of the general fastcontext swap, built
+ * from the library's own sources (with context_switch_fast_asm.S) */
+#include "../../../src/fastcontext/context.c"
+
+#include <stdlib.h>
+#include <qthread/qtimer.h>
+
+static uctxt_t fast_main, fast_coro;
+
+static void fast_bounce(void *arg)
+{
+    for (;;) {
+        qt_swapctxt(&fast_coro, &fast_main);
+    }
+}
+
+double time_fastcontext_switch(size_t rounds,
+                               size_t stack_size)
+{
+    qtimer_t timer = qtimer_create();
+    void    *stack = malloc(stack_size);
+    double   secs;
+    size_t   i;
+
+    assert(stack);
+    getcontext(&fast_coro);
+    fast_coro.uc_stack.ss_sp   = stack;
+    fast_coro.uc_stack.ss_size = stack_size;
+    qt_makectxt(&fast_coro, (void (*)(void))fast_bounce, 1, stack);
+
+    qt_swapctxt(&fast_main, &fast_coro); /* warm up */
+    qtimer_start(timer);
+    for (i = 0; i < rounds; i++) {
+        qt_swapctxt(&fast_main, &fast_coro);
+    }
+    qtimer_stop(timer);
+    secs = qtimer_secs(timer);
+    qtimer_destroy(timer);
+    free(stack);
+    return secs;
+}
+
+/* vim:set expandtab */
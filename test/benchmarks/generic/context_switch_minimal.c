@@ -0,0 +1,47 @@
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+/* time_context_switch's measurement of the minimal context swap, built from
+ * the library's own sources (with context_switch_minimal_asm.S) */
+#include "../../../src/fastcontext/minimal-context.c"
+
+#include <stdlib.h>
+#include <qthread/qtimer.h>
+
+static uctxt_t minimal_main, minimal_coro;
+
+static void minimal_bounce(void *arg)
+{
+    for (;;) {
+        qt_swapctxt(&minimal_coro, &minimal_main);
+    }
+}
+
+double time_minimal_switch(size_t rounds,
+                           size_t stack_size)
+{
+    qtimer_t timer = qtimer_create();
+    void    *stack = malloc(stack_size);
+    double   secs;
+    size_t   i;
+
+    assert(stack);
+    getcontext(&minimal_coro);
+    minimal_coro.uc_stack.ss_sp   = stack;
+    minimal_coro.uc_stack.ss_size = stack_size;
+    qt_makectxt(&minimal_coro, (void (*)(void))minimal_bounce, 1, stack);
+
+    qt_swapctxt(&minimal_main, &minimal_coro); /* warm up */
+    qtimer_start(timer);
+    for (i = 0; i < rounds; i++) {
+        qt_swapctxt(&minimal_main, &minimal_coro);
+    }
+    qtimer_stop(timer);
+    secs = qtimer_secs(timer);
+    qtimer_destroy(timer);
+    free(stack);
+    return secs;
+}
+
+/* vim:set expandtab */
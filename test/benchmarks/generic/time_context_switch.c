@@ -0,0 +1,137 @@
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+#include <stdio.h>                     /* for printf() */
+#include <stdlib.h>                    /* for malloc() */
+#include <assert.h>                    /* for assert() */
+#ifdef HAVE_UCONTEXT_H
+# include <ucontext.h>
+#endif
+#include <qthread/qthread.h>
+#include <qthread/qtimer.h>
+#include "argparsing.h"
+
+/* Measures the cost of one context switch, ROUNDS times back and forth
+ * between two contexts, with:
+ *
+ *  - libc's swapcontext(), which saves and restores the signal mask with a
+ *    system call on every switch;
+ *  - the general fastcontext swap (src/fastcontext/asm.S), which saves the
+ *    argument and callee-saved registers and the floating-point control
+ *    registers;
+ *  - the minimal swap (src/fastcontext/minimal-asm.S), which saves only the
+ *    callee-saved registers;
+ *
+ * the last two built from the library's sources when it was configured to
+ * use the minimal swap. Then it times qthread_yield() between two tasks on
+ * one worker, which is two switches (task to worker to task) plus the
+ * scheduler, through whichever swap the library was built with. */
+
+size_t ROUNDS     = 1000000;
+size_t CORO_STACK = 65536;
+
+#ifdef QTHREAD_MINIMAL_CONTEXT
+double time_fastcontext_switch(size_t rounds,
+                               size_t stack_size);
+double time_minimal_switch(size_t rounds,
+                           size_t stack_size);
+#endif
+
+static void report(const char *name,
+                   double      secs,
+                   size_t      switches)
+{                                      /*{{{ */
+    printf("\t%-24s %7.1f nsecs/switch\n", name, secs * 1e9 / switches);
+}                                      /*}}} */
+
+#if defined(HAVE_UCONTEXT_H) && defined(HAVE_GETCONTEXT) && \
+    defined(HAVE_MAKECONTEXT) && defined(HAVE_SWAPCONTEXT)
+static ucontext_t native_main, native_coro;
+
+static void native_bounce(void)
+{                                      /*{{{ */
+    for (;;) {
+        swapcontext(&native_coro, &native_main);
+    }
+}                                      /*}}} */
+
+static double time_native_switch(size_t rounds)
+{                                      /*{{{ */
+    qtimer_t timer = qtimer_create();
+    void    *stack = malloc(CORO_STACK);
+    double   secs;
+    size_t   i;
+
+    assert(stack);
+    getcontext(&native_coro);
+    native_coro.uc_stack.ss_sp   = stack;
+    native_coro.uc_stack.ss_size = CORO_STACK;
+    native_coro.uc_link          = NULL;
+    makecontext(&native_coro, native_bounce, 0);
+
+    swapcontext(&native_main, &native_coro); /* warm up */
+    qtimer_start(timer);
+    for (i = 0; i < rounds; i++) {
+        swapcontext(&native_main, &native_coro);
+    }
+    qtimer_stop(timer);
+    secs = qtimer_secs(timer);
+    qtimer_destroy(timer);
+    free(stack);
+    return secs;
+}                                      /*}}} */
+
+#endif /* if defined(HAVE_UCONTEXT_H) && ... */
+
+static aligned_t yielder(void *arg)
+{                                      /*{{{ */
+    size_t i;
+
+    for (i = 0; i < ROUNDS; i++) {
+        qthread_yield();
+    }
+    return 0;
+}                                      /*}}} */
+
+int main(int   argc,
+         char *argv[])
+{
+    qtimer_t  timer;
+    aligned_t rets[2];
+
+    CHECK_VERBOSE();
+    NUMARG(ROUNDS, "ROUNDS");
+    NUMARG(CORO_STACK, "CORO_STACK");
+    assert(ROUNDS > 0);
+
+    /* each round switches there and back */
+#if defined(HAVE_UCONTEXT_H) && defined(HAVE_GETCONTEXT) && \
+    defined(HAVE_MAKECONTEXT) && defined(HAVE_SWAPCONTEXT)
+    report("native ucontext:", time_native_switch(ROUNDS), 2 * ROUNDS);
+#else
+    printf("\tnative ucontext:         unavailable\n");
+#endif
+#ifdef QTHREAD_MINIMAL_CONTEXT
+    report("fastcontext:", time_fastcontext_switch(ROUNDS, CORO_STACK), 2 * ROUNDS);
+    report("minimal:", time_minimal_switch(ROUNDS, CORO_STACK), 2 * ROUNDS);
+#else
+    printf("\tfastcontext, minimal:    not built (the library does not use the minimal swap)\n");
+#endif
+
+    setenv("QT_NUM_SHEPHERDS", "1", 1);
+    setenv("QT_NUM_WORKERS_PER_SHEPHERD", "1", 1);
+    assert(qthread_initialize() == QTHREAD_SUCCESS);
+    timer = qtimer_create();
+    qtimer_start(timer);
+    qthread_fork(yielder, NULL, &rets[0]);
+    qthread_fork(yielder, NULL, &rets[1]);
+    qthread_readFF(NULL, &rets[0]);
+    qthread_readFF(NULL, &rets[1]);
+    qtimer_stop(timer);
+    /* 2 * ROUNDS yields, each two switches */
+    report("qthread_yield():", qtimer_secs(timer), 4 * ROUNDS);
+    qtimer_destroy(timer);
+    return 0;
+}
+
+/* vim:set expandtab */
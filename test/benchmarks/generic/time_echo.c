@@ -0,0 +1,207 @@
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+#include <stdio.h>                     /* for printf() */
+#include <stdlib.h>                    /* for malloc() */
+#include <string.h>                    /* for memset() */
+#include <assert.h>                    /* for assert() */
+#include <unistd.h>                    /* for close() */
+#include <netinet/in.h>                /* for struct sockaddr_in */
+#include <arpa/inet.h>                 /* for htonl() */
+#include <sys/socket.h>
+#include <qthread/qthread.h>
+#include <qthread/qtimer.h>
+#include <qthread/qt_syscalls.h>
+#include "argparsing.h"
+
+/* An echo server over loopback TCP. One task accepts connections and starts
+ * a task per connection that echoes what it reads until end-of-file. First
+ * SLOW clients connect and say nothing, tying up their server tasks in
+ * read(); then CLIENTS tasks each make CONNS/CLIENTS connections in turn,
+ * bouncing a MSG-byte message ECHOES times over each before hanging up.
+ * Reports connections/sec and the mean and worst time from connect() to the
+ * last echo. Build with --enable-io-epoll and compare QT_IO_EPOLL=1 with
+ * QT_IO_EPOLL=0, which uses the proxy threads. With proxies, every task
+ * waiting in a call holds one of QT_MAX_IO_WORKERS (10 by default), and
+ * this needs 1 + SLOW + 2 * CLIENTS of them. */
+
+size_t CONNS   = 2000;
+size_t CLIENTS = 2;
+size_t ECHOES  = 4;
+size_t MSG     = 64;
+size_t SLOW    = 4;
+
+static int                listener;
+static struct sockaddr_in addr;
+static aligned_t         *handlers;
+static double            *lat_total, *lat_worst;
+
+static void exactly(int   s,
+                    char *buf,
+                    int   writing)
+{                                      /*{{{ */
+    size_t done = 0;
+
+    while (done < MSG) {
+        ssize_t r = writing ? qt_write(s, buf + done, MSG - done) : qt_read(s, buf + done, MSG - done);
+
+        assert(r > 0);
+        done += (size_t)r;
+    }
+}                                      /*}}} */
+
+static aligned_t echo(void *arg)
+{                                      /*{{{ */
+    int     s   = (int)(intptr_t)arg;
+    char   *buf = malloc(MSG);
+    ssize_t r;
+
+    assert(buf);
+    while ((r = qt_read(s, buf, MSG)) > 0) {
+        assert(qt_write(s, buf, (size_t)r) == r);
+    }
+    assert(r == 0);
+    close(s);
+    free(buf);
+    return 0;
+}                                      /*}}} */
+
+static aligned_t acceptor(void *arg)
+{                                      /*{{{ */
+    size_t i;
+
+    for (i = 0; i < SLOW + CONNS; i++) {
+        int s = qt_accept(listener, NULL, NULL);
+
+        assert(s >= 0);
+        qthread_fork(echo, (void *)(intptr_t)s, &handlers[i]);
+    }
+    return 0;
+}                                      /*}}} */
+
+static int dial(void)
+{                                      /*{{{ */
+    int s = socket(AF_INET, SOCK_STREAM, 0);
+
+    assert(s >= 0);
+    assert(qt_connect(s, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+    return s;
+}                                      /*}}} */
+
+static aligned_t quiet(void *arg)
+{                                      /*{{{ */
+    ((int *)arg)[0] = dial();
+    return 0;
+}                                      /*}}} */
+
+static aligned_t client(void *arg)
+{                                      /*{{{ */
+    size_t   me  = (size_t)(uintptr_t)arg;
+    char    *buf = malloc(MSG);
+    qtimer_t t   = qtimer_create();
+    size_t   c, e;
+
+    assert(buf);
+    memset(buf, 'q', MSG);
+    for (c = me; c < CONNS; c += CLIENTS) {
+        int    s;
+        double secs;
+
+        qtimer_start(t);
+        s = dial();
+        for (e = 0; e < ECHOES; e++) {
+            exactly(s, buf, 1);
+            exactly(s, buf, 0);
+        }
+        qtimer_stop(t);
+        close(s);
+        secs = qtimer_secs(t);
+        lat_total[me] += secs;
+        if (secs > lat_worst[me]) { lat_worst[me] = secs; }
+    }
+    qtimer_destroy(t);
+    free(buf);
+    return 0;
+}                                      /*}}} */
+
+int main(int   argc,
+         char *argv[])
+{
+    qtimer_t   timer;
+    aligned_t  accepting, *rets;
+    int       *silent;
+    socklen_t  len = sizeof(addr);
+    double     total = 0, worst = 0;
+    size_t     i;
+
+    assert(qthread_initialize() == QTHREAD_SUCCESS);
+    CHECK_VERBOSE();
+    NUMARG(CONNS, "CONNS");
+    NUMARG(CLIENTS, "CLIENTS");
+    NUMARG(ECHOES, "ECHOES");
+    NUMARG(MSG, "MSG");
+    NUMARG(SLOW, "SLOW");
+    assert(CLIENTS > 0 && MSG > 0);
+
+    timer     = qtimer_create();
+    handlers  = malloc(sizeof(aligned_t) * (SLOW + CONNS));
+    rets      = malloc(sizeof(aligned_t) * (SLOW + CLIENTS));
+    silent    = malloc(sizeof(int) * (SLOW + 1));
+    lat_total = calloc(CLIENTS, sizeof(double));
+    lat_worst = calloc(CLIENTS, sizeof(double));
+    assert(handlers && rets && silent && lat_total && lat_worst);
+
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    assert(listener >= 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    assert(bind(listener, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+    assert(listen(listener, 128) == 0);
+    assert(getsockname(listener, (struct sockaddr *)&addr, &len) == 0);
+    printf("%u threads, %lu quiet clients\n", qthread_num_workers(), (unsigned long)SLOW);
+
+    qthread_fork(acceptor, NULL, &accepting);
+    for (i = 0; i < SLOW; i++) {
+        qthread_fork(quiet, &silent[i], &rets[i]);
+    }
+    for (i = 0; i < SLOW; i++) {
+        qthread_readFF(NULL, &rets[i]);
+    }
+
+    qtimer_start(timer);
+    for (i = 0; i < CLIENTS; i++) {
+        qthread_fork(client, (void *)(uintptr_t)i, &rets[i]);
+    }
+    for (i = 0; i < CLIENTS; i++) {
+        qthread_readFF(NULL, &rets[i]);
+    }
+    qtimer_stop(timer);
+
+    for (i = 0; i < SLOW; i++) {
+        close(silent[i]);
+    }
+    qthread_readFF(NULL, &accepting);
+    for (i = 0; i < SLOW + CONNS; i++) {
+        qthread_readFF(NULL, &handlers[i]);
+    }
+    close(listener);
+
+    for (i = 0; i < CLIENTS; i++) {
+        total += lat_total[i];
+        if (lat_worst[i] > worst) { worst = lat_worst[i]; }
+    }
+    printf("\t%10.0f connections/sec\n", CONNS / qtimer_secs(timer));
+    printf("\t%10.2f usecs mean, %.2f usecs worst, per connection of %lu echoes\n",
+           total * 1e6 / CONNS, worst * 1e6, (unsigned long)ECHOES);
+
+    free(lat_worst);
+    free(lat_total);
+    free(silent);
+    free(rets);
+    free(handlers);
+    qtimer_destroy(timer);
+    return 0;
+}
+
+/* vim:set expandtab */
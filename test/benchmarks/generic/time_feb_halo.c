@@ -0,0 +1,159 @@
+#include <stdio.h>                     /* for printf() */
+#include <stdlib.h>                    /* for malloc() */
+#include <assert.h>                    /* for assert() */
+#include <qthread/qthread.h>
+#include <qthread/qloop.h>
+#include <qthread/qtimer.h>
+#include "argparsing.h"
+
+/* A halo exchange on a ring of BLOCKS blocks, each with a HALO-word ghost
+ * region on either side, done with FEBs. Every step, each block's consumer
+ * task waits for both of its ghost regions to fill, reads them and empties
+ * them, while each block's producer task writes its edges into its
+ * neighbours' ghost regions. Consumers and producers are started together, so
+ * some consumers have to wait. The exchange is timed once with one FEB call
+ * per word, and once with the vectored qthread_*_many() calls. */
+
+size_t BLOCKS = 64;
+size_t HALO   = 256;
+size_t STEPS  = 100;
+
+static aligned_t   *ghosts;    /* BLOCKS x 2 sides x HALO */
+static aligned_t  **ghost_ptr; /* the same, as pointers */
+static aligned_t  **send_ptr;  /* where each block's edges go */
+static aligned_t   *edges;     /* BLOCKS x 2 sides x HALO */
+static aligned_t   *received;  /* BLOCKS x 2 sides x HALO */
+static volatile int batched;
+
+#define GHOST(b, side) ((b) * 2 * HALO + (side) * HALO)
+
+static void exchange(const size_t startat,
+                     const size_t stopat,
+                     void        *arg)
+{                                      /*{{{ */
+    size_t i, w;
+
+    for (i = startat; i < stopat; i++) {
+        if (i < BLOCKS) {
+            /* consumer for block i */
+            aligned_t *const *mine = &ghost_ptr[GHOST(i, 0)];
+            aligned_t        *into = &received[GHOST(i, 0)];
+
+            if (batched) {
+                qthread_readFF_many(into, mine, 2 * HALO);
+                qthread_empty_many(mine, 2 * HALO);
+            } else {
+                for (w = 0; w < 2 * HALO; w++) {
+                    qthread_readFF(&into[w], mine[w]);
+                }
+                for (w = 0; w < 2 * HALO; w++) {
+                    qthread_empty(mine[w]);
+                }
+            }
+        } else {
+            /* producer for block i - BLOCKS */
+            const size_t      b    = i - BLOCKS;
+            aligned_t *const *to   = &send_ptr[GHOST(b, 0)];
+            const aligned_t  *from = &edges[GHOST(b, 0)];
+
+            if (batched) {
+                qthread_writeF_many(to, from, 2 * HALO);
+            } else {
+                for (w = 0; w < 2 * HALO; w++) {
+                    qthread_writeF(to[w], &from[w]);
+                }
+            }
+        }
+    }
+}                                      /*}}} */
+
+static double run(int use_batches)
+{                                      /*{{{ */
+    qtimer_t timer = qtimer_create();
+    size_t   s, b, w;
+    double   secs;
+
+    batched = use_batches;
+    qtimer_start(timer);
+    for (s = 0; s < STEPS; s++) {
+        qt_loop(0, 2 * BLOCKS, exchange, NULL);
+    }
+    qtimer_stop(timer);
+    secs = qtimer_secs(timer);
+    qtimer_destroy(timer);
+
+    /* the left ghost of b holds the right edge of b-1, and vice versa */
+    for (b = 0; b < BLOCKS; b++) {
+        for (w = 0; w < HALO; w++) {
+            assert(received[GHOST(b, 0) + w] == edges[GHOST((b + BLOCKS - 1) % BLOCKS, 1) + w]);
+            assert(received[GHOST(b, 1) + w] == edges[GHOST((b + 1) % BLOCKS, 0) + w]);
+        }
+    }
+    return secs;
+}                                      /*}}} */
+
+static void report(const char *name,
+                   double      secs)
+{                                      /*{{{ */
+    const double words = (double)STEPS * BLOCKS * 2 * HALO;
+
+    printf("\t%-24s %12g secs (%u-threads %u steps)\n", name, secs,
+           qthread_num_workers(), (unsigned)STEPS);
+    printf("\t = word throughput: %30f words/sec\n", words / secs);
+}                                      /*}}} */
+
+int main(int   argc,
+         char *argv[])
+{
+    size_t b, side, w;
+    double per_word, vectored;
+
+    assert(qthread_initialize() == QTHREAD_SUCCESS);
+
+    CHECK_VERBOSE();
+    NUMARG(BLOCKS, "BLOCKS");
+    NUMARG(HALO, "HALO");
+    NUMARG(STEPS, "STEPS");
+    assert(BLOCKS > 1 && HALO > 0);
+    printf("%u threads, %u blocks, %u-word halos...\n",
+           qthread_num_workers(), (unsigned)BLOCKS, (unsigned)HALO);
+
+    ghosts    = malloc(BLOCKS * 2 * HALO * sizeof(aligned_t));
+    edges     = malloc(BLOCKS * 2 * HALO * sizeof(aligned_t));
+    received  = malloc(BLOCKS * 2 * HALO * sizeof(aligned_t));
+    ghost_ptr = malloc(BLOCKS * 2 * HALO * sizeof(aligned_t *));
+    send_ptr  = malloc(BLOCKS * 2 * HALO * sizeof(aligned_t *));
+    assert(ghosts && edges && received && ghost_ptr && send_ptr);
+    for (b = 0; b < BLOCKS; b++) {
+        for (side = 0; side < 2; side++) {
+            /* my left edge goes to my left neighbour's right ghost */
+            const size_t to = side ? GHOST((b + 1) % BLOCKS, 0)
+                                   : GHOST((b + BLOCKS - 1) % BLOCKS, 1);
+
+            for (w = 0; w < HALO; w++) {
+                edges[GHOST(b, side) + w]     = (b << 20) | (side << 19) | w;
+                ghost_ptr[GHOST(b, side) + w] = &ghosts[GHOST(b, side) + w];
+                send_ptr[GHOST(b, side) + w]  = &ghosts[to + w];
+            }
+        }
+    }
+    qthread_empty_many(ghost_ptr, BLOCKS * 2 * HALO);
+
+    /* prime it */
+    run(0);
+    per_word = run(0);
+    report("Per-word halo exchange:", per_word);
+    vectored = run(1);
+    report("Vectored halo exchange:", vectored);
+    printf("\t = speedup: %38.2fx\n", per_word / vectored);
+
+    qthread_fill_many(ghost_ptr, BLOCKS * 2 * HALO);
+    free(ghosts);
+    free(edges);
+    free(received);
+    free(ghost_ptr);
+    free(send_ptr);
+    return 0;
+}
+
+/* vim:set expandtab */
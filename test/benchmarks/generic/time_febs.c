@@ -9,6 +9,7 @@
 size_t     TEST_SELECTION = 0xffffffff;
 size_t     ITERATIONS     = 100000;
 size_t     MAXPARALLELISM = 256;
+size_t     REGISTER       = 0; /* use qthread_feb_region_register() */
 aligned_t  incrementme    = 0;
 aligned_t *increments     = NULL;
 
@@ -84,6 +85,37 @@ static void balanced_noncomp_readFF(const size_t startat,
     }
 }                                      /*}}} */
 
+static void balanced_noncomp_readFE_writeEF(const size_t startat,
+                                            const size_t stopat,
+                                            void        *arg)
+{                                      /*{{{ */
+    size_t     i;
+    aligned_t *mine = ((aligned_t *)arg) + qthread_worker(NULL);
+    aligned_t  v;
+
+    for (i = startat; i < stopat; i++) {
+        qthread_readFE(&v, mine);
+        qthread_writeEF_const(mine, v + 1);
+    }
+}                                      /*}}} */
+
+static void register_febs(aligned_t *base,
+                          size_t     count)
+{                                      /*{{{ */
+    if (REGISTER) {
+        int ret = qthread_feb_region_register(base, count);
+
+        assert(ret == QTHREAD_SUCCESS || ret == QTHREAD_NOT_ALLOWED);
+    }
+}                                      /*}}} */
+
+static void unregister_febs(aligned_t *base)
+{                                      /*{{{ */
+    if (REGISTER) {
+        qthread_feb_region_unregister(base);
+    }
+}                                      /*}}} */
+
 static aligned_t justreturn(void *arg)
 {   /*{{{*/
     return 7;
@@ -123,6 +155,7 @@ int main(int   argc,
     NUMARG(ITERATIONS, "ITERATIONS");
     NUMARG(MAXPARALLELISM, "MAXPARALLELISM");
     NUMARG(TEST_SELECTION, "TEST_SELECTION");
+    NUMARG(REGISTER, "REGISTER");
     workers = qthread_num_workers();
     printf("%u threads...\n", workers);
     rets = malloc(sizeof(aligned_t) * MAXPARALLELISM);
@@ -160,10 +193,12 @@ int main(int   argc,
         printf("\tBalanced competing readFF: ");
         fflush(stdout);
         shared = (aligned_t *)calloc(1, sizeof(aligned_t));
+        register_febs(shared, 1);
         qtimer_start(timer);
         qt_loop_balance(0, MAXPARALLELISM * ITERATIONS, balanced_readFF,
                         shared);
         qtimer_stop(timer);
+        unregister_febs(shared);
         free(shared);
 
         printf("%23g secs (%u-threads %u iters)\n", qtimer_secs(timer),
@@ -209,11 +244,13 @@ int main(int   argc,
         printf("\tBalanced false-sharing readFF: ");
         fflush(stdout);
         shared = (aligned_t *)calloc(workers, sizeof(aligned_t));
+        register_febs(shared, workers);
         qtimer_start(timer);
         qt_loop_balance(0, ITERATIONS * MAXPARALLELISM,
                         balanced_falseshare_readFF,
                         shared);
         qtimer_stop(timer);
+        unregister_febs(shared);
         free(shared);
 
         printf("%19g secs (%u-threads %u iters)\n", qtimer_secs(timer),
@@ -320,6 +357,7 @@ int main(int   argc,
     if (TEST_SELECTION & (1 << 7)) {
         aligned_t *rets = calloc(ITERATIONS, sizeof(aligned_t));
         size_t     i;
+        register_febs(rets, ITERATIONS);
         /* LOOP SYNCHRONIZATION */
         printf("\tLoop synchronization: ");
         fflush(stdout);
@@ -341,6 +379,7 @@ int main(int   argc,
             qthread_readFF(NULL, rets + i);
         }
         qtimer_stop(timer);
+        unregister_febs(rets);
         free(rets);
 
         printf("%21g secs (%u-threads %u-qthreads)\n", qtimer_secs(timer),
@@ -354,6 +393,29 @@ int main(int   argc,
                human_readable_rate(rate));
     }
 
+    if (TEST_SELECTION & (1 << 8)) {
+        aligned_t *mine;
+        /* BALANCED INDEPENDENT READFE/WRITEEF */
+        printf("\tBalanced independent readFE/writeEF: ");
+        fflush(stdout);
+        mine = (aligned_t *)calloc(workers, sizeof(aligned_t));
+        register_febs(mine, workers);
+        qtimer_start(timer);
+        qt_loop_balance(0, ITERATIONS * MAXPARALLELISM,
+                        balanced_noncomp_readFE_writeEF,
+                        mine);
+        qtimer_stop(timer);
+        unregister_febs(mine);
+        free(mine);
+
+        printf("%14g secs (%u-threads %u iters)\n", qtimer_secs(timer),
+               workers, (unsigned)(ITERATIONS * MAXPARALLELISM));
+        iprintf("\t + average pair time: %28g secs\n",
+                qtimer_secs(timer) / (ITERATIONS * MAXPARALLELISM));
+        printf("\t = pair throughput: %30f pairs/sec\n",
+               (ITERATIONS * MAXPARALLELISM) / qtimer_secs(timer));
+    }
+
     qtimer_destroy(timer);
     free(rets);
 
@@ -0,0 +1,148 @@
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+#include <stdio.h>                     /* for printf() */
+#include <stdlib.h>                    /* for malloc() */
+#include <string.h>                    /* for memset() */
+#include <assert.h>                    /* for assert() */
+#ifdef __linux__
+# include <unistd.h>                   /* for syscall() */
+# include <sys/ioctl.h>                /* for ioctl() */
+# include <sys/syscall.h>
+# include <linux/perf_event.h>
+#endif
+#include <qthread/qthread.h>
+#include <qthread/qtimer.h>
+#include "argparsing.h"
+
+/* Measures what backing the memory pools with huge pages buys: ROUNDS times,
+ * spawns LIVE tasks, each with ARGS bytes of copied arguments, before any of
+ * them runs, so that all of their task structures and queue nodes are live
+ * at once, and then runs them all. Reports the time per task, the data TLB
+ * misses per task where perf events are available (counted on the main
+ * thread, which is worker 0 and, with one worker, runs everything), and how
+ * much of the pool memory is in huge-page regions. Run it with and without
+ * QT_HUGEPAGES=1. */
+
+size_t LIVE   = 1000000;
+size_t ROUNDS = 4;
+size_t ARGS   = 64;
+
+static int open_dtlb_counter(void)
+{                                      /*{{{ */
+#if defined(__linux__) && defined(SYS_perf_event_open)
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size   = sizeof(attr);
+    attr.type   = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB |
+                  (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled       = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+    return -1;
+#endif
+}                                      /*}}} */
+
+static long long read_counter(int fd)
+{                                      /*{{{ */
+    long long count = -1;
+
+#ifdef __linux__
+    if ((fd < 0) || (read(fd, &count, sizeof(count)) != sizeof(count))) { count = -1; }
+#endif
+    return count;
+}                                      /*}}} */
+
+static long anon_huge_kb(void)
+{                                      /*{{{ */
+#ifdef __linux__
+    FILE *f = fopen("/proc/self/smaps_rollup", "r");
+    char  line[128];
+    long  kb = -1;
+
+    if (f) {
+        while (fgets(line, sizeof(line), f)) {
+            if (sscanf(line, "AnonHugePages: %ld kB", &kb) == 1) { break; }
+        }
+        fclose(f);
+    }
+    return kb;
+#else
+    return -1;
+#endif
+}                                      /*}}} */
+
+static aligned_t task(void *arg)
+{                                      /*{{{ */
+    return ((unsigned char *)arg)[0] + ((unsigned char *)arg)[ARGS - 1];
+}                                      /*}}} */
+
+int main(int   argc,
+         char *argv[])
+{
+    qtimer_t       timer;
+    aligned_t     *rets;
+    unsigned char *args;
+    size_t         i, r;
+    int            fd;
+    long long      before, misses;
+
+    CHECK_VERBOSE();
+    NUMARG(LIVE, "LIVE");
+    NUMARG(ROUNDS, "ROUNDS");
+    NUMARG(ARGS, "ARGS");
+    assert(LIVE > 0 && ARGS > 0);
+
+    fd = open_dtlb_counter();
+#if defined(__linux__) && defined(PERF_EVENT_IOC_ENABLE)
+    if (fd >= 0) { ioctl(fd, PERF_EVENT_IOC_ENABLE, 0); }
+#endif
+    assert(qthread_initialize() == QTHREAD_SUCCESS);
+    timer = qtimer_create();
+    rets  = malloc(sizeof(aligned_t) * LIVE);
+    args  = malloc(ARGS);
+    assert(rets && args);
+    memset(args, 1, ARGS);
+    printf("%u threads, %lu live tasks with %lu bytes of arguments, %lu rounds\n",
+           qthread_num_workers(), (unsigned long)LIVE, (unsigned long)ARGS,
+           (unsigned long)ROUNDS);
+
+    before = read_counter(fd);
+    qtimer_start(timer);
+    for (r = 0; r < ROUNDS; r++) {
+        for (i = 0; i < LIVE; i++) {
+            qthread_spawn(task, args, ARGS, &rets[i], 0, NULL, NO_SHEPHERD,
+                          QTHREAD_SPAWN_SIMPLE);
+        }
+        for (i = 0; i < LIVE; i++) {
+            qthread_readFF(NULL, &rets[i]);
+            assert(rets[i] == 2);
+        }
+    }
+    qtimer_stop(timer);
+    misses = read_counter(fd);
+
+    printf("\t%7.1f nsecs/task\n", qtimer_secs(timer) * 1e9 / (LIVE * ROUNDS));
+    if ((before < 0) || (misses < 0)) {
+        printf("\tdTLB misses: unavailable\n");
+    } else {
+        printf("\t%7.2f dTLB load misses/task\n",
+               (double)(misses - before) / (LIVE * ROUNDS));
+    }
+    printf("\tpools: %lu kB, %lu kB of it in huge-page regions, %ld kB AnonHugePages\n",
+           (unsigned long)qthread_readstate(POOL_BYTES) / 1024,
+           (unsigned long)qthread_readstate(POOL_HUGEPAGE_BYTES) / 1024,
+           anon_huge_kb());
+
+    free(args);
+    free(rets);
+    qtimer_destroy(timer);
+    return 0;
+}
+
+/* vim:set expandtab */
@@ -0,0 +1,102 @@
+#include <stdio.h>                     /* for printf() */
+#include <stdlib.h>                    /* for strtol() */
+#include <assert.h>                    /* for assert() */
+#include <time.h>                      /* for nanosleep() */
+#include <sys/time.h>
+#include <sys/resource.h>              /* for getrusage() */
+#include <qthread/qthread.h>
+#include <qthread/qtimer.h>
+#include "argparsing.h"
+
+/* Measures what idle workers cost and how quickly they react:
+ *  1. the CPU time the process burns while every worker but this one has
+ *     nothing to do (worker 0 is asleep in the OS), and
+ *  2. the wake-to-run latency: the time from spawning a task onto an idle
+ *     shepherd to that task starting, after the shepherd has sat idle for
+ *     IDLE_USECS.
+ * With spinning idle loops (1) approaches one CPU per idle worker; with
+ * --enable-parking it should approach zero, at some cost in (2) once the
+ * idle period exceeds the spin phase (see QT_PARK_SPINS). */
+
+size_t ITERATIONS = 100;
+size_t IDLE_USECS = 20000;
+
+static double cpu_secs(void)
+{                                      /*{{{ */
+    struct rusage ru;
+
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec +
+           (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1e-6;
+}                                      /*}}} */
+
+static void os_sleep(size_t usecs)
+{                                      /*{{{ */
+    struct timespec ts;
+
+    ts.tv_sec  = usecs / 1000000;
+    ts.tv_nsec = (usecs % 1000000) * 1000;
+    while (nanosleep(&ts, &ts) != 0) ;
+}                                      /*}}} */
+
+static aligned_t wake_task(void *arg)
+{                                      /*{{{ */
+    qtimer_stop((qtimer_t)arg);
+    return 0;
+}                                      /*}}} */
+
+int main(int   argc,
+         char *argv[])
+{
+    qtimer_t              timer = qtimer_create();
+    qtimer_t              wall  = qtimer_create();
+    qthread_shepherd_id_t target;
+    double                cpu, total = 0.0, min = 1e9, max = 0.0;
+    unsigned int          workers;
+    size_t                i;
+
+    assert(qthread_initialize() == QTHREAD_SUCCESS);
+
+    CHECK_VERBOSE();
+    NUMARG(ITERATIONS, "ITERATIONS");
+    NUMARG(IDLE_USECS, "IDLE_USECS");
+    workers = qthread_num_workers();
+    target  = (qthread_num_shepherds() > 1) ? 1 : 0;
+    printf("%u threads...\n", workers);
+
+    /* IDLE CPU */
+    printf("\tIdle CPU use: ");
+    fflush(stdout);
+    cpu = cpu_secs();
+    qtimer_start(wall);
+    os_sleep(ITERATIONS * IDLE_USECS);
+    qtimer_stop(wall);
+    cpu = cpu_secs() - cpu;
+    printf("%7.3f CPUs over %g secs (%u idle workers)\n",
+           cpu / qtimer_secs(wall), qtimer_secs(wall), workers - 1);
+
+    /* WAKE-TO-RUN LATENCY */
+    printf("\tWake-to-run latency (shepherd %u): ", (unsigned)target);
+    fflush(stdout);
+    for (i = 0; i < ITERATIONS; i++) {
+        aligned_t ret;
+        double    secs;
+
+        os_sleep(IDLE_USECS);
+        qtimer_start(timer);
+        qthread_fork_to(wake_task, timer, &ret, target);
+        qthread_readFF(NULL, &ret);
+        secs   = qtimer_secs(timer);
+        total += secs;
+        if (secs < min) { min = secs; }
+        if (secs > max) { max = secs; }
+    }
+    printf("%9.3f usecs avg, %9.3f min, %9.3f max\n",
+           total * 1e6 / ITERATIONS, min * 1e6, max * 1e6);
+
+    qtimer_destroy(timer);
+    qtimer_destroy(wall);
+    return 0;
+}
+
+/* vim:set expandtab */
@@ -0,0 +1,231 @@
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+#include <stdio.h>                     /* for printf() */
+#include <stdlib.h>                    /* for malloc() */
+#include <string.h>                    /* for memset() */
+#include <assert.h>                    /* for assert() */
+#include <unistd.h>                    /* for close() */
+#include <netinet/in.h>                /* for struct sockaddr_in */
+#include <arpa/inet.h>                 /* for htonl() */
+#include <sys/socket.h>
+#include <qthread/qthread.h>
+#include <qthread/qtimer.h>
+#include <qthread/qt_syscalls.h>
+#include "argparsing.h"
+
+/* Measures the blocking system call path. First, TASKS tasks each make OPS
+ * preads of BLOCK bytes from scattered offsets of a FILESIZE-byte temporary
+ * file (which the page cache holds, so this is the cost of the calls rather
+ * than of the disk); then PAIRS pairs of tasks bounce a MSG-byte message
+ * over loopback TCP ROUNDS times. Reports calls/sec and the mean and worst
+ * latency of a call (a round trip, for the sockets) as the tasks saw it.
+ * Build with --enable-io-uring and compare QT_IO_URING=1 with QT_IO_URING=0,
+ * which uses the proxy threads (QT_MAX_IO_WORKERS of them). Keep PAIRS at
+ * or below QT_MAX_IO_WORKERS / 2: with proxies, every blocked read holds one. */
+
+size_t TASKS    = 64;
+size_t OPS      = 256;
+size_t BLOCK    = 4096;
+size_t FILESIZE = 16 * 1024 * 1024;
+size_t PAIRS    = 4;
+size_t ROUNDS   = 2000;
+size_t MSG      = 64;
+
+static int                fd;
+static int                listener;
+static struct sockaddr_in addr;
+
+typedef struct {
+    double total;
+    double worst;
+} lat_t;
+
+static lat_t *lats;
+
+static aligned_t reader(void *arg)
+{                                      /*{{{ */
+    size_t   me     = (size_t)(uintptr_t)arg;
+    char    *buf    = malloc(BLOCK);
+    qtimer_t t      = qtimer_create();
+    size_t   blocks = FILESIZE / BLOCK;
+    size_t   i, b   = me * 7919;
+
+    assert(buf);
+    for (i = 0; i < OPS; i++) {
+        double secs;
+
+        b = (b * 1103515245 + 12345) % blocks;
+        qtimer_start(t);
+        assert(qt_pread(fd, buf, BLOCK, (off_t)(b * BLOCK)) == (ssize_t)BLOCK);
+        qtimer_stop(t);
+        secs = qtimer_secs(t);
+        lats[me].total += secs;
+        if (secs > lats[me].worst) { lats[me].worst = secs; }
+    }
+    qtimer_destroy(t);
+    free(buf);
+    return 0;
+}                                      /*}}} */
+
+static void exactly(ssize_t (*op)(int, void *, size_t),
+                    int     s,
+                    char   *buf)
+{                                      /*{{{ */
+    size_t done = 0;
+
+    while (done < MSG) {
+        ssize_t r = op(s, buf + done, MSG - done);
+
+        assert(r > 0);
+        done += (size_t)r;
+    }
+}                                      /*}}} */
+
+static ssize_t send_some(int     s,
+                         void   *buf,
+                         size_t  n)
+{                                      /*{{{ */
+    return qt_write(s, buf, n);
+}                                      /*}}} */
+
+static aligned_t server(void *arg)
+{                                      /*{{{ */
+    char  *buf = malloc(MSG);
+    int    s   = qt_accept(listener, NULL, NULL);
+    size_t r;
+
+    assert(buf && s >= 0);
+    for (r = 0; r < ROUNDS; r++) {
+        exactly(qt_read, s, buf);
+        exactly(send_some, s, buf);
+    }
+    close(s);
+    free(buf);
+    return 0;
+}                                      /*}}} */
+
+static aligned_t client(void *arg)
+{                                      /*{{{ */
+    size_t   me  = (size_t)(uintptr_t)arg;
+    char    *buf = malloc(MSG);
+    int      s   = socket(AF_INET, SOCK_STREAM, 0);
+    qtimer_t t   = qtimer_create();
+    size_t   r;
+
+    assert(buf && s >= 0);
+    memset(buf, 'q', MSG);
+    assert(qt_connect(s, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+    for (r = 0; r < ROUNDS; r++) {
+        double secs;
+
+        qtimer_start(t);
+        exactly(send_some, s, buf);
+        exactly(qt_read, s, buf);
+        qtimer_stop(t);
+        secs = qtimer_secs(t);
+        lats[me].total += secs;
+        if (secs > lats[me].worst) { lats[me].worst = secs; }
+    }
+    close(s);
+    qtimer_destroy(t);
+    free(buf);
+    return 0;
+}                                      /*}}} */
+
+static void report(const char *what,
+                   size_t      n,
+                   size_t      calls,
+                   qtimer_t    timer)
+{                                      /*{{{ */
+    double total = 0, worst = 0;
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        total += lats[i].total;
+        if (lats[i].worst > worst) { worst = lats[i].worst; }
+    }
+    printf("%s\t%10.0f/sec\t%8.2f usecs mean\t%8.2f usecs worst\n", what,
+           calls / qtimer_secs(timer), total * 1e6 / calls, worst * 1e6);
+}                                      /*}}} */
+
+int main(int   argc,
+         char *argv[])
+{
+    char       filename[] = "time_io.XXXXXX";
+    qtimer_t   timer;
+    aligned_t *rets;
+    char      *chunk;
+    socklen_t  len = sizeof(addr);
+    size_t     i, n;
+
+    assert(qthread_initialize() == QTHREAD_SUCCESS);
+    CHECK_VERBOSE();
+    NUMARG(TASKS, "TASKS");
+    NUMARG(OPS, "OPS");
+    NUMARG(BLOCK, "BLOCK");
+    NUMARG(FILESIZE, "FILESIZE");
+    NUMARG(PAIRS, "PAIRS");
+    NUMARG(ROUNDS, "ROUNDS");
+    NUMARG(MSG, "MSG");
+    assert(BLOCK > 0 && FILESIZE >= BLOCK && MSG > 0);
+
+    timer = qtimer_create();
+    n     = (TASKS > PAIRS * 2) ? TASKS : PAIRS * 2;
+    rets  = malloc(sizeof(aligned_t) * n);
+    lats  = malloc(sizeof(lat_t) * n);
+    assert(rets && lats);
+    printf("%u threads\n", qthread_num_workers());
+
+    /* file reads */
+    fd = mkstemp(filename);
+    assert(fd >= 0);
+    unlink(filename);
+    chunk = malloc(BLOCK);
+    assert(chunk);
+    memset(chunk, 'q', BLOCK);
+    for (i = 0; i < FILESIZE / BLOCK; i++) {
+        assert(pwrite(fd, chunk, BLOCK, (off_t)(i * BLOCK)) == (ssize_t)BLOCK);
+    }
+    free(chunk);
+    memset(lats, 0, sizeof(lat_t) * n);
+    qtimer_start(timer);
+    for (i = 0; i < TASKS; i++) {
+        qthread_fork(reader, (void *)(uintptr_t)i, &rets[i]);
+    }
+    for (i = 0; i < TASKS; i++) {
+        qthread_readFF(NULL, &rets[i]);
+    }
+    qtimer_stop(timer);
+    close(fd);
+    report("pread", TASKS, TASKS * OPS, timer);
+
+    /* loopback ping-pong */
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    assert(listener >= 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    assert(bind(listener, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+    assert(listen(listener, (int)PAIRS) == 0);
+    assert(getsockname(listener, (struct sockaddr *)&addr, &len) == 0);
+    memset(lats, 0, sizeof(lat_t) * n);
+    qtimer_start(timer);
+    for (i = 0; i < PAIRS; i++) {
+        qthread_fork(server, NULL, &rets[PAIRS + i]);
+        qthread_fork(client, (void *)(uintptr_t)i, &rets[i]);
+    }
+    for (i = 0; i < PAIRS * 2; i++) {
+        qthread_readFF(NULL, &rets[i]);
+    }
+    qtimer_stop(timer);
+    close(listener);
+    report("tcp rtt", PAIRS, PAIRS * ROUNDS, timer);
+
+    free(lats);
+    free(rets);
+    qtimer_destroy(timer);
+    return 0;
+}
+
+/* vim:set expandtab */
@@ -0,0 +1,128 @@
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+#include <stdio.h>                     /* for printf() */
+#include <stdlib.h>                    /* for malloc() */
+#include <string.h>                    /* for memset() */
+#include <assert.h>                    /* for assert() */
+#include <unistd.h>                    /* for pwrite() and usleep() */
+#include <qthread/qthread.h>
+#include <qthread/qtimer.h>
+#include <qthread/qt_syscalls.h>
+#include "argparsing.h"
+
+/* Throughput of the proxy threads. BURSTS times, TASKS tasks each make OPS
+ * preads of BLOCK bytes from scattered offsets of a FILESIZE-byte temporary
+ * file (which the page cache holds, so this is the cost of getting the calls
+ * to and from the proxies rather than of the disk), then everything stops
+ * for PAUSE microseconds, long enough for idle proxies to time out unless
+ * the keep-alive pool holds them. Reports preads/sec and the mean and worst
+ * latency of a pread as the tasks saw it. Build without --enable-io-uring, or
+ * run with QT_IO_URING=0, and vary QT_MAX_IO_WORKERS and QT_IO_KEEPALIVE. */
+
+size_t BURSTS   = 20;
+size_t PAUSE    = 2000;
+size_t TASKS    = 64;
+size_t OPS      = 64;
+size_t BLOCK    = 4096;
+size_t FILESIZE = 16 * 1024 * 1024;
+
+static int fd;
+
+typedef struct {
+    double total;
+    double worst;
+} lat_t;
+
+static lat_t *lats;
+
+static aligned_t reader(void *arg)
+{                                      /*{{{ */
+    size_t   me     = (size_t)(uintptr_t)arg;
+    char    *buf    = malloc(BLOCK);
+    qtimer_t t      = qtimer_create();
+    size_t   blocks = FILESIZE / BLOCK;
+    size_t   i, b   = me * 7919;
+
+    assert(buf);
+    for (i = 0; i < OPS; i++) {
+        double secs;
+
+        b = (b * 1103515245 + 12345) % blocks;
+        qtimer_start(t);
+        assert(qt_pread(fd, buf, BLOCK, (off_t)(b * BLOCK)) == (ssize_t)BLOCK);
+        qtimer_stop(t);
+        secs = qtimer_secs(t);
+        lats[me].total += secs;
+        if (secs > lats[me].worst) { lats[me].worst = secs; }
+    }
+    qtimer_destroy(t);
+    free(buf);
+    return 0;
+}                                      /*}}} */
+
+int main(int   argc,
+         char *argv[])
+{
+    char       filename[] = "time_pread.XXXXXX";
+    qtimer_t   timer;
+    aligned_t *rets;
+    char      *chunk;
+    double     busy = 0, total = 0, worst = 0;
+    size_t     i, burst;
+
+    assert(qthread_initialize() == QTHREAD_SUCCESS);
+    CHECK_VERBOSE();
+    NUMARG(BURSTS, "BURSTS");
+    NUMARG(PAUSE, "PAUSE");
+    NUMARG(TASKS, "TASKS");
+    NUMARG(OPS, "OPS");
+    NUMARG(BLOCK, "BLOCK");
+    NUMARG(FILESIZE, "FILESIZE");
+    assert(BLOCK > 0 && FILESIZE >= BLOCK);
+
+    timer = qtimer_create();
+    rets  = malloc(sizeof(aligned_t) * TASKS);
+    lats  = calloc(TASKS, sizeof(lat_t));
+    assert(rets && lats);
+    printf("%u threads\n", qthread_num_workers());
+
+    fd = mkstemp(filename);
+    assert(fd >= 0);
+    unlink(filename);
+    chunk = malloc(BLOCK);
+    assert(chunk);
+    memset(chunk, 'q', BLOCK);
+    for (i = 0; i < FILESIZE / BLOCK; i++) {
+        assert(pwrite(fd, chunk, BLOCK, (off_t)(i * BLOCK)) == (ssize_t)BLOCK);
+    }
+    free(chunk);
+
+    for (burst = 0; burst < BURSTS; burst++) {
+        qtimer_start(timer);
+        for (i = 0; i < TASKS; i++) {
+            qthread_fork(reader, (void *)(uintptr_t)i, &rets[i]);
+        }
+        for (i = 0; i < TASKS; i++) {
+            qthread_readFF(NULL, &rets[i]);
+        }
+        qtimer_stop(timer);
+        busy += qtimer_secs(timer);
+        if (PAUSE > 0) { usleep(PAUSE); }
+    }
+    close(fd);
+
+    for (i = 0; i < TASKS; i++) {
+        total += lats[i].total;
+        if (lats[i].worst > worst) { worst = lats[i].worst; }
+    }
+    printf("pread\t%10.0f/sec\t%8.2f usecs mean\t%8.2f usecs worst\n",
+           BURSTS * TASKS * OPS / busy, total * 1e6 / (BURSTS * TASKS * OPS), worst * 1e6);
+
+    free(lats);
+    free(rets);
+    qtimer_destroy(timer);
+    return 0;
+}
+
+/* vim:set expandtab */
@@ -0,0 +1,142 @@
+#include <stdio.h>                     /* for printf() */
+#include <stdlib.h>                    /* for qsort() */
+#include <assert.h>                    /* for assert() */
+#include <qthread/qthread.h>
+#include <qthread/qtimer.h>
+#include "argparsing.h"
+
+/* Spawn-to-start latency of short "probe" tasks while every worker is kept
+ * busy by a saturating, self-respawning load of LOW_USECS tasks at priority
+ * level 0 (CHAINS of them per worker). Every PROBE_USECS one of the load
+ * tasks spawns a probe just before it respawns itself, so the probe always
+ * has newer load queued alongside it. The probes run first at level 0 and
+ * then at the highest level. Run with QT_PRIORITY_LEVELS=2 or more; with the
+ * default of one level both rows should look alike. A level-0 probe can be
+ * starved until the load stops, which it does after MAX_MSECS. */
+
+size_t ITERATIONS  = 200;
+size_t LOW_USECS   = 100;
+size_t PROBE_USECS = 1000;
+size_t CHAINS      = 4;
+size_t MAX_MSECS   = 2000;
+
+static volatile aligned_t stop_load = 0;
+static aligned_t          live      = 0;
+static aligned_t          probes_spawned;
+static aligned_t          probes_done;
+static double             load_deadline;
+static volatile double    next_probe;
+static double            *latency;
+static unsigned int       probe_level;
+
+static void spin(size_t usecs)
+{                                      /*{{{ */
+    double const until = qtimer_wtime() + usecs * 1e-6;
+
+    while (qtimer_wtime() < until) ;
+}                                      /*}}} */
+
+static aligned_t probe_task(void *arg)
+{                                      /*{{{ */
+    double *slot = (double *)arg;
+
+    *slot = qtimer_wtime() - *slot;
+    if (qthread_incr(&probes_done, 1) == ITERATIONS - 1) {
+        stop_load = 1;
+    }
+    return 0;
+}                                      /*}}} */
+
+static aligned_t load_task(void *arg)
+{                                      /*{{{ */
+    double now;
+
+    spin(LOW_USECS);
+    now = qtimer_wtime();
+    if ((now >= next_probe) && (probes_spawned < ITERATIONS)) {
+        aligned_t i = qthread_incr(&probes_spawned, 1);
+
+        if (i < ITERATIONS) {
+            next_probe = now + PROBE_USECS * 1e-6;
+            latency[i] = now;
+            qthread_spawn(probe_task, &latency[i], 0, NULL, 0, NULL,
+                          NO_SHEPHERD, QTHREAD_SPAWN_PRIORITY(probe_level));
+        }
+    }
+    if (!stop_load && (now < load_deadline)) {
+        qthread_fork(load_task, NULL, NULL);
+    } else {
+        qthread_incr(&live, -1);
+    }
+    return 0;
+}                                      /*}}} */
+
+static int cmp_double(const void *a,
+                      const void *b)
+{                                      /*{{{ */
+    double const x = *(const double *)a, y = *(const double *)b;
+
+    return (x < y) ? -1 : (x > y);
+}                                      /*}}} */
+
+static void run_phase(unsigned int level,
+                      const char  *name)
+{                                      /*{{{ */
+    unsigned int workers = qthread_num_workers();
+    size_t       i;
+    double       total = 0.0;
+
+    probe_level    = level;
+    probes_spawned = 0;
+    probes_done    = 0;
+    stop_load      = 0;
+    next_probe     = qtimer_wtime();
+    load_deadline  = next_probe + MAX_MSECS * 1e-3;
+    live           = CHAINS * workers;
+    for (i = 0; i < CHAINS * workers; i++) {
+        qthread_fork(load_task, NULL, NULL);
+    }
+    while (live) qthread_yield();
+    while (probes_done < probes_spawned) qthread_yield();
+    if (probes_done < ITERATIONS) {
+        printf("\t%-9s probes: only %lu of %lu spawned before MAX_MSECS\n",
+               name, (unsigned long)probes_done, (unsigned long)ITERATIONS);
+        return;
+    }
+
+    qsort(latency, ITERATIONS, sizeof(double), cmp_double);
+    for (i = 0; i < ITERATIONS; i++) total += latency[i];
+    printf("\t%-9s probes: %10.3f usecs avg, %10.3f p50, %10.3f p99, %10.3f max\n",
+           name, total * 1e6 / ITERATIONS,
+           latency[ITERATIONS / 2] * 1e6,
+           latency[(ITERATIONS * 99) / 100] * 1e6,
+           latency[ITERATIONS - 1] * 1e6);
+}                                      /*}}} */
+
+int main(int   argc,
+         char *argv[])
+{
+    assert(qthread_initialize() == QTHREAD_SUCCESS);
+
+    CHECK_VERBOSE();
+    NUMARG(ITERATIONS, "ITERATIONS");
+    NUMARG(LOW_USECS, "LOW_USECS");
+    NUMARG(PROBE_USECS, "PROBE_USECS");
+    NUMARG(CHAINS, "CHAINS");
+    NUMARG(MAX_MSECS, "MAX_MSECS");
+    assert(ITERATIONS > 0);
+    printf("%u threads, %u x %u usec tasks of background load...\n",
+           qthread_num_workers(), (unsigned)(CHAINS * qthread_num_workers()),
+           (unsigned)LOW_USECS);
+
+    latency = malloc(ITERATIONS * sizeof(double));
+    assert(latency);
+
+    run_phase(0, "normal");
+    run_phase(QTHREAD_PRIORITY_LEVELS_MAX - 1, "priority");
+
+    free(latency);
+    return 0;
+}
+
+/* vim:set expandtab */
@@ -0,0 +1,136 @@
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+#include <stdio.h>                     /* for printf() */
+#include <stdlib.h>                    /* for malloc() */
+#include <string.h>                    /* for memset() */
+#include <assert.h>                    /* for assert() */
+#include <unistd.h>                    /* for unlink() */
+#include <qthread/qthread.h>
+#include <qthread/qtimer.h>
+#include <qthread/qt_syscalls.h>
+#include "argparsing.h"
+
+/* Sequential I/O in chunks. ROUNDS times, TASKS tasks each qt_pwrite one
+ * CHUNK-byte chunk of a temporary file, chunk i at offset i * CHUNK, so that
+ * together they write it from end to end; then they read it back the same
+ * way with qt_pread. Reports the bandwidth of each phase and how many read
+ * or write system calls the process made per call, from /proc/self/io, which
+ * is below 1 when the proxies merge adjacent calls. Build without
+ * --enable-io-uring, or run with QT_IO_URING=0, and vary QT_IO_COALESCE and
+ * QT_IO_COALESCE_WINDOW. */
+
+size_t ROUNDS = 20;
+size_t TASKS  = 256;
+size_t CHUNK  = 4096;
+
+static int    fd;
+static char **bufs;
+
+static aligned_t writer(void *arg)
+{                                      /*{{{ */
+    size_t i = (size_t)(uintptr_t)arg;
+
+    assert(qt_pwrite(fd, bufs[i], CHUNK, (off_t)(i * CHUNK)) == (ssize_t)CHUNK);
+    return 0;
+}                                      /*}}} */
+
+static aligned_t reader(void *arg)
+{                                      /*{{{ */
+    size_t i = (size_t)(uintptr_t)arg;
+
+    assert(qt_pread(fd, bufs[i], CHUNK, (off_t)(i * CHUNK)) == (ssize_t)CHUNK);
+    assert(bufs[i][0] == (char)i && bufs[i][CHUNK - 1] == (char)i);
+    return 0;
+}                                      /*}}} */
+
+/* the number of read (<field> "syscr") or write ("syscw") system calls the
+ * process has made, or -1 if the kernel does not say */
+static long syscalls(const char *field)
+{                                      /*{{{ */
+    FILE *f = fopen("/proc/self/io", "r");
+    char  name[32];
+    long  v, ret = -1;
+
+    if (f == NULL) { return -1; }
+    while (fscanf(f, "%31[^:]: %ld\n", name, &v) == 2) {
+        if (strcmp(name, field) == 0) { ret = v; }
+    }
+    fclose(f);
+    return ret;
+}                                      /*}}} */
+
+static void phase(const char *name,
+                  qthread_f   f,
+                  const char *field,
+                  aligned_t  *rets,
+                  qtimer_t    timer)
+{                                      /*{{{ */
+    long   before = syscalls(field), after;
+    double secs   = 0;
+    size_t r, i;
+
+    for (r = 0; r < ROUNDS; r++) {
+        qtimer_start(timer);
+        for (i = 0; i < TASKS; i++) {
+            qthread_fork(f, (void *)(uintptr_t)i, &rets[i]);
+        }
+        for (i = 0; i < TASKS; i++) {
+            qthread_readFF(NULL, &rets[i]);
+        }
+        qtimer_stop(timer);
+        secs += qtimer_secs(timer);
+    }
+    after = syscalls(field);
+    printf("%s\t%10.2f MB/s", name, ROUNDS * TASKS * CHUNK / secs / 1e6);
+    if ((before >= 0) && (after >= 0)) {
+        printf("\t%6.3f syscalls per call\n", (double)(after - before) / (ROUNDS * TASKS));
+    } else {
+        printf("\n");
+    }
+}                                      /*}}} */
+
+int main(int   argc,
+         char *argv[])
+{
+    char       filename[] = "time_seqio.XXXXXX";
+    qtimer_t   timer;
+    aligned_t *rets;
+    size_t     i;
+
+    assert(qthread_initialize() == QTHREAD_SUCCESS);
+    CHECK_VERBOSE();
+    NUMARG(ROUNDS, "ROUNDS");
+    NUMARG(TASKS, "TASKS");
+    NUMARG(CHUNK, "CHUNK");
+    assert(CHUNK > 0);
+
+    timer = qtimer_create();
+    rets  = malloc(sizeof(aligned_t) * TASKS);
+    bufs  = malloc(sizeof(char *) * TASKS);
+    assert(rets && bufs);
+    for (i = 0; i < TASKS; i++) {
+        bufs[i] = malloc(CHUNK);
+        assert(bufs[i]);
+        memset(bufs[i], (int)(char)i, CHUNK);
+    }
+    printf("%u threads\n", qthread_num_workers());
+
+    fd = mkstemp(filename);
+    assert(fd >= 0);
+    unlink(filename);
+
+    phase("pwrite", writer, "syscw", rets, timer);
+    phase("pread", reader, "syscr", rets, timer);
+    close(fd);
+
+    for (i = 0; i < TASKS; i++) {
+        free(bufs[i]);
+    }
+    free(bufs);
+    free(rets);
+    qtimer_destroy(timer);
+    return 0;
+}
+
+/* vim:set expandtab */
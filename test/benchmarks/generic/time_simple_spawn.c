@@ -0,0 +1,79 @@
+#include <stdio.h>                     /* for printf() */
+#include <stdlib.h>                    /* for strtol() */
+#include <assert.h>                    /* for assert() */
+#include <qthread/qthread.h>
+#include <qthread/qtimer.h>
+#include "argparsing.h"
+
+/* Measures the per-task cost of spawning and running a leaf task that never
+ * blocks, ITERATIONS times each way:
+ *  1. as an ordinary task, which gets a stack and a context of its own and
+ *     is switched into and out of, and
+ *  2. with QTHREAD_SPAWN_SIMPLE, which runs as a plain call on the worker's
+ *     stack.
+ * The spawning task waits for each batch of BATCH tasks before spawning the
+ * next, so the figures include running the tasks, not just queueing them. */
+
+size_t ITERATIONS = 1000000;
+size_t BATCH      = 1000;
+
+static aligned_t leaf(void *arg)
+{                                      /*{{{ */
+    return (aligned_t)(uintptr_t)arg + 1;
+}                                      /*}}} */
+
+static double run(unsigned int flags,
+                  aligned_t   *rets)
+{                                      /*{{{ */
+    qtimer_t timer = qtimer_create();
+    double   secs;
+    size_t   i, j;
+
+    qtimer_start(timer);
+    for (i = 0; i < ITERATIONS; i += BATCH) {
+        const size_t n = (ITERATIONS - i < BATCH) ? ITERATIONS - i : BATCH;
+
+        for (j = 0; j < n; j++) {
+            qthread_spawn(leaf, (void *)(uintptr_t)j, 0, &rets[j], 0, NULL,
+                          NO_SHEPHERD, flags);
+        }
+        for (j = 0; j < n; j++) {
+            qthread_readFF(NULL, &rets[j]);
+            assert(rets[j] == j + 1);
+        }
+    }
+    qtimer_stop(timer);
+    secs = qtimer_secs(timer);
+    qtimer_destroy(timer);
+    return secs;
+}                                      /*}}} */
+
+int main(int   argc,
+         char *argv[])
+{
+    aligned_t *rets;
+    double     full, simple;
+
+    assert(qthread_initialize() == QTHREAD_SUCCESS);
+
+    CHECK_VERBOSE();
+    NUMARG(ITERATIONS, "ITERATIONS");
+    NUMARG(BATCH, "BATCH");
+    assert(BATCH > 0);
+    rets = malloc(sizeof(aligned_t) * BATCH);
+    assert(rets);
+    printf("%u threads...\n", qthread_num_workers());
+
+    run(0, rets);                      /* warm the pools up */
+    full   = run(0, rets);
+    simple = run(QTHREAD_SPAWN_SIMPLE, rets);
+    printf("\tFull tasks:   %9.1f nsecs/task (%lu tasks in %g secs)\n",
+           full * 1e9 / ITERATIONS, (unsigned long)ITERATIONS, full);
+    printf("\tSimple tasks: %9.1f nsecs/task (%lu tasks in %g secs)\n",
+           simple * 1e9 / ITERATIONS, (unsigned long)ITERATIONS, simple);
+
+    free(rets);
+    return 0;
+}
+
+/* vim:set expandtab */
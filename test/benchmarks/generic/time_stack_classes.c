@@ -0,0 +1,155 @@
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+#include <stdio.h>                     /* for printf() */
+#include <stdlib.h>                    /* for malloc() */
+#include <assert.h>                    /* for assert() */
+#include <unistd.h>                    /* for sysconf() */
+#include <qthread/qthread.h>
+#include <qthread/qtimer.h>
+#include "argparsing.h"
+
+/* Measures what tasks of each stack size class cost: TASKS tasks per class,
+ * BATCH of them alive at once, each touching USE bytes of its stack. Reports
+ * the time per task and the resident memory that the first batch of each
+ * class adds while all of it is alive. Then DEEP_TASKS default-class tasks
+ * each recurse DEEP bytes down, or as far as their stack allows, and it
+ * reports how far they got and the resident memory afterwards. Compare a
+ * build with --enable-growable-stacks against one without. */
+
+size_t TASKS      = 1000000;
+size_t BATCH      = 10000;
+size_t USE        = 2048;
+size_t DEEP_TASKS = 1000;
+size_t DEEP       = 65536;
+
+static aligned_t gate;
+static aligned_t arrived;
+
+static long resident_kb(void)
+{                                      /*{{{ */
+#ifdef __linux__
+    FILE *f = fopen("/proc/self/statm", "r");
+    long  size, resident = -1;
+
+    if (f) {
+        if (fscanf(f, "%ld %ld", &size, &resident) != 2) { resident = -1; }
+        fclose(f);
+    }
+    return (resident < 0) ? -1 : resident * (sysconf(_SC_PAGESIZE) / 1024);
+#else
+    return -1;
+#endif
+}                                      /*}}} */
+
+/* touches at least `bytes` of stack below the caller, stopping a few kB
+ * short of the bottom; returns how far it got */
+static size_t dive(size_t bytes,
+                   size_t start)
+{                                      /*{{{ */
+    volatile char frame[512];
+    const size_t  left = qthread_stackleft();
+    size_t        reached;
+
+    frame[0] = frame[sizeof(frame) - 1] = 1;
+    if ((start - left >= bytes) || (left < 4096 + sizeof(frame))) {
+        return start - left;
+    }
+    reached = dive(bytes, start);
+    return reached + frame[0] - frame[sizeof(frame) - 1];
+}                                      /*}}} */
+
+static aligned_t task(void *arg)
+{                                      /*{{{ */
+    dive(USE, qthread_stackleft());
+    if (arg) {
+        qthread_incr(&arrived, 1);
+        qthread_readFF(NULL, &gate);
+    }
+    return 0;
+}                                      /*}}} */
+
+static aligned_t deep_task(void *arg)
+{                                      /*{{{ */
+    return dive(DEEP, qthread_stackleft());
+}                                      /*}}} */
+
+int main(int   argc,
+         char *argv[])
+{
+    qtimer_t     timer;
+    aligned_t   *rets;
+    size_t       i, j, reached;
+    unsigned int cls;
+    long         rss;
+
+    assert(qthread_initialize() == QTHREAD_SUCCESS);
+    timer = qtimer_create();
+
+    CHECK_VERBOSE();
+    NUMARG(TASKS, "TASKS");
+    NUMARG(BATCH, "BATCH");
+    NUMARG(USE, "USE");
+    NUMARG(DEEP_TASKS, "DEEP_TASKS");
+    NUMARG(DEEP, "DEEP");
+    assert(BATCH > 0);
+    rets = malloc(sizeof(aligned_t) * ((BATCH > DEEP_TASKS) ? BATCH : DEEP_TASKS));
+    assert(rets);
+    printf("%u threads, %lu tasks per class, %lu alive at once, %lu bytes of stack each\n",
+           qthread_num_workers(), (unsigned long)TASKS, (unsigned long)BATCH,
+           (unsigned long)USE);
+
+    for (cls = 0; cls < QTHREAD_STACK_CLASSES; cls++) {
+        long added = 0;
+
+        qtimer_start(timer);
+        for (i = 0; i < TASKS; i += BATCH) {
+            const size_t n = (TASKS - i < BATCH) ? TASKS - i : BATCH;
+
+            /* the first batch waits until all of it has been spawned */
+            qthread_empty(&gate);
+            arrived = 0;
+            rss     = resident_kb();
+            for (j = 0; j < n; j++) {
+                qthread_spawn(task, (i == 0) ? &gate : NULL, 0, &rets[j], 0, NULL,
+                              NO_SHEPHERD, QTHREAD_SPAWN_STACK(cls));
+            }
+            if (i == 0) {
+                /* let them all get as far as the gate */
+                while (arrived < n) { qthread_yield(); }
+                added = resident_kb() - rss;
+            }
+            qthread_fill(&gate);
+            for (j = 0; j < n; j++) {
+                qthread_readFF(NULL, &rets[j]);
+            }
+        }
+        qtimer_stop(timer);
+        printf("\tclass %u (%8lu bytes): %7.1f nsecs/task, %7.2f kB resident per live task\n",
+               cls, (unsigned long)qthread_stack_class_size(cls),
+               qtimer_secs(timer) * 1e9 / TASKS,
+               (rss < 0) ? -1.0 : (double)added / ((TASKS < BATCH) ? TASKS : BATCH));
+    }
+
+    qtimer_start(timer);
+    for (j = 0; j < DEEP_TASKS; j++) {
+        qthread_fork(deep_task, NULL, &rets[j]);
+    }
+    reached = (size_t)-1;
+    for (j = 0; j < DEEP_TASKS; j++) {
+        qthread_readFF(NULL, &rets[j]);
+        if (rets[j] < reached) { reached = rets[j]; }
+    }
+    qtimer_stop(timer);
+    printf("\t%lu tasks %lu bytes deep: %7.1f usecs/task, reached %lu bytes, %ld kB resident after\n",
+           (unsigned long)DEEP_TASKS, (unsigned long)DEEP,
+           qtimer_secs(timer) * 1e6 / DEEP_TASKS, (unsigned long)reached,
+           resident_kb());
+    printf("\tstacks grew %lu times\n", (unsigned long)qthread_readstate(STACK_GROWTHS));
+
+    free(rets);
+    qtimer_destroy(timer);
+    return 0;
+}
+
+/* vim:set expandtab */
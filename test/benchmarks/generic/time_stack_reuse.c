@@ -0,0 +1,149 @@
+#include <stdio.h>                     /* for printf() */
+#include <stdlib.h>                    /* for strtol() */
+#include <string.h>                    /* for memset() */
+#include <assert.h>                    /* for assert() */
+#include <unistd.h>                    /* for syscall() */
+#include <sys/resource.h>              /* for getrusage() */
+#ifdef __linux__
+# include <sys/syscall.h>
+# include <linux/perf_event.h>
+#endif
+#include <qthread/qthread.h>
+#include <qthread/qtimer.h>
+#include "argparsing.h"
+
+/* Measures how well task stacks are recycled: TASKS tasks, each writing
+ * TOUCH bytes of its stack, are spawned BATCH at a time. With MIGRATE set
+ * (and more than one shepherd), every task moves to the next shepherd
+ * before touching its stack, so it finishes on a different worker than it
+ * started on and its stack is donated to that worker.
+ *
+ * Reports the time per task, the runtime's stack cache hit, miss and
+ * donation counts, minor page faults and, where the kernel lets us count
+ * them, L1 data cache read misses across all threads. Compare runs with
+ * QT_STACK_CACHE=0 against the default. */
+
+size_t TASKS   = 200000;
+size_t TOUCH   = 4096;
+size_t BATCH   = 1024;
+size_t MIGRATE = 0;
+
+static qthread_shepherd_id_t nsheps;
+
+/* write roughly TOUCH bytes of stack, a kilobyte per frame */
+static aligned_t touch(size_t bytes)
+{                                      /*{{{ */
+    volatile char frame[1024];
+
+    memset((char *)frame, 1, sizeof(frame));
+    if (bytes > sizeof(frame)) {
+        return touch(bytes - sizeof(frame)) + frame[0];
+    }
+    return frame[sizeof(frame) - 1];
+}                                      /*}}} */
+
+static aligned_t task(void *arg)
+{                                      /*{{{ */
+    if (MIGRATE && (nsheps > 1)) {
+        qthread_migrate_to((qthread_shep() + 1) % nsheps);
+    }
+    return touch(TOUCH);
+}                                      /*}}} */
+
+/* Counts L1D read misses of this thread and, once they exit, of every
+ * thread it creates afterward: open it before qthread_initialize() and read
+ * it after qthread_finalize(). Returns -1 if the kernel will not count. */
+static int open_miss_counter(void)
+{                                      /*{{{ */
+#if defined(__linux__) && defined(__NR_perf_event_open)
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.type           = PERF_TYPE_HW_CACHE;
+    attr.size           = sizeof(attr);
+    attr.config         = PERF_COUNT_HW_CACHE_L1D |
+                          (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.inherit        = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+    return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+    return -1;
+#endif
+}                                      /*}}} */
+
+int main(int   argc,
+         char *argv[])
+{
+    qtimer_t      timer;
+    aligned_t    *rets;
+    struct rusage before, after;
+    size_t        hits, misses, donations;
+    size_t        i, j;
+    int           miss_fd = open_miss_counter();
+
+    assert(qthread_initialize() == QTHREAD_SUCCESS);
+    timer = qtimer_create();
+
+    CHECK_VERBOSE();
+    NUMARG(TASKS, "TASKS");
+    NUMARG(TOUCH, "TOUCH");
+    NUMARG(BATCH, "BATCH");
+    NUMARG(MIGRATE, "MIGRATE");
+    assert(BATCH > 0);
+    assert(TOUCH + 4096 < qthread_readstate(STACK_SIZE));
+    nsheps = qthread_num_shepherds();
+    rets   = malloc(sizeof(aligned_t) * BATCH);
+    assert(rets);
+    printf("%u threads, %u shepherds%s...\n", qthread_num_workers(),
+           (unsigned)nsheps, (MIGRATE && nsheps > 1) ? ", migrating" : "");
+
+    hits      = qthread_readstate(STACK_CACHE_HITS);
+    misses    = qthread_readstate(STACK_CACHE_MISSES);
+    donations = qthread_readstate(STACK_DONATIONS);
+    getrusage(RUSAGE_SELF, &before);
+    qtimer_start(timer);
+    for (i = 0; i < TASKS; i += BATCH) {
+        const size_t n = (TASKS - i < BATCH) ? TASKS - i : BATCH;
+
+        for (j = 0; j < n; j++) {
+            qthread_fork(task, NULL, &rets[j]);
+        }
+        for (j = 0; j < n; j++) {
+            qthread_readFF(NULL, &rets[j]);
+        }
+    }
+    qtimer_stop(timer);
+    getrusage(RUSAGE_SELF, &after);
+    hits      = qthread_readstate(STACK_CACHE_HITS) - hits;
+    misses    = qthread_readstate(STACK_CACHE_MISSES) - misses;
+    donations = qthread_readstate(STACK_DONATIONS) - donations;
+
+    printf("\tTime:           %9.1f nsecs/task (%lu tasks in %g secs)\n",
+           qtimer_secs(timer) * 1e9 / TASKS, (unsigned long)TASKS,
+           qtimer_secs(timer));
+    printf("\tStack cache:    %9lu hits, %lu misses, %lu donations\n",
+           (unsigned long)hits, (unsigned long)misses,
+           (unsigned long)donations);
+    printf("\tMinor faults:   %9ld\n", after.ru_minflt - before.ru_minflt);
+
+    free(rets);
+    qtimer_destroy(timer);
+    qthread_finalize();
+
+    if (miss_fd >= 0) {
+        unsigned long long l1d_misses = 0;
+
+        if (read(miss_fd, &l1d_misses, sizeof(l1d_misses)) == sizeof(l1d_misses)) {
+            printf("\tL1D misses:     %9.1f per task (whole run)\n",
+                   (double)l1d_misses / TASKS);
+        }
+        close(miss_fd);
+    } else {
+        printf("\tL1D misses:     unavailable (no hardware cache events)\n");
+    }
+    return 0;
+}
+
+/* vim:set expandtab */
@@ -0,0 +1,120 @@
+#include <stdio.h>                     /* for printf() */
+#include <stdlib.h>                    /* for strtol() */
+#include <string.h>                    /* for memset() */
+#include <assert.h>                    /* for assert() */
+#include <unistd.h>                    /* for sysconf() */
+#include <qthread/qthread.h>
+#include <qthread/qtimer.h>
+#include "argparsing.h"
+
+/* Measures what task stacks cost in memory and in spawn time:
+ *  1. resident memory with BURST tasks all blocked at once (so all of their
+ *     stacks are live, each with TOUCH bytes of it written), and again after
+ *     they have all finished, and
+ *  2. the rate at which SPAWNS short tasks can be forked and retired.
+ * With --enable-stack-arenas the second RSS figure should fall back toward
+ * the baseline (see QT_STACK_RETAIN); with the default stack pool it stays
+ * at the peak. */
+
+size_t BURST  = 4096;
+size_t TOUCH  = 8192;
+size_t SPAWNS = 100000;
+
+static aligned_t gate;
+static aligned_t started;
+
+static double rss_mb(void)
+{                                      /*{{{ */
+    FILE         *f = fopen("/proc/self/statm", "r");
+    unsigned long size, resident;
+
+    if (f == NULL) { return 0.0; }
+    if (fscanf(f, "%lu %lu", &size, &resident) != 2) {
+        resident = 0;
+    }
+    fclose(f);
+    return resident * (double)sysconf(_SC_PAGESIZE) / (1024.0 * 1024.0);
+}                                      /*}}} */
+
+/* write roughly TOUCH bytes of stack, a kilobyte per frame */
+static aligned_t touch(size_t bytes)
+{                                      /*{{{ */
+    volatile char frame[1024];
+
+    memset((char *)frame, 1, sizeof(frame));
+    if (bytes > sizeof(frame)) {
+        return touch(bytes - sizeof(frame)) + frame[0];
+    }
+    return frame[sizeof(frame) - 1];
+}                                      /*}}} */
+
+static aligned_t blocker(void *arg)
+{                                      /*{{{ */
+    aligned_t ret = touch(TOUCH);
+
+    qthread_incr(&started, 1);
+    qthread_readFF(NULL, &gate);
+    return ret;
+}                                      /*}}} */
+
+static aligned_t null_task(void *arg)
+{                                      /*{{{ */
+    return 0;
+}                                      /*}}} */
+
+int main(int   argc,
+         char *argv[])
+{
+    qtimer_t   timer = qtimer_create();
+    aligned_t *rets;
+    double     base, peak, after;
+    size_t     i;
+
+    assert(qthread_initialize() == QTHREAD_SUCCESS);
+
+    CHECK_VERBOSE();
+    NUMARG(BURST, "BURST");
+    NUMARG(TOUCH, "TOUCH");
+    NUMARG(SPAWNS, "SPAWNS");
+    assert(TOUCH + 4096 < qthread_readstate(STACK_SIZE));
+    rets = malloc(sizeof(aligned_t) * (BURST > SPAWNS ? BURST : SPAWNS));
+    assert(rets);
+    printf("%u threads...\n", qthread_num_workers());
+
+    /* RESIDENT MEMORY */
+    base = rss_mb();
+    qthread_empty(&gate);
+    for (i = 0; i < BURST; i++) {
+        qthread_fork(blocker, NULL, &rets[i]);
+    }
+    while (started < BURST) {
+        qthread_yield();
+    }
+    peak = rss_mb();
+    qthread_fill(&gate);
+    for (i = 0; i < BURST; i++) {
+        qthread_readFF(NULL, &rets[i]);
+    }
+    after = rss_mb();
+    printf("\tRSS with %lu stacks live: %9.1f MB (%9.1f before, %9.1f after)\n",
+           (unsigned long)BURST, peak, base, after);
+
+    /* SPAWN RATE */
+    qtimer_start(timer);
+    for (i = 0; i < SPAWNS; i++) {
+        qthread_fork(null_task, NULL, &rets[i]);
+    }
+    for (i = 0; i < SPAWNS; i++) {
+        qthread_readFF(NULL, &rets[i]);
+    }
+    qtimer_stop(timer);
+    printf("\tSpawn rate: %9.0f tasks/sec (%lu tasks in %g secs)\n",
+           SPAWNS / qtimer_secs(timer), (unsigned long)SPAWNS,
+           qtimer_secs(timer));
+
+    free(rets);
+    qtimer_destroy(timer);
+    return 0;
+}
+
+/* vim:set expandtab */
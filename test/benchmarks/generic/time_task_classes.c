@@ -0,0 +1,120 @@
+#include <stdio.h>                     /* for printf() */
+#include <stdlib.h>                    /* for malloc() */
+#include <string.h>                    /* for memset() */
+#include <assert.h>                    /* for assert() */
+#include <qthread/qthread.h>
+#include <qthread/qtimer.h>
+#include "argparsing.h"
+
+/* Measures the cost of spawning tasks that copy their arguments, for
+ * argument blocks of several sizes: TASKS tasks of each size are spawned
+ * BATCH at a time. Reports the time per task and, for each task size class
+ * the runtime uses, the structure size, how many tasks it handed out, and
+ * the memory held by a batch of such tasks while they are all alive. Compare
+ * against QT_ARGCOPY_SIZE=0 (arguments copied into a separate buffer). */
+
+size_t TASKS = 100000;
+size_t BATCH = 1024;
+
+static const size_t arg_sizes[] = { 8, 32, 64, 128, 256, 512, 1024 };
+#define NUM_SIZES (sizeof(arg_sizes) / sizeof(arg_sizes[0]))
+
+static aligned_t task(void *arg)
+{                                      /*{{{ */
+    return *(const unsigned char *)arg;
+}                                      /*}}} */
+
+/* the argument block starts with a pointer to the word to wait on */
+static aligned_t hold(void *arg)
+{                                      /*{{{ */
+    qthread_readFF(NULL, *(aligned_t **)arg);
+    return 0;
+}                                      /*}}} */
+
+/* bytes held by live task structures, from the runtime's class counters */
+static size_t live_bytes(void)
+{                                      /*{{{ */
+    qthread_task_class_stats_t stats;
+    size_t                     bytes = 0;
+    unsigned int               c;
+
+    for (c = 0; c < qthread_task_classes(); c++) {
+        qthread_task_class_stats(c, &stats);
+        bytes += stats.live * stats.bytes;
+    }
+    return bytes;
+}                                      /*}}} */
+
+int main(int   argc,
+         char *argv[])
+{
+    qtimer_t                   timer;
+    aligned_t                 *rets;
+    aligned_t                  gate;
+    unsigned char             *arg;
+    qthread_task_class_stats_t stats;
+    size_t                     i, j, k;
+    unsigned int               c;
+
+    assert(qthread_initialize() == QTHREAD_SUCCESS);
+    timer = qtimer_create();
+
+    CHECK_VERBOSE();
+    NUMARG(TASKS, "TASKS");
+    NUMARG(BATCH, "BATCH");
+    assert(BATCH > 0);
+    rets = malloc(sizeof(aligned_t) * BATCH);
+    arg  = malloc(arg_sizes[NUM_SIZES - 1]);
+    assert(rets && arg);
+    memset(arg, 1, arg_sizes[NUM_SIZES - 1]);
+    *(aligned_t **)arg = &gate;
+    printf("%u threads, %u task classes\n", qthread_num_workers(),
+           qthread_task_classes());
+
+    for (k = 0; k < NUM_SIZES; k++) {
+        size_t base, peak;
+
+        qtimer_start(timer);
+        for (i = 0; i < TASKS; i += BATCH) {
+            const size_t n = (TASKS - i < BATCH) ? TASKS - i : BATCH;
+
+            for (j = 0; j < n; j++) {
+                qthread_fork_copyargs(task, arg, arg_sizes[k], &rets[j]);
+            }
+            for (j = 0; j < n; j++) {
+                qthread_readFF(NULL, &rets[j]);
+            }
+        }
+        qtimer_stop(timer);
+
+        /* the footprint of a batch of such tasks, all alive at once */
+        qthread_empty(&gate);
+        base = live_bytes();
+        for (j = 0; j < BATCH; j++) {
+            qthread_fork_copyargs(hold, arg, arg_sizes[k], &rets[j]);
+        }
+        peak = live_bytes() - base;
+        qthread_fill(&gate);
+        for (j = 0; j < BATCH; j++) {
+            qthread_readFF(NULL, &rets[j]);
+        }
+
+        printf("\t%4lu-byte args: %7.1f nsecs/task, %6.1f bytes/live task\n",
+               (unsigned long)arg_sizes[k],
+               qtimer_secs(timer) * 1e9 / TASKS, (double)peak / BATCH);
+    }
+
+    for (c = 0; c < qthread_task_classes(); c++) {
+        qthread_task_class_stats(c, &stats);
+        printf("\tclass %u: %5lu bytes (%4lu argument bytes), %lu tasks\n", c,
+               (unsigned long)stats.bytes, (unsigned long)stats.args,
+               (unsigned long)stats.allocs);
+    }
+
+    free(arg);
+    free(rets);
+    qtimer_destroy(timer);
+    return 0;
+}
+
+/* vim:set expandtab */
@@ -4,13 +4,14 @@
 #include <qthread/qthread.h>
 #include <qthread/qloop.h>
 #include <qthread/qtimer.h>
+#include "argparsing.h"
 
 
 // native qthreads version of thread-ring, based on Chapel's release version
 //   https://github.com/chapel-lang/chapel/blob/master/test/release/examples/benchmarks/shootout/threadring.chpl
 
 //static int n = 1000, ntasks = 503;
-static int n = 50000000, ntasks = 503;
+static size_t n = 50000000, ntasks = 503;
 static aligned_t *mailbox;
 
 static void passTokens(size_t start, size_t stop, void* arg) {
@@ -31,6 +32,9 @@ static void passTokens(size_t start, size_t stop, void* arg) {
 
 static void init() {
   assert(qthread_initialize() == 0);
+  CHECK_VERBOSE();
+  NUMARG(n, "PASSES");
+  NUMARG(ntasks, "TASKS");
   printf("%i threads...\n", qthread_num_workers());
 
   // init array of syncvars (code grabbed from stress/feb_stream.c)
@@ -53,6 +57,9 @@ int main(int argc, char **argv) {
   ring_time = qtimer_secs(timer);
 
   printf("\tThread ring time: %f usecs, %f/sec\n", 1000000 * ring_time / ntasks, ntasks / ring_time);
+  /* one hop is a fill waking the next task and that task getting to run;
+   * compare runs with QT_WAKE_HANDOFF=0 and QT_WAKE_HANDOFF=1 */
+  printf("\tPer-hop latency: %f usecs (%lu hops)\n", 1000000 * ring_time / n, (unsigned long)n);
 
   return 0;
 }
@@ -0,0 +1,69 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <qthread/qthread.h>
+#include "argparsing.h"
+
+/* Tasks spawned with QTHREAD_SPAWN_PRIORITY() must run highest level first.
+ * Everything is spawned from a single worker before it blocks, so with aging
+ * off the order of execution is fully determined by the levels. */
+
+#define LEVELS   4
+#define PER_LEVEL 16
+
+static aligned_t counter = 0;
+static aligned_t ran_at[LEVELS * PER_LEVEL];
+
+static aligned_t record(void *arg)
+{
+    ran_at[(uintptr_t)arg] = qthread_incr(&counter, 1);
+    return 0;
+}
+
+int main(int   argc,
+         char *argv[])
+{
+    aligned_t rets[LEVELS * PER_LEVEL];
+    aligned_t first[LEVELS], last[LEVELS];
+    uintptr_t i;
+    int       l;
+
+    setenv("QT_NUM_SHEPHERDS", "1", 1);
+    setenv("QT_NUM_WORKERS_PER_SHEPHERD", "1", 1);
+    setenv("QT_PRIORITY_LEVELS", "4", 1);
+    setenv("QT_PRIORITY_AGING", "0", 1);
+    assert(qthread_initialize() == QTHREAD_SUCCESS);
+
+    CHECK_VERBOSE();
+
+    /* lowest level first; the top level is requested as 7, which must be
+     * clamped to the highest configured level (3) */
+    for (i = 0; i < LEVELS * PER_LEVEL; i++) {
+        unsigned int p = i / PER_LEVEL;
+
+        if (p == LEVELS - 1) { p = QTHREAD_PRIORITY_LEVELS_MAX - 1; }
+        assert(qthread_spawn(record, (void *)i, 0, &rets[i], 0, NULL,
+                             NO_SHEPHERD, QTHREAD_SPAWN_PRIORITY(p)) == QTHREAD_SUCCESS);
+    }
+    for (i = 0; i < LEVELS * PER_LEVEL; i++) {
+        qthread_readFF(NULL, &rets[i]);
+    }
+    assert(counter == LEVELS * PER_LEVEL);
+
+    for (l = 0; l < LEVELS; l++) {
+        first[l] = LEVELS * PER_LEVEL;
+        last[l]  = 0;
+        for (i = l * PER_LEVEL; i < (l + 1) * PER_LEVEL; i++) {
+            if (ran_at[i] < first[l]) { first[l] = ran_at[i]; }
+            if (ran_at[i] > last[l]) { last[l] = ran_at[i]; }
+        }
+        iprintf("level %i ran %lu..%lu\n", l, (unsigned long)first[l], (unsigned long)last[l]);
+    }
+    for (l = 0; l < LEVELS - 1; l++) {
+        assert(last[l + 1] < first[l]);
+    }
+
+    return 0;
+}
+
+/* vim:set expandtab */